@@ -0,0 +1,23 @@
+#ifndef ALLPAIRS_H
+#define ALLPAIRS_H
+
+#include "hash_t.h"
+#include "index.h"
+#include "vocab.h"
+
+/* -------------------- Junção por Similaridade (todos os pares) -------------------- */
+
+typedef struct {
+  long int pairs;       /**< Pares (ou vizinhos) gravados */
+  long int candidates;  /**< Pares com termo em comum nos sufixos indexados */
+  long int verified;    /**< Pares que passaram pelo limite e foram verificados */
+  long int indexed;     /**< Postings no índice de sufixos */
+  long int nnz;         /**< Postings de todos os documentos */
+} allpairs_stats;
+
+int allpairs_join(const inv_index_t *index, hash_t **global_tf,
+                  const vocab_t *vocab, const double *global_doc_norms,
+                  long int num_docs, double threshold, int top_m,
+                  int nthreads, const char *filename, allpairs_stats *stats);
+
+#endif
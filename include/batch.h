@@ -0,0 +1,14 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "hash_t.h"
+#include "preprocess_query.h"
+
+/* -------------------- Consultas em Lote (uma passada pelos documentos) -------------------- */
+
+int batch_top_k(hash_t *const *queries, const double *query_norms, int nqueries,
+                hash_t **global_tf, const double *global_doc_norms,
+                long int num_docs, int k, int nthreads, DocSim *out,
+                long int *found);
+
+#endif
@@ -0,0 +1,23 @@
+#ifndef BOOLEAN_H
+#define BOOLEAN_H
+
+#include "hash_t.h"
+#include "index.h"
+#include "preprocess_query.h"
+#include "roaring.h"
+
+/* -------------------- Consultas Booleanas (+obrigatório / -proibido) -------------------- */
+
+#define BOOL_GALLOP_RATIO 32 /**< Listas com tamanhos nessa razão: busca galopante */
+
+long int bool_intersect(long int *a, long int na, const long int *b,
+                        long int nb);
+long int bool_subtract(long int *a, long int na, const long int *b,
+                       long int nb);
+long int boolean_top_k(const inv_index_t *index, hash_t **global_tf,
+                       const hash_t *query_tf, double query_norm,
+                       const double *global_doc_norms, long int num_docs,
+                       const bool_query *ops, const roaring_t *filter, int k,
+                       DocSim *out, long int *ncand_out);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef CHAMPION_H
+#define CHAMPION_H
+
+#include "hash_t.h"
+#include "index.h"
+#include "preprocess_query.h"
+#include <stdio.h>
+
+/* -------------------- Listas de Campeões (camada 1 do índice) -------------------- */
+
+typedef struct {
+  long int r;          /**< Máximo de documentos por termo */
+  long int num_terms;  /**< Número de termos (mesma ordem de index->lists) */
+  long int *offsets;   /**< Início da lista de cada termo (num_terms + 1) */
+  double *tail;        /**< Maior values / norma fora da lista (0 se completa) */
+  long int *doc_ids;   /**< Campeões de cada termo em ordem crescente */
+  long int queries;    /**< Consultas avaliadas na camada de campeões */
+  long int fallbacks;  /**< Consultas que precisaram do índice completo */
+} champion_t;
+
+champion_t *champion_build(const inv_index_t *index,
+                           const double *global_doc_norms, long int r);
+int champion_save(const champion_t *champ, const char *filename);
+champion_t *champion_load(const char *filename, const inv_index_t *index,
+                          long int r);
+void champion_free(champion_t *champ);
+
+long int champion_top_k(champion_t *champ, const inv_index_t *index,
+                        const hash_t *query_tf, double query_norm,
+                        const double *global_doc_norms, int k,
+                        double min_score, int exact, DocSim *out,
+                        int *fallback);
+void champion_report(const champion_t *champ, FILE *out);
+
+#endif
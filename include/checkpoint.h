@@ -0,0 +1,20 @@
+#ifndef CHECKPOINT_H
+#define CHECKPOINT_H
+
+#include "hash_t.h"
+
+/* -------------------- Checkpoints da Construção -------------------- */
+
+#define CKPT_BUILD 0  /**< Construção iniciada com checkpoints */
+#define CKPT_FASE1 1  /**< Todos os lotes da FASE 1 gravados */
+
+int ckpt_phase(const char *table, long int entries, const char *db,
+               long int *batch);
+int ckpt_mark(const char *table, long int entries, int phase, long int batch);
+int ckpt_save_chunk(const char *table, long int entries, hash_t **global_tf,
+                    long int lo, long int hi);
+int ckpt_load_chunk(const char *table, long int entries, hash_t **global_tf,
+                    long int lo, long int hi, hash_t *vocab);
+int ckpt_clear(const char *table, long int entries);
+
+#endif
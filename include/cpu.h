@@ -0,0 +1,15 @@
+#ifndef CPU_H
+#define CPU_H
+
+#include <pthread.h>
+
+/* -------------------- CPUs, Afinidade e NUMA -------------------- */
+
+int cpu_init(int pin);
+int cpu_available(void);
+int cpu_nodes(void);
+
+int cpu_thread_create(pthread_t *tid, int worker, void *(*fn)(void *), void *arg);
+int cpu_bind_node(int node);
+
+#endif
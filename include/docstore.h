@@ -0,0 +1,28 @@
+#ifndef DOCSTORE_H
+#define DOCSTORE_H
+
+#include "hash_t.h"
+#include <stddef.h>
+
+/* -------------------- Armazém de Documentos (mmap) -------------------- */
+
+typedef struct {
+  void *base;               /**< Início do mapeamento */
+  size_t size;              /**< Tamanho do arquivo mapeado */
+  long int num_docs;        /**< Posições da tabela de offsets (max article_id + 1) */
+  const long int *offsets;  /**< Início de cada texto (num_docs + 1 posições) */
+  const char *texts;        /**< Textos concatenados, cada um terminado em '\0' */
+} docstore_t;
+
+int docstore_build(const char *db, const char *table, const char *filename);
+int docstore_is_stale(const char *filename, const char *db);
+docstore_t *docstore_open(const char *filename);
+void docstore_close(docstore_t *store);
+
+const char *docstore_get(const docstore_t *store, long int doc_id, size_t *len_out);
+void docstore_prefetch(const docstore_t *store, const long int *doc_ids, long int k);
+
+size_t docstore_snippet(const char *text, size_t len, const hash_t *query_tf,
+                        size_t width, const char **start_out);
+
+#endif
@@ -3,6 +3,7 @@
 
 #include "hash_t.h"
 #include <stddef.h>
+#include <stdint.h>
 
 /* -------------------- Stopwords -------------------- */
 
@@ -14,15 +15,20 @@ void free_stopwords(void);
 /* -------------------- Funções de Serialização -------------------- */
 
 char *get_filecontent(const char *filename_txt);
+int file_is_stale(const char *filename, const char *source);
 int save_hash(const hash_t *gh, const char *filename);
-int save_hash_array(hash_t **hashes, long int num_hashes, const char *filename);
+int save_hash_array(hash_t **hashes, long int num_hashes, const char *filename,
+                    int nthreads);
 int save_doc_norms(const double *norms, long int num_docs,
                    const char *filename);
+uint32_t crc32c(uint32_t crc, const void *data, size_t n);
 
 /* -------------------- Funções de Carregamento -------------------- */
 
 hash_t *load_hash(const char *filename);
-hash_t **load_hash_array(const char *filename, long int *num_hashes_out);
-double *load_doc_norms(const char *filename, long int *num_docs_out);
+hash_t **load_hash_array(const char *filename, long int *num_hashes_out,
+                         int nthreads);
+double *load_doc_norms(const char *filename, long int *num_docs_out,
+                       int nthreads);
 
 #endif
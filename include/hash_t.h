@@ -6,6 +6,11 @@
 
 /* ---------- Hash Table (string → double) ---------- */
 
+#ifndef HASH_INIT_CAP
+#define HASH_INIT_CAP 256 /**< Capacidade inicial padrão */
+#endif
+#define MAX_LOAD 0.75     /**< Fator de carga máximo antes de rehash */
+
 typedef struct HashEntry {
   char *word;
   size_t wlen;
@@ -22,6 +27,8 @@ typedef struct hash_t {
 hash_t *hash_new(void);
 void hash_free(hash_t *set);
 double hash_find(const hash_t *set, const char *word);
+double hash_find_prehashed(const hash_t *set, const char *word, size_t wlen,
+                           uint64_t h);
 void hash_add(hash_t *set, const char *word, double value);
 int hash_contains(const hash_t *set, const char *word);
 void hash_merge(hash_t *dst, const hash_t *src);
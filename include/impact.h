@@ -0,0 +1,42 @@
+#ifndef IMPACT_H
+#define IMPACT_H
+
+#include "hash_t.h"
+#include "index.h"
+#include "preprocess_query.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+/* -------------------- Índice Ordenado por Impacto (score-at-a-time) -------------------- */
+
+#define IMPACT_LEVELS 255 /**< Níveis de quantização do impacto */
+
+typedef struct {
+  long int num_terms;    /**< Termos (mesma ordem de index->lists) */
+  long int num_docs;     /**< Documentos do índice */
+  double max_impact;     /**< Maior values / norma do índice (nível máximo) */
+  long int *seg_start;   /**< Primeiro segmento de cada termo (num_terms + 1) */
+  uint8_t *seg_level;    /**< Nível de cada segmento (decrescente por termo) */
+  long int *seg_offset;  /**< Início de cada segmento em doc_ids (segmentos + 1) */
+  long int *doc_ids;     /**< Postings agrupados por nível, doc_id crescente */
+  double *values;        /**< values / norma de cada posting (impacto exato) */
+  double *acc;           /**< Acumuladores da consulta (um por documento) */
+  long int *touched;     /**< Documentos com acumulador não nulo */
+  long int queries;      /**< Consultas avaliadas */
+  long int partial;      /**< Consultas interrompidas pelo prazo */
+  double select_ns;      /**< Custo médio da seleção por documento tocado */
+  double rescore_ns;     /**< Custo médio do recálculo por documento e termo */
+} impact_t;
+
+impact_t *impact_build(const inv_index_t *index, const double *global_doc_norms);
+void impact_free(impact_t *imp);
+
+long int impact_top_k(impact_t *imp, const inv_index_t *index,
+                      const hash_t *query_tf, double query_norm,
+                      const double *global_doc_norms, int k,
+                      const struct timespec *deadline, DocSim *out, int *exact,
+                      long int *processed, long int *total);
+void impact_report(const impact_t *imp, FILE *out);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef INDEX_H
+#define INDEX_H
+
+#include "hash_t.h"
+#include "roaring.h"
+#include "vocab.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------- Índice Invertido (termo → documentos) -------------------- */
+
+typedef struct {
+  char *word;         /**< Termo (stem) */
+  size_t wlen;        /**< Comprimento do termo */
+  long int df;        /**< Frequência de documento (tamanho da lista) */
+  double idf;         /**< IDF global do termo */
+  long int *doc_ids;  /**< IDs dos documentos em ordem crescente */
+  double *values;     /**< TF-IDF do termo em cada documento */
+  double max_score;   /**< Maior values[i] / norma do documento (WAND) */
+  double *block_max;  /**< Mesmo máximo por bloco de WAND_BLOCK postings */
+  long int *block_last; /**< Último doc_id de cada bloco */
+} PostingList;
+
+typedef struct {
+  PostingList *lists; /**< Listas invertidas */
+  long int num_terms; /**< Número de termos (listas) */
+  long int num_docs;  /**< Número de documentos indexados */
+  hash_t *lookup;     /**< termo → posição em lists (até congelar) */
+  const vocab_t *vocab; /**< Vocabulário congelado (substitui lookup) */
+  uint64_t *deleted;  /**< Bitmap de documentos removidos (NULL se nenhum) */
+} inv_index_t;
+
+/**
+ * @brief Verifica se o documento foi removido (tombstone)
+ */
+static inline int index_is_deleted(const inv_index_t *index, long int doc_id) {
+  return index->deleted && ((index->deleted[doc_id >> 6] >> (doc_id & 63)) & 1);
+}
+
+inv_index_t *index_load(const char *filename);
+void index_free(inv_index_t *index);
+const PostingList *index_find(const inv_index_t *index, const char *word);
+vocab_t *index_freeze_vocab(inv_index_t *index);
+int index_use_vocab(inv_index_t *index, const vocab_t *vocab);
+
+double *index_similarities(const inv_index_t *index, const hash_t *query_tf,
+                           double query_norm, const double *global_doc_norms,
+                           int nthreads, const roaring_t *filter);
+
+#endif
@@ -0,0 +1,47 @@
+#ifndef KMEANS_H
+#define KMEANS_H
+
+#include "hash_t.h"
+#include "preprocess_query.h"
+#include "vocab.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* -------------------- Busca Podada por Clusters (k-means esférico) -------------------- */
+
+#define KMEANS_TERMS 256 /**< Termos mantidos em cada centroide (esparsificado) */
+#define KMEANS_ITERS 10  /**< Máximo de iterações do k-means */
+
+typedef struct {
+  int nclusters;          /**< Número de clusters */
+  long int num_docs;      /**< Documentos do modelo */
+  long int num_terms;     /**< Termos do vocabulário (ids dos centroides) */
+  int *cent_len;          /**< Termos de cada centroide (<= KMEANS_TERMS) */
+  uint32_t *cent_term;    /**< Termos dos centroides (nclusters × KMEANS_TERMS) */
+  double *cent_weight;    /**< Pesos dos centroides (vetores unitários) */
+  long int *offsets;      /**< Documentos do cluster c: [offsets[c], offsets[c + 1]) */
+  long int *doc_ids;      /**< Documentos agrupados por cluster, em ordem crescente */
+  long int *post_start;   /**< Centroides do termo t: [post_start[t], post_start[t + 1]) */
+  int *post_cluster;
+  double *post_weight;
+  double *scores;         /**< Rascunho da consulta: score de cada centroide */
+  long int *cands;        /**< Rascunho da consulta: documentos dos clusters sondados */
+  long int queries;       /**< Consultas avaliadas */
+  long int scanned;       /**< Documentos pontuados */
+} kmeans_t;
+
+kmeans_t *kmeans_build(hash_t **global_tf, const double *global_doc_norms,
+                       long int num_docs, const vocab_t *vocab, int nclusters,
+                       int nthreads);
+int kmeans_save(const kmeans_t *km, const char *filename);
+kmeans_t *kmeans_load(const char *filename, long int num_docs,
+                      const vocab_t *vocab, int nclusters);
+void kmeans_free(kmeans_t *km);
+
+long int kmeans_top_k(kmeans_t *km, const vocab_t *vocab, hash_t **global_tf,
+                      const hash_t *query_tf, double query_norm,
+                      const double *global_doc_norms, int k, int nprobe,
+                      DocSim *out, long int *scanned);
+void kmeans_report(const kmeans_t *km, FILE *out);
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef LEXICON_H
+#define LEXICON_H
+
+#include "index.h"
+#include "vocab.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------- Dicionário Ordenado (front coding) -------------------- */
+
+#define LEXICON_BLOCK 16   /**< Termos por bloco (o primeiro é gravado inteiro) */
+#define LEXICON_EXPAND 32  /**< Termos de maior df por curinga (marin*) */
+
+typedef struct {
+  long int num_terms;          /**< Termos (ids em ordem lexicográfica) */
+  long int num_blocks;         /**< Blocos de LEXICON_BLOCK termos */
+  long int max_len;            /**< Maior termo (bytes) */
+  const uint32_t *block_off;   /**< Início de cada bloco em data */
+  const uint32_t *block_max;   /**< Maior df de cada bloco */
+  const uint32_t *df;          /**< Frequência de documento de cada termo */
+  const unsigned char *data;   /**< Blocos com prefixos compartilhados */
+  void *base;                  /**< Buffer com o layout do arquivo */
+  size_t size;                 /**< Tamanho de base em bytes */
+  int mapped;                  /**< base veio de mmap (1) ou malloc (0) */
+} lexicon_t;
+
+lexicon_t *lexicon_build(const vocab_t *vocab, const inv_index_t *index,
+                         long int num_docs);
+int lexicon_save(const lexicon_t *lx, const char *filename);
+lexicon_t *lexicon_open(const char *filename);
+void lexicon_free(lexicon_t *lx);
+
+long int lexicon_term(const lexicon_t *lx, long int id, char *buf);
+long int lexicon_find(const lexicon_t *lx, const char *word, size_t len);
+long int lexicon_prefix(const lexicon_t *lx, const char *prefix, size_t len,
+                        long int *first);
+long int lexicon_complete(const lexicon_t *lx, const char *prefix, size_t len,
+                          long int n, long int *ids);
+
+#endif
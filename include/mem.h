@@ -0,0 +1,50 @@
+#ifndef MEM_H
+#define MEM_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+/* -------------------- Contabilidade de Memória -------------------- */
+
+typedef enum {
+  MEM_HASH_BUCKETS = 0, /**< Vetores de buckets (e structs hash_t) */
+  MEM_HASH_ENTRIES,     /**< Nós HashEntry */
+  MEM_HASH_KEYS,        /**< Strings das chaves */
+  MEM_TOKENS,           /**< Vetores de tokens e tokens individuais */
+  MEM_ARTICLE_TEXT,     /**< Textos completos dos artigos */
+  MEM_NORMS,            /**< Normas dos documentos */
+  MEM_QUERY,            /**< Buffers da consulta (similaridades, ranking) */
+  MEM_IO,               /**< Buffers de leitura/escrita */
+  MEM_POSTINGS,         /**< Listas invertidas (SPIMI e índice carregado) */
+  MEM_CACHE,            /**< Cache de resultados e de termos das consultas */
+  MEM_VOCAB,            /**< Vocabulário congelado (hash perfeita) */
+  MEM_NUM_TAGS
+} mem_tag;
+
+void mem_track_alloc(mem_tag tag, size_t bytes);
+void mem_track_free(mem_tag tag, size_t bytes);
+void mem_flush(void);
+
+size_t mem_current(mem_tag tag);
+size_t mem_peak(mem_tag tag);
+size_t mem_total_peak(void);
+long int mem_peak_rss_kb(void);
+void mem_report(FILE *out);
+
+/* -------------------- Orçamento de Memória -------------------- */
+
+size_t mem_parse_size(const char *str);
+void mem_format_size(size_t bytes, char *buf, size_t buflen);
+
+typedef struct {
+  size_t persistent;    /**< TF por documento + normas (vivos até o fim) */
+  size_t vocab;         /**< Vocabulários locais + global */
+  size_t per_doc_batch; /**< Memória transitória por documento em lote */
+} mem_estimate;
+
+mem_estimate mem_estimate_build(long int entries, long int avg_len,
+                                int nthreads);
+long int mem_plan_batch(const mem_estimate *est, size_t budget, int nthreads,
+                        long int batch_size);
+
+#endif
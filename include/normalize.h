@@ -0,0 +1,10 @@
+#ifndef NORMALIZE_H
+#define NORMALIZE_H
+
+#include <stddef.h>
+
+/* -------------------- Normalização de Texto -------------------- */
+
+size_t normalize_text(const char *in, size_t len, char *out);
+
+#endif
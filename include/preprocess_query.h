@@ -2,11 +2,41 @@
 #define PREPROCESS_QUERY_H
 
 #include "hash_t.h"
+#include "lexicon.h"
+#include "roaring.h"
+#include "vocab.h"
+#include <stdint.h>
 
-int preprocess_query(const char *query_user, const hash_t *global_idf,
-                     hash_t **query_tf_out, double *query_norm_out);
+typedef struct {
+  long int doc_id;
+  double similarity;
+} DocSim;
+
+typedef struct {
+  char **required;     /**< Stems obrigatórios (+termo) */
+  long int nrequired;
+  char **excluded;     /**< Stems proibidos (-termo) */
+  long int nexcluded;
+} bool_query;
+
+int preprocess_query(const char *query_user, const vocab_t *global_vocab,
+                     const lexicon_t *lexicon, hash_t **query_tf_out,
+                     double *query_norm_out, bool_query *ops);
+void bool_query_free(bool_query *ops);
+int query_has_operators(const char *query_user);
+int query_has_wildcard(const char *query_user);
+char *query_prefix(const char *word);
 double *compute_similarities(const hash_t *query_tf, double query_norm,
                              hash_t **global_tf, const double *global_doc_norms,
-                             long int num_docs, int nthreads);
+                             long int num_docs, int nthreads,
+                             const roaring_t *filter);
+int compare_sim(const void *a, const void *b);
+void topk_offer(DocSim *heap, long int *n, int k, DocSim item);
+long int topk_fill_zeros(DocSim *out, long int n, long int k, long int num_docs,
+                         const uint64_t *deleted, const roaring_t *filter);
+long int rerank_top_k(const hash_t *query_tf, double query_norm,
+                      hash_t **global_tf, const double *global_doc_norms,
+                      long int num_docs, const long int *cands,
+                      long int ncands, int k, DocSim *out);
 
 #endif
@@ -0,0 +1,38 @@
+#ifndef QCACHE_H
+#define QCACHE_H
+
+#include "hash_t.h"
+#include "preprocess_query.h"
+#include <stddef.h>
+#include <stdio.h>
+
+/* -------------------- Cache de Consultas (dois níveis) -------------------- */
+
+typedef struct lru_cache lru_cache;
+
+typedef struct {
+  long int version;      /**< Versão do modelo a que os resultados pertencem */
+  lru_cache *results;    /**< Nível 1: vetor canônico da query + k → top-k */
+  lru_cache *terms;      /**< Nível 2: termo → postings extraídos do modelo */
+  long int result_hits;  /**< Acertos no cache de resultados */
+  long int result_misses;/**< Faltas no cache de resultados */
+  long int term_hits;    /**< Acertos no cache de termos */
+  long int term_misses;  /**< Faltas no cache de termos */
+} qcache_t;
+
+qcache_t *qcache_new(size_t max_results, size_t max_term_bytes,
+                     long int version);
+void qcache_free(qcache_t *cache);
+void qcache_set_version(qcache_t *cache, long int version);
+
+char *qcache_key(const hash_t *query_tf, long int k);
+const DocSim *qcache_get(qcache_t *cache, const char *key, long int *n_out);
+void qcache_put(qcache_t *cache, const char *key, const DocSim *top, long int n);
+
+double *qcache_similarities(qcache_t *cache, const hash_t *query_tf,
+                            double query_norm, hash_t **global_tf,
+                            const double *global_doc_norms, long int num_docs);
+
+void qcache_report(const qcache_t *cache, FILE *out);
+
+#endif
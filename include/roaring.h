@@ -0,0 +1,40 @@
+#ifndef ROARING_H
+#define ROARING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------- Bitmap Comprimido (estilo Roaring) -------------------- */
+
+#define ROARING_ARRAY_MAX 4096  /**< Acima disso o contêiner vira bitmap */
+
+typedef struct {
+  uint16_t key;       /**< 16 bits altos dos documentos do contêiner */
+  uint32_t card;      /**< Documentos no contêiner */
+  uint32_t cap;       /**< Capacidade de array (contêiner de array) */
+  uint16_t *array;    /**< 16 bits baixos, crescentes (NULL se bitmap) */
+  uint64_t *bits;     /**< 65536 bits (NULL se array) */
+} roaring_container;
+
+typedef struct {
+  long int n;                  /**< Contêineres em uso */
+  long int cap;
+  roaring_container *c;        /**< Contêineres em ordem de key */
+  long int card;               /**< Documentos no conjunto */
+} roaring_t;
+
+roaring_t *roaring_new(void);
+void roaring_free(roaring_t *r);
+int roaring_add(roaring_t *r, uint32_t x);
+int roaring_add_range(roaring_t *r, uint32_t lo, uint32_t hi);
+roaring_t *roaring_and(const roaring_t *a, const roaring_t *b);
+roaring_t *roaring_from_ranges(const char *spec);
+
+int roaring_contains(const roaring_t *r, uint32_t x);
+long int roaring_next(const roaring_t *r, long int x);
+size_t roaring_bytes(const roaring_t *r);
+
+int roaring_save(const roaring_t *r, const char *filename);
+roaring_t *roaring_load(const char *filename);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef SEGMENT_H
+#define SEGMENT_H
+
+#include "index.h"
+#include "spimi.h"
+
+/* -------------------- Índice Incremental em Segmentos -------------------- */
+
+typedef struct {
+  char file[256];     /**< Arquivo do segmento (run com TF bruto) */
+  long int first_id;  /**< Menor article_id do segmento */
+  long int last_id;   /**< Maior article_id do segmento */
+  long int ndocs;     /**< Documentos na lista do segmento */
+  long int ndeleted;  /**< Documentos marcados no bitmap de tombstones */
+} segment_info;
+
+typedef struct {
+  segment_info *segs; /**< Segmentos em ordem crescente de article_id */
+  int count;          /**< Número de segmentos */
+  long int next_seq;  /**< Sequência do próximo arquivo de segmento */
+} segment_manifest;
+
+int segment_manifest_load(const char *table, segment_manifest *manifest);
+void segment_manifest_free(segment_manifest *manifest);
+
+long int segment_update(const spimi_config *cfg);
+inv_index_t *segment_open(const char *table, double **doc_norms_out);
+int segment_merge(const char *table, int factor);
+
+long int segment_delete(const char *table, long int *ids, long int n);
+long int segment_reindex(const spimi_config *cfg, long int *ids, long int n);
+int segment_compact(const char *table, double threshold);
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef SHARD_H
+#define SHARD_H
+
+#include "hash_t.h"
+#include "preprocess_query.h"
+#include <sys/types.h>
+
+/* -------------------- Shards por Intervalo de Documentos -------------------- */
+
+typedef struct {
+  long int num_docs;   /**< N do IDF: documentos existentes (todos os shards) */
+  int nshards;         /**< Número de shards */
+  long int *bounds;    /**< Intervalos [bounds[i], bounds[i+1]) de cada shard */
+  hash_t *df;          /**< termo → df global */
+} shard_stats;
+
+int shard_build(hash_t **global_tf, const double *global_doc_norms,
+                long int num_docs, long int num_live, int nshards,
+                const char *table, long int entries);
+int shard_files_exist(const char *table, long int entries, int nshards);
+
+shard_stats *shard_stats_load(const char *table, long int entries, int nshards);
+void shard_stats_free(shard_stats *stats);
+hash_t *shard_stats_idf(const shard_stats *stats);
+
+int shard_serve(const char *table, long int entries, int shard, int nshards,
+                const char *socket_path);
+
+/* -------------------- Coordenador (scatter-gather) -------------------- */
+
+typedef struct {
+  int nshards;   /**< Número de shards */
+  pid_t *pids;   /**< Processos servidores (0 se externos) */
+  int *fds;      /**< Conexões com cada shard */
+  char **paths;  /**< Caminhos dos sockets Unix */
+} shard_cluster;
+
+shard_cluster *shard_cluster_start(const char *table, long int entries,
+                                   int nshards, const char *socket_dir);
+long int shard_search(shard_cluster *cluster, const hash_t *query_tf,
+                      double query_norm, const bool_query *ops, int k,
+                      DocSim *out, long int *ncand_out);
+void shard_cluster_stop(shard_cluster *cluster);
+
+#endif
@@ -0,0 +1,48 @@
+#ifndef SIMHASH_H
+#define SIMHASH_H
+
+#include "hash_t.h"
+#include "preprocess_query.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* -------------------- Assinaturas SimHash e LSH em Faixas -------------------- */
+
+#define SIMHASH_MAX_BITS 256 /**< Maior assinatura (faixas × linhas) */
+
+typedef struct {
+  uint64_t key;        /**< Bits da faixa na assinatura do documento */
+  long int doc_id;
+} simhash_entry;
+
+typedef struct {
+  int bits;                 /**< Bits por assinatura */
+  int words;                /**< uint64_t por assinatura */
+  long int num_docs;        /**< Documentos do modelo */
+  uint64_t *sigs;           /**< Assinaturas (num_docs × words) */
+  int bands;                /**< Faixas do LSH */
+  int rows;                 /**< Bits por faixa */
+  simhash_entry *buckets;   /**< Por faixa, num_docs entradas ordenadas por chave */
+  long int *band_len;       /**< Entradas de cada faixa (sem documentos vazios) */
+  long int *stamp;          /**< Última consulta que viu cada documento */
+  long int *cands;          /**< Candidatos da consulta atual */
+  int (*hamming)(const uint64_t *, const uint64_t *, int);
+  long int queries;         /**< Consultas avaliadas */
+  long int candidates;      /**< Candidatos gerados pelas faixas */
+  long int reranked;        /**< Candidatos com cosseno recalculado */
+} simhash_t;
+
+simhash_t *simhash_build(hash_t **global_tf, long int num_docs, int bits);
+int simhash_save(const simhash_t *sh, const char *filename);
+simhash_t *simhash_load(const char *filename, long int num_docs, int bits);
+int simhash_bands(simhash_t *sh, int bands, int rows,
+                  const double *global_doc_norms);
+void simhash_free(simhash_t *sh);
+
+long int simhash_top_k(simhash_t *sh, hash_t **global_tf,
+                       const hash_t *query_tf, double query_norm,
+                       const double *global_doc_norms, int k, long int rerank,
+                       DocSim *out, long int *ncand);
+void simhash_report(const simhash_t *sh, FILE *out);
+
+#endif
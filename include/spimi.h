@@ -0,0 +1,42 @@
+#ifndef SPIMI_H
+#define SPIMI_H
+
+#include <stddef.h>
+
+/* -------------------- Indexação SPIMI (fora da memória) -------------------- */
+
+typedef struct {
+  const char *db;      /**< Arquivo SQLite */
+  const char *table;   /**< Tabela com os artigos */
+  long int entries;    /**< Número de documentos a indexar */
+  long int num_live;   /**< N do IDF: linhas existentes em [0, entries) */
+  int nthreads;        /**< Threads de indexação e de merge */
+  long int batch;      /**< Documentos lidos do SQLite por vez */
+  size_t block_bytes;  /**< Limite de memória do bloco de cada thread */
+  const char *tmp_dir; /**< Diretório dos runs parciais */
+} spimi_config;
+
+int spimi_build(const spimi_config *cfg, const char *filename_postings,
+                const char *filename_idf, const char *filename_doc_norms);
+
+/* -------------------- Runs com TF Bruto (segmentos) -------------------- */
+
+int spimi_build_run(const spimi_config *cfg, long int first_doc,
+                    const char *output);
+int spimi_build_run_ids(const spimi_config *cfg, const long int *ids,
+                        const char *output);
+int spimi_merge_runs(char **inputs, long int n, const char *output);
+
+/* -------------------- Map/Shuffle/Reduce em Processos -------------------- */
+
+int spimi_map(const spimi_config *cfg, int mapper, int nmappers, int nreducers);
+int spimi_reduce(const spimi_config *cfg, int reducer, int nmappers,
+                 int nreducers);
+int spimi_finalize(const spimi_config *cfg, int nreducers,
+                   const char *filename_postings, const char *filename_idf,
+                   const char *filename_doc_norms);
+int spimi_mapreduce(const spimi_config *cfg, int nmappers, int nreducers,
+                    const char *filename_postings, const char *filename_idf,
+                    const char *filename_doc_norms);
+
+#endif
@@ -1,11 +1,29 @@
 #ifndef SQLITE_HELPER_H
 #define SQLITE_HELPER_H
 
+#include <stddef.h>
+
 long int get_single_int(const char *db, const char *query,
                         const char *table);
 char **get_str_arr(const char *db, const char *query, long int start,
                    long int count, const char *table);
 char **get_documents_by_ids(const char *db, const char *table,
                             const long int *doc_ids, long int k);
+int for_each_document(const char *db, const char *table,
+                      int (*callback)(long int, const char *, size_t, void *),
+                      void *ctx);
+int for_each_id(const char *db, const char *table, const char *predicate,
+                int (*callback)(long int, void *), void *ctx);
+void free_str_arr(char **arr, long int count);
+
+/* -------------------- Leitores por Thread -------------------- */
+
+typedef struct db_reader db_reader;
+
+db_reader *db_reader_open(const char *db, const char *table);
+void db_reader_close(db_reader *reader);
+char ***db_reader_tokenize_range(db_reader *reader, long int lo, long int hi);
+char ***db_reader_tokenize_ids(db_reader *reader, const long int *doc_ids,
+                               long int n);
 
 #endif
@@ -0,0 +1,50 @@
+#ifndef TOKCACHE_H
+#define TOKCACHE_H
+
+#include "hash_t.h"
+#include "vocab.h"
+#include <stdint.h>
+#include <stdio.h>
+
+/* -------------------- Cache de Tokens (ids de termos em varint) -------------------- */
+
+typedef struct {
+  long int num_docs;              /**< Documentos no cache ([0, num_docs)) */
+  long int num_terms;             /**< Termos do dicionário do cache */
+  const char **words;             /**< Termo de cada id (aponta para o pool) */
+  const uint64_t *offsets;        /**< Tokens do doc d: [offsets[d], offsets[d + 1]) */
+  const unsigned char *stream;    /**< Ids dos termos em varint (LEB128) */
+  void *base;                     /**< Arquivo mapeado */
+  size_t size;                    /**< Tamanho do arquivo */
+} tokcache_t;
+
+typedef struct {
+  hash_t *dict;        /**< Termo → id local + 1 */
+  char **words;        /**< Termo de cada id local */
+  long int num_words;
+  long int cap_words;
+  FILE *fp;            /**< Ids locais em varint, na ordem dos documentos */
+  char path[300];      /**< Arquivo temporário da thread */
+  long int first;      /**< Primeiro documento do intervalo da thread */
+  long int count;      /**< Documentos do intervalo */
+  long int added;      /**< Documentos já gravados */
+  uint64_t *lens;      /**< Bytes de cada documento no arquivo temporário */
+  unsigned char *buf;  /**< Varints do documento antes do fwrite */
+  size_t buf_cap;
+  int failed;          /**< Intervalo incompleto (ex.: lote restaurado) */
+} tokcache_writer;
+
+tokcache_t *tokcache_open(const char *filename, const char *db,
+                          long int entries);
+void tokcache_close(tokcache_t *tc);
+long int tokcache_doc(const tokcache_t *tc, long int d, hash_t *tf,
+                      hash_t *vocab);
+
+tokcache_writer *tokcache_writer_new(const char *filename, int id,
+                                     long int first, long int count);
+void tokcache_writer_add(tokcache_writer *w, char **tokens);
+void tokcache_writer_free(tokcache_writer *w);
+long int tokcache_finish(tokcache_writer **writers, int n, const vocab_t *vocab,
+                         const char *filename);
+
+#endif
@@ -0,0 +1,58 @@
+#ifndef VOCAB_H
+#define VOCAB_H
+
+#include "hash_t.h"
+#include <stddef.h>
+#include <stdint.h>
+
+/* -------------------- Vocabulário Congelado (hash perfeita mínima) -------------------- */
+
+typedef struct {
+  uint32_t str_off;   /**< Início do termo no pool de strings */
+  uint32_t str_len;   /**< Comprimento do termo */
+  long int postings;  /**< Posição da lista invertida (-1 sem índice) */
+  double idf;         /**< IDF global do termo */
+} vocab_entry;
+
+typedef struct {
+  long int num_terms;          /**< Termos (= posições de entries) */
+  long int num_buckets;        /**< Buckets da tabela de deslocamentos */
+  uint64_t seed;               /**< Semente do hash dos termos */
+  const uint32_t *disp;        /**< Deslocamento de cada bucket */
+  const vocab_entry *entries;  /**< Entrada de cada termo, indexada pelo id */
+  const char *pool;            /**< Termos concatenados, cada um terminado em '\0' */
+  void *base;                  /**< Buffer com o layout do arquivo */
+  size_t size;                 /**< Tamanho de base em bytes */
+  int mapped;                  /**< base veio de mmap (1) ou malloc (0) */
+} vocab_t;
+
+typedef struct {
+  const char *word;   /**< Termo */
+  size_t wlen;        /**< Comprimento do termo */
+  double idf;         /**< IDF global */
+  long int postings;  /**< Posição da lista invertida (-1 sem índice) */
+} vocab_term;
+
+vocab_t *vocab_build(const vocab_term *terms, long int n);
+vocab_t *vocab_from_hash(const hash_t *idf);
+int vocab_save(const vocab_t *vocab, const char *filename);
+vocab_t *vocab_open(const char *filename);
+void vocab_free(vocab_t *vocab);
+
+long int vocab_find(const vocab_t *vocab, const char *word, size_t len);
+
+/**
+ * @brief IDF do termo de id `id` (0 para termo ausente, id < 0)
+ */
+static inline double vocab_idf(const vocab_t *vocab, long int id) {
+  return id < 0 ? 0.0 : vocab->entries[id].idf;
+}
+
+/**
+ * @brief Termo de id `id` (terminado em '\0')
+ */
+static inline const char *vocab_word(const vocab_t *vocab, long int id) {
+  return vocab->pool + vocab->entries[id].str_off;
+}
+
+#endif
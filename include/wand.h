@@ -0,0 +1,17 @@
+#ifndef WAND_H
+#define WAND_H
+
+#include "hash_t.h"
+#include "index.h"
+#include "preprocess_query.h"
+
+/* -------------------- Top-k com Poda Dinâmica (WAND / Block-Max WAND) -------------------- */
+
+#define WAND_BLOCK 64 /**< Postings por bloco de block_max */
+
+int wand_build_bounds(inv_index_t *index, const double *global_doc_norms);
+long int wand_top_k(const inv_index_t *index, const hash_t *query_tf,
+                    double query_norm, const double *global_doc_norms, int k,
+                    int nthreads, const roaring_t *filter, DocSim *out);
+
+#endif
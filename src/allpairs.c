@@ -0,0 +1,467 @@
+/**
+ * @file allpairs.c
+ * @brief Junção por similaridade: todos os pares de documentos com cosseno >= τ
+ *
+ * Segue o AllPairs com o limite L2 do L2AP. Os documentos viram vetores
+ * unitários (values / |d|) e os termos são renumerados por df decrescente.
+ * Em cada documento, o prefixo (termos mais frequentes) vai até onde a
+ * norma L2 do prefixo ainda é menor que τ; só o sufixo entra no índice.
+ * Um par com cosseno >= τ sempre tem um termo em comum nos dois sufixos:
+ * os termos comuns fora deles estão todos no prefixo de um dos dois
+ * documentos, cuja norma limita a sua contribuição a menos que τ.
+ *
+ * Para cada documento x, as listas dos termos do seu sufixo acumulam o
+ * produto parcial com os outros documentos, do termo mais raro para o mais
+ * frequente; quando a norma do restante de x fica menor que τ, nenhum
+ * documento novo vira candidato. O candidato y só é verificado
+ * (produto completo, merge das linhas) se o acumulado mais a norma do
+ * prefixo do documento de maior limite ainda puder chegar a τ. Os
+ * documentos são distribuídos em blocos entre as threads e cada thread
+ * grava os seus pares no arquivo em lotes.
+ */
+
+#include "../include/allpairs.h"
+#include "../include/cpu.h"
+#include "../include/mem.h"
+#include "../include/preprocess_query.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ALLPAIRS_CHUNK 64          /**< Documentos entregues por vez a cada thread */
+#define ALLPAIRS_BUF (64 * 1024)   /**< Saída acumulada por thread antes do fwrite */
+#define ALLPAIRS_SLACK 1e-6        /**< Folga do limite (pesos em float) */
+
+typedef struct {
+  uint32_t rank;   // Termo renumerado (0 = maior df)
+  float weight;    // values / |d|
+} ap_entry;
+
+typedef struct {
+  uint32_t doc;
+  float weight;
+} ap_posting;
+
+typedef struct {
+  long int num_docs;
+  long int *start;        // Linha do documento d: [start[d], start[d + 1])
+  ap_entry *rows;         // Termos de cada linha em rank crescente
+  long int *split;        // Primeira posição indexada (sufixo) de cada linha
+  float *pnorm;           // Norma L2 do prefixo
+  uint32_t *split_rank;   // Rank do primeiro termo indexado
+  long int *lstart;       // Lista do rank r: [lstart[r], lstart[r + 1])
+  ap_posting *lists;      // Sufixos indexados, doc crescente em cada lista
+  size_t bytes;           // Memória contabilizada
+} ap_data;
+
+typedef struct {
+  const ap_data *ap;
+  double threshold;
+  int top_m;
+  FILE *fp;
+  pthread_mutex_t *lock;  // Protege next e fp
+  long int *next;         // Próximo bloco de documentos
+  allpairs_stats stats;
+  int failed;
+} ap_args;
+
+static int compare_entry(const void *a, const void *b) {
+  uint32_t x = ((const ap_entry *)a)->rank, y = ((const ap_entry *)b)->rank;
+  return (x > y) - (x < y);
+}
+
+static const long int *df_sort_key;
+
+static int compare_df(const void *a, const void *b) {
+  long int x = *(const long int *)a, y = *(const long int *)b;
+  if (df_sort_key[x] != df_sort_key[y])
+    return df_sort_key[x] > df_sort_key[y] ? -1 : 1;
+  return (x > y) - (x < y);
+}
+
+static void ap_free(ap_data *ap) {
+  mem_track_free(MEM_POSTINGS, ap->bytes);
+  free(ap->start);
+  free(ap->rows);
+  free(ap->split);
+  free(ap->pnorm);
+  free(ap->split_rank);
+  free(ap->lstart);
+  free(ap->lists);
+}
+
+/**
+ * @brief Monta as linhas normalizadas, os prefixos e o índice de sufixos
+ *
+ * As linhas vêm do índice invertido (transposto) ou, sem ele, de global_tf
+ * com os ids do vocabulário.
+ */
+static int ap_build(ap_data *ap, const inv_index_t *index, hash_t **global_tf,
+                    const vocab_t *vocab, const double *norms, long int N,
+                    double threshold) {
+  memset(ap, 0, sizeof(*ap));
+  ap->num_docs = N;
+  long int V = index ? index->num_terms : vocab->num_terms;
+
+  // [1] df de cada termo e tamanho de cada linha
+  long int *df = calloc(V ? V : 1, sizeof(long int));
+  long int *order = malloc((V ? V : 1) * sizeof(long int));
+  uint32_t *rank_of = malloc((V ? V : 1) * sizeof(uint32_t));
+  ap->start = calloc(N + 1, sizeof(long int));
+  if (!df || !order || !rank_of || !ap->start) {
+    free(df);
+    free(order);
+    free(rank_of);
+    return -1;
+  }
+  if (index) {
+    for (long int t = 0; t < V; t++)
+      for (long int i = 0; i < index->lists[t].df; i++) {
+        long int d = index->lists[t].doc_ids[i];
+        if (norms[d] > 0.0 && !index_is_deleted(index, d)) {
+          df[t]++;
+          ap->start[d + 1]++;
+        }
+      }
+  } else {
+    for (long int d = 0; d < N; d++) {
+      if (!global_tf[d] || norms[d] <= 0.0)
+        continue;
+      for (size_t i = 0; i < global_tf[d]->cap; i++)
+        for (HashEntry *e = global_tf[d]->buckets[i]; e; e = e->next) {
+          long int t = vocab_find(vocab, e->word, e->wlen);
+          if (t >= 0 && e->value > 0.0) {
+            df[t]++;
+            ap->start[d + 1]++;
+          }
+        }
+    }
+  }
+  for (long int d = 0; d < N; d++)
+    ap->start[d + 1] += ap->start[d];
+  long int nnz = ap->start[N];
+
+  // [2] Ranks por df decrescente (empate: menor id)
+  for (long int t = 0; t < V; t++)
+    order[t] = t;
+  df_sort_key = df;
+  qsort(order, V, sizeof(long int), compare_df);
+  for (long int r = 0; r < V; r++)
+    rank_of[order[r]] = (uint32_t)r;
+
+  ap->rows = malloc((nnz ? nnz : 1) * sizeof(ap_entry));
+  ap->split = malloc(N * sizeof(long int));
+  ap->pnorm = malloc(N * sizeof(float));
+  ap->split_rank = malloc(N * sizeof(uint32_t));
+  ap->lstart = calloc(V + 1, sizeof(long int));
+  long int *fill = malloc(N * sizeof(long int));
+  if (!ap->rows || !ap->split || !ap->pnorm || !ap->split_rank ||
+      !ap->lstart || !fill) {
+    free(df);
+    free(order);
+    free(rank_of);
+    free(fill);
+    ap_free(ap);
+    return -1;
+  }
+  memcpy(fill, ap->start, N * sizeof(long int));
+
+  // [3] Linhas em rank crescente
+  if (index) {
+    for (long int r = 0; r < V; r++) {
+      const PostingList *pl = &index->lists[order[r]];
+      for (long int i = 0; i < pl->df; i++) {
+        long int d = pl->doc_ids[i];
+        if (norms[d] > 0.0 && !index_is_deleted(index, d))
+          ap->rows[fill[d]++] = (ap_entry){(uint32_t)r, (float)(pl->values[i] / norms[d])};
+      }
+    }
+  } else {
+    for (long int d = 0; d < N; d++) {
+      if (!global_tf[d] || norms[d] <= 0.0)
+        continue;
+      for (size_t i = 0; i < global_tf[d]->cap; i++)
+        for (HashEntry *e = global_tf[d]->buckets[i]; e; e = e->next) {
+          long int t = vocab_find(vocab, e->word, e->wlen);
+          if (t >= 0 && e->value > 0.0)
+            ap->rows[fill[d]++] = (ap_entry){rank_of[t], (float)(e->value / norms[d])};
+        }
+      qsort(ap->rows + ap->start[d], ap->start[d + 1] - ap->start[d],
+            sizeof(ap_entry), compare_entry);
+    }
+  }
+  free(df);
+  free(order);
+  free(rank_of);
+  free(fill);
+
+  // [4] Prefixo de cada linha: maior início com norma L2 < τ
+  double t2 = threshold * threshold;
+  long int indexed = 0;
+  for (long int d = 0; d < N; d++) {
+    double s = 0.0;
+    long int j = ap->start[d];
+    while (j < ap->start[d + 1] &&
+           s + (double)ap->rows[j].weight * ap->rows[j].weight < t2) {
+      s += (double)ap->rows[j].weight * ap->rows[j].weight;
+      j++;
+    }
+    ap->split[d] = j;
+    ap->pnorm[d] = (float)sqrt(s);
+    ap->split_rank[d] = j < ap->start[d + 1] ? ap->rows[j].rank : UINT32_MAX;
+    for (; j < ap->start[d + 1]; j++)
+      ap->lstart[ap->rows[j].rank + 1]++;
+    indexed += ap->start[d + 1] - ap->split[d];
+  }
+
+  // [5] Índice dos sufixos (documentos em ordem crescente)
+  for (long int r = 0; r < V; r++)
+    ap->lstart[r + 1] += ap->lstart[r];
+  ap->lists = malloc((indexed ? indexed : 1) * sizeof(ap_posting));
+  long int *pos = malloc((V ? V : 1) * sizeof(long int));
+  if (!ap->lists || !pos) {
+    free(pos);
+    ap_free(ap);
+    return -1;
+  }
+  memcpy(pos, ap->lstart, V * sizeof(long int));
+  for (long int d = 0; d < N; d++)
+    for (long int j = ap->split[d]; j < ap->start[d + 1]; j++)
+      ap->lists[pos[ap->rows[j].rank]++] = (ap_posting){(uint32_t)d, ap->rows[j].weight};
+  free(pos);
+
+  ap->bytes = (N + 1) * sizeof(long int) + nnz * sizeof(ap_entry) +
+              N * (sizeof(long int) + sizeof(float) + sizeof(uint32_t)) +
+              (V + 1) * sizeof(long int) + indexed * sizeof(ap_posting);
+  mem_track_alloc(MEM_POSTINGS, ap->bytes);
+  return 0;
+}
+
+/**
+ * @brief Produto escalar exato das linhas x e y (merge por rank)
+ */
+static double ap_dot(const ap_data *ap, long int x, long int y) {
+  const ap_entry *a = ap->rows + ap->start[x], *ae = ap->rows + ap->start[x + 1];
+  const ap_entry *b = ap->rows + ap->start[y], *be = ap->rows + ap->start[y + 1];
+  double dot = 0.0;
+  while (a < ae && b < be) {
+    if (a->rank < b->rank)
+      a++;
+    else if (a->rank > b->rank)
+      b++;
+    else
+      dot += (double)(a++)->weight * (b++)->weight;
+  }
+  return dot;
+}
+
+/**
+ * @brief Grava o buffer da thread no arquivo (sob o lock)
+ */
+static void ap_flush(ap_args *a, char *buf, size_t *len) {
+  if (!*len)
+    return;
+  pthread_mutex_lock(a->lock);
+  if (fwrite(buf, 1, *len, a->fp) != *len)
+    a->failed = 1;
+  pthread_mutex_unlock(a->lock);
+  *len = 0;
+}
+
+static void ap_emit(ap_args *a, char *buf, size_t *len, long int x,
+                    long int y, double sim) {
+  if (*len > ALLPAIRS_BUF - 64)
+    ap_flush(a, buf, len);
+  *len += snprintf(buf + *len, ALLPAIRS_BUF - *len, "%ld\t%ld\t%.6f\n", x, y, sim);
+  a->stats.pairs++;
+}
+
+static void *allpairs_thread(void *arg) {
+  ap_args *a = (ap_args *)arg;
+  const ap_data *ap = a->ap;
+  long int N = ap->num_docs;
+  float *acc = calloc(N, sizeof(float));
+  uint32_t *touched = malloc(N * sizeof(uint32_t));
+  char *buf = malloc(ALLPAIRS_BUF);
+  DocSim *heap = malloc((a->top_m > 0 ? a->top_m : 1) * sizeof(DocSim));
+  if (!acc || !touched || !buf || !heap) {
+    free(acc);
+    free(touched);
+    free(buf);
+    free(heap);
+    a->failed = 1;
+    return NULL;
+  }
+  size_t len = 0;
+
+  for (;;) {
+    pthread_mutex_lock(a->lock);
+    long int x0 = *a->next;
+    *a->next += ALLPAIRS_CHUNK;
+    pthread_mutex_unlock(a->lock);
+    if (x0 >= N)
+      break;
+    long int x1 = x0 + ALLPAIRS_CHUNK < N ? x0 + ALLPAIRS_CHUNK : N;
+
+    for (long int x = x0; x < x1; x++) {
+      // [1] Produto parcial pelos sufixos, dos termos raros para os
+      // frequentes (só y > x no modo de pares). Um documento ainda não
+      // visto só entra se a norma do que falta de x puder chegar a τ
+      double rem = 0.0;
+      for (long int j = ap->start[x]; j < ap->start[x + 1]; j++)
+        rem += (double)ap->rows[j].weight * ap->rows[j].weight;
+      double t2 = a->threshold * a->threshold - ALLPAIRS_SLACK;
+      long int ntouched = 0;
+      for (long int j = ap->start[x + 1] - 1; j >= ap->split[x]; j--) {
+        const ap_posting *p = ap->lists + ap->lstart[ap->rows[j].rank];
+        const ap_posting *pe = ap->lists + ap->lstart[ap->rows[j].rank + 1];
+        if (!a->top_m) {
+          long int lo = 0, hi = pe - p;
+          while (lo < hi) {
+            long int mid = lo + (hi - lo) / 2;
+            if (p[mid].doc <= (uint32_t)x)
+              lo = mid + 1;
+            else
+              hi = mid;
+          }
+          p += lo;
+        }
+        float w = ap->rows[j].weight;
+        int admit = rem >= t2;
+        rem -= (double)w * w;
+        for (; p < pe; p++) {
+          if (p->doc == (uint32_t)x)
+            continue;
+          if (acc[p->doc] == 0.0f) {
+            if (!admit)
+              continue;
+            touched[ntouched++] = p->doc;
+          }
+          acc[p->doc] += w * p->weight;
+        }
+      }
+      a->stats.candidates += ntouched;
+
+      // [2] Limite L2 e verificação exata
+      long int n = 0;
+      for (long int i = 0; i < ntouched; i++) {
+        long int y = touched[i];
+        double bound = acc[y] + (ap->split_rank[x] >= ap->split_rank[y]
+                                     ? ap->pnorm[x]
+                                     : ap->pnorm[y]);
+        acc[y] = 0.0f;
+        if (bound < a->threshold - ALLPAIRS_SLACK)
+          continue;
+        a->stats.verified++;
+        double sim = ap_dot(ap, x, y);
+        if (sim < a->threshold || sim <= 0.0)
+          continue;
+        if (a->top_m)
+          topk_offer(heap, &n, a->top_m, (DocSim){y, sim});
+        else
+          ap_emit(a, buf, &len, x, y, sim);
+      }
+      if (a->top_m) {
+        qsort(heap, n, sizeof(DocSim), compare_sim);
+        for (long int i = 0; i < n; i++)
+          ap_emit(a, buf, &len, x, heap[i].doc_id, heap[i].similarity);
+      }
+    }
+  }
+  ap_flush(a, buf, &len);
+
+  free(acc);
+  free(touched);
+  free(buf);
+  free(heap);
+  return NULL;
+}
+
+/**
+ * @brief Grava todos os pares com cosseno >= τ (ou os top-m vizinhos)
+ *
+ * Cada linha do arquivo é "doc_a<TAB>doc_b<TAB>cosseno". No modo de pares,
+ * cada par aparece uma vez (doc_a < doc_b). Com top_m > 0, cada documento
+ * tem os seus m vizinhos de maior cosseno (>= τ), em ordem decrescente.
+ * A ordem entre documentos depende das threads.
+ *
+ * @param index Índice invertido (NULL = usar global_tf)
+ * @param global_tf Vetores TF-IDF dos documentos (sem índice)
+ * @param vocab Vocabulário (ids dos termos de global_tf)
+ * @param global_doc_norms Normas dos documentos
+ * @param num_docs Número de documentos
+ * @param threshold Cosseno mínimo τ (0 < τ <= 1; 0 só com top_m)
+ * @param top_m Vizinhos por documento (0 = todos os pares)
+ * @param nthreads Threads de trabalho
+ * @param filename Arquivo de saída
+ * @param stats Saída: contadores da junção
+ * @return 0 em sucesso, -1 em erro
+ */
+int allpairs_join(const inv_index_t *index, hash_t **global_tf,
+                  const vocab_t *vocab, const double *global_doc_norms,
+                  long int num_docs, double threshold, int top_m,
+                  int nthreads, const char *filename, allpairs_stats *stats) {
+  memset(stats, 0, sizeof(*stats));
+  if (num_docs <= 0 || threshold > 1.0 || (threshold <= 0.0 && top_m <= 0))
+    return -1;
+  if (nthreads <= 0)
+    nthreads = 1;
+
+  ap_data ap;
+  if (ap_build(&ap, index, global_tf, vocab, global_doc_norms, num_docs,
+               threshold) != 0) {
+    fprintf(stderr, "Erro ao montar o índice da junção por similaridade\n");
+    return -1;
+  }
+  stats->nnz = ap.start[num_docs];
+  stats->indexed = ap.lstart[index ? index->num_terms : vocab->num_terms];
+
+  FILE *fp = fopen(filename, "w");
+  ap_args *args = calloc(nthreads, sizeof(ap_args));
+  pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+  if (!fp || !args || !tids) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", filename);
+    if (fp)
+      fclose(fp);
+    free(args);
+    free(tids);
+    ap_free(&ap);
+    return -1;
+  }
+
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  long int next = 0;
+  int created = 0, failed = 0;
+  for (int i = 0; i < nthreads; i++) {
+    args[i] = (ap_args){&ap, threshold, top_m, fp, &lock, &next, {0}, 0};
+    if (nthreads == 1) {
+      allpairs_thread(&args[i]);
+    } else if (cpu_thread_create(&tids[i], i, allpairs_thread, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %d da junção\n", i);
+      failed = 1;
+      break;
+    } else {
+      created++;
+    }
+  }
+  for (int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+  for (int i = 0; i < nthreads; i++) {
+    failed |= args[i].failed;
+    stats->pairs += args[i].stats.pairs;
+    stats->candidates += args[i].stats.candidates;
+    stats->verified += args[i].stats.verified;
+  }
+
+  if (fclose(fp) != 0)
+    failed = 1;
+  if (failed)
+    fprintf(stderr, "Erro ao gravar pares em %s\n", filename);
+  free(args);
+  free(tids);
+  ap_free(&ap);
+  return failed ? -1 : 0;
+}
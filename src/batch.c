@@ -0,0 +1,306 @@
+/**
+ * @file batch.c
+ * @brief Pontuação de várias consultas em uma única passada pelos documentos
+ *
+ * compute_similarities percorre todos os documentos a cada consulta. Aqui Q
+ * consultas são pontuadas juntas, como um produto esparso D × Qᵀ calculado
+ * linha a linha (Gustavson): cada documento é lido uma vez e seus valores
+ * para a união dos termos das consultas vão para um vetor denso; depois,
+ * cada consulta que tem algum termo no documento soma o produto escalar a
+ * partir desse vetor. O hash de cada termo da união é calculado uma vez
+ * por lote (hash_find_prehashed), não uma vez por documento e consulta.
+ *
+ * O estado do lado das consultas (união, listas termo → consultas e um
+ * heap de top-k por consulta) é pequeno e fica na cache durante a passada;
+ * o tamanho do lote controla esse estado. A soma de cada consulta segue a
+ * ordem dos seus buckets, como em compute_similarities_thread, então o
+ * top-k de cada consulta é o mesmo da consulta isolada.
+ */
+
+#include "../include/batch.h"
+#include "../include/cpu.h"
+#include "../include/mem.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Termos das consultas do lote
+ */
+typedef struct {
+  int nqueries;
+  long int nterms;           // Termos distintos (união)
+  const char **word;         // Palavra de cada termo da união
+  size_t *wlen;
+  uint64_t *hash;            // hash_str de cada termo
+  long int *q_start;         // Termos da consulta q: [q_start[q], q_start[q + 1])
+  long int *q_term;          // Termo da união, na ordem dos buckets da query
+  double *q_weight;          // Peso TF-IDF na query
+  long int *t_start;         // Consultas do termo u: [t_start[u], t_start[u + 1])
+  int *t_query;
+  const double *query_norms;
+} batch_terms;
+
+typedef struct {
+  const batch_terms *bt;
+  hash_t **global_tf;
+  const double *doc_norms;
+  long int start;            // Primeiro documento do intervalo
+  long int end;              // Fim do intervalo (exclusivo)
+  int k;
+  DocSim *heaps;             // Saída: top-k de cada consulta (Q × k)
+  long int *counts;          // Saída: documentos em cada heap
+  int failed;
+} batch_args;
+
+static void *batch_thread(void *arg) {
+  batch_args *a = (batch_args *)arg;
+  const batch_terms *bt = a->bt;
+  long int U = bt->nterms;
+  int Q = bt->nqueries;
+
+  double *docval = calloc(U ? U : 1, sizeof(double));
+  long int *hits = malloc((U ? U : 1) * sizeof(long int));
+  long int *stamp = malloc((Q ? Q : 1) * sizeof(long int));
+  int *touched = malloc((Q ? Q : 1) * sizeof(int));
+  if (!docval || !hits || !stamp || !touched) {
+    free(docval);
+    free(hits);
+    free(stamp);
+    free(touched);
+    a->failed = 1;
+    return NULL;
+  }
+  for (int q = 0; q < Q; q++)
+    stamp[q] = -1;
+
+  for (long int d = a->start; d < a->end; d++) {
+    const hash_t *doc = a->global_tf[d];
+    double norm = a->doc_norms[d];
+    if (!doc || norm <= 0.0)
+      continue;
+
+    // [1] Valores do documento para os termos da união
+    long int nhits = 0;
+    for (long int u = 0; u < U; u++) {
+      double v = hash_find_prehashed(doc, bt->word[u], bt->wlen[u], bt->hash[u]);
+      if (v > 0.0) {
+        docval[u] = v;
+        hits[nhits++] = u;
+      }
+    }
+
+    // [2] Consultas com algum termo no documento
+    int ntouched = 0;
+    for (long int h = 0; h < nhits; h++)
+      for (long int i = bt->t_start[hits[h]]; i < bt->t_start[hits[h] + 1]; i++) {
+        int q = bt->t_query[i];
+        if (stamp[q] != d) {
+          stamp[q] = d;
+          touched[ntouched++] = q;
+        }
+      }
+
+    // [3] Produto escalar de cada uma, na ordem dos buckets da query
+    for (int t = 0; t < ntouched; t++) {
+      int q = touched[t];
+      double dot = 0.0;
+      for (long int j = bt->q_start[q]; j < bt->q_start[q + 1]; j++) {
+        double v = docval[bt->q_term[j]];
+        if (v > 0.0)
+          dot += bt->q_weight[j] * v;
+      }
+      double qnorm = bt->query_norms[q];
+      double sim = qnorm > 0.0 ? dot / (qnorm * norm) : 0.0;
+      if (sim > 0.0)
+        topk_offer(a->heaps + (size_t)q * a->k, &a->counts[q], a->k,
+                   (DocSim){d, sim});
+    }
+
+    for (long int h = 0; h < nhits; h++)
+      docval[hits[h]] = 0.0;
+  }
+
+  free(docval);
+  free(hits);
+  free(stamp);
+  free(touched);
+  return NULL;
+}
+
+static void batch_terms_free(batch_terms *bt) {
+  free(bt->word);
+  free(bt->wlen);
+  free(bt->hash);
+  free(bt->q_start);
+  free(bt->q_term);
+  free(bt->q_weight);
+  free(bt->t_start);
+  free(bt->t_query);
+}
+
+/**
+ * @brief Monta a união dos termos e as listas consulta → termos → consultas
+ */
+static int batch_terms_build(batch_terms *bt, hash_t *const *queries, int Q,
+                             const double *query_norms) {
+  memset(bt, 0, sizeof(*bt));
+  bt->nqueries = Q;
+  bt->query_norms = query_norms;
+
+  long int total = 0;
+  for (int q = 0; q < Q; q++)
+    total += queries[q] ? (long int)queries[q]->size : 0;
+
+  bt->word = malloc((total ? total : 1) * sizeof(char *));
+  bt->wlen = malloc((total ? total : 1) * sizeof(size_t));
+  bt->hash = malloc((total ? total : 1) * sizeof(uint64_t));
+  bt->q_start = malloc((Q + 1) * sizeof(long int));
+  bt->q_term = malloc((total ? total : 1) * sizeof(long int));
+  bt->q_weight = malloc((total ? total : 1) * sizeof(double));
+  bt->t_start = calloc(total + 2, sizeof(long int));
+  bt->t_query = malloc((total ? total : 1) * sizeof(int));
+  if (!bt->word || !bt->wlen || !bt->hash || !bt->q_start || !bt->q_term ||
+      !bt->q_weight || !bt->t_start || !bt->t_query) {
+    batch_terms_free(bt);
+    return -1;
+  }
+
+  // Termo → posição na união (guardada como u + 1: hash_find devolve 0 se ausente)
+  hash_t *ids = hash_new();
+  long int n = 0;
+  for (int q = 0; q < Q; q++) {
+    bt->q_start[q] = n;
+    if (!queries[q])
+      continue;
+    for (size_t i = 0; i < queries[q]->cap; i++)
+      for (HashEntry *e = queries[q]->buckets[i]; e; e = e->next) {
+        // Peso zero não altera nenhum score
+        if (e->value <= 0.0)
+          continue;
+        long int u = (long int)hash_find(ids, e->word) - 1;
+        if (u < 0) {
+          u = bt->nterms++;
+          hash_add(ids, e->word, (double)(u + 1));
+          bt->word[u] = e->word;
+          bt->wlen[u] = e->wlen;
+          bt->hash[u] = hash_str(e->word, e->wlen);
+        }
+        bt->q_term[n] = u;
+        bt->q_weight[n++] = e->value;
+        bt->t_start[u + 2]++;
+      }
+  }
+  bt->q_start[Q] = n;
+  hash_free(ids);
+
+  // Listas termo → consultas (contagem em t_start[u + 2], depois prefixos)
+  for (long int u = 0; u < bt->nterms; u++)
+    bt->t_start[u + 2] += bt->t_start[u + 1];
+  for (int q = 0; q < Q; q++)
+    for (long int j = bt->q_start[q]; j < bt->q_start[q + 1]; j++)
+      bt->t_query[bt->t_start[bt->q_term[j] + 1]++] = q;
+  return 0;
+}
+
+/**
+ * @brief Top-k de várias consultas com uma passada pelos documentos
+ *
+ * @param queries Hashes TF-IDF das consultas (NULL = consulta vazia)
+ * @param query_norms Normas das consultas
+ * @param nqueries Número de consultas
+ * @param global_tf Vetores TF-IDF dos documentos
+ * @param global_doc_norms Normas dos documentos
+ * @param num_docs Número de documentos
+ * @param k Documentos por consulta
+ * @param nthreads Número de threads
+ * @param out Saída: top-k da consulta q em out[q * k ...]
+ * @param found Saída: documentos no top-k de cada consulta
+ * @return 0 em sucesso, -1 em erro
+ */
+int batch_top_k(hash_t *const *queries, const double *query_norms, int nqueries,
+                hash_t **global_tf, const double *global_doc_norms,
+                long int num_docs, int k, int nthreads, DocSim *out,
+                long int *found) {
+  if (nqueries <= 0 || k <= 0) {
+    for (int q = 0; q < nqueries; q++)
+      found[q] = 0;
+    return 0;
+  }
+
+  batch_terms bt;
+  if (batch_terms_build(&bt, queries, nqueries, query_norms) != 0)
+    return -1;
+
+  if (nthreads <= 0) nthreads = 1;
+  if (nthreads > num_docs) nthreads = num_docs > 0 ? (int)num_docs : 1;
+
+  size_t heap_len = (size_t)nthreads * nqueries * k;
+  batch_args *args = calloc(nthreads, sizeof(batch_args));
+  pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+  DocSim *heaps = malloc(heap_len * sizeof(DocSim));
+  long int *counts = calloc((size_t)nthreads * nqueries, sizeof(long int));
+  DocSim *merged = malloc((size_t)nthreads * k * sizeof(DocSim));
+  if (!args || !tids || !heaps || !counts || !merged) {
+    batch_terms_free(&bt);
+    free(args);
+    free(tids);
+    free(heaps);
+    free(counts);
+    free(merged);
+    return -1;
+  }
+  mem_track_alloc(MEM_QUERY, heap_len * sizeof(DocSim));
+
+  // Intervalos contíguos de documentos, um conjunto de heaps por thread
+  long int base = num_docs / nthreads, rem = num_docs % nthreads;
+  int created = 0, failed = 0;
+  for (int i = 0; i < nthreads; i++) {
+    args[i] = (batch_args){&bt, global_tf, global_doc_norms,
+                           i * base + (i < rem ? i : rem), 0, k,
+                           heaps + (size_t)i * nqueries * k,
+                           counts + (size_t)i * nqueries, 0};
+    args[i].end = args[i].start + base + (i < rem);
+    if (nthreads == 1) {
+      batch_thread(&args[i]);
+    } else if (cpu_thread_create(&tids[i], i, batch_thread, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %d para consultas em lote\n", i);
+      failed = 1;
+      break;
+    } else {
+      created++;
+    }
+  }
+  for (int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+  for (int i = 0; i < nthreads; i++)
+    failed |= args[i].failed;
+
+  // Une os heaps das threads de cada consulta
+  for (int q = 0; q < nqueries && !failed; q++) {
+    long int total = 0;
+    for (int i = 0; i < nthreads; i++) {
+      long int c = counts[(size_t)i * nqueries + q];
+      memcpy(merged + total, heaps + ((size_t)i * nqueries + q) * k,
+             c * sizeof(DocSim));
+      total += c;
+    }
+    qsort(merged, total, sizeof(DocSim), compare_sim);
+    long int n = total < k ? total : k;
+    memcpy(out + (size_t)q * k, merged, n * sizeof(DocSim));
+    found[q] =
+        topk_fill_zeros(out + (size_t)q * k, n, k, num_docs, NULL, NULL);
+    failed |= found[q] < 0;
+  }
+
+  mem_track_free(MEM_QUERY, heap_len * sizeof(DocSim));
+  batch_terms_free(&bt);
+  free(args);
+  free(tids);
+  free(heaps);
+  free(counts);
+  free(merged);
+  return failed ? -1 : 0;
+}
@@ -0,0 +1,425 @@
+/**
+ * @file boolean.c
+ * @brief Consultas com termos obrigatórios (+termo) e proibidos (-termo)
+ *
+ * Uma consulta booleana só devolve documentos que contêm todos os termos
+ * obrigatórios e nenhum proibido; sem obrigatórios, basta conter algum
+ * termo da consulta. O ranking continua sendo o cosseno com o vetor da
+ * consulta (obrigatórios e opcionais; os proibidos não pontuam).
+ *
+ * Com índice invertido, os candidatos saem das listas de doc_ids:
+ * - as listas dos obrigatórios são intersectadas em ordem crescente de df,
+ *   partindo de uma cópia da menor. Com tamanhos muito diferentes
+ *   (BOOL_GALLOP_RATIO), cada candidato é procurado na lista maior por
+ *   busca galopante; senão, as listas são percorridas juntas em blocos de
+ *   4 doc_ids comparados todos contra todos (AVX2 quando a CPU tem a
+ *   extensão);
+ * - as listas dos proibidos são subtraídas com a mesma busca galopante;
+ * - os termos da consulta são então pontuados só nos candidatos, andando
+ *   em cada lista por busca galopante até o próximo candidato.
+ *
+ * O produto escalar de cada candidato soma os termos na ordem dos buckets
+ * da query, como compute_similarities_thread e index_similarities, então
+ * os scores coincidem com os da pontuação exaustiva.
+ *
+ * No modelo por documento não há listas de doc_ids: cada documento é
+ * testado com hash_contains e pontuado na mesma passada.
+ */
+
+#include "../include/boolean.h"
+#include "../include/mem.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#include <immintrin.h>
+#endif
+
+/* ------------- Operações em listas ordenadas de doc_ids ------------- */
+
+/**
+ * @brief Primeira posição >= pos com ids[p] >= target (busca galopante)
+ */
+static long int gallop(const long int *ids, long int pos, long int n,
+                       long int target) {
+  if (pos >= n || ids[pos] >= target)
+    return pos;
+
+  long int lo = pos, step = 1;
+  while (lo + step < n && ids[lo + step] < target) {
+    lo += step;
+    step *= 2;
+  }
+  long int hi = lo + step < n ? lo + step : n;
+  // ids[lo] < target; resposta em (lo, hi]
+  while (lo + 1 < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (ids[mid] < target)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+/**
+ * @brief Interseção por merge; out pode ser o próprio a (escreve atrás de i)
+ */
+static long int merge_generic(const long int *a, long int na,
+                              const long int *b, long int nb, long int *out) {
+  long int n = 0, i = 0, j = 0;
+  while (i < na && j < nb) {
+    if (a[i] < b[j]) {
+      i++;
+    } else if (a[i] > b[j]) {
+      j++;
+    } else {
+      out[n++] = a[i];
+      i++;
+      j++;
+    }
+  }
+  return n;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// Blocos de 4 doc_ids de a e de b comparados todos contra todos (b em 4
+// rotações); avança o bloco de menor máximo (os dois, se iguais). Um
+// doc_id de a casa com no máximo um de b, então as máscaras dos blocos de
+// b visitados são acumuladas até o bloco de a avançar.
+__attribute__((target("avx2"))) static long int
+merge_avx2(const long int *a, long int na, const long int *b, long int nb,
+           long int *out) {
+  long int n = 0, i = 0, j = 0;
+  int acc = 0;
+  while (i + 4 <= na && j + 4 <= nb) {
+    __m256i va = _mm256_loadu_si256((const __m256i *)(a + i));
+    __m256i vb = _mm256_loadu_si256((const __m256i *)(b + j));
+    __m256i m = _mm256_cmpeq_epi64(va, vb);
+    m = _mm256_or_si256(
+        m, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x39)));
+    m = _mm256_or_si256(
+        m, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x4E)));
+    m = _mm256_or_si256(
+        m, _mm256_cmpeq_epi64(va, _mm256_permute4x64_epi64(vb, 0x93)));
+    acc |= _mm256_movemask_pd(_mm256_castsi256_pd(m));
+
+    long int amax = a[i + 3], bmax = b[j + 3];
+    if (amax <= bmax) {
+      for (; acc; acc &= acc - 1)
+        out[n++] = a[i + __builtin_ctz(acc)];
+      i += 4;
+    }
+    if (bmax <= amax)
+      j += 4;
+  }
+  // Casamentos do bloco atual de a com blocos de b já saltados
+  for (; acc; acc &= acc - 1)
+    out[n++] = a[i + __builtin_ctz(acc)];
+  // Cauda (menos de 4 doc_ids em a ou em b); os casamentos acima são
+  // menores que b[j] e não se repetem
+  return n + merge_generic(a + i, na - i, b + j, nb - j, out + n);
+}
+#endif
+
+/**
+ * @brief Interseção de listas crescentes, gravada no início de a
+ *
+ * @param a Lista (sobrescrita com o resultado)
+ * @param na Tamanho de a
+ * @param b Lista a intersectar
+ * @param nb Tamanho de b
+ * @return Tamanho da interseção
+ */
+long int bool_intersect(long int *a, long int na, const long int *b,
+                        long int nb) {
+  long int n = 0;
+  if (nb >= BOOL_GALLOP_RATIO * na) {
+    // b muito maior: cada doc_id de a é procurado em b
+    for (long int i = 0, pos = 0; i < na; i++) {
+      pos = gallop(b, pos, nb, a[i]);
+      if (pos == nb)
+        break;
+      if (b[pos] == a[i])
+        a[n++] = a[i];
+    }
+    return n;
+  }
+  if (na >= BOOL_GALLOP_RATIO * nb) {
+    // a muito maior: cada doc_id de b é procurado em a
+    for (long int j = 0, pos = 0; j < nb; j++) {
+      pos = gallop(a, pos, na, b[j]);
+      if (pos == na)
+        break;
+      if (a[pos] == b[j])
+        a[n++] = b[j];
+    }
+    return n;
+  }
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  if (__builtin_cpu_supports("avx2"))
+    return merge_avx2(a, na, b, nb, a);
+#endif
+  return merge_generic(a, na, b, nb, a);
+}
+
+/**
+ * @brief Remove de a os doc_ids presentes em b (resultado no início de a)
+ *
+ * @return Tamanho de a sem os doc_ids de b
+ */
+long int bool_subtract(long int *a, long int na, const long int *b,
+                       long int nb) {
+  long int n = 0;
+  for (long int i = 0, pos = 0; i < na; i++) {
+    pos = gallop(b, pos, nb, a[i]);
+    if (pos < nb && b[pos] == a[i])
+      continue;
+    a[n++] = a[i];
+  }
+  return n;
+}
+
+static int compare_long(const void *a, const void *b) {
+  long int x = *(const long int *)a, y = *(const long int *)b;
+  return (x > y) - (x < y);
+}
+
+static int compare_df(const void *a, const void *b) {
+  long int x = (*(const PostingList *const *)a)->df;
+  long int y = (*(const PostingList *const *)b)->df;
+  return (x > y) - (x < y);
+}
+
+/* ------------- Candidatos e pontuação ------------- */
+
+/**
+ * @brief Documentos que satisfazem a consulta booleana (índice invertido)
+ *
+ * @param n_out Saída: quantidade de candidatos
+ * @return doc_ids crescentes (caller deve liberar), ou NULL em erro
+ */
+static long int *index_candidates(const inv_index_t *index,
+                                  const hash_t *query_tf, const bool_query *ops,
+                                  const roaring_t *filter, long int *n_out) {
+  long int n = 0;
+  long int *cand = NULL;
+
+  if (ops->nrequired > 0) {
+    const PostingList **lists = malloc(ops->nrequired * sizeof(PostingList *));
+    if (!lists)
+      return NULL;
+    int missing = 0;
+    for (long int i = 0; i < ops->nrequired; i++) {
+      lists[i] = index_find(index, ops->required[i]);
+      missing |= !lists[i] || lists[i]->df == 0;
+    }
+    if (missing) {
+      // Termo obrigatório fora do vocabulário: nenhum documento
+      free(lists);
+      *n_out = 0;
+      return malloc(sizeof(long int));
+    }
+
+    // Menor lista primeiro: cada interseção só pode encolher o resultado
+    qsort(lists, ops->nrequired, sizeof(PostingList *), compare_df);
+    cand = malloc(lists[0]->df * sizeof(long int));
+    if (!cand) {
+      free(lists);
+      return NULL;
+    }
+    memcpy(cand, lists[0]->doc_ids, lists[0]->df * sizeof(long int));
+    n = lists[0]->df;
+    for (long int i = 1; i < ops->nrequired && n > 0; i++)
+      n = bool_intersect(cand, n, lists[i]->doc_ids, lists[i]->df);
+    free(lists);
+  } else {
+    // Sem obrigatórios: união das listas dos termos da consulta
+    long int total = 0;
+    for (size_t i = 0; i < query_tf->cap; i++)
+      for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+        const PostingList *pl = index_find(index, q->word);
+        total += pl ? pl->df : 0;
+      }
+    cand = malloc((total ? total : 1) * sizeof(long int));
+    if (!cand)
+      return NULL;
+    for (size_t i = 0; i < query_tf->cap; i++)
+      for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+        const PostingList *pl = index_find(index, q->word);
+        if (pl) {
+          memcpy(cand + n, pl->doc_ids, pl->df * sizeof(long int));
+          n += pl->df;
+        }
+      }
+    qsort(cand, n, sizeof(long int), compare_long);
+    long int m = 0;
+    for (long int i = 0; i < n; i++)
+      if (m == 0 || cand[m - 1] != cand[i])
+        cand[m++] = cand[i];
+    n = m;
+  }
+
+  for (long int i = 0; i < ops->nexcluded && n > 0; i++) {
+    const PostingList *pl = index_find(index, ops->excluded[i]);
+    if (pl)
+      n = bool_subtract(cand, n, pl->doc_ids, pl->df);
+  }
+
+  // Removidos (tombstones) e documentos fora do filtro
+  long int m = 0;
+  for (long int i = 0; i < n; i++)
+    if (!index_is_deleted(index, cand[i]) &&
+        (!filter || roaring_contains(filter, (uint32_t)cand[i])))
+      cand[m++] = cand[i];
+  *n_out = m;
+  return cand;
+}
+
+/**
+ * @brief Cosseno dos candidatos, somando os termos na ordem dos buckets
+ *
+ * @return 0 em sucesso, -1 em falha de alocação
+ */
+static int index_score(const inv_index_t *index, const hash_t *query_tf,
+                       double query_norm, const double *global_doc_norms,
+                       const long int *cand, long int n, int k, DocSim *out,
+                       long int *nout) {
+  double *dot = calloc(n ? n : 1, sizeof(double));
+  if (!dot)
+    return -1;
+  mem_track_alloc(MEM_QUERY, n * sizeof(double));
+
+  for (size_t i = 0; i < query_tf->cap; i++)
+    for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+      const PostingList *pl = index_find(index, q->word);
+      if (!pl)
+        continue;
+      // Lista densa em relação aos candidatos: avanço linear; senão galope
+      int dense = pl->df <= BOOL_GALLOP_RATIO * n;
+      for (long int c = 0, pos = 0; c < n; c++) {
+        if (dense)
+          while (pos < pl->df && pl->doc_ids[pos] < cand[c])
+            pos++;
+        else
+          pos = gallop(pl->doc_ids, pos, pl->df, cand[c]);
+        if (pos == pl->df)
+          break;
+        if (pl->doc_ids[pos] == cand[c] && pl->values[pos] > 0.0)
+          dot[c] += q->value * pl->values[pos];
+      }
+    }
+
+  for (long int c = 0; c < n; c++) {
+    double norm = global_doc_norms[cand[c]];
+    double sim = (query_norm > 0.0 && norm > 0.0)
+                     ? dot[c] / (query_norm * norm)
+                     : 0.0;
+    topk_offer(out, nout, k, (DocSim){cand[c], sim});
+  }
+  mem_track_free(MEM_QUERY, n * sizeof(double));
+  free(dot);
+  return 0;
+}
+
+/**
+ * @brief Testa e pontua cada documento do modelo por documento
+ *
+ * @return Documentos que satisfazem a consulta
+ */
+static long int doc_scan(hash_t **global_tf, const hash_t *query_tf,
+                         double query_norm, const double *global_doc_norms,
+                         long int num_docs, const bool_query *ops,
+                         const roaring_t *filter, int k, DocSim *out,
+                         long int *nout) {
+  long int matched = 0;
+  for (long int d = filter ? roaring_next(filter, 0) : 0;
+       d >= 0 && d < num_docs;
+       d = filter ? roaring_next(filter, d + 1) : d + 1) {
+    const hash_t *doc = global_tf[d];
+    if (!doc)
+      continue;
+
+    int ok = 1;
+    for (long int i = 0; ok && i < ops->nrequired; i++)
+      ok = hash_contains(doc, ops->required[i]);
+    for (long int i = 0; ok && i < ops->nexcluded; i++)
+      ok = !hash_contains(doc, ops->excluded[i]);
+    if (!ok)
+      continue;
+
+    int any = ops->nrequired > 0;
+    double dot = 0.0;
+    for (size_t i = 0; i < query_tf->cap; i++)
+      for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+        double v = hash_find(doc, q->word);
+        if (v > 0.0)
+          dot += q->value * v;
+        if (!any)
+          any = v > 0.0 || hash_contains(doc, q->word);
+      }
+    if (!any)
+      continue;
+
+    double norm = global_doc_norms[d];
+    double sim = (query_norm > 0.0 && norm > 0.0) ? dot / (query_norm * norm)
+                                                  : 0.0;
+    topk_offer(out, nout, k, (DocSim){d, sim});
+    matched++;
+  }
+  return matched;
+}
+
+/**
+ * @brief Top-k por cosseno entre os documentos que satisfazem a consulta
+ *
+ * Diferente das demais consultas, o resultado não é completado com
+ * documentos de score zero: só entram documentos que satisfazem os
+ * operadores (pode haver menos de k).
+ *
+ * @param index Índice invertido (NULL: usa global_tf)
+ * @param global_tf Vetores TF-IDF dos documentos (sem índice)
+ * @param query_tf Vetor TF-IDF da consulta (obrigatórios e opcionais)
+ * @param query_norm Norma da consulta
+ * @param global_doc_norms Normas dos documentos
+ * @param num_docs Número de documentos
+ * @param ops Termos obrigatórios e proibidos
+ * @param filter Documentos permitidos (NULL = todos)
+ * @param k Tamanho do top-k
+ * @param out Saída: top-k ordenado (k posições)
+ * @param ncand_out Saída: documentos que satisfazem a consulta
+ * @return Documentos em out, ou -1 em erro
+ */
+long int boolean_top_k(const inv_index_t *index, hash_t **global_tf,
+                       const hash_t *query_tf, double query_norm,
+                       const double *global_doc_norms, long int num_docs,
+                       const bool_query *ops, const roaring_t *filter, int k,
+                       DocSim *out, long int *ncand_out) {
+  long int n = 0;
+  *ncand_out = 0;
+  if (k <= 0)
+    return 0;
+
+  if (index) {
+    long int ncand;
+    long int *cand = index_candidates(index, query_tf, ops, filter, &ncand);
+    if (!cand)
+      return -1;
+    int rc = index_score(index, query_tf, query_norm, global_doc_norms, cand,
+                         ncand, k, out, &n);
+    free(cand);
+    if (rc != 0)
+      return -1;
+    *ncand_out = ncand;
+  } else if (global_tf) {
+    *ncand_out = doc_scan(global_tf, query_tf, query_norm, global_doc_norms,
+                          num_docs, ops, filter, k, out, &n);
+  } else {
+    return -1;
+  }
+
+  qsort(out, n, sizeof(DocSim), compare_sim);
+  return n;
+}
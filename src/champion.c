@@ -0,0 +1,431 @@
+/**
+ * @file champion.c
+ * @brief Listas de campeões: camada de alto impacto para top-k aproximado
+ *
+ * Para cada termo, a camada guarda os r documentos de maior values / |d|
+ * (a contribuição do termo ao cosseno, a menos do peso na query), em ordem
+ * de doc_id, e o maior valor que ficou de fora (tail).
+ *
+ * Uma consulta só considera os documentos que aparecem nas listas de
+ * campeões dos seus termos. O score desses candidatos é exato: os valores
+ * vêm das listas completas, somados na ordem dos buckets da query, como em
+ * index_similarities. A perda de recall vem apenas dos documentos fora das
+ * listas. Se menos de k candidatos atingem o limiar (min_score), a consulta
+ * deve ser refeita no índice completo (fallback). No modo exato, o fallback
+ * também ocorre quando algum documento fora das listas ainda poderia
+ * superar o k-ésimo candidato (soma de q_t / |q| * tail_t), então o top-k
+ * respondido pela camada é sempre o mesmo da pontuação completa.
+ */
+
+#include "../include/champion.h"
+#include "../include/log.h"
+#include "../include/mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define CHAMPION_MAGIC "CHAMPLS1"
+#define CHAMPION_SLACK (1.0 + 1e-9) /**< Folga do limite (arredondamento) */
+
+static void champion_track(const champion_t *champ, int alloc) {
+  size_t bytes = (champ->num_terms + 1) * sizeof(long int) +
+                 champ->num_terms * sizeof(double) +
+                 champ->offsets[champ->num_terms] * sizeof(long int);
+  if (alloc)
+    mem_track_alloc(MEM_POSTINGS, bytes);
+  else
+    mem_track_free(MEM_POSTINGS, bytes);
+}
+
+static champion_t *champion_alloc(long int r, long int num_terms, long int total) {
+  champion_t *champ = calloc(1, sizeof(champion_t));
+  if (!champ)
+    return NULL;
+  champ->r = r;
+  champ->num_terms = num_terms;
+  champ->offsets = calloc(num_terms + 1, sizeof(long int));
+  champ->tail = calloc(num_terms ? num_terms : 1, sizeof(double));
+  champ->doc_ids = malloc((total ? total : 1) * sizeof(long int));
+  if (!champ->offsets || !champ->tail || !champ->doc_ids) {
+    free(champ->offsets);
+    free(champ->tail);
+    free(champ->doc_ids);
+    free(champ);
+    return NULL;
+  }
+  return champ;
+}
+
+/**
+ * @brief n-ésimo maior valor de v (v é reordenado)
+ */
+static double nth_largest(double *v, long int len, long int n) {
+  long int lo = 0, hi = len - 1;
+  while (lo < hi) {
+    double pivot = v[lo + (hi - lo) / 2];
+    long int i = lo, j = hi;
+    while (i <= j) {
+      while (v[i] > pivot)
+        i++;
+      while (v[j] < pivot)
+        j--;
+      if (i <= j) {
+        double tmp = v[i];
+        v[i++] = v[j];
+        v[j--] = tmp;
+      }
+    }
+    if (n <= j)
+      hi = j;
+    else if (n >= i)
+      lo = i;
+    else
+      return v[n];
+  }
+  return v[n];
+}
+
+/**
+ * @brief Seleciona as listas de campeões de todos os termos do índice
+ *
+ * Empates no r-ésimo valor ficam com os menores doc_ids.
+ *
+ * @param index Índice invertido
+ * @param global_doc_norms Normas dos documentos
+ * @param r Máximo de documentos por termo (> 0)
+ * @return Camada de campeões, ou NULL em erro
+ */
+champion_t *champion_build(const inv_index_t *index,
+                           const double *global_doc_norms, long int r) {
+  if (!index || !global_doc_norms || r <= 0)
+    return NULL;
+
+  long int total = 0, max_df = 0;
+  for (long int t = 0; t < index->num_terms; t++) {
+    long int df = index->lists[t].df;
+    total += df < r ? df : r;
+    if (df > max_df)
+      max_df = df;
+  }
+
+  champion_t *champ = champion_alloc(r, index->num_terms, total);
+  double *scores = malloc((max_df ? max_df : 1) * sizeof(double));
+  double *work = malloc((max_df ? max_df : 1) * sizeof(double));
+  if (!champ || !scores || !work) {
+    champion_free(champ);
+    free(scores);
+    free(work);
+    return NULL;
+  }
+
+  long int pos = 0;
+  for (long int t = 0; t < index->num_terms; t++) {
+    const PostingList *pl = &index->lists[t];
+    champ->offsets[t] = pos;
+    if (pl->df <= r) {
+      memcpy(champ->doc_ids + pos, pl->doc_ids, pl->df * sizeof(long int));
+      pos += pl->df;
+      continue;
+    }
+
+    for (long int i = 0; i < pl->df; i++) {
+      double norm = global_doc_norms[pl->doc_ids[i]];
+      scores[i] = pl->values[i] > 0.0 && norm > 0.0 ? pl->values[i] / norm : 0.0;
+    }
+    memcpy(work, scores, pl->df * sizeof(double));
+    double cut = nth_largest(work, pl->df, r - 1);
+
+    // Acima do corte entram todos; no corte, os primeiros até completar r
+    long int above = 0;
+    for (long int i = 0; i < pl->df; i++)
+      above += scores[i] > cut;
+    long int ties = r - above;
+    double tail = 0.0;
+    for (long int i = 0; i < pl->df; i++) {
+      if (scores[i] > cut || (scores[i] == cut && ties-- > 0))
+        champ->doc_ids[pos++] = pl->doc_ids[i];
+      else if (scores[i] > tail)
+        tail = scores[i];
+    }
+    champ->tail[t] = tail;
+  }
+  champ->offsets[index->num_terms] = pos;
+
+  free(scores);
+  free(work);
+  champion_track(champ, 1);
+  LOG(stdout, "Listas de campeões: %ld termos, %ld postings (r=%ld)",
+      champ->num_terms, pos, r);
+  return champ;
+}
+
+/**
+ * @brief Grava a camada de campeões
+ *
+ * Formato: magic (8 bytes), r, num_terms, offsets[num_terms + 1],
+ * tail[num_terms], doc_ids[offsets[num_terms]].
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+int champion_save(const champion_t *champ, const char *filename) {
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+
+  long int n = champ->num_terms, total = champ->offsets[n];
+  int rc = fwrite(CHAMPION_MAGIC, 1, 8, fp) == 8 &&
+                   fwrite(&champ->r, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(&n, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(champ->offsets, sizeof(long int), n + 1, fp) == (size_t)n + 1 &&
+                   fwrite(champ->tail, sizeof(double), n, fp) == (size_t)n &&
+                   fwrite(champ->doc_ids, sizeof(long int), total, fp) == (size_t)total
+               ? 0
+               : -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar listas de campeões %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Carrega a camada de campeões gravada para este índice
+ *
+ * @param filename Arquivo gravado por champion_save
+ * @param index Índice a que a camada pertence
+ * @param r Tamanho de lista esperado
+ * @return Camada, ou NULL se ausente, de outro índice/r ou inválida
+ */
+champion_t *champion_load(const char *filename, const inv_index_t *index,
+                          long int r) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+    return NULL;
+
+  char magic[8];
+  long int file_r, n, total;
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, CHAMPION_MAGIC, 8) != 0 ||
+      fread(&file_r, sizeof(long int), 1, fp) != 1 ||
+      fread(&n, sizeof(long int), 1, fp) != 1 || file_r != r ||
+      n != index->num_terms) {
+    fclose(fp);
+    return NULL;
+  }
+
+  // offsets antes de alocar doc_ids, que depende do total
+  long int *offsets = malloc((n + 1) * sizeof(long int));
+  if (!offsets || fread(offsets, sizeof(long int), n + 1, fp) != (size_t)n + 1) {
+    free(offsets);
+    fclose(fp);
+    return NULL;
+  }
+  total = offsets[n];
+
+  champion_t *champ = champion_alloc(r, n, total);
+  int ok = champ != NULL && offsets[0] == 0;
+  if (ok) {
+    memcpy(champ->offsets, offsets, (n + 1) * sizeof(long int));
+    for (long int t = 0; t < n && ok; t++) {
+      long int len = offsets[t + 1] - offsets[t];
+      ok = len >= 0 && len <= r && len <= index->lists[t].df;
+    }
+  }
+  free(offsets);
+  ok = ok && fread(champ->tail, sizeof(double), n, fp) == (size_t)n &&
+       fread(champ->doc_ids, sizeof(long int), total, fp) == (size_t)total;
+  for (long int i = 0; ok && i < total; i++)
+    ok = champ->doc_ids[i] >= 0 && champ->doc_ids[i] < index->num_docs;
+  fclose(fp);
+
+  if (!ok) {
+    fprintf(stderr, "Aviso: listas de campeões inválidas em %s\n", filename);
+    if (champ) {
+      free(champ->offsets);
+      free(champ->tail);
+      free(champ->doc_ids);
+      free(champ);
+    }
+    return NULL;
+  }
+  champion_track(champ, 1);
+  return champ;
+}
+
+void champion_free(champion_t *champ) {
+  if (!champ)
+    return;
+  champion_track(champ, 0);
+  free(champ->offsets);
+  free(champ->tail);
+  free(champ->doc_ids);
+  free(champ);
+}
+
+/* ------------- Consulta ------------- */
+
+static int compare_long(const void *a, const void *b) {
+  long int x = *(const long int *)a, y = *(const long int *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Primeira posição >= lo com ids[pos] >= target (busca galopante)
+ */
+static long int gallop(const long int *ids, long int lo, long int n,
+                       long int target) {
+  if (lo >= n || ids[lo] >= target)
+    return lo;
+  long int step = 1;
+  while (lo + step < n && ids[lo + step] < target) {
+    lo += step;
+    step *= 2;
+  }
+  long int hi = lo + step < n ? lo + step : n;
+  while (lo + 1 < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (ids[mid] < target)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  return hi;
+}
+
+typedef struct {
+  const PostingList *pl;
+  long int term;  // Posição da lista no índice (e na camada)
+  double weight;  // Peso TF-IDF do termo na query
+} champion_term;
+
+/**
+ * @brief Top-k a partir das listas de campeões dos termos da query
+ *
+ * @param champ Camada de campeões (contadores são atualizados)
+ * @param index Índice invertido completo
+ * @param query_tf Hash TF-IDF da query
+ * @param query_norm Norma da query
+ * @param global_doc_norms Normas dos documentos
+ * @param k Número de documentos
+ * @param min_score Score mínimo de um candidato para contar no top-k
+ * @param exact Exige que nenhum documento fora das listas possa entrar no top-k
+ * @param out Saída: top-k ordenados (k posições)
+ * @param fallback Saída: 1 se a consulta deve ser refeita no índice completo
+ * @return Número de documentos em out, ou -1 em erro
+ */
+long int champion_top_k(champion_t *champ, const inv_index_t *index,
+                        const hash_t *query_tf, double query_norm,
+                        const double *global_doc_norms, int k,
+                        double min_score, int exact, DocSim *out,
+                        int *fallback) {
+  *fallback = 0;
+  if (k <= 0)
+    return 0;
+
+  // Termos na ordem dos buckets da query (ordem de soma do score)
+  champion_term *terms = malloc((hash_size(query_tf) + 1) * sizeof(champion_term));
+  if (!terms)
+    return -1;
+  int m = 0;
+  long int total = 0;
+  double bound = 0.0;
+  for (size_t i = 0; i < query_tf->cap; i++)
+    for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+      const PostingList *pl = index_find(index, q->word);
+      if (!pl || pl->df == 0 || q->value <= 0.0)
+        continue;
+      long int t = pl - index->lists;
+      terms[m++] = (champion_term){pl, t, q->value};
+      total += champ->offsets[t + 1] - champ->offsets[t];
+      if (query_norm > 0.0)
+        bound += q->value / query_norm * champ->tail[t];
+    }
+
+  // Candidatos: união das listas de campeões, sem removidos
+  long int *cand = malloc((total ? total : 1) * sizeof(long int));
+  double *dot = NULL;
+  DocSim *sims = NULL;
+  if (!cand) {
+    free(terms);
+    return -1;
+  }
+  total = 0;
+  for (int i = 0; i < m; i++) {
+    long int t = terms[i].term, len = champ->offsets[t + 1] - champ->offsets[t];
+    memcpy(cand + total, champ->doc_ids + champ->offsets[t], len * sizeof(long int));
+    total += len;
+  }
+  qsort(cand, total, sizeof(long int), compare_long);
+  long int ncand = 0;
+  for (long int i = 0; i < total; i++)
+    if ((ncand == 0 || cand[i] != cand[ncand - 1]) &&
+        !index_is_deleted(index, cand[i]))
+      cand[ncand++] = cand[i];
+
+  dot = calloc(ncand ? ncand : 1, sizeof(double));
+  sims = malloc((ncand ? ncand : 1) * sizeof(DocSim));
+  if (!dot || !sims) {
+    free(terms);
+    free(cand);
+    free(dot);
+    free(sims);
+    return -1;
+  }
+  mem_track_alloc(MEM_QUERY, ncand * (sizeof(double) + sizeof(DocSim)));
+
+  // Valores exatos dos candidatos nas listas completas
+  for (int i = 0; i < m; i++) {
+    const PostingList *pl = terms[i].pl;
+    long int pos = 0;
+    for (long int c = 0; c < ncand && pos < pl->df; c++) {
+      pos = gallop(pl->doc_ids, pos, pl->df, cand[c]);
+      if (pos < pl->df && pl->doc_ids[pos] == cand[c] && pl->values[pos] > 0.0)
+        dot[c] += terms[i].weight * pl->values[pos];
+    }
+  }
+
+  long int nsims = 0, reached = 0;
+  for (long int c = 0; c < ncand; c++) {
+    double norm = global_doc_norms[cand[c]];
+    double sim = (query_norm > 0.0 && norm > 0.0) ? dot[c] / (query_norm * norm)
+                                                  : 0.0;
+    if (sim <= 0.0)
+      continue;
+    sims[nsims++] = (DocSim){cand[c], sim};
+    reached += sim >= min_score;
+  }
+  qsort(sims, nsims, sizeof(DocSim), compare_sim);
+  long int n = nsims < k ? nsims : k;
+  memcpy(out, sims, n * sizeof(DocSim));
+
+  if (reached < k || (exact && out[k - 1].similarity <= bound * CHAMPION_SLACK))
+    *fallback = 1;
+  champ->queries++;
+  champ->fallbacks += *fallback;
+
+  mem_track_free(MEM_QUERY, ncand * (sizeof(double) + sizeof(DocSim)));
+  free(terms);
+  free(cand);
+  free(dot);
+  free(sims);
+  return n;
+}
+
+/**
+ * @brief Exibe quantas consultas precisaram do índice completo
+ */
+void champion_report(const champion_t *champ, FILE *out) {
+  char size[32];
+  mem_format_size(champ->offsets[champ->num_terms] * sizeof(long int), size,
+                  sizeof(size));
+  fprintf(out, "[CAMPEÕES] r=%ld consultas=%ld fallbacks=%ld taxa=%.1f%% (%s)\n",
+          champ->r, champ->queries, champ->fallbacks,
+          champ->queries ? 100.0 * champ->fallbacks / champ->queries : 0.0, size);
+}
@@ -0,0 +1,211 @@
+/**
+ * @file checkpoint.c
+ * @brief Checkpoints da construção do modelo por documento
+ *
+ * Com --checkpoint, cada lote da FASE 1 grava as contagens de termos dos
+ * seus documentos (formato de save_hash_array, com CRC por seção e
+ * .tmp + rename) em
+ *
+ *     models/ckpt_<table>_<entries>_<lo>_<hi>.bin
+ *
+ * e um marcador da construção guarda a última fase concluída e o tamanho
+ * dos lotes:
+ *
+ *     models/ckpt_<table>_<entries>.bin
+ *       magic[8], long int entries, long int phase, long int batch
+ *
+ * Os lotes são múltiplos de batch ([k·batch, (k+1)·batch)) e as threads
+ * recebem lotes inteiros, então os nomes dos checkpoints só dependem do
+ * tamanho do lote: uma retomada reutiliza o batch do marcador, mesmo com
+ * outro --nthreads, --batch_size ou --memory_budget.
+ *
+ * Enquanto o marcador existir, o modelo não está completo: uma nova
+ * execução refaz a construção, carregando dos checkpoints os lotes já
+ * processados em vez de ler e tokenizar de novo os textos do SQLite. O
+ * vocabulário local do lote é reconstruído das próprias contagens (são os
+ * mesmos termos). Com a FASE 1 concluída, todos os lotes estão em disco e
+ * a retomada nem abre o cache de tokens. A FASE 2 não tem checkpoint: o
+ * TF-IDF é recalculado das contagens, sem acessar o banco. Depois que
+ * todos os arquivos do modelo foram salvos, o marcador e os lotes são
+ * removidos.
+ */
+
+#include "../include/checkpoint.h"
+#include "../include/file_io.h"
+#include "../include/log.h"
+
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define CKPT_MAGIC "CKPTRUN2"
+
+static void marker_filename(char *filename, const char *table,
+                            long int entries) {
+  snprintf(filename, 256, "models/ckpt_%s_%ld.bin", table, entries);
+}
+
+static void chunk_filename(char *filename, const char *table, long int entries,
+                           long int lo, long int hi) {
+  snprintf(filename, 256, "models/ckpt_%s_%ld_%ld_%ld.bin", table, entries, lo,
+           hi);
+}
+
+/**
+ * @brief Última fase concluída de uma construção interrompida
+ *
+ * @param table Tabela do modelo
+ * @param entries Documentos do modelo
+ * @param db Banco de origem (o marcador não vale se o banco é mais novo)
+ * @param batch Saída: documentos por lote da construção interrompida
+ * @return CKPT_BUILD ou CKPT_FASE1; -1 sem construção pendente
+ */
+int ckpt_phase(const char *table, long int entries, const char *db,
+               long int *batch) {
+  char filename[256];
+  marker_filename(filename, table, entries);
+  if (access(filename, F_OK) == -1)
+    return -1;
+  if (file_is_stale(filename, db)) {
+    printf("[CHECKPOINT] %s é mais novo que os checkpoints, descartando\n", db);
+    ckpt_clear(table, entries);
+    return -1;
+  }
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+    return -1;
+  char magic[8];
+  long int n = 0, phase = -1, b = 0;
+  int ok = fread(magic, 1, 8, fp) == 8 && memcmp(magic, CKPT_MAGIC, 8) == 0 &&
+           fread(&n, sizeof(long int), 1, fp) == 1 &&
+           fread(&phase, sizeof(long int), 1, fp) == 1 &&
+           fread(&b, sizeof(long int), 1, fp) == 1 && n == entries &&
+           phase >= CKPT_BUILD && phase <= CKPT_FASE1 && b > 0;
+  fclose(fp);
+  if (!ok) {
+    // Marcador de outra versão: os lotes gravados podem ter outros limites
+    printf("[CHECKPOINT] Marcador %s inválido, descartando\n", filename);
+    ckpt_clear(table, entries);
+    return -1;
+  }
+  *batch = b;
+  return (int)phase;
+}
+
+/**
+ * @brief Registra a fase concluída (gravado em .tmp e trocado com rename)
+ *
+ * @param batch Documentos por lote (define os limites dos checkpoints)
+ * @return 0 em sucesso, -1 em erro
+ */
+int ckpt_mark(const char *table, long int entries, int phase, long int batch) {
+  char filename[256], tmp[300];
+  marker_filename(filename, table, entries);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+  long int p = phase;
+  int rc = fwrite(CKPT_MAGIC, 1, 8, fp) == 8 &&
+                   fwrite(&entries, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(&p, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(&batch, sizeof(long int), 1, fp) == 1
+               ? 0
+               : -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar checkpoint %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Grava as contagens de termos dos documentos [lo, hi)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+int ckpt_save_chunk(const char *table, long int entries, hash_t **global_tf,
+                    long int lo, long int hi) {
+  char filename[256];
+  chunk_filename(filename, table, entries, lo, hi);
+  return save_hash_array(global_tf + lo, hi - lo, filename, 1);
+}
+
+/**
+ * @brief Restaura os documentos [lo, hi) de um checkpoint válido
+ *
+ * As hashes de global_tf no intervalo são substituídas pelas carregadas e
+ * os termos entram no vocabulário local da thread.
+ *
+ * @param vocab Vocabulário local (IDF) da thread
+ * @return 0 se o lote foi restaurado, -1 se precisa ser processado
+ */
+int ckpt_load_chunk(const char *table, long int entries, hash_t **global_tf,
+                    long int lo, long int hi, hash_t *vocab) {
+  char filename[256];
+  chunk_filename(filename, table, entries, lo, hi);
+  if (access(filename, F_OK) == -1)
+    return -1;
+
+  long int n = 0;
+  hash_t **tf = load_hash_array(filename, &n, 1);
+  if (!tf)
+    return -1;
+  if (n != hi - lo) {
+    for (long int i = 0; i < n; i++)
+      if (tf[i])
+        hash_free(tf[i]);
+    free(tf);
+    return -1;
+  }
+
+  for (long int i = 0; i < n; i++) {
+    if (global_tf[lo + i])
+      hash_free(global_tf[lo + i]);
+    global_tf[lo + i] = tf[i] ? tf[i] : hash_new();
+    for (size_t b = 0; b < global_tf[lo + i]->cap; b++)
+      for (HashEntry *e = global_tf[lo + i]->buckets[b]; e; e = e->next)
+        hash_add(vocab, e->word, 0.0);
+  }
+  free(tf);
+  return 0;
+}
+
+/**
+ * @brief Remove o marcador e os lotes gravados para este modelo
+ *
+ * @return Número de arquivos removidos
+ */
+int ckpt_clear(const char *table, long int entries) {
+  char filename[300], prefix[256];
+  marker_filename(filename, table, entries);
+  snprintf(prefix, sizeof(prefix), "ckpt_%s_%ld_", table, entries);
+  size_t plen = strlen(prefix);
+
+  int removed = remove(filename) == 0;
+  DIR *dir = opendir("models");
+  if (!dir)
+    return removed;
+  for (struct dirent *de; (de = readdir(dir));) {
+    long int lo, hi;
+    int used = 0;
+    if (strncmp(de->d_name, prefix, plen) != 0 ||
+        sscanf(de->d_name + plen, "%ld_%ld.bin%n", &lo, &hi, &used) != 2 ||
+        de->d_name[plen + used] != '\0' || used == 0)
+      continue;
+    snprintf(filename, sizeof(filename), "models/%s", de->d_name);
+    removed += remove(filename) == 0;
+  }
+  closedir(dir);
+  LOG(stdout, "[CHECKPOINT] %d arquivos removidos", removed);
+  return removed;
+}
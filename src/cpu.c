@@ -0,0 +1,182 @@
+/**
+ * @file cpu.c
+ * @brief Número de threads, fixação de workers em CPUs e nós NUMA
+ *
+ * As CPUs permitidas ao processo (máscara de afinidade, que já respeita
+ * taskset e cgroups) são ordenadas por nó NUMA. O worker i roda na CPU
+ * cpus[i % ncpus]: como os workers recebem intervalos contíguos de
+ * documentos, workers vizinhos (e seus intervalos) ficam no mesmo nó.
+ *
+ * Não há alocação explícita por nó: a política padrão do Linux
+ * (first-touch) coloca cada página no nó da thread que a escreve primeiro,
+ * então basta que as estruturas de cada intervalo sejam criadas pelo worker
+ * que o possui: na FASE 1 e, para modelos lidos do disco, em
+ * load_hash_array e load_doc_norms. A topologia vem de /sys/devices/system/node; sem ela, todas
+ * as CPUs ficam no nó 0.
+ */
+
+#define _GNU_SOURCE
+#include "../include/cpu.h"
+#include "../include/log.h"
+
+#include <dirent.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int cpu_ids[CPU_SETSIZE];  // CPUs permitidas, ordenadas por (nó, id)
+static int cpu_node[CPU_SETSIZE]; // Nó NUMA de cada posição de cpu_ids
+static int ncpus;                 // CPUs permitidas
+static int nnodes;                // Nós distintos entre as CPUs permitidas
+static int pinning;               // Fixar workers em CPUs
+
+/**
+ * @brief Marca em `node_of` o nó das CPUs de uma lista do sysfs ("0-3,8-11")
+ */
+static void read_cpulist(const char *path, int node, int *node_of) {
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return;
+
+  char buf[4096];
+  if (fgets(buf, sizeof(buf), fp)) {
+    char *p = buf;
+    while (*p && *p != '\n') {
+      char *end;
+      long lo = strtol(p, &end, 10), hi = lo;
+      if (end == p)
+        break;
+      if (*end == '-')
+        hi = strtol(end + 1, &end, 10);
+      for (long c = lo; c <= hi && c < CPU_SETSIZE; c++)
+        if (c >= 0)
+          node_of[c] = node;
+      p = *end == ',' ? end + 1 : end;
+    }
+  }
+  fclose(fp);
+}
+
+/**
+ * @brief Lê a máscara de afinidade e a topologia NUMA
+ *
+ * Deve ser chamada pela thread principal antes de criar workers.
+ *
+ * @param pin Fixar os workers criados com cpu_thread_create em CPUs
+ * @return Número de CPUs disponíveis para o processo (>= 1)
+ */
+int cpu_init(int pin) {
+  static int node_of[CPU_SETSIZE];
+  memset(node_of, 0, sizeof(node_of));
+
+  DIR *dir = opendir("/sys/devices/system/node");
+  if (dir) {
+    struct dirent *de;
+    while ((de = readdir(dir))) {
+      int node;
+      if (sscanf(de->d_name, "node%d", &node) != 1)
+        continue;
+      char path[300];
+      snprintf(path, sizeof(path), "/sys/devices/system/node/%s/cpulist",
+               de->d_name);
+      read_cpulist(path, node, node_of);
+    }
+    closedir(dir);
+  }
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  ncpus = 0;
+  if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+    for (int c = 0; c < CPU_SETSIZE; c++)
+      if (CPU_ISSET(c, &set)) {
+        // Inserção ordenada por (nó, id)
+        int i = ncpus++;
+        while (i > 0 && cpu_node[i - 1] > node_of[c]) {
+          cpu_ids[i] = cpu_ids[i - 1];
+          cpu_node[i] = cpu_node[i - 1];
+          i--;
+        }
+        cpu_ids[i] = c;
+        cpu_node[i] = node_of[c];
+      }
+  }
+
+  nnodes = ncpus > 0 ? 1 : 0;
+  for (int i = 1; i < ncpus; i++)
+    if (cpu_node[i] != cpu_node[i - 1])
+      nnodes++;
+
+  pinning = pin && ncpus > 0;
+  LOG(stdout, "CPUs disponíveis: %d em %d nós NUMA (fixação: %s)", ncpus,
+      nnodes, pinning ? "sim" : "não");
+  return ncpus > 0 ? ncpus : 1;
+}
+
+int cpu_available(void) { return ncpus > 0 ? ncpus : 1; }
+
+int cpu_nodes(void) { return nnodes > 0 ? nnodes : 1; }
+
+/**
+ * @brief Cria a thread do worker `worker`, fixada na CPU correspondente
+ *
+ * Sem cpu_init (ou com fixação desabilitada) equivale a pthread_create.
+ *
+ * @return 0 em sucesso, código de erro de pthread_create caso contrário
+ */
+int cpu_thread_create(pthread_t *tid, int worker, void *(*fn)(void *),
+                      void *arg) {
+  if (!pinning)
+    return pthread_create(tid, NULL, fn, arg);
+
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu_ids[worker % ncpus], &set);
+
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  int rc = pthread_attr_setaffinity_np(&attr, sizeof(set), &set) == 0
+               ? pthread_create(tid, &attr, fn, arg)
+               : pthread_create(tid, NULL, fn, arg);
+  pthread_attr_destroy(&attr);
+  return rc;
+}
+
+/**
+ * @brief Restringe o processo às CPUs do n-ésimo nó (módulo o número de nós)
+ *
+ * Usado pelos processos de shard antes de carregar o shard, para que sua
+ * memória e a pontuação fiquem no mesmo nó.
+ *
+ * @param node Índice do nó entre os nós das CPUs permitidas
+ * @return 0 em sucesso, -1 em erro
+ */
+int cpu_bind_node(int node) {
+  if (ncpus == 0)
+    return -1;
+
+  // Posições [first, last) de cpu_ids que pertencem ao nó escolhido
+  int target = node % nnodes, k = 0, first = 0;
+  for (int i = 1; i <= ncpus && k <= target; i++) {
+    if (i == ncpus || cpu_node[i] != cpu_node[i - 1]) {
+      if (k == target) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        for (int j = first; j < i; j++)
+          CPU_SET(cpu_ids[j], &set);
+        if (sched_setaffinity(0, sizeof(set), &set) != 0)
+          return -1;
+        // Workers deste processo passam a usar só as CPUs do nó
+        memmove(cpu_ids, cpu_ids + first, (i - first) * sizeof(int));
+        memmove(cpu_node, cpu_node + first, (i - first) * sizeof(int));
+        ncpus = i - first;
+        nnodes = 1;
+        return 0;
+      }
+      k++;
+      first = i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,305 @@
+/**
+ * @file docstore.c
+ * @brief Armazém de documentos mapeado em memória para exibir o top-k
+ *
+ * O texto dos documentos é copiado uma vez do SQLite para
+ * models/docstore_<table>.bin:
+ *
+ *     char magic[8] ("DOCSTOR1")
+ *     long int num_docs                 (max article_id + 1)
+ *     long int offsets[num_docs + 1]    (relativos ao início dos textos)
+ *     char texts[]                      (cada texto terminado em '\0')
+ *
+ * Documento ausente tem offsets[i] == offsets[i + 1]. O arquivo é aberto
+ * com mmap: buscar os top-k é apenas indexar a tabela de offsets, e os
+ * ponteiros devolvidos apontam direto para o mapeamento (sem cópia e sem
+ * abrir o banco). Os textos não são comprimidos, justamente para que o
+ * acesso continue sem cópia.
+ *
+ * docstore_snippet escolhe, sem copiar o artigo, a janela de texto com mais
+ * ocorrências dos termos da consulta (comparados após normalização e
+ * stemming, como no pré-processamento).
+ */
+
+#include "../include/docstore.h"
+#include "../include/file_io.h"
+#include "../include/normalize.h"
+#include "../include/sqlite_helper.h"
+
+#include <fcntl.h>
+#include <libstemmer.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define DOCSTORE_MAGIC "DOCSTOR1"
+#define SNIPPET_MAX_MATCHES 256 /**< Ocorrências consideradas por documento */
+
+/* ------------- Construção ------------- */
+
+typedef struct {
+  FILE *fp;
+  long int *offsets;
+  long int num_docs;
+  long int pos;   // Bytes de texto já gravados
+  long int last;  // Último article_id gravado
+} build_ctx;
+
+static int build_doc(long int doc_id, const char *text, size_t len, void *arg) {
+  build_ctx *c = (build_ctx *)arg;
+  // Linhas além do max(article_id) lido antes (inserções concorrentes) ou
+  // article_id repetido ficam de fora
+  if (doc_id <= c->last || doc_id >= c->num_docs)
+    return 0;
+
+  for (long int d = c->last + 1; d <= doc_id; d++)
+    c->offsets[d] = c->pos;
+  fwrite(text, 1, len, c->fp);
+  fputc('\0', c->fp);
+  c->pos += (long int)len + 1;
+  c->last = doc_id;
+  return ferror(c->fp) ? -1 : 0;
+}
+
+/**
+ * @brief Copia os textos da tabela para o armazém de documentos
+ *
+ * @param db Caminho para o arquivo SQLite
+ * @param table Nome da tabela
+ * @param filename Arquivo de saída (gravado em .tmp e trocado com rename)
+ * @return 0 em sucesso, -1 em erro
+ */
+int docstore_build(const char *db, const char *table, const char *filename) {
+  long int max_id = get_single_int(
+      db, "select coalesce(max(article_id), -1) from \"%w\";", table);
+  if (max_id < -1)
+    return -1;
+
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  build_ctx c = {0};
+  c.num_docs = max_id + 1;
+  c.last = -1;
+  c.offsets = malloc((c.num_docs + 1) * sizeof(long int));
+  c.fp = fopen(tmp, "wb");
+  if (!c.offsets || !c.fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    free(c.offsets);
+    if (c.fp)
+      fclose(c.fp);
+    return -1;
+  }
+
+  // Textos depois do cabeçalho; os offsets são gravados no final
+  long int header = 8 + sizeof(long int) + (c.num_docs + 1) * sizeof(long int);
+  int rc = fseek(c.fp, header, SEEK_SET) == 0 &&
+                   for_each_document(db, table, build_doc, &c) == 0
+               ? 0
+               : -1;
+
+  if (rc == 0) {
+    for (long int d = c.last + 1; d <= c.num_docs; d++)
+      c.offsets[d] = c.pos;
+    rewind(c.fp);
+    fwrite(DOCSTORE_MAGIC, 1, 8, c.fp);
+    fwrite(&c.num_docs, sizeof(long int), 1, c.fp);
+    fwrite(c.offsets, sizeof(long int), c.num_docs + 1, c.fp);
+    rc = ferror(c.fp) ? -1 : 0;
+  }
+  if (fclose(c.fp) != 0)
+    rc = -1;
+  free(c.offsets);
+
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar armazém de documentos %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Verifica se o armazém não existe ou é mais antigo que o banco
+ *
+ * @return 1 se precisa ser (re)construído, 0 caso contrário
+ */
+int docstore_is_stale(const char *filename, const char *db) {
+  return file_is_stale(filename, db);
+}
+
+/* ------------- Leitura ------------- */
+
+/**
+ * @brief Mapeia o armazém de documentos em memória
+ *
+ * @return Armazém aberto, ou NULL se ausente ou inválido
+ */
+docstore_t *docstore_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < 8 + (off_t)(2 * sizeof(long int))) {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  const char *p = (const char *)base;
+  long int num_docs;
+  memcpy(&num_docs, p + 8, sizeof(long int));
+  size_t header = 8 + sizeof(long int) + (num_docs + 1) * sizeof(long int);
+  const long int *offsets = (const long int *)(p + 8 + sizeof(long int));
+  if (memcmp(p, DOCSTORE_MAGIC, 8) != 0 || num_docs < 0 ||
+      header > (size_t)st.st_size ||
+      header + offsets[num_docs] > (size_t)st.st_size) {
+    fprintf(stderr, "Erro: armazém de documentos inválido: %s\n", filename);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+
+  docstore_t *store = malloc(sizeof(docstore_t));
+  if (!store) {
+    munmap(base, st.st_size);
+    return NULL;
+  }
+  store->base = base;
+  store->size = st.st_size;
+  store->num_docs = num_docs;
+  store->offsets = offsets;
+  store->texts = p + header;
+  madvise(base, st.st_size, MADV_RANDOM);
+  return store;
+}
+
+void docstore_close(docstore_t *store) {
+  if (!store)
+    return;
+  munmap(store->base, store->size);
+  free(store);
+}
+
+/**
+ * @brief Texto do documento, sem cópia
+ *
+ * @param store Armazém aberto
+ * @param doc_id article_id do documento
+ * @param len_out Saída: tamanho do texto em bytes
+ * @return Ponteiro para o texto no mapeamento (terminado em '\0'), ou NULL
+ *         se o documento não existe
+ */
+const char *docstore_get(const docstore_t *store, long int doc_id,
+                         size_t *len_out) {
+  if (doc_id < 0 || doc_id >= store->num_docs)
+    return NULL;
+  long int start = store->offsets[doc_id], end = store->offsets[doc_id + 1];
+  if (end == start)
+    return NULL;
+  *len_out = (size_t)(end - start - 1);
+  return store->texts + start;
+}
+
+/**
+ * @brief Pede ao kernel as páginas dos k documentos de uma só vez
+ */
+void docstore_prefetch(const docstore_t *store, const long int *doc_ids,
+                       long int k) {
+  long int page = sysconf(_SC_PAGESIZE);
+  for (long int i = 0; i < k; i++) {
+    size_t len;
+    const char *text = docstore_get(store, doc_ids[i], &len);
+    if (!text)
+      continue;
+    uintptr_t start = (uintptr_t)text & ~(uintptr_t)(page - 1);
+    madvise((void *)start, (uintptr_t)text + len + 1 - start, MADV_WILLNEED);
+  }
+}
+
+/* ------------- Trechos (snippets) ------------- */
+
+static int is_space(char c) {
+  return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+}
+
+/**
+ * @brief Janela do texto com mais ocorrências dos termos da consulta
+ *
+ * Os tokens são separados como em tokenize() e comparados com os termos da
+ * consulta após normalize_text + stemming. A janela começa um pouco antes da
+ * primeira ocorrência escolhida e termina em fronteira de palavra.
+ *
+ * @param text Texto do documento
+ * @param len Tamanho do texto
+ * @param query_tf Termos da consulta (já com stem)
+ * @param width Tamanho máximo da janela em bytes
+ * @param start_out Saída: início da janela (dentro de text)
+ * @return Tamanho da janela em bytes
+ */
+size_t docstore_snippet(const char *text, size_t len, const hash_t *query_tf,
+                        size_t width, const char **start_out) {
+  size_t matches[SNIPPET_MAX_MATCHES];
+  int nmatches = 0;
+
+  struct sb_stemmer *stemmer = sb_stemmer_new("english", NULL);
+  char word[64];
+  for (size_t i = 0; stemmer && i < len && nmatches < SNIPPET_MAX_MATCHES;) {
+    while (i < len && is_space(text[i]))
+      i++;
+    size_t start = i;
+    while (i < len && !is_space(text[i]))
+      i++;
+    size_t raw_len = i - start < sizeof(word) - 1 ? i - start : sizeof(word) - 1;
+    size_t wlen = normalize_text(text + start, raw_len, word);
+    if (wlen < 2)
+      continue;
+    const char *stemmed = (const char *)sb_stemmer_stem(
+        stemmer, (const sb_symbol *)word, (int)wlen);
+    if (stemmed && hash_contains(query_tf, stemmed))
+      matches[nmatches++] = start;
+  }
+  sb_stemmer_delete(stemmer);
+
+  // Janela [matches[b], matches[b] + width) com mais ocorrências
+  size_t begin = 0;
+  int best = 0;
+  for (int a = 0, b = 0; a < nmatches; a++) {
+    while (b < nmatches && matches[b] < matches[a] + width)
+      b++;
+    if (b - a > best) {
+      best = b - a;
+      begin = matches[a];
+    }
+  }
+
+  // Um pouco de contexto antes da ocorrência, começando em início de palavra
+  if (begin > width / 4) {
+    size_t ctx = begin - width / 4;
+    while (ctx < begin && !is_space(text[ctx - 1]))
+      ctx++;
+    begin = ctx;
+  } else {
+    begin = 0;
+  }
+
+  size_t n = len - begin < width ? len - begin : width;
+  if (begin + n < len) {
+    size_t cut = n;
+    while (cut > 0 && !is_space(text[begin + cut]))
+      cut--;
+    if (cut > 0)
+      n = cut;
+  }
+
+  *start_out = text + begin;
+  return n;
+}
@@ -13,11 +13,18 @@
  */
 
 #include "../include/file_io.h"
+#include "../include/cpu.h"
 #include "../include/log.h"
+#include "../include/mem.h"
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 /* -------------------- Stopwords -------------------- */
 
@@ -107,56 +114,292 @@ int save_hash(const hash_t *gh, const char *filename) {
   return 0;
 }
 
+/* ---- global_tf em seções paralelas ----
+ *
+ * Formato (TF_MAGIC):
+ *   magic[8], num_hashes, num_sections,
+ *   num_sections × tf_section {first, count, offset, bytes, crc, pad},
+ *   seções de dados, cada uma alinhada a TF_ALIGN.
+ *
+ * Cada seção guarda os documentos [first, first + count) no mesmo formato
+ * de registro do arquivo antigo: cap, size e (wlen, word, value) por
+ * entrada. A seção é serializada por uma thread em um buffer próprio e
+ * gravada com pwrite no seu offset; o CRC-32C de cada seção vai no
+ * cabeçalho, gravado por último.
+ */
+
+#define TF_MAGIC "TFARRAY2"
+#define TF_ALIGN 4096              /**< Alinhamento das seções no arquivo */
+#define TF_BUF (4 * 1024 * 1024)   /**< Buffer de serialização por thread */
+
+typedef struct {
+  long int first;   // Primeiro documento da seção
+  long int count;   // Documentos da seção
+  long int offset;  // Início da seção no arquivo
+  long int bytes;   // Tamanho da seção
+  uint32_t crc;     // CRC-32C dos dados da seção
+  uint32_t pad;
+} tf_section;
+
+typedef struct {
+  hash_t **hashes;
+  tf_section *sec;  // Gravação: seção da thread; leitura: todas as seções
+  int fd;
+  int failed;
+  long int nsec;    // Leitura: seções do arquivo
+  long int first;   // Leitura: documentos [first, end) da thread
+  long int end;
+  const char *filename;
+} tf_args;
+
+static uint32_t crc_table[256];
+static pthread_once_t crc_once = PTHREAD_ONCE_INIT;
+static uint32_t (*crc_update)(uint32_t, const unsigned char *, size_t);
+
+static uint32_t crc32c_table(uint32_t crc, const unsigned char *p, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    crc = crc_table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+__attribute__((target("sse4.2"))) static uint32_t
+crc32c_sse42(uint32_t crc, const unsigned char *p, size_t n) {
+  uint64_t c = crc;
+  for (; n >= 8; n -= 8, p += 8) {
+    uint64_t v;
+    memcpy(&v, p, 8);
+    c = __builtin_ia32_crc32di(c, v);
+  }
+  crc = (uint32_t)c;
+  for (; n > 0; n--, p++)
+    crc = __builtin_ia32_crc32qi(crc, *p);
+  return crc;
+}
+
+static void crc_init(void) {
+  for (uint32_t i = 0; i < 256; i++) {
+    uint32_t c = i;
+    for (int k = 0; k < 8; k++)
+      c = (c & 1) ? (c >> 1) ^ 0x82F63B78u : c >> 1;
+    crc_table[i] = c;
+  }
+  crc_update = __builtin_cpu_supports("sse4.2") ? crc32c_sse42 : crc32c_table;
+}
+
+/**
+ * @brief CRC-32C (Castagnoli), pelo SSE4.2 quando a CPU tem a instrução
+ *
+ * @param crc CRC dos bytes anteriores (0 no início)
+ * @param data Bytes seguintes
+ * @param n Quantidade de bytes
+ * @return CRC acumulado
+ */
+uint32_t crc32c(uint32_t crc, const void *data, size_t n) {
+  pthread_once(&crc_once, crc_init);
+  return ~crc_update(~crc, (const unsigned char *)data, n);
+}
+
+/**
+ * @brief Bytes que a seção ocupa no arquivo (sem o alinhamento)
+ */
+static void *tf_size_thread(void *arg) {
+  tf_args *a = (tf_args *)arg;
+  long int bytes = 0;
+  for (long int d = a->sec->first; d < a->sec->first + a->sec->count; d++) {
+    bytes += 2 * sizeof(size_t);
+    hash_t *h = a->hashes[d];
+    if (!h)
+      continue;
+    for (size_t j = 0; j < h->cap; j++)
+      for (HashEntry *e = h->buckets[j]; e; e = e->next)
+        bytes += sizeof(size_t) + e->wlen + sizeof(double);
+  }
+  a->sec->bytes = bytes;
+  return NULL;
+}
+
+typedef struct {
+  tf_args *a;
+  char *buf;
+  size_t len;
+  long int pos;   // Offset no arquivo do início de buf
+} tf_writer;
+
+static void tf_flush(tf_writer *w) {
+  size_t done = 0;
+  while (done < w->len && !w->a->failed) {
+    ssize_t n = pwrite(w->a->fd, w->buf + done, w->len - done, w->pos + done);
+    if (n <= 0)
+      w->a->failed = 1;
+    else
+      done += n;
+  }
+  w->a->sec->crc = crc32c(w->a->sec->crc, w->buf, w->len);
+  w->pos += w->len;
+  w->len = 0;
+}
+
+static void tf_put(tf_writer *w, const void *data, size_t n) {
+  const char *p = (const char *)data;
+  while (n > 0) {
+    size_t room = TF_BUF - w->len;
+    size_t take = n < room ? n : room;
+    memcpy(w->buf + w->len, p, take);
+    w->len += take;
+    p += take;
+    n -= take;
+    if (w->len == TF_BUF)
+      tf_flush(w);
+  }
+}
+
+/**
+ * @brief Serializa a seção no buffer da thread e grava no seu offset
+ */
+static void *tf_write_thread(void *arg) {
+  tf_args *a = (tf_args *)arg;
+  tf_writer w = {a, NULL, 0, a->sec->offset};
+  if (posix_memalign((void **)&w.buf, TF_ALIGN, TF_BUF) != 0) {
+    a->failed = 1;
+    return NULL;
+  }
+
+  a->sec->crc = 0;
+  size_t zero[2] = {0, 0};
+  for (long int d = a->sec->first; d < a->sec->first + a->sec->count; d++) {
+    hash_t *h = a->hashes[d];
+    if (!h) {
+      // Hash nulo - capacidade 0
+      tf_put(&w, zero, sizeof(zero));
+      continue;
+    }
+    size_t head[2] = {h->cap, h->size};
+    tf_put(&w, head, sizeof(head));
+    for (size_t j = 0; j < h->cap; j++)
+      for (HashEntry *e = h->buckets[j]; e; e = e->next) {
+        tf_put(&w, &e->wlen, sizeof(size_t));
+        tf_put(&w, e->word, e->wlen);
+        tf_put(&w, &e->value, sizeof(double));
+      }
+  }
+  tf_flush(&w);
+  free(w.buf);
+  return NULL;
+}
+
+/**
+ * @brief Executa fn sobre cada seção (ou intervalo), uma thread por item
+ */
+static int tf_parallel(void *(*fn)(void *), tf_args *args, int nsec) {
+  pthread_t *tids = malloc((nsec ? nsec : 1) * sizeof(pthread_t));
+  if (!tids)
+    return -1;
+  int created = 0, failed = 0;
+  for (int i = 0; i < nsec; i++) {
+    if (nsec == 1) {
+      fn(&args[i]);
+    } else if (cpu_thread_create(&tids[i], i, fn, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %d de leitura/gravação\n", i);
+      failed = 1;
+      break;
+    } else {
+      created++;
+    }
+  }
+  for (int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+  for (int i = 0; i < nsec; i++)
+    failed |= args[i].failed;
+  free(tids);
+  return failed ? -1 : 0;
+}
+
 /**
  * @brief Salva array de hashes em arquivo binário
  *
+ * O array é dividido em uma seção por thread. Cada thread mede e depois
+ * serializa a sua seção, gravando-a com pwrite no offset calculado; o
+ * cabeçalho com os CRCs é gravado no fim, e o arquivo troca de nome
+ * (.tmp + rename) só se todas as seções foram gravadas.
+ *
  * @param hashes Array de hash_t* (tipicamente global_tf)
  * @param num_hashes Número de hashes no array
  * @param filename Caminho do arquivo de saída
+ * @param nthreads Threads de gravação (seções do arquivo)
  * @return 0 em sucesso, -1 em erro
  */
-int save_hash_array(hash_t **hashes, long int num_hashes, const char *filename) {
+int save_hash_array(hash_t **hashes, long int num_hashes, const char *filename,
+                    int nthreads) {
   if (!hashes || !filename) {
     fprintf(stderr, "Erro: hashes ou filename é nulo\n");
     return -1;
   }
 
-  FILE *fp = fopen(filename, "wb");
-  if (!fp) {
-    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", filename);
+  long int nsec = nthreads > 0 ? nthreads : 1;
+  if (nsec > num_hashes)
+    nsec = num_hashes;
+  tf_section *sec = calloc(nsec ? nsec : 1, sizeof(tf_section));
+  tf_args *args = calloc(nsec ? nsec : 1, sizeof(tf_args));
+  if (!sec || !args) {
+    free(sec);
+    free(args);
     return -1;
   }
 
-  // Salvar número de hashes
-  fwrite(&num_hashes, sizeof(long int), 1, fp);
-
-  // Salvar cada hash
-  for (long int i = 0; i < num_hashes; i++) {
-    hash_t *h = hashes[i];
-    if (!h) {
-      // Hash nulo - salvar apenas capacidade 0
-      size_t zero = 0;
-      fwrite(&zero, sizeof(size_t), 1, fp);
-      fwrite(&zero, sizeof(size_t), 1, fp);
-      continue;
-    }
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    free(sec);
+    free(args);
+    return -1;
+  }
 
-    // Salvar capacidade e tamanho
-    fwrite(&h->cap, sizeof(size_t), 1, fp);
-    fwrite(&h->size, sizeof(size_t), 1, fp);
+  // [1] Seções contíguas e os seus tamanhos
+  long int base = nsec ? num_hashes / nsec : 0, rem = nsec ? num_hashes % nsec : 0;
+  for (long int i = 0; i < nsec; i++) {
+    sec[i].first = i * base + (i < rem ? i : rem);
+    sec[i].count = base + (i < rem);
+    args[i] = (tf_args){.hashes = hashes, .sec = &sec[i], .fd = fd};
+  }
+  int rc = tf_parallel(tf_size_thread, args, (int)nsec);
+
+  // [2] Offsets alinhados, depois do cabeçalho
+  long int header = 8 + 2 * sizeof(long int) + nsec * sizeof(tf_section);
+  long int offset = (header + TF_ALIGN - 1) / TF_ALIGN * TF_ALIGN;
+  for (long int i = 0; i < nsec; i++) {
+    sec[i].offset = offset;
+    offset += (sec[i].bytes + TF_ALIGN - 1) / TF_ALIGN * TF_ALIGN;
+  }
 
-    // Salvar cada entrada
-    for (size_t j = 0; j < h->cap; j++) {
-      for (HashEntry *e = h->buckets[j]; e; e = e->next) {
-        fwrite(&e->wlen, sizeof(size_t), 1, fp);
-        fwrite(e->word, sizeof(char), e->wlen, fp);
-        fwrite(&e->value, sizeof(double), 1, fp);
-      }
+  // [3] Seções em paralelo, cabeçalho por último
+  if (rc == 0)
+    rc = tf_parallel(tf_write_thread, args, (int)nsec);
+  if (rc == 0) {
+    char *head = calloc(1, header);
+    if (head) {
+      memcpy(head, TF_MAGIC, 8);
+      memcpy(head + 8, &num_hashes, sizeof(long int));
+      memcpy(head + 8 + sizeof(long int), &nsec, sizeof(long int));
+      memcpy(head + 8 + 2 * sizeof(long int), sec, nsec * sizeof(tf_section));
     }
+    if (!head || pwrite(fd, head, header, 0) != header)
+      rc = -1;
+    free(head);
+  }
+  if (close(fd) != 0)
+    rc = -1;
+  free(sec);
+  free(args);
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar %s\n", filename);
+    remove(tmp);
+    return -1;
   }
 
-  fclose(fp);
-  LOG(stdout, "global_tf salvo em %s (%ld hashes)\n", filename, num_hashes);
+  LOG(stdout, "global_tf salvo em %s (%ld hashes, %ld seções)\n", filename,
+      num_hashes, nsec);
   return 0;
 }
 
@@ -225,10 +468,12 @@ char *get_filecontent(const char *filename_txt) {
     fclose(fp);
     return NULL;
   }
+  mem_track_alloc(MEM_IO, size + 1);
 
   size_t read_size = fread(content, 1, size, fp);
   if ((long int)read_size != size) {
     fprintf(stderr, "Erro ao ler arquivo %s\n", filename_txt);
+    mem_track_free(MEM_IO, size + 1);
     free(content);
     fclose(fp);
     return NULL;
@@ -240,6 +485,24 @@ char *get_filecontent(const char *filename_txt) {
   return content;
 }
 
+/**
+ * @brief Verifica se um arquivo derivado não existe ou é mais antigo que a fonte
+ *
+ * @param filename Arquivo derivado (ex.: armazém de documentos, vocabulário)
+ * @param source Arquivo do qual ele foi gerado
+ * @return 1 se precisa ser (re)gerado, 0 caso contrário
+ */
+int file_is_stale(const char *filename, const char *source) {
+  struct stat st_file, st_src;
+  if (stat(filename, &st_file) != 0)
+    return 1;
+  if (stat(source, &st_src) != 0)
+    return 0;
+  if (st_src.st_mtim.tv_sec != st_file.st_mtim.tv_sec)
+    return st_src.st_mtim.tv_sec > st_file.st_mtim.tv_sec;
+  return st_src.st_mtim.tv_nsec > st_file.st_mtim.tv_nsec;
+}
+
 /**
  * @brief Carrega tabela hash de arquivo binário
  *
@@ -323,14 +586,191 @@ hash_t *load_hash(const char *filename) {
   return gh;
 }
 
+/**
+ * @brief Reconstrói os hashes [lo, hi) a partir dos registros de uma seção
+ *
+ * Os registros antes de lo são percorridos sem criar hashes; a leitura
+ * para em hi.
+ */
+static int tf_parse_section(const char *buf, long int bytes, hash_t **out,
+                            long int count, long int lo, long int hi) {
+  const char *p = buf, *end = buf + bytes;
+  char word[4096];
+  for (long int d = 0; d < hi; d++) {
+    size_t head[2];
+    if (end - p < (long int)sizeof(head))
+      return -1;
+    memcpy(head, p, sizeof(head));
+    p += sizeof(head);
+    if (head[0] == 0)
+      continue;
+
+    if (d < lo) {
+      for (size_t j = 0; j < head[1]; j++) {
+        size_t wlen;
+        if (end - p < (long int)sizeof(size_t))
+          return -1;
+        memcpy(&wlen, p, sizeof(size_t));
+        p += sizeof(size_t);
+        if (end - p < (long int)sizeof(double) ||
+            (size_t)(end - p) - sizeof(double) < wlen)
+          return -1;
+        p += wlen + sizeof(double);
+      }
+      continue;
+    }
+
+    out[d] = hash_new();
+    for (size_t j = 0; j < head[1]; j++) {
+      size_t wlen;
+      double value;
+      if (end - p < (long int)sizeof(size_t))
+        return -1;
+      memcpy(&wlen, p, sizeof(size_t));
+      p += sizeof(size_t);
+      if (end - p < (long int)sizeof(double) || (size_t)(end - p) - sizeof(double) < wlen)
+        return -1;
+      char *w = wlen < sizeof(word) ? word : malloc(wlen + 1);
+      if (!w)
+        return -1;
+      memcpy(w, p, wlen);
+      w[wlen] = '\0';
+      memcpy(&value, p + wlen, sizeof(double));
+      p += wlen + sizeof(double);
+      hash_add(out[d], w, value);
+      if (w != word)
+        free(w);
+    }
+  }
+  return hi < count || p == end ? 0 : -1;
+}
+
+/**
+ * @brief Lê as seções que cobrem [first, end) e cria os hashes da thread
+ *
+ * Cada thread cria os hashes do seu intervalo (o mesmo das threads de
+ * consulta), então a memória fica no nó NUMA da thread que os pontua.
+ * Uma seção dividida entre duas threads é lida e conferida por ambas.
+ */
+static void *tf_load_thread(void *arg) {
+  tf_args *a = (tf_args *)arg;
+  char *buf = NULL;
+  long int buf_cap = 0;
+  for (long int i = 0; i < a->nsec && !a->failed; i++) {
+    tf_section *sec = &a->sec[i];
+    long int lo = a->first > sec->first ? a->first : sec->first;
+    long int hi = a->end < sec->first + sec->count ? a->end
+                                                   : sec->first + sec->count;
+    if (lo >= hi)
+      continue;
+    if (sec->bytes > buf_cap) {
+      free(buf);
+      buf_cap = sec->bytes;
+      buf = malloc(buf_cap);
+    }
+    if (!buf || pread(a->fd, buf, sec->bytes, sec->offset) != sec->bytes) {
+      a->failed = 1;
+      break;
+    }
+    if (crc32c(0, buf, sec->bytes) != sec->crc) {
+      fprintf(stderr, "CRC inválido na seção %ld de %s\n", i, a->filename);
+      a->failed = 1;
+      break;
+    }
+    if (tf_parse_section(buf, sec->bytes, a->hashes + sec->first, sec->count,
+                         lo - sec->first, hi - sec->first) != 0)
+      a->failed = 1;
+  }
+  free(buf);
+  return NULL;
+}
+
+/**
+ * @brief Carrega o arquivo em seções, conferindo o CRC de cada uma
+ *
+ * Os documentos são divididos entre nthreads threads como nas consultas
+ * (intervalos contíguos; a thread i na mesma CPU do worker i), e cada
+ * thread lê as seções do seu intervalo.
+ *
+ * @param fp Arquivo posicionado logo após o magic
+ * @param filename Nome do arquivo (mensagens de erro)
+ * @param num_hashes_out Recebe o número de hashes (pode ser NULL)
+ * @param nthreads Threads de leitura
+ * @return Array de hash_t*, ou NULL em erro
+ */
+static hash_t **tf_load_sections(FILE *fp, const char *filename,
+                                 long int *num_hashes_out, int nthreads) {
+  long int num_hashes, nsec;
+  if (fread(&num_hashes, sizeof(long int), 1, fp) != 1 ||
+      fread(&nsec, sizeof(long int), 1, fp) != 1 || num_hashes < 0 ||
+      nsec < 0 || nsec > num_hashes) {
+    fprintf(stderr, "Cabeçalho inválido em %s\n", filename);
+    return NULL;
+  }
+
+  tf_section *sec = malloc((nsec ? nsec : 1) * sizeof(tf_section));
+  hash_t **hashes = calloc(num_hashes ? num_hashes : 1, sizeof(hash_t *));
+  long int next = 0;
+  int ok = sec && hashes &&
+           fread(sec, sizeof(tf_section), nsec, fp) == (size_t)nsec;
+
+  for (long int i = 0; ok && i < nsec; i++) {
+    if (sec[i].first != next || sec[i].count < 0 ||
+        sec[i].first + sec[i].count > num_hashes || sec[i].bytes < 0) {
+      ok = 0;
+      break;
+    }
+    next += sec[i].count;
+  }
+  ok = ok && next == num_hashes;
+
+  // [1] Intervalos das threads de leitura
+  long int nt = nthreads > 0 ? nthreads : 1;
+  if (nt > num_hashes)
+    nt = num_hashes ? num_hashes : 1;
+  tf_args *args = ok ? calloc(nt, sizeof(tf_args)) : NULL;
+  if (ok && !args)
+    ok = 0;
+  long int base = num_hashes / nt, rem = num_hashes % nt;
+  for (long int i = 0; ok && i < nt; i++) {
+    long int first = i * base + (i < rem ? i : rem);
+    args[i] = (tf_args){.hashes = hashes, .sec = sec, .fd = fileno(fp),
+                        .nsec = nsec, .first = first,
+                        .end = first + base + (i < rem), .filename = filename};
+  }
+
+  // [2] Seções lidas e conferidas em paralelo
+  if (ok)
+    ok = tf_parallel(tf_load_thread, args, (int)nt) == 0;
+  free(args);
+  free(sec);
+
+  if (!ok) {
+    fprintf(stderr, "Erro ao carregar %s\n", filename);
+    for (long int d = 0; hashes && d < num_hashes; d++)
+      if (hashes[d])
+        hash_free(hashes[d]);
+    free(hashes);
+    return NULL;
+  }
+
+  if (num_hashes_out)
+    *num_hashes_out = num_hashes;
+  LOG(stdout, "global_tf carregado de %s (%ld hashes, %ld seções, %ld threads)\n",
+      filename, num_hashes, nsec, nt);
+  return hashes;
+}
+
 /**
  * @brief Carrega array de hashes de arquivo binário
  *
  * @param filename Caminho para arquivo binário
  * @param num_hashes_out Ponteiro para receber número de hashes (pode ser NULL)
+ * @param nthreads Threads de leitura (só no formato em seções)
  * @return Array de hash_t*, ou NULL em erro
  */
-hash_t **load_hash_array(const char *filename, long int *num_hashes_out) {
+hash_t **load_hash_array(const char *filename, long int *num_hashes_out,
+                         int nthreads) {
   if (!filename) {
     fprintf(stderr, "Erro: filename é nulo\n");
     return NULL;
@@ -342,6 +782,15 @@ hash_t **load_hash_array(const char *filename, long int *num_hashes_out) {
     return NULL;
   }
 
+  // Arquivo em seções (save_hash_array); sem o magic, formato antigo
+  char magic[8];
+  if (fread(magic, 1, 8, fp) == 8 && memcmp(magic, TF_MAGIC, 8) == 0) {
+    hash_t **hashes = tf_load_sections(fp, filename, num_hashes_out, nthreads);
+    fclose(fp);
+    return hashes;
+  }
+  rewind(fp);
+
   // Ler número de hashes
   long int num_hashes;
   if (fread(&num_hashes, sizeof(long int), 1, fp) != 1) {
@@ -436,14 +885,47 @@ hash_t **load_hash_array(const char *filename, long int *num_hashes_out) {
   return hashes;
 }
 
+typedef struct {
+  double *norms;
+  int fd;
+  long int first;  // Normas [first, end) da thread
+  long int end;
+  int failed;
+} norms_args;
+
+/**
+ * @brief Lê as normas do intervalo da thread (first-touch no seu nó)
+ */
+static void *norms_load_thread(void *arg) {
+  norms_args *a = (norms_args *)arg;
+  size_t want = (a->end - a->first) * sizeof(double), done = 0;
+  off_t pos = sizeof(long int) + a->first * sizeof(double);
+  while (done < want) {
+    ssize_t n = pread(a->fd, (char *)(a->norms + a->first) + done,
+                      want - done, pos + done);
+    if (n <= 0) {
+      a->failed = 1;
+      break;
+    }
+    done += n;
+  }
+  return NULL;
+}
+
 /**
  * @brief Carrega normas de documentos de arquivo binário
  *
+ * As normas são lidas em intervalos contíguos por nthreads threads (os
+ * intervalos das consultas), então cada página fica no nó da thread que a
+ * usa.
+ *
  * @param filename Caminho para arquivo binário
  * @param num_docs_out Ponteiro para receber número de documentos
+ * @param nthreads Threads de leitura
  * @return Array de double com normas, ou NULL em erro
  */
-double *load_doc_norms(const char *filename, long int *num_docs_out) {
+double *load_doc_norms(const char *filename, long int *num_docs_out,
+                       int nthreads) {
   if (!filename) {
     fprintf(stderr, "Erro: filename é nulo\n");
     return NULL;
@@ -457,18 +939,53 @@ double *load_doc_norms(const char *filename, long int *num_docs_out) {
 
   // Ler número de documentos
   long int num_docs;
-  fread(&num_docs, sizeof(long int), 1, fp);
-
-  // Alocar e ler normas
-  double *norms = (double *)malloc(num_docs * sizeof(double));
-  if (!norms) {
+  struct stat st;
+  if (fread(&num_docs, sizeof(long int), 1, fp) != 1 || num_docs < 0 ||
+      fstat(fileno(fp), &st) != 0 ||
+      st.st_size < (off_t)(sizeof(long int) + num_docs * sizeof(double))) {
+    fprintf(stderr, "Arquivo de normas truncado ou inválido: %s\n", filename);
     fclose(fp);
     return NULL;
   }
 
-  fread(norms, sizeof(double), num_docs, fp);
-
+  // Alocar; as páginas só são tocadas pelas threads de leitura
+  double *norms = (double *)malloc((num_docs ? num_docs : 1) * sizeof(double));
+  long int nt = nthreads > 0 ? nthreads : 1;
+  if (nt > num_docs)
+    nt = num_docs ? num_docs : 1;
+  norms_args *args = calloc(nt, sizeof(norms_args));
+  pthread_t *tids = malloc(nt * sizeof(pthread_t));
+  int failed = !norms || !args || !tids;
+
+  long int base = num_docs / nt, rem = num_docs % nt, created = 0;
+  for (long int i = 0; !failed && i < nt; i++) {
+    args[i].norms = norms;
+    args[i].fd = fileno(fp);
+    args[i].first = i * base + (i < rem ? i : rem);
+    args[i].end = args[i].first + base + (i < rem);
+    if (nt == 1) {
+      norms_load_thread(&args[i]);
+    } else if (cpu_thread_create(&tids[i], i, norms_load_thread, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %ld de leitura\n", i);
+      failed = 1;
+    } else {
+      created++;
+    }
+  }
+  for (long int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+  for (long int i = 0; args && i < nt; i++)
+    failed |= args[i].failed;
+  free(args);
+  free(tids);
   fclose(fp);
+
+  if (failed) {
+    fprintf(stderr, "Erro ao carregar %s\n", filename);
+    free(norms);
+    return NULL;
+  }
+  mem_track_alloc(MEM_NORMS, num_docs * sizeof(double));
   LOG(stdout, "global_doc_norms carregado de %s (%ld normas)\n", filename, num_docs);
 
   if (num_docs_out)
@@ -16,15 +16,11 @@
  */
 
 #include "../include/hash_t.h"
+#include "../include/mem.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#ifndef HASH_INIT_CAP
-#define HASH_INIT_CAP 256 /**< Capacidade inicial padrão */
-#endif
-#define MAX_LOAD 0.75             /**< Fator de carga máximo antes de rehash */
-
 /* ------------- Funções Auxiliares ------------- */
 
 /**
@@ -42,6 +38,7 @@ static char *safe_strdup(const char *s) {
     exit(1);
   }
   memcpy(p, s, n);
+  mem_track_alloc(MEM_HASH_KEYS, n);
   return p;
 }
 
@@ -86,6 +83,8 @@ hash_t *hash_new(void) {
     perror("calloc");
     exit(1);
   }
+  mem_track_alloc(MEM_HASH_BUCKETS,
+                  sizeof(*set) + set->cap * sizeof(HashEntry *));
 
   return set;
 }
@@ -105,12 +104,16 @@ void hash_free(hash_t *set) {
     HashEntry *e = set->buckets[i];
     while (e) {
       HashEntry *n = e->next;
+      mem_track_free(MEM_HASH_KEYS, e->wlen + 1);
+      mem_track_free(MEM_HASH_ENTRIES, sizeof(*e));
       free(e->word);
       free(e);
       e = n;
     }
   }
 
+  mem_track_free(MEM_HASH_BUCKETS,
+                 sizeof(*set) + set->cap * sizeof(HashEntry *));
   free(set->buckets);
   free(set);
 }
@@ -143,6 +146,7 @@ static void hash_rehash(hash_t *set, size_t ncap) {
     }
   }
 
+  mem_track_alloc(MEM_HASH_BUCKETS, (ncap - set->cap) * sizeof(HashEntry *));
   free(set->buckets);
   set->buckets = nb;
   set->cap = ncap;
@@ -181,6 +185,7 @@ void hash_add(hash_t *set, const char *word, double value) {
     perror("malloc");
     exit(1);
   }
+  mem_track_alloc(MEM_HASH_ENTRIES, sizeof(*e));
 
   e->word = safe_strdup(word);
   e->wlen = wlen;
@@ -281,3 +286,22 @@ double hash_find(const hash_t *set, const char *word) {
 
   return 0.0;
 }
+
+/**
+ * @brief Busca com o hash da palavra já calculado (hash_str)
+ *
+ * Para quem procura as mesmas palavras em muitas tabelas.
+ *
+ * @param set Tabela hash
+ * @param word Palavra a buscar
+ * @param wlen Comprimento da palavra
+ * @param h hash_str(word, wlen)
+ * @return Valor associado, ou 0.0 se não encontrado
+ */
+double hash_find_prehashed(const hash_t *set, const char *word, size_t wlen,
+                           uint64_t h) {
+  for (HashEntry *e = set->buckets[h & (set->cap - 1)]; e; e = e->next)
+    if (e->wlen == wlen && memcmp(e->word, word, wlen) == 0)
+      return e->value;
+  return 0.0;
+}
@@ -0,0 +1,398 @@
+/**
+ * @file impact.c
+ * @brief Consulta score-at-a-time em um índice ordenado por impacto
+ *
+ * O impacto de um posting é values / |d|, sua contribuição ao cosseno a
+ * menos do peso q_t / |q| do termo na query. Cada lista é quantizada em
+ * IMPACT_LEVELS níveis lineares (relativos ao maior impacto do índice) e
+ * reorganizada em segmentos por nível decrescente; dentro de um segmento
+ * os doc_ids ficam em ordem crescente.
+ *
+ * A consulta ordena os segmentos dos seus termos por q_t * nível e os
+ * processa do maior para o menor, somando q_t * impacto em acumuladores
+ * por documento: os postings que mais mudam o ranking vêm primeiro. O prazo
+ * é verificado a cada IMPACT_CHECK postings; ao estourar, o top-k atual é
+ * devolvido como parcial. Em qualquer caso, os documentos escolhidos têm o
+ * score recalculado nas listas completas, na ordem dos buckets da query,
+ * então uma consulta processada até o fim devolve o mesmo top-k (e os mesmos
+ * scores) da pontuação exaustiva.
+ */
+
+#include "../include/impact.h"
+#include "../include/log.h"
+#include "../include/mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define IMPACT_CHECK 1024  /**< Postings entre consultas ao relógio */
+#define IMPACT_MARGIN 1e-9 /**< Margem relativa dos candidatos recalculados */
+#define IMPACT_SELECT_NS 10.0 /**< Estimativa inicial da seleção por documento */
+#define IMPACT_RESCORE_NS 1000.0 /**< Estimativa inicial do recálculo por termo */
+#define IMPACT_RESERVE 2.0    /**< Folga sobre os custos médios estimados */
+
+static size_t impact_bytes(const impact_t *imp) {
+  long int nsegs = imp->seg_start[imp->num_terms];
+  long int total = imp->seg_offset[nsegs];
+  return (imp->num_terms + 1) * sizeof(long int) +
+         nsegs * (sizeof(uint8_t) + sizeof(long int)) + sizeof(long int) +
+         total * (sizeof(long int) + sizeof(double));
+}
+
+static inline int impact_level(double impact, double max_impact) {
+  int level = (int)(impact / max_impact * IMPACT_LEVELS + 0.999999);
+  return level < 1 ? 1 : level > IMPACT_LEVELS ? IMPACT_LEVELS : level;
+}
+
+/**
+ * @brief Constrói a versão ordenada por impacto do índice
+ *
+ * Postings de valor ou norma nula não contribuem para nenhum score e
+ * ficam de fora.
+ *
+ * @param index Índice invertido
+ * @param global_doc_norms Normas dos documentos
+ * @return Índice por impacto, ou NULL em erro
+ */
+impact_t *impact_build(const inv_index_t *index, const double *global_doc_norms) {
+  if (!index || !global_doc_norms)
+    return NULL;
+
+  impact_t *imp = calloc(1, sizeof(impact_t));
+  if (!imp)
+    return NULL;
+  imp->num_terms = index->num_terms;
+  imp->num_docs = index->num_docs;
+  imp->select_ns = IMPACT_SELECT_NS;
+  imp->rescore_ns = IMPACT_RESCORE_NS;
+
+  // [1] Maior impacto, postings úteis e segmentos (níveis distintos)
+  long int total = 0, nsegs = 0;
+  for (long int t = 0; t < index->num_terms; t++) {
+    const PostingList *pl = &index->lists[t];
+    for (long int i = 0; i < pl->df; i++) {
+      double norm = global_doc_norms[pl->doc_ids[i]];
+      if (pl->values[i] > 0.0 && norm > 0.0 && pl->values[i] / norm > imp->max_impact)
+        imp->max_impact = pl->values[i] / norm;
+    }
+  }
+  long int count[IMPACT_LEVELS + 1];
+  for (long int t = 0; t < index->num_terms; t++) {
+    const PostingList *pl = &index->lists[t];
+    memset(count, 0, sizeof(count));
+    for (long int i = 0; i < pl->df; i++) {
+      double norm = global_doc_norms[pl->doc_ids[i]];
+      if (pl->values[i] > 0.0 && norm > 0.0)
+        count[impact_level(pl->values[i] / norm, imp->max_impact)]++;
+    }
+    for (int l = 1; l <= IMPACT_LEVELS; l++) {
+      total += count[l];
+      nsegs += count[l] > 0;
+    }
+  }
+
+  imp->seg_start = malloc((index->num_terms + 1) * sizeof(long int));
+  imp->seg_level = malloc((nsegs ? nsegs : 1) * sizeof(uint8_t));
+  imp->seg_offset = malloc((nsegs + 1) * sizeof(long int));
+  imp->doc_ids = malloc((total ? total : 1) * sizeof(long int));
+  imp->values = malloc((total ? total : 1) * sizeof(double));
+  imp->acc = calloc(index->num_docs ? index->num_docs : 1, sizeof(double));
+  imp->touched = malloc((index->num_docs ? index->num_docs : 1) * sizeof(long int));
+  if (!imp->seg_start || !imp->seg_level || !imp->seg_offset || !imp->doc_ids ||
+      !imp->values || !imp->acc || !imp->touched) {
+    free(imp->seg_start);
+    free(imp->seg_level);
+    free(imp->seg_offset);
+    free(imp->doc_ids);
+    free(imp->values);
+    free(imp->acc);
+    free(imp->touched);
+    free(imp);
+    return NULL;
+  }
+
+  // [2] Counting sort estável de cada lista por nível decrescente
+  long int seg = 0, pos = 0;
+  long int next[IMPACT_LEVELS + 1];
+  for (long int t = 0; t < index->num_terms; t++) {
+    const PostingList *pl = &index->lists[t];
+    imp->seg_start[t] = seg;
+    memset(count, 0, sizeof(count));
+    for (long int i = 0; i < pl->df; i++) {
+      double norm = global_doc_norms[pl->doc_ids[i]];
+      if (pl->values[i] > 0.0 && norm > 0.0)
+        count[impact_level(pl->values[i] / norm, imp->max_impact)]++;
+    }
+    for (int l = IMPACT_LEVELS; l >= 1; l--) {
+      if (!count[l])
+        continue;
+      imp->seg_level[seg] = (uint8_t)l;
+      imp->seg_offset[seg++] = pos;
+      next[l] = pos;
+      pos += count[l];
+    }
+    for (long int i = 0; i < pl->df; i++) {
+      double norm = global_doc_norms[pl->doc_ids[i]];
+      if (pl->values[i] <= 0.0 || norm <= 0.0)
+        continue;
+      long int p = next[impact_level(pl->values[i] / norm, imp->max_impact)]++;
+      imp->doc_ids[p] = pl->doc_ids[i];
+      imp->values[p] = pl->values[i] / norm;
+    }
+  }
+  imp->seg_start[index->num_terms] = seg;
+  imp->seg_offset[seg] = pos;
+
+  mem_track_alloc(MEM_POSTINGS, impact_bytes(imp));
+  mem_track_alloc(MEM_QUERY, imp->num_docs * (sizeof(double) + sizeof(long int)));
+  LOG(stdout, "Índice por impacto: %ld postings em %ld segmentos", total, nsegs);
+  return imp;
+}
+
+void impact_free(impact_t *imp) {
+  if (!imp)
+    return;
+  mem_track_free(MEM_POSTINGS, impact_bytes(imp));
+  mem_track_free(MEM_QUERY, imp->num_docs * (sizeof(double) + sizeof(long int)));
+  free(imp->seg_start);
+  free(imp->seg_level);
+  free(imp->seg_offset);
+  free(imp->doc_ids);
+  free(imp->values);
+  free(imp->acc);
+  free(imp->touched);
+  free(imp);
+}
+
+/* ------------- Consulta ------------- */
+
+typedef struct {
+  const PostingList *pl;
+  long int term;  // Posição da lista no índice
+  double weight;  // Peso TF-IDF do termo na query
+} impact_term;
+
+typedef struct {
+  double key;     // weight * nível: ordem de processamento
+  int term;       // Termo na ordem dos buckets (desempate)
+  long int begin;
+  long int end;
+} impact_seg;
+
+static int compare_seg(const void *a, const void *b) {
+  const impact_seg *x = (const impact_seg *)a, *y = (const impact_seg *)b;
+  if (x->key != y->key)
+    return x->key > y->key ? -1 : 1;
+  if (x->term != y->term)
+    return x->term - y->term;
+  return (x->begin > y->begin) - (x->begin < y->begin);
+}
+
+static inline double elapsed_ns(const struct timespec *from) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - from->tv_sec) * 1e9 + (now.tv_nsec - from->tv_nsec);
+}
+
+/**
+ * @brief Mantém em heap (raiz = menor) os k maiores valores vistos
+ */
+static void heap_offer(double *heap, long int *n, int k, double v) {
+  long int i;
+  if (*n < k) {
+    for (i = (*n)++; i > 0 && heap[(i - 1) / 2] > v; i = (i - 1) / 2)
+      heap[i] = heap[(i - 1) / 2];
+    heap[i] = v;
+    return;
+  }
+  if (v <= heap[0])
+    return;
+  i = 0;
+  for (;;) {
+    long int l = 2 * i + 1, r = l + 1, min = i;
+    double mv = v;
+    if (l < *n && heap[l] < mv) {
+      min = l;
+      mv = heap[l];
+    }
+    if (r < *n && heap[r] < mv)
+      min = r;
+    if (min == i)
+      break;
+    heap[i] = heap[min];
+    i = min;
+  }
+  heap[i] = v;
+}
+
+/**
+ * @brief Score exato do documento, somado na ordem dos buckets da query
+ */
+static double exact_score(const impact_term *terms, int m, long int doc,
+                          double query_norm, double doc_norm) {
+  double dot = 0.0;
+  for (int i = 0; i < m; i++) {
+    const PostingList *pl = terms[i].pl;
+    long int lo = 0, hi = pl->df;
+    while (lo < hi) {
+      long int mid = lo + (hi - lo) / 2;
+      if (pl->doc_ids[mid] < doc)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    if (lo < pl->df && pl->doc_ids[lo] == doc && pl->values[lo] > 0.0)
+      dot += terms[i].weight * pl->values[lo];
+  }
+  return (query_norm > 0.0 && doc_norm > 0.0) ? dot / (query_norm * doc_norm)
+                                              : 0.0;
+}
+
+/**
+ * @brief Top-k score-at-a-time, interrompido no prazo
+ *
+ * @param imp Índice por impacto (acumuladores e contadores são atualizados)
+ * @param index Índice invertido completo (scores exatos do top-k)
+ * @param query_tf Hash TF-IDF da query
+ * @param query_norm Norma da query
+ * @param global_doc_norms Normas dos documentos
+ * @param k Número de documentos
+ * @param deadline Instante limite em CLOCK_MONOTONIC (NULL = sem prazo)
+ * @param out Saída: top-k ordenados (k posições)
+ * @param exact Saída: 1 se todos os postings foram processados
+ * @param processed Saída: postings processados
+ * @param total Saída: postings dos termos da query
+ * @return Número de documentos em out, ou -1 em erro
+ */
+long int impact_top_k(impact_t *imp, const inv_index_t *index,
+                      const hash_t *query_tf, double query_norm,
+                      const double *global_doc_norms, int k,
+                      const struct timespec *deadline, DocSim *out, int *exact,
+                      long int *processed, long int *total) {
+  *exact = 1;
+  *processed = *total = 0;
+  if (k <= 0)
+    return 0;
+
+  // Termos na ordem dos buckets da query e seus segmentos
+  impact_term *terms = malloc((hash_size(query_tf) + 1) * sizeof(impact_term));
+  long int nsegs = 0;
+  int m = 0;
+  if (!terms)
+    return -1;
+  for (size_t i = 0; i < query_tf->cap; i++)
+    for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+      const PostingList *pl = index_find(index, q->word);
+      if (!pl || pl->df == 0 || q->value <= 0.0)
+        continue;
+      long int t = pl - index->lists;
+      terms[m++] = (impact_term){pl, t, q->value};
+      nsegs += imp->seg_start[t + 1] - imp->seg_start[t];
+    }
+
+  impact_seg *segs = malloc((nsegs ? nsegs : 1) * sizeof(impact_seg));
+  if (!segs) {
+    free(terms);
+    return -1;
+  }
+  nsegs = 0;
+  for (int i = 0; i < m; i++)
+    for (long int s = imp->seg_start[terms[i].term];
+         s < imp->seg_start[terms[i].term + 1]; s++) {
+      segs[nsegs++] = (impact_seg){terms[i].weight * imp->seg_level[s], i,
+                                   imp->seg_offset[s], imp->seg_offset[s + 1]};
+      *total += imp->seg_offset[s + 1] - imp->seg_offset[s];
+    }
+  qsort(segs, nsegs, sizeof(impact_seg), compare_seg);
+
+  // [1] Segmentos do maior para o menor impacto, até o prazo. A seleção
+  // custa proporcional aos documentos tocados e o recálculo a k * termos:
+  // o tempo estimado dos dois é reservado antes do prazo
+  double *acc = imp->acc;
+  double rescore = (double)k * m * imp->rescore_ns;
+  long int ntouched = 0, done = 0;
+  for (long int s = 0; s < nsegs && *exact; s++) {
+    double w = terms[segs[s].term].weight;
+    for (long int p = segs[s].begin; p < segs[s].end; p++) {
+      if ((++done & (IMPACT_CHECK - 1)) == 0 && deadline &&
+          elapsed_ns(deadline) +
+                  IMPACT_RESERVE * (ntouched * imp->select_ns + rescore) >= 0.0) {
+        *exact = 0;
+        break;
+      }
+      long int d = imp->doc_ids[p];
+      if (acc[d] == 0.0)
+        imp->touched[ntouched++] = d;
+      acc[d] += w * imp->values[p];
+    }
+  }
+  *processed = *exact ? *total : done - 1;
+
+  // [2] Candidatos: documentos até uma margem abaixo do k-ésimo acumulador
+  struct timespec t_select;
+  clock_gettime(CLOCK_MONOTONIC, &t_select);
+  long int nscored = 0, nheap = 0;
+  double *heap = malloc(k * sizeof(double));
+  DocSim *cand = malloc((ntouched ? ntouched : 1) * sizeof(DocSim));
+  if (!heap || !cand) {
+    for (long int i = 0; i < ntouched; i++)
+      acc[imp->touched[i]] = 0.0;
+    free(terms);
+    free(segs);
+    free(heap);
+    free(cand);
+    return -1;
+  }
+  for (long int i = 0; i < ntouched; i++) {
+    long int d = imp->touched[i];
+    double sim = acc[d] / query_norm;
+    acc[d] = 0.0;
+    if (index_is_deleted(index, d) || query_norm <= 0.0)
+      continue;
+    cand[nscored++] = (DocSim){d, sim};
+    heap_offer(heap, &nheap, k, sim);
+  }
+
+  double select_ns = elapsed_ns(&t_select);
+  double cut = nheap == k ? heap[0] * (1.0 - IMPACT_MARGIN) : 0.0;
+  long int ncand = 0;
+  for (long int i = 0; i < nscored; i++)
+    if (cand[i].similarity >= cut) {
+      long int d = cand[i].doc_id;
+      cand[ncand++] = (DocSim){d, exact_score(terms, m, d, query_norm,
+                                              global_doc_norms[d])};
+    }
+  double rescore_ns = elapsed_ns(&t_select) - select_ns;
+  qsort(cand, ncand, sizeof(DocSim), compare_sim);
+  long int n = 0;
+  for (long int i = 0; i < ncand && n < k; i++)
+    if (cand[i].similarity > 0.0)
+      out[n++] = cand[i];
+
+  // [3] Completo, o ranking termina com score zero em ordem de doc_id
+  if (*exact && n < k)
+    n = topk_fill_zeros(out, n, k, index->num_docs, index->deleted, NULL);
+
+  // Custos médios da seleção e do recálculo (reserva do prazo)
+  if (ntouched >= IMPACT_CHECK)
+    imp->select_ns = 0.75 * imp->select_ns + 0.25 * select_ns / ntouched;
+  if (ncand > 0 && m > 0)
+    imp->rescore_ns = 0.75 * imp->rescore_ns + 0.25 * rescore_ns / (ncand * m);
+
+  imp->queries++;
+  imp->partial += !*exact;
+  free(terms);
+  free(segs);
+  free(heap);
+  free(cand);
+  return n;
+}
+
+/**
+ * @brief Exibe quantas consultas foram interrompidas pelo prazo
+ */
+void impact_report(const impact_t *imp, FILE *out) {
+  fprintf(out, "[IMPACTO] consultas=%ld parciais=%ld taxa=%.1f%%\n",
+          imp->queries, imp->partial,
+          imp->queries ? 100.0 * imp->partial / imp->queries : 0.0);
+}
@@ -0,0 +1,361 @@
+/**
+ * @file index.c
+ * @brief Índice invertido (termo → lista de documentos) e consulta term-at-a-time
+ *
+ * O índice invertido é a saída do modo de construção SPIMI. Formato do
+ * arquivo (models/postings_<table>_<entries>.bin):
+ *
+ *     long int num_docs
+ *     long int num_terms
+ *     para cada termo:
+ *       size_t wlen, char word[wlen], long int df, double idf,
+ *       long int doc_ids[df] (crescentes), double values[df] (TF-IDF)
+ *
+ * A similaridade é calculada termo a termo: cada thread percorre, para cada
+ * termo da consulta, apenas o trecho da lista invertida que cai no seu
+ * intervalo de documentos, acumulando o produto escalar. A ordem de soma
+ * por documento é a mesma de compute_similarities_thread (ordem dos buckets
+ * da query), então os scores coincidem com os do modelo por documento.
+ */
+
+#include "../include/index.h"
+#include "../include/cpu.h"
+#include "../include/log.h"
+#include "../include/mem.h"
+#include "../include/wand.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------- Carregamento ------------- */
+
+/**
+ * @brief Libera um índice invertido e todas as suas listas
+ *
+ * @param index Índice a ser liberado (pode ser NULL)
+ */
+void index_free(inv_index_t *index) {
+  if (!index)
+    return;
+
+  for (long int i = 0; i < index->num_terms; i++) {
+    PostingList *pl = &index->lists[i];
+    mem_track_free(MEM_POSTINGS, pl->df * (sizeof(long int) + sizeof(double)));
+    free(pl->word);
+    free(pl->doc_ids);
+    free(pl->values);
+    if (pl->block_max)
+      mem_track_free(MEM_POSTINGS, (pl->df + WAND_BLOCK - 1) / WAND_BLOCK *
+                                       (sizeof(double) + sizeof(long int)));
+    free(pl->block_max);
+    free(pl->block_last);
+  }
+  mem_track_free(MEM_POSTINGS, index->num_terms * sizeof(PostingList));
+  free(index->lists);
+  hash_free(index->lookup);
+  free(index->deleted);
+  free(index);
+}
+
+/**
+ * @brief Lê uma lista invertida (termo, df, idf, doc_ids, values) do arquivo
+ *
+ * @param fp Arquivo posicionado no início da lista
+ * @param pl Lista a preencher (buffers alocados aqui, mesmo em erro)
+ * @return 0 em sucesso, -1 se o arquivo estiver truncado ou inválido
+ */
+static int read_posting_list(FILE *fp, PostingList *pl) {
+  if (fread(&pl->wlen, sizeof(size_t), 1, fp) != 1)
+    return -1;
+  pl->word = malloc(pl->wlen + 1);
+  if (!pl->word || fread(pl->word, 1, pl->wlen, fp) != pl->wlen)
+    return -1;
+  pl->word[pl->wlen] = '\0';
+
+  if (fread(&pl->df, sizeof(long int), 1, fp) != 1 ||
+      fread(&pl->idf, sizeof(double), 1, fp) != 1 || pl->df < 0)
+    return -1;
+
+  pl->doc_ids = malloc((pl->df ? pl->df : 1) * sizeof(long int));
+  pl->values = malloc((pl->df ? pl->df : 1) * sizeof(double));
+  if (!pl->doc_ids || !pl->values)
+    return -1;
+
+  if (fread(pl->doc_ids, sizeof(long int), pl->df, fp) != (size_t)pl->df ||
+      fread(pl->values, sizeof(double), pl->df, fp) != (size_t)pl->df)
+    return -1;
+
+  return 0;
+}
+
+/**
+ * @brief Carrega índice invertido salvo pelo modo SPIMI
+ *
+ * @param filename Caminho do arquivo de postings
+ * @return Índice carregado, ou NULL em erro
+ */
+inv_index_t *index_load(const char *filename) {
+  if (!filename) {
+    fprintf(stderr, "Erro: filename é nulo\n");
+    return NULL;
+  }
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para leitura\n", filename);
+    return NULL;
+  }
+
+  inv_index_t *index = calloc(1, sizeof(*index));
+  if (!index) {
+    fclose(fp);
+    return NULL;
+  }
+
+  if (fread(&index->num_docs, sizeof(long int), 1, fp) != 1 ||
+      fread(&index->num_terms, sizeof(long int), 1, fp) != 1 ||
+      index->num_terms < 0) {
+    fprintf(stderr, "Erro: cabeçalho inválido em %s\n", filename);
+    free(index);
+    fclose(fp);
+    return NULL;
+  }
+
+  long int num_terms = index->num_terms;
+  index->num_terms = 0; // Cresce conforme as listas são lidas (para index_free)
+  index->lists = calloc(num_terms ? num_terms : 1, sizeof(PostingList));
+  index->lookup = hash_new();
+  if (!index->lists) {
+    index_free(index);
+    fclose(fp);
+    return NULL;
+  }
+  mem_track_alloc(MEM_POSTINGS, num_terms * sizeof(PostingList));
+
+  for (long int i = 0; i < num_terms; i++) {
+    PostingList pl = {0};
+    if (read_posting_list(fp, &pl) != 0) {
+      fprintf(stderr, "Erro: arquivo de postings truncado ou corrompido: %s\n",
+              filename);
+      free(pl.word);
+      free(pl.doc_ids);
+      free(pl.values);
+      index_free(index);
+      fclose(fp);
+      return NULL;
+    }
+
+    mem_track_alloc(MEM_POSTINGS, pl.df * (sizeof(long int) + sizeof(double)));
+    index->lists[index->num_terms++] = pl;
+    hash_add(index->lookup, pl.word, (double)i);
+  }
+
+  fclose(fp);
+  LOG(stdout, "Índice invertido carregado de %s (%ld termos, %ld documentos)",
+      filename, index->num_terms, index->num_docs);
+  return index;
+}
+
+/**
+ * @brief Busca a lista invertida de um termo
+ *
+ * @param index Índice invertido
+ * @param word Termo procurado
+ * @return Lista do termo, ou NULL se ausente
+ */
+const PostingList *index_find(const inv_index_t *index, const char *word) {
+  if (!index || !word)
+    return NULL;
+  if (index->vocab) {
+    long int id = vocab_find(index->vocab, word, strlen(word));
+    return id < 0 ? NULL : &index->lists[index->vocab->entries[id].postings];
+  }
+  if (!hash_contains(index->lookup, word))
+    return NULL;
+  return &index->lists[(long int)hash_find(index->lookup, word)];
+}
+
+/**
+ * @brief Congela o vocabulário do índice (termo → id, IDF e lista)
+ *
+ * A partir daqui index_find usa a hash perfeita e a hash de lookup é
+ * liberada. O vocabulário pertence ao caller e deve viver mais que o índice.
+ *
+ * @param index Índice invertido
+ * @return Vocabulário construído, ou NULL em erro
+ */
+vocab_t *index_freeze_vocab(inv_index_t *index) {
+  vocab_term *terms = malloc((index->num_terms ? index->num_terms : 1) *
+                             sizeof(vocab_term));
+  if (!terms)
+    return NULL;
+  for (long int i = 0; i < index->num_terms; i++) {
+    const PostingList *pl = &index->lists[i];
+    terms[i] = (vocab_term){pl->word, pl->wlen, pl->idf, i};
+  }
+
+  vocab_t *vocab = vocab_build(terms, index->num_terms);
+  free(terms);
+  if (vocab)
+    index_use_vocab(index, vocab);
+  return vocab;
+}
+
+/**
+ * @brief Passa a buscar os termos do índice no vocabulário congelado
+ *
+ * @param index Índice invertido
+ * @param vocab Vocabulário construído sobre este índice (ex.: lido do disco)
+ * @return 0 em sucesso, -1 se o vocabulário não corresponde ao índice
+ */
+int index_use_vocab(inv_index_t *index, const vocab_t *vocab) {
+  if (vocab->num_terms != index->num_terms)
+    return -1;
+  if (vocab->num_terms > 0) {
+    // Amostra: o primeiro id deve apontar para a lista do mesmo termo
+    long int pos = vocab->entries[0].postings;
+    if (pos < 0 || pos >= index->num_terms ||
+        strcmp(index->lists[pos].word, vocab_word(vocab, 0)) != 0)
+      return -1;
+  }
+
+  index->vocab = vocab;
+  hash_free(index->lookup);
+  index->lookup = NULL;
+  return 0;
+}
+
+/* ------------- Similaridade Term-at-a-Time ------------- */
+
+typedef struct {
+  long int start;                 // Documento inicial
+  long int end;                   // Documento final (exclusivo)
+  const inv_index_t *index;       // Índice invertido
+  const hash_t *query_tf;         // Hash TF-IDF da query
+  double query_norm;              // Norma da query
+  const double *global_doc_norms; // Normas dos documentos
+  double *similarities;           // Saída (compartilhada, intervalos disjuntos)
+  const roaring_t *filter;        // Documentos permitidos (NULL = todos)
+} index_sim_args;
+
+/**
+ * @brief Primeira posição da lista com doc_id >= target (busca binária)
+ */
+static long int lower_bound(const long int *ids, long int n, long int target) {
+  long int lo = 0, hi = n;
+  while (lo < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (ids[mid] < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void *index_similarities_thread(void *arg) {
+  index_sim_args *a = (index_sim_args *)arg;
+
+  for (size_t i = 0; i < a->query_tf->cap; i++) {
+    for (HashEntry *q = a->query_tf->buckets[i]; q; q = q->next) {
+      const PostingList *pl = index_find(a->index, q->word);
+      if (!pl)
+        continue;
+
+      for (long int p = lower_bound(pl->doc_ids, pl->df, a->start);
+           p < pl->df && pl->doc_ids[p] < a->end; p++) {
+        if (a->filter) {
+          // Postings fora do filtro são saltadas até o próximo permitido
+          long int next = roaring_next(a->filter, pl->doc_ids[p]);
+          if (next != pl->doc_ids[p]) {
+            if (next < 0)
+              break;
+            p += lower_bound(pl->doc_ids + p, pl->df - p, next) - 1;
+            continue;
+          }
+        }
+        if (pl->values[p] > 0.0)
+          a->similarities[pl->doc_ids[p]] += q->value * pl->values[p];
+      }
+    }
+  }
+
+  for (long int d = a->filter ? roaring_next(a->filter, a->start) : a->start;
+       d >= 0 && d < a->end;
+       d = a->filter ? roaring_next(a->filter, d + 1) : d + 1) {
+    double doc_norm = a->global_doc_norms[d];
+    if (a->query_norm > 0.0 && doc_norm > 0.0)
+      a->similarities[d] /= a->query_norm * doc_norm;
+    else
+      a->similarities[d] = 0.0;
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Calcula similaridade cosseno da query com todos os documentos do índice
+ *
+ * @param index Índice invertido
+ * @param query_tf Hash TF-IDF da query
+ * @param query_norm Norma da query
+ * @param global_doc_norms Normas dos documentos
+ * @param nthreads Número de threads
+ * @param filter Documentos permitidos (NULL = todos; os demais ficam com 0)
+ * @return Array de similaridades (num_docs posições), ou NULL em erro
+ */
+double *index_similarities(const inv_index_t *index, const hash_t *query_tf,
+                           double query_norm, const double *global_doc_norms,
+                           int nthreads, const roaring_t *filter) {
+  if (!index || !query_tf || !global_doc_norms || index->num_docs <= 0)
+    return NULL;
+
+  if (nthreads <= 0) nthreads = 1;
+
+  long int num_docs = index->num_docs;
+  double *similarities = calloc(num_docs, sizeof(double));
+  pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
+  index_sim_args *args = malloc(nthreads * sizeof(index_sim_args));
+  if (!similarities || !threads || !args) {
+    free(similarities);
+    free(threads);
+    free(args);
+    return NULL;
+  }
+  mem_track_alloc(MEM_QUERY, num_docs * sizeof(double));
+
+  long int base = num_docs / nthreads;
+  long int rem = num_docs % nthreads;
+  int created = 0;
+  for (int i = 0; i < nthreads; i++) {
+    args[i].start = i * base + (i < rem ? i : rem);
+    args[i].end = args[i].start + base + (i < rem ? 1 : 0);
+    args[i].index = index;
+    args[i].query_tf = query_tf;
+    args[i].query_norm = query_norm;
+    args[i].global_doc_norms = global_doc_norms;
+    args[i].similarities = similarities;
+    args[i].filter = filter;
+
+    if (cpu_thread_create(&threads[i], i, index_similarities_thread, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %d para similaridade\n", i);
+      break;
+    }
+    created++;
+  }
+
+  for (int i = 0; i < created; i++)
+    pthread_join(threads[i], NULL);
+
+  free(threads);
+  free(args);
+
+  if (created < nthreads) {
+    mem_track_free(MEM_QUERY, num_docs * sizeof(double));
+    free(similarities);
+    return NULL;
+  }
+  return similarities;
+}
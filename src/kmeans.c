@@ -0,0 +1,640 @@
+/**
+ * @file kmeans.c
+ * @brief Busca podada por clusters: k-means esférico sobre os vetores TF-IDF
+ *
+ * Offline, os documentos do modelo por documento (global_tf / |d|, vetores
+ * unitários) são agrupados por k-means esférico: cada documento vai para o
+ * centroide de maior cosseno e cada centroide é a soma normalizada dos seus
+ * documentos. Os centroides são esparsificados (KMEANS_TERMS termos de
+ * maior peso) e indexados por termo, então a atribuição de um documento só
+ * percorre os centroides que compartilham algum termo com ele. Atribuição
+ * (por intervalo de documentos) e atualização (por intervalo de clusters)
+ * rodam nas threads de trabalho, como as fases do pré-processamento.
+ *
+ * Na consulta, os centroides são pontuados primeiro e só os documentos dos
+ * nprobe clusters mais próximos recebem o cosseno exato: o custo cai de N
+ * para cerca de N · nprobe / nclusters documentos.
+ */
+
+#include "../include/kmeans.h"
+#include "../include/cpu.h"
+#include "../include/mem.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define KMEANS_MAGIC "KMEANS01"
+
+/**
+ * @brief Documentos normalizados em CSR (ids do vocabulário)
+ */
+typedef struct {
+  long int *start;   // Termos do documento d: [start[d], start[d + 1])
+  uint32_t *term;
+  float *weight;     // values / |d|
+} doc_matrix;
+
+typedef struct {
+  kmeans_t *km;
+  const doc_matrix *docs;
+  long int start;    // Primeiro documento (atribuição) ou cluster (atualização)
+  long int end;      // Fim do intervalo (exclusivo)
+  int *assign;       // Cluster de cada documento (-1 = nenhum)
+  long int changed;  // Saída: documentos que trocaram de cluster
+  int failed;
+} kmeans_args;
+
+/**
+ * @brief n-ésimo maior valor de v (v é reordenado)
+ */
+static double nth_largest(double *v, long int len, long int n) {
+  long int lo = 0, hi = len - 1;
+  while (lo < hi) {
+    double pivot = v[lo + (hi - lo) / 2];
+    long int i = lo, j = hi;
+    while (i <= j) {
+      while (v[i] > pivot)
+        i++;
+      while (v[j] < pivot)
+        j--;
+      if (i <= j) {
+        double tmp = v[i];
+        v[i++] = v[j];
+        v[j--] = tmp;
+      }
+    }
+    if (n <= j)
+      hi = j;
+    else if (n >= i)
+      lo = i;
+    else
+      return v[n];
+  }
+  return v[n];
+}
+
+static uint64_t kmeans_mix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Índice termo → centroides, usado na atribuição e na consulta
+ */
+static int kmeans_index(kmeans_t *km) {
+  long int V = km->num_terms, total = 0;
+  for (int c = 0; c < km->nclusters; c++)
+    total += km->cent_len[c];
+
+  free(km->post_cluster);
+  free(km->post_weight);
+  memset(km->post_start, 0, (V + 1) * sizeof(long int));
+  km->post_cluster = malloc((total ? total : 1) * sizeof(int));
+  km->post_weight = malloc((total ? total : 1) * sizeof(double));
+  if (!km->post_cluster || !km->post_weight)
+    return -1;
+
+  for (int c = 0; c < km->nclusters; c++)
+    for (int i = 0; i < km->cent_len[c]; i++)
+      km->post_start[km->cent_term[(size_t)c * KMEANS_TERMS + i] + 1]++;
+  for (long int t = 0; t < V; t++)
+    km->post_start[t + 1] += km->post_start[t];
+  for (int c = 0; c < km->nclusters; c++)
+    for (int i = 0; i < km->cent_len[c]; i++) {
+      size_t slot = (size_t)c * KMEANS_TERMS + i;
+      long int p = km->post_start[km->cent_term[slot]]++;
+      km->post_cluster[p] = c;
+      km->post_weight[p] = km->cent_weight[slot];
+    }
+  // Os incrementos deslocaram cada início para o termo seguinte
+  for (long int t = V; t > 0; t--)
+    km->post_start[t] = km->post_start[t - 1];
+  km->post_start[0] = 0;
+  return 0;
+}
+
+/**
+ * @brief Agrupa os documentos por cluster (doc_id crescente em cada um)
+ */
+static void kmeans_layout(kmeans_t *km, const int *assign) {
+  memset(km->offsets, 0, (km->nclusters + 1) * sizeof(long int));
+  for (long int d = 0; d < km->num_docs; d++)
+    if (assign[d] >= 0)
+      km->offsets[assign[d] + 1]++;
+  for (int c = 0; c < km->nclusters; c++)
+    km->offsets[c + 1] += km->offsets[c];
+  for (long int d = 0; d < km->num_docs; d++)
+    if (assign[d] >= 0)
+      km->doc_ids[km->offsets[assign[d]]++] = d;
+  for (int c = km->nclusters; c > 0; c--)
+    km->offsets[c] = km->offsets[c - 1];
+  km->offsets[0] = 0;
+}
+
+/**
+ * @brief Atribui cada documento do intervalo ao centroide de maior cosseno
+ *
+ * Documentos sem termo em comum com nenhum centroide mantêm o cluster.
+ */
+static void *kmeans_assign_thread(void *arg) {
+  kmeans_args *a = (kmeans_args *)arg;
+  const kmeans_t *km = a->km;
+  const doc_matrix *dm = a->docs;
+  double *scores = calloc(km->nclusters, sizeof(double));
+  int *touched = malloc(km->nclusters * sizeof(int));
+  if (!scores || !touched) {
+    free(scores);
+    free(touched);
+    a->failed = 1;
+    return NULL;
+  }
+
+  for (long int d = a->start; d < a->end; d++) {
+    if (dm->start[d] == dm->start[d + 1])
+      continue;
+    int ntouched = 0;
+    for (long int i = dm->start[d]; i < dm->start[d + 1]; i++) {
+      uint32_t t = dm->term[i];
+      for (long int p = km->post_start[t]; p < km->post_start[t + 1]; p++) {
+        int c = km->post_cluster[p];
+        if (scores[c] == 0.0)
+          touched[ntouched++] = c;
+        scores[c] += dm->weight[i] * km->post_weight[p];
+      }
+    }
+
+    int best = -1;
+    double best_score = 0.0;
+    for (int i = 0; i < ntouched; i++) {
+      int c = touched[i];
+      if (scores[c] > best_score || (scores[c] == best_score && c < best)) {
+        best = c;
+        best_score = scores[c];
+      }
+      scores[c] = 0.0;
+    }
+    if (best < 0)
+      best = a->assign[d] >= 0 ? a->assign[d] : (int)(d % km->nclusters);
+    if (best != a->assign[d]) {
+      a->assign[d] = best;
+      a->changed++;
+    }
+  }
+
+  free(scores);
+  free(touched);
+  return NULL;
+}
+
+/**
+ * @brief Recalcula os centroides do intervalo de clusters
+ *
+ * Centroide = soma dos documentos do cluster, restrita aos KMEANS_TERMS
+ * termos de maior peso e normalizada. Cluster vazio mantém o centroide.
+ */
+static void *kmeans_update_thread(void *arg) {
+  kmeans_args *a = (kmeans_args *)arg;
+  kmeans_t *km = a->km;
+  const doc_matrix *dm = a->docs;
+  long int V = km->num_terms;
+  double *acc = calloc(V ? V : 1, sizeof(double));
+  uint32_t *touched = malloc((V ? V : 1) * sizeof(uint32_t));
+  double *tmp = malloc((V ? V : 1) * sizeof(double));
+  if (!acc || !touched || !tmp) {
+    free(acc);
+    free(touched);
+    free(tmp);
+    a->failed = 1;
+    return NULL;
+  }
+
+  for (long int c = a->start; c < a->end; c++) {
+    if (km->offsets[c] == km->offsets[c + 1])
+      continue;
+    long int ntouched = 0;
+    for (long int j = km->offsets[c]; j < km->offsets[c + 1]; j++) {
+      long int d = km->doc_ids[j];
+      for (long int i = dm->start[d]; i < dm->start[d + 1]; i++) {
+        uint32_t t = dm->term[i];
+        if (acc[t] == 0.0)
+          touched[ntouched++] = t;
+        acc[t] += dm->weight[i];
+      }
+    }
+
+    // Limiar do KMEANS_TERMS-ésimo maior peso (empates pela ordem de chegada)
+    double cut = 0.0;
+    long int above = ntouched;
+    if (ntouched > KMEANS_TERMS) {
+      for (long int i = 0; i < ntouched; i++)
+        tmp[i] = acc[touched[i]];
+      cut = nth_largest(tmp, ntouched, KMEANS_TERMS - 1);
+      above = 0;
+      for (long int i = 0; i < ntouched; i++)
+        above += acc[touched[i]] > cut;
+    }
+    long int ties = KMEANS_TERMS - above;
+
+    uint32_t *term = km->cent_term + c * KMEANS_TERMS;
+    double *weight = km->cent_weight + c * KMEANS_TERMS;
+    int len = 0;
+    double norm = 0.0;
+    for (long int i = 0; i < ntouched; i++) {
+      uint32_t t = touched[i];
+      if (acc[t] > cut || (acc[t] == cut && ties-- > 0)) {
+        term[len] = t;
+        weight[len++] = acc[t];
+        norm += acc[t] * acc[t];
+      }
+      acc[t] = 0.0;
+    }
+    norm = sqrt(norm);
+    for (int i = 0; i < len; i++)
+      weight[i] /= norm;
+    km->cent_len[c] = len;
+  }
+
+  free(acc);
+  free(touched);
+  free(tmp);
+  return NULL;
+}
+
+/**
+ * @brief Executa fn em nthreads intervalos contíguos de [0, n)
+ */
+static int kmeans_parallel(void *(*fn)(void *), kmeans_t *km,
+                           const doc_matrix *dm, int *assign, long int n,
+                           int nthreads, long int *changed) {
+  if (nthreads > n)
+    nthreads = n > 0 ? (int)n : 1;
+  kmeans_args *args = calloc(nthreads, sizeof(kmeans_args));
+  pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+  if (!args || !tids) {
+    free(args);
+    free(tids);
+    return -1;
+  }
+
+  long int base = n / nthreads, rem = n % nthreads;
+  int created = 0, failed = 0;
+  for (int i = 0; i < nthreads; i++) {
+    args[i] = (kmeans_args){km, dm, i * base + (i < rem ? i : rem), 0,
+                            assign, 0, 0};
+    args[i].end = args[i].start + base + (i < rem);
+    if (nthreads == 1) {
+      fn(&args[i]);
+    } else if (cpu_thread_create(&tids[i], i, fn, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %d do k-means\n", i);
+      failed = 1;
+      break;
+    } else {
+      created++;
+    }
+  }
+  for (int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+
+  if (changed)
+    *changed = 0;
+  for (int i = 0; i < nthreads; i++) {
+    failed |= args[i].failed;
+    if (changed)
+      *changed += args[i].changed;
+  }
+  free(args);
+  free(tids);
+  return failed ? -1 : 0;
+}
+
+static kmeans_t *kmeans_alloc(int nclusters, long int num_docs,
+                              long int num_terms) {
+  kmeans_t *km = calloc(1, sizeof(kmeans_t));
+  if (!km)
+    return NULL;
+  km->nclusters = nclusters;
+  km->num_docs = num_docs;
+  km->num_terms = num_terms;
+  size_t slots = (size_t)nclusters * KMEANS_TERMS;
+  km->cent_len = calloc(nclusters, sizeof(int));
+  km->cent_term = malloc(slots * sizeof(uint32_t));
+  km->cent_weight = malloc(slots * sizeof(double));
+  km->offsets = calloc(nclusters + 1, sizeof(long int));
+  km->doc_ids = malloc((num_docs ? num_docs : 1) * sizeof(long int));
+  km->post_start = calloc(num_terms + 1, sizeof(long int));
+  km->scores = malloc(nclusters * sizeof(double));
+  km->cands = malloc((num_docs ? num_docs : 1) * sizeof(long int));
+  if (!km->cent_len || !km->cent_term || !km->cent_weight || !km->offsets ||
+      !km->doc_ids || !km->post_start || !km->scores || !km->cands) {
+    kmeans_free(km);
+    return NULL;
+  }
+  mem_track_alloc(MEM_POSTINGS,
+                  slots * (sizeof(uint32_t) + sizeof(double)) +
+                      (num_terms + 1) * sizeof(long int) +
+                      2 * num_docs * sizeof(long int));
+  return km;
+}
+
+/**
+ * @brief Agrupa os documentos por k-means esférico
+ *
+ * Sementes: nclusters documentos distintos escolhidos por uma sequência
+ * pseudoaleatória fixa (o agrupamento é reprodutível). Para após
+ * KMEANS_ITERS iterações ou quando menos de 0,1% dos documentos trocam
+ * de cluster.
+ *
+ * @param global_tf Vetores TF-IDF dos documentos
+ * @param global_doc_norms Normas dos documentos
+ * @param num_docs Número de documentos
+ * @param vocab Vocabulário (ids dos termos dos centroides)
+ * @param nclusters Número de clusters
+ * @param nthreads Threads de trabalho
+ * @return Clusters, ou NULL em erro
+ */
+kmeans_t *kmeans_build(hash_t **global_tf, const double *global_doc_norms,
+                       long int num_docs, const vocab_t *vocab, int nclusters,
+                       int nthreads) {
+  if (nclusters <= 0 || num_docs <= 0)
+    return NULL;
+  if (nthreads <= 0)
+    nthreads = 1;
+
+  // [1] Documentos normalizados em CSR
+  doc_matrix dm = {0};
+  long int nnz = 0, nonempty = 0;
+  for (long int d = 0; d < num_docs; d++)
+    if (global_tf[d] && global_doc_norms[d] > 0.0) {
+      nnz += global_tf[d]->size;
+      nonempty++;
+    }
+  dm.start = malloc((num_docs + 1) * sizeof(long int));
+  dm.term = malloc((nnz ? nnz : 1) * sizeof(uint32_t));
+  dm.weight = malloc((nnz ? nnz : 1) * sizeof(float));
+  int *assign = malloc(num_docs * sizeof(int));
+  if (nclusters > nonempty)
+    nclusters = nonempty > 0 ? (int)nonempty : 1;
+  kmeans_t *km = kmeans_alloc(nclusters, num_docs, vocab->num_terms);
+  if (!dm.start || !dm.term || !dm.weight || !assign || !km) {
+    free(dm.start);
+    free(dm.term);
+    free(dm.weight);
+    free(assign);
+    kmeans_free(km);
+    return NULL;
+  }
+  mem_track_alloc(MEM_QUERY, nnz * (sizeof(uint32_t) + sizeof(float)));
+
+  long int n = 0;
+  for (long int d = 0; d < num_docs; d++) {
+    dm.start[d] = n;
+    assign[d] = -1;
+    double norm = global_doc_norms[d];
+    if (!global_tf[d] || norm <= 0.0)
+      continue;
+    for (size_t i = 0; i < global_tf[d]->cap; i++)
+      for (HashEntry *e = global_tf[d]->buckets[i]; e; e = e->next) {
+        long int id = vocab_find(vocab, e->word, e->wlen);
+        if (id < 0 || e->value <= 0.0)
+          continue;
+        dm.term[n] = (uint32_t)id;
+        dm.weight[n++] = (float)(e->value / norm);
+      }
+  }
+  dm.start[num_docs] = n;
+
+  // [2] Sementes: cada cluster começa com um documento
+  for (int c = 0; c < nclusters && nonempty > 0; c++) {
+    long int d;
+    uint64_t draw = (uint64_t)c;
+    do
+      d = (long int)(kmeans_mix(draw++ * 0x9E3779B97F4A7C15ULL) % num_docs);
+    while (assign[d] >= 0 || dm.start[d] == dm.start[d + 1]);
+    assign[d] = c;
+  }
+
+  // [3] Atualização dos centroides e reatribuição até estabilizar
+  int rc = 0;
+  for (int it = 0; rc == 0; it++) {
+    kmeans_layout(km, assign);
+    rc = kmeans_parallel(kmeans_update_thread, km, &dm, assign, nclusters,
+                         nthreads, NULL);
+    if (rc == 0)
+      rc = kmeans_index(km);
+    if (rc != 0 || it == KMEANS_ITERS)
+      break;
+
+    long int changed = 0;
+    rc = kmeans_parallel(kmeans_assign_thread, km, &dm, assign, num_docs,
+                         nthreads, &changed);
+    printf("[K-MEANS] Iteração %d: %ld documentos trocaram de cluster\n",
+           it + 1, changed);
+    if (changed * 1000 < nonempty) {
+      kmeans_layout(km, assign);
+      break;
+    }
+  }
+
+  mem_track_free(MEM_QUERY, nnz * (sizeof(uint32_t) + sizeof(float)));
+  free(dm.start);
+  free(dm.term);
+  free(dm.weight);
+  free(assign);
+  if (rc != 0) {
+    kmeans_free(km);
+    return NULL;
+  }
+  return km;
+}
+
+/**
+ * @brief Grava centroides e a lista cluster → documentos
+ *
+ * @param km Clusters
+ * @param filename Arquivo de destino (gravado via .tmp + rename)
+ * @return 0 em sucesso, -1 em erro
+ */
+int kmeans_save(const kmeans_t *km, const char *filename) {
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+
+  long int C = km->nclusters, total = km->offsets[C];
+  size_t slots = (size_t)C * KMEANS_TERMS;
+  int rc = fwrite(KMEANS_MAGIC, 1, 8, fp) == 8 &&
+                   fwrite(&C, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(&km->num_docs, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(&km->num_terms, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(km->cent_len, sizeof(int), C, fp) == (size_t)C &&
+                   fwrite(km->cent_term, sizeof(uint32_t), slots, fp) == slots &&
+                   fwrite(km->cent_weight, sizeof(double), slots, fp) == slots &&
+                   fwrite(km->offsets, sizeof(long int), C + 1, fp) == (size_t)C + 1 &&
+                   fwrite(km->doc_ids, sizeof(long int), total, fp) == (size_t)total
+               ? 0
+               : -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar clusters %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Carrega os clusters gravados para este modelo
+ *
+ * @param filename Arquivo gravado por kmeans_save
+ * @param num_docs Documentos esperados
+ * @param vocab Vocabulário do modelo
+ * @param nclusters Número de clusters pedido
+ * @return Clusters, ou NULL se ausentes, de outro modelo ou inválidos
+ */
+kmeans_t *kmeans_load(const char *filename, long int num_docs,
+                      const vocab_t *vocab, int nclusters) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+    return NULL;
+
+  char magic[8];
+  long int C, n, V;
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, KMEANS_MAGIC, 8) != 0 ||
+      fread(&C, sizeof(long int), 1, fp) != 1 ||
+      fread(&n, sizeof(long int), 1, fp) != 1 ||
+      fread(&V, sizeof(long int), 1, fp) != 1 || C <= 0 || C > nclusters ||
+      n != num_docs || V != vocab->num_terms) {
+    fclose(fp);
+    return NULL;
+  }
+
+  kmeans_t *km = kmeans_alloc((int)C, n, V);
+  size_t slots = (size_t)C * KMEANS_TERMS;
+  int ok = km != NULL &&
+           fread(km->cent_len, sizeof(int), C, fp) == (size_t)C &&
+           fread(km->cent_term, sizeof(uint32_t), slots, fp) == slots &&
+           fread(km->cent_weight, sizeof(double), slots, fp) == slots &&
+           fread(km->offsets, sizeof(long int), C + 1, fp) == (size_t)C + 1 &&
+           km->offsets[0] == 0 && km->offsets[C] <= n;
+  for (long int c = 0; ok && c < C; c++) {
+    ok = km->cent_len[c] >= 0 && km->cent_len[c] <= KMEANS_TERMS &&
+         km->offsets[c] <= km->offsets[c + 1];
+    for (int i = 0; ok && i < km->cent_len[c]; i++)
+      ok = km->cent_term[c * KMEANS_TERMS + i] < (uint64_t)V;
+  }
+  ok = ok && fread(km->doc_ids, sizeof(long int), km->offsets[C], fp) ==
+                 (size_t)km->offsets[C];
+  for (long int i = 0; ok && i < km->offsets[C]; i++)
+    ok = km->doc_ids[i] >= 0 && km->doc_ids[i] < n;
+  fclose(fp);
+
+  if (!ok || kmeans_index(km) != 0) {
+    fprintf(stderr, "Aviso: clusters inválidos em %s\n", filename);
+    kmeans_free(km);
+    return NULL;
+  }
+  return km;
+}
+
+void kmeans_free(kmeans_t *km) {
+  if (!km)
+    return;
+  if (km->cent_len && km->cent_term && km->cent_weight && km->offsets &&
+      km->doc_ids && km->post_start && km->scores && km->cands)
+    mem_track_free(MEM_POSTINGS,
+                   (size_t)km->nclusters * KMEANS_TERMS *
+                           (sizeof(uint32_t) + sizeof(double)) +
+                       (km->num_terms + 1) * sizeof(long int) +
+                       2 * km->num_docs * sizeof(long int));
+  free(km->cent_len);
+  free(km->cent_term);
+  free(km->cent_weight);
+  free(km->offsets);
+  free(km->doc_ids);
+  free(km->post_start);
+  free(km->post_cluster);
+  free(km->post_weight);
+  free(km->scores);
+  free(km->cands);
+  free(km);
+}
+
+/**
+ * @brief Top-k aproximado: centroides primeiro, depois os nprobe clusters
+ *
+ * Os scores devolvidos são exatos (rerank_top_k); a aproximação está só
+ * nos documentos fora dos clusters sondados.
+ *
+ * @param km Clusters
+ * @param vocab Vocabulário (ids dos termos da consulta)
+ * @param global_tf Vetores TF-IDF dos documentos
+ * @param query_tf Vetor TF-IDF da consulta
+ * @param query_norm Norma da consulta
+ * @param global_doc_norms Normas dos documentos
+ * @param k Tamanho do top-k
+ * @param nprobe Clusters sondados
+ * @param out Saída: top-k ordenado
+ * @param scanned Saída: documentos pontuados
+ * @return Documentos em out, ou -1 em erro
+ */
+long int kmeans_top_k(kmeans_t *km, const vocab_t *vocab, hash_t **global_tf,
+                      const hash_t *query_tf, double query_norm,
+                      const double *global_doc_norms, int k, int nprobe,
+                      DocSim *out, long int *scanned) {
+  *scanned = 0;
+  if (k <= 0)
+    return 0;
+  km->queries++;
+
+  // [1] Cosseno (a menos de |q|) da consulta com cada centroide
+  int C = km->nclusters;
+  memset(km->scores, 0, C * sizeof(double));
+  for (size_t i = 0; i < query_tf->cap; i++)
+    for (HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
+      long int t = vocab_find(vocab, e->word, e->wlen);
+      if (t < 0 || t >= km->num_terms || e->value <= 0.0)
+        continue;
+      for (long int p = km->post_start[t]; p < km->post_start[t + 1]; p++)
+        km->scores[km->post_cluster[p]] += e->value * km->post_weight[p];
+    }
+
+  // [2] Documentos dos nprobe melhores centroides (empate: menor cluster)
+  long int n = 0;
+  for (int probe = 0; probe < nprobe && probe < C; probe++) {
+    int best = -1;
+    for (int c = 0; c < C; c++)
+      if (km->scores[c] >= 0.0 && (best < 0 || km->scores[c] > km->scores[best]))
+        best = c;
+    km->scores[best] = -1.0;
+    memcpy(km->cands + n, km->doc_ids + km->offsets[best],
+           (km->offsets[best + 1] - km->offsets[best]) * sizeof(long int));
+    n += km->offsets[best + 1] - km->offsets[best];
+  }
+  km->scanned += n;
+  *scanned = n;
+
+  // [3] Cosseno exato dos documentos sondados
+  return rerank_top_k(query_tf, query_norm, global_tf, global_doc_norms,
+                      km->num_docs, km->cands, n, k, out);
+}
+
+void kmeans_report(const kmeans_t *km, FILE *out) {
+  fprintf(out,
+          "[K-MEANS] %d clusters, consultas=%ld documentos/consulta=%.1f "
+          "(%.1f%% de %ld)\n",
+          km->nclusters, km->queries,
+          km->queries ? (double)km->scanned / km->queries : 0.0,
+          km->queries && km->num_docs
+              ? 100.0 * km->scanned / km->queries / km->num_docs
+              : 0.0,
+          km->num_docs);
+}
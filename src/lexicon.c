@@ -0,0 +1,528 @@
+/**
+ * @file lexicon.c
+ * @brief Dicionário de termos ordenado, com front coding em blocos
+ *
+ * O vocabulário congelado (vocab.c) responde "termo → id" em O(1), mas a
+ * hash perfeita não preserva ordem: não há como listar os termos que
+ * começam com "marin" sem varrer todos. O léxico guarda os mesmos termos
+ * em ordem lexicográfica (ids próprios, em [0, num_terms)), agrupados em
+ * blocos de LEXICON_BLOCK termos. O primeiro termo de cada bloco é gravado
+ * inteiro; os demais só com o comprimento do prefixo em comum com o
+ * anterior e o sufixo que falta (front coding), o que reduz o texto dos
+ * termos a uma fração do pool do vocabulário.
+ *
+ * A busca faz uma busca binária nos primeiros termos dos blocos e
+ * decodifica no máximo um bloco. Um prefixo corresponde a um intervalo
+ * contíguo de ids; as completações mais frequentes saem de df[] com o
+ * maior df de cada bloco (block_max) descartando blocos inteiros.
+ *
+ * O buffer em memória tem o mesmo layout do arquivo
+ * (models/lexicon_<table>_<entries>.bin), que é aberto com mmap:
+ *
+ *     char magic[8] ("LEXICON1")
+ *     long int num_terms
+ *     long int num_blocks
+ *     long int max_len
+ *     long int data_size
+ *     uint32_t block_off[num_blocks]  (completado até múltiplo de 8 bytes)
+ *     uint32_t block_max[num_blocks]  (completado até múltiplo de 8 bytes)
+ *     uint32_t df[num_terms]          (completado até múltiplo de 8 bytes)
+ *     unsigned char data[data_size]   (blocos: varint len + termo, depois
+ *                                      varint comum + varint sufixo + sufixo)
+ */
+
+#include "../include/lexicon.h"
+#include "../include/mem.h"
+
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define LEXICON_MAGIC "LEXICON1"
+#define LEXICON_HEADER (8 + 4 * sizeof(long int))
+
+/* ------------- Varint ------------- */
+
+/**
+ * @brief Grava v em LEB128 em buf (até 5 bytes); devolve os bytes usados
+ */
+static inline int put_varint(unsigned char *buf, uint32_t v) {
+  int n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (unsigned char)(v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = (unsigned char)v;
+  return n;
+}
+
+/**
+ * @brief Lê um varint de [*p, end); devolve -1 se o valor está truncado
+ */
+static inline int get_varint(const unsigned char **p, const unsigned char *end,
+                             uint32_t *v) {
+  uint32_t x = 0;
+  for (int shift = 0; *p < end && shift < 35; shift += 7) {
+    unsigned char b = *(*p)++;
+    x |= (uint32_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = x;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* ------------- Blocos ------------- */
+
+static inline size_t pad8(size_t n) { return (n + 7) & ~(size_t)7; }
+
+/**
+ * @brief Primeiro termo do bloco b, lido direto do buffer (sem cópia)
+ *
+ * @return Comprimento do termo, ou -1 se o bloco está corrompido
+ */
+static long int block_head(const lexicon_t *lx, long int b,
+                           const unsigned char **word) {
+  const unsigned char *end = (const unsigned char *)lx->base + lx->size;
+  const unsigned char *p = lx->data + lx->block_off[b];
+  uint32_t len;
+  if (get_varint(&p, end, &len) != 0 || len > (uint32_t)lx->max_len ||
+      (size_t)(end - p) < len)
+    return -1;
+  *word = p;
+  return (long int)len;
+}
+
+/**
+ * @brief Decodifica o próximo termo de um bloco
+ *
+ * @param p Posição no bloco (avança para o termo seguinte)
+ * @param buf Termo anterior na entrada, termo decodificado na saída
+ * @param prev_len Comprimento do termo anterior (-1 no início do bloco)
+ * @return Comprimento do termo, ou -1 se o bloco está corrompido
+ */
+static long int next_term(const lexicon_t *lx, const unsigned char **p,
+                          char *buf, long int prev_len) {
+  const unsigned char *end = (const unsigned char *)lx->base + lx->size;
+  uint32_t shared = 0, suffix;
+  if (prev_len >= 0 && get_varint(p, end, &shared) != 0)
+    return -1;
+  if (get_varint(p, end, &suffix) != 0 ||
+      shared > (uint32_t)(prev_len < 0 ? 0 : prev_len) ||
+      (uint64_t)shared + suffix > (uint64_t)lx->max_len ||
+      (size_t)(end - *p) < suffix)
+    return -1;
+  memcpy(buf + shared, *p, suffix);
+  *p += suffix;
+  buf[shared + suffix] = '\0';
+  return (long int)(shared + suffix);
+}
+
+/**
+ * @brief Ordem lexicográfica por bytes (prefixo vem antes)
+ */
+static int term_cmp(const char *a, size_t alen, const char *b, size_t blen) {
+  int c = memcmp(a, b, alen < blen ? alen : blen);
+  if (c != 0)
+    return c;
+  return alen < blen ? -1 : alen > blen;
+}
+
+/**
+ * @brief Termo vem depois da chave (past = 0: termo >= chave; past = 1:
+ *        termo > todos os termos com o prefixo chave)
+ */
+static int term_after(const char *term, size_t tlen, const char *key,
+                      size_t klen, int past) {
+  if (!past)
+    return term_cmp(term, tlen, key, klen) >= 0;
+  return memcmp(term, key, tlen < klen ? tlen : klen) > 0;
+}
+
+/**
+ * @brief Primeiro id cujo termo vem depois da chave (num_terms se nenhum)
+ *
+ * @param buf Buffer de trabalho com pelo menos max_len + 1 bytes
+ * @return Id, ou -1 se o léxico está corrompido
+ */
+static long int lower_bound(const lexicon_t *lx, const char *key, size_t klen,
+                            int past, char *buf) {
+  // Primeiro bloco cujo termo inicial já vem depois da chave
+  long int lo = 0, hi = lx->num_blocks;
+  while (lo < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    const unsigned char *head;
+    long int len = block_head(lx, mid, &head);
+    if (len < 0)
+      return -1;
+    if (term_after((const char *)head, (size_t)len, key, klen, past))
+      hi = mid;
+    else
+      lo = mid + 1;
+  }
+  if (lo == 0)
+    return 0;
+
+  // A resposta está no bloco anterior, depois do seu termo inicial
+  long int b = lo - 1;
+  const unsigned char *p = lx->data + lx->block_off[b];
+  long int len = next_term(lx, &p, buf, -1);
+  for (long int id = b * LEXICON_BLOCK + 1;
+       len >= 0 && id < lx->num_terms && id < (b + 1) * LEXICON_BLOCK; id++) {
+    len = next_term(lx, &p, buf, len);
+    if (len >= 0 && term_after(buf, (size_t)len, key, klen, past))
+      return id;
+  }
+  if (len < 0)
+    return -1;
+  return lo < lx->num_blocks ? lo * LEXICON_BLOCK : lx->num_terms;
+}
+
+/* ------------- Construção ------------- */
+
+typedef struct {
+  const char *word;
+  uint32_t len;
+  uint32_t df;
+} lexicon_item;
+
+static int compare_item(const void *a, const void *b) {
+  const lexicon_item *x = a, *y = b;
+  return term_cmp(x->word, x->len, y->word, y->len);
+}
+
+/**
+ * @brief Aponta os campos do léxico para dentro do buffer
+ *
+ * @return 0 se o cabeçalho é válido para o tamanho do buffer, -1 caso contrário
+ */
+static int lexicon_attach(lexicon_t *lx, void *base, size_t size) {
+  const char *p = (const char *)base;
+  if (size < LEXICON_HEADER || memcmp(p, LEXICON_MAGIC, 8) != 0)
+    return -1;
+
+  long int data_size;
+  memcpy(&lx->num_terms, p + 8, sizeof(long int));
+  memcpy(&lx->num_blocks, p + 8 + sizeof(long int), sizeof(long int));
+  memcpy(&lx->max_len, p + 8 + 2 * sizeof(long int), sizeof(long int));
+  memcpy(&data_size, p + 8 + 3 * sizeof(long int), sizeof(long int));
+  if (lx->num_terms < 0 || lx->num_terms > (long int)UINT32_MAX ||
+      lx->max_len < 0 || data_size < 0 || (size_t)data_size > size ||
+      lx->num_blocks != (lx->num_terms + LEXICON_BLOCK - 1) / LEXICON_BLOCK)
+    return -1;
+
+  size_t blocks_bytes = pad8((size_t)lx->num_blocks * sizeof(uint32_t));
+  size_t max_off = LEXICON_HEADER + blocks_bytes;
+  size_t df_off = max_off + blocks_bytes;
+  size_t data_off = df_off + pad8((size_t)lx->num_terms * sizeof(uint32_t));
+  if (data_off + (size_t)data_size != size)
+    return -1;
+
+  lx->block_off = (const uint32_t *)(p + LEXICON_HEADER);
+  lx->block_max = (const uint32_t *)(p + max_off);
+  lx->df = (const uint32_t *)(p + df_off);
+  lx->data = (const unsigned char *)(p + data_off);
+  for (long int b = 0; b < lx->num_blocks; b++)
+    if (lx->block_off[b] >= (uint64_t)data_size ||
+        (b > 0 && lx->block_off[b] <= lx->block_off[b - 1]))
+      return -1;
+  lx->base = base;
+  lx->size = size;
+  return 0;
+}
+
+/**
+ * @brief Constrói o léxico a partir do vocabulário congelado
+ *
+ * O df vem do tamanho da lista invertida quando há índice; no modelo por
+ * documento é recuperado do IDF (idf = log2(N / df)).
+ *
+ * @param vocab Vocabulário congelado
+ * @param index Índice invertido (NULL no modelo por documento)
+ * @param num_docs Número de documentos da coleção
+ * @return Léxico construído, ou NULL em erro
+ */
+lexicon_t *lexicon_build(const vocab_t *vocab, const inv_index_t *index,
+                         long int num_docs) {
+  if (!vocab)
+    return NULL;
+
+  long int n = vocab->num_terms;
+  lexicon_item *items = malloc((n ? n : 1) * sizeof(lexicon_item));
+  if (!items)
+    return NULL;
+
+  size_t text_bytes = 0;
+  long int max_len = 0;
+  for (long int id = 0; id < n; id++) {
+    const vocab_entry *e = &vocab->entries[id];
+    double df;
+    if (index && e->postings >= 0)
+      df = (double)index->lists[e->postings].df;
+    else
+      df = (double)llround((double)num_docs / exp2(e->idf));
+    if (df < 1.0)
+      df = 1.0;
+    if (df > (double)UINT32_MAX)
+      df = (double)UINT32_MAX;
+    items[id] = (lexicon_item){vocab_word(vocab, id), e->str_len, (uint32_t)df};
+    text_bytes += e->str_len;
+    if ((long int)e->str_len > max_len)
+      max_len = e->str_len;
+  }
+  qsort(items, n, sizeof(lexicon_item), compare_item);
+
+  // Pior caso: cada termo inteiro com dois varints de 5 bytes
+  long int nb = (n + LEXICON_BLOCK - 1) / LEXICON_BLOCK;
+  size_t blocks_bytes = pad8((size_t)nb * sizeof(uint32_t));
+  size_t data_off = LEXICON_HEADER + 2 * blocks_bytes +
+                    pad8((size_t)n * sizeof(uint32_t));
+  size_t data_cap = text_bytes + (size_t)n * 10;
+  if (data_cap > UINT32_MAX) {
+    fprintf(stderr, "Erro: léxico grande demais (%zu bytes)\n", data_cap);
+    free(items);
+    return NULL;
+  }
+
+  lexicon_t *lx = calloc(1, sizeof(lexicon_t));
+  unsigned char *base = calloc(1, data_off + data_cap);
+  if (!lx || !base) {
+    free(lx);
+    free(base);
+    free(items);
+    return NULL;
+  }
+
+  uint32_t *block_off = (uint32_t *)(base + LEXICON_HEADER);
+  uint32_t *block_max = (uint32_t *)(base + LEXICON_HEADER + blocks_bytes);
+  uint32_t *df = (uint32_t *)(base + LEXICON_HEADER + 2 * blocks_bytes);
+  unsigned char *data = base + data_off;
+  size_t pos = 0;
+  for (long int i = 0; i < n; i++) {
+    const lexicon_item *t = &items[i];
+    long int b = i / LEXICON_BLOCK;
+    df[i] = t->df;
+    if (i % LEXICON_BLOCK == 0) {
+      block_off[b] = (uint32_t)pos;
+      block_max[b] = t->df;
+      pos += put_varint(data + pos, t->len);
+      memcpy(data + pos, t->word, t->len);
+      pos += t->len;
+      continue;
+    }
+    if (t->df > block_max[b])
+      block_max[b] = t->df;
+    const lexicon_item *prev = &items[i - 1];
+    uint32_t shared = 0;
+    while (shared < prev->len && shared < t->len &&
+           prev->word[shared] == t->word[shared])
+      shared++;
+    pos += put_varint(data + pos, shared);
+    pos += put_varint(data + pos, t->len - shared);
+    memcpy(data + pos, t->word + shared, t->len - shared);
+    pos += t->len - shared;
+  }
+  free(items);
+
+  // O buffer fica com o tamanho exato do arquivo
+  size_t size = data_off + pos;
+  unsigned char *shrunk = realloc(base, size);
+  if (shrunk)
+    base = shrunk;
+  long int data_size = (long int)pos;
+  memcpy(base, LEXICON_MAGIC, 8);
+  memcpy(base + 8, &n, sizeof(long int));
+  memcpy(base + 8 + sizeof(long int), &nb, sizeof(long int));
+  memcpy(base + 8 + 2 * sizeof(long int), &max_len, sizeof(long int));
+  memcpy(base + 8 + 3 * sizeof(long int), &data_size, sizeof(long int));
+  if (lexicon_attach(lx, base, size) != 0) {
+    free(lx);
+    free(base);
+    return NULL;
+  }
+  lx->mapped = 0;
+  mem_track_alloc(MEM_VOCAB, size);
+  return lx;
+}
+
+/* ------------- Persistência ------------- */
+
+/**
+ * @brief Grava o léxico (gravado em .tmp e trocado com rename)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+int lexicon_save(const lexicon_t *lx, const char *filename) {
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+  int rc = fwrite(lx->base, 1, lx->size, fp) == lx->size ? 0 : -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar léxico %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Abre o léxico gravado com mmap (somente leitura)
+ *
+ * @return Léxico, ou NULL se o arquivo não existe ou é inválido
+ */
+lexicon_t *lexicon_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)LEXICON_HEADER) {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  lexicon_t *lx = calloc(1, sizeof(lexicon_t));
+  if (!lx || lexicon_attach(lx, base, st.st_size) != 0) {
+    fprintf(stderr, "Erro: léxico inválido: %s\n", filename);
+    free(lx);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+  lx->mapped = 1;
+  madvise(base, st.st_size, MADV_RANDOM);
+  return lx;
+}
+
+/**
+ * @brief Libera o léxico (desmapeia o arquivo ou libera o buffer)
+ */
+void lexicon_free(lexicon_t *lx) {
+  if (!lx)
+    return;
+  if (lx->mapped) {
+    munmap(lx->base, lx->size);
+  } else {
+    mem_track_free(MEM_VOCAB, lx->size);
+    free(lx->base);
+  }
+  free(lx);
+}
+
+/* ------------- Consultas ------------- */
+
+/**
+ * @brief Termo de id `id` (ordem lexicográfica)
+ *
+ * @param buf Saída com pelo menos max_len + 1 bytes (terminada em '\0')
+ * @return Comprimento do termo, ou -1 se id é inválido
+ */
+long int lexicon_term(const lexicon_t *lx, long int id, char *buf) {
+  if (id < 0 || id >= lx->num_terms)
+    return -1;
+  long int b = id / LEXICON_BLOCK;
+  const unsigned char *p = lx->data + lx->block_off[b];
+  long int len = next_term(lx, &p, buf, -1);
+  for (long int i = b * LEXICON_BLOCK; len >= 0 && i < id; i++)
+    len = next_term(lx, &p, buf, len);
+  return len;
+}
+
+/**
+ * @brief Busca exata de um termo
+ *
+ * @return Id lexicográfico do termo, ou -1 se ausente
+ */
+long int lexicon_find(const lexicon_t *lx, const char *word, size_t len) {
+  char *buf = malloc(lx->max_len + 1);
+  if (!buf)
+    return -1;
+  long int id = lower_bound(lx, word, len, 0, buf);
+  long int found = -1;
+  if (id >= 0 && id < lx->num_terms) {
+    long int tlen = lexicon_term(lx, id, buf);
+    if (tlen == (long int)len && memcmp(buf, word, len) == 0)
+      found = id;
+  }
+  free(buf);
+  return found;
+}
+
+/**
+ * @brief Intervalo de ids dos termos que começam com `prefix`
+ *
+ * @param first Saída: primeiro id do intervalo
+ * @return Número de termos com o prefixo, ou -1 em erro
+ */
+long int lexicon_prefix(const lexicon_t *lx, const char *prefix, size_t len,
+                        long int *first) {
+  char *buf = malloc(lx->max_len + 1);
+  if (!buf)
+    return -1;
+  long int lo = lower_bound(lx, prefix, len, 0, buf);
+  long int hi = lo < 0 ? -1 : lower_bound(lx, prefix, len, 1, buf);
+  free(buf);
+  if (lo < 0 || hi < 0)
+    return -1;
+  *first = lo;
+  return hi > lo ? hi - lo : 0;
+}
+
+/**
+ * @brief Até n termos com o prefixo, do maior para o menor df
+ *
+ * Empates ficam na ordem lexicográfica. Blocos cujo maior df não supera
+ * o pior termo já escolhido são pulados sem olhar seus termos.
+ *
+ * @param ids Saída: ids lexicográficos (pelo menos n posições)
+ * @return Número de ids escritos, ou -1 em erro
+ */
+long int lexicon_complete(const lexicon_t *lx, const char *prefix, size_t len,
+                          long int n, long int *ids) {
+  long int first;
+  long int count = lexicon_prefix(lx, prefix, len, &first);
+  if (count < 0)
+    return -1;
+
+  // ids[0..m) fica ordenado por df decrescente: ids[m - 1] é o pior
+  long int m = 0;
+  long int end = first + count;
+  for (long int id = first; id < end && n > 0;) {
+    long int b = id / LEXICON_BLOCK;
+    long int block_end = (b + 1) * LEXICON_BLOCK < end ? (b + 1) * LEXICON_BLOCK
+                                                       : end;
+    if (m == n && lx->block_max[b] <= lx->df[ids[m - 1]]) {
+      id = block_end;
+      continue;
+    }
+    for (; id < block_end; id++) {
+      uint32_t df = lx->df[id];
+      if (m == n && df <= lx->df[ids[m - 1]])
+        continue;
+      long int j = m < n ? m++ : n - 1;
+      while (j > 0 && lx->df[ids[j - 1]] < df) {
+        ids[j] = ids[j - 1];
+        j--;
+      }
+      ids[j] = id;
+    }
+  }
+  return m;
+}
@@ -18,15 +18,37 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
+#include "../include/allpairs.h"
+#include "../include/batch.h"
+#include "../include/boolean.h"
+#include "../include/champion.h"
+#include "../include/checkpoint.h"
+#include "../include/cpu.h"
+#include "../include/docstore.h"
 #include "../include/file_io.h"
 #include "../include/hash_t.h"
+#include "../include/impact.h"
+#include "../include/index.h"
+#include "../include/kmeans.h"
+#include "../include/lexicon.h"
 #include "../include/log.h"
+#include "../include/mem.h"
 #include "../include/preprocess.h"
 #include "../include/preprocess_query.h"
+#include "../include/qcache.h"
+#include "../include/roaring.h"
+#include "../include/segment.h"
+#include "../include/shard.h"
+#include "../include/simhash.h"
+#include "../include/spimi.h"
 #include "../include/sqlite_helper.h"
+#include "../include/tokcache.h"
+#include "../include/vocab.h"
+#include "../include/wand.h"
 
 static inline double get_elapsed_time(struct timespec *start, struct timespec *end) {
   return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
@@ -40,9 +62,19 @@ static inline double get_elapsed_time(struct timespec *start, struct timespec *e
  */
 hash_t **global_tf;              /**< Array de hashes TF (Term Frequency) por documento */
 hash_t *global_idf;              /**< Hash IDF (Inverse Document Frequency) global */
+vocab_t *global_vocab;           /**< Vocabulário congelado (termo → id, IDF, lista) */
 double *global_doc_norms;        /**< Array com normas dos vetores de documentos */
+inv_index_t *global_index;       /**< Índice invertido (modo SPIMI) */
+champion_t *global_champions;    /**< Listas de campeões do índice (--champions) */
+impact_t *global_impact;         /**< Índice ordenado por impacto (--impact) */
+simhash_t *global_simhash;       /**< Assinaturas SimHash e faixas LSH (--lsh) */
+kmeans_t *global_kmeans;         /**< Clusters do k-means esférico (--kmeans) */
+docstore_t *global_docs;         /**< Textos mapeados para exibir o top-k */
+roaring_t *global_filter;        /**< Documentos permitidos nas consultas (NULL = todos) */
+lexicon_t *global_lexicon;       /**< Termos em ordem lexicográfica (curingas, --complete) */
 size_t global_vocab_size;        /**< Tamanho do vocabulário (palavras únicas) */
 long int global_entries = 0;     /**< Número total de documentos processados */
+long int global_num_live = 0;    /**< N do IDF: linhas existentes em [0, entries) */
 /** @} */
 
 /** @defgroup config Variáveis de Configuração
@@ -51,10 +83,6 @@ long int global_entries = 0;     /**< Número total de documentos processados */
 int VERBOSE = 0;                 /**< Flag de verbosidade (0=desabilitado, 1=habilitado) */
 /** @} */
 
-/* --------------- Macros --------------- */
-
-#define MAX_THREADS 16           /**< Número máximo de threads suportadas */
-
 /**
  * @struct thread_args
  * @brief Argumentos passados para cada thread de pré-processamento
@@ -66,6 +94,12 @@ typedef struct {
   long int id;                   /**< ID da thread (0 a nthreads-1) */
   const char *db;                /**< Caminho para o arquivo SQLite */
   const char *table;             /**< Nome da tabela no banco de dados */
+  long int batch;                /**< Documentos por lote na FASE 1 */
+  int checkpoint;                /**< Grava/restaura os lotes da FASE 1 */
+  long int resumed;              /**< Lotes restaurados de checkpoints */
+  const tokcache_t *tokens;      /**< Cache de tokens lido (NULL = SQLite) */
+  tokcache_writer *token_writer; /**< Grava o cache de tokens (NULL = não) */
+  int failed;                    /**< A FASE 1 da thread não terminou */
 } thread_args;
 
 /**
@@ -80,24 +114,74 @@ typedef struct {
   const char *query_user;        /**< Query do usuário (string direta) */
   const char *query_filename;    /**< Arquivo contendo a query do usuário */
   const char *table;             /**< Nome da tabela no banco de dados */
-  int nthreads;                  /**< Número de threads para pré-processamento */
+  int nthreads;                  /**< Número de threads (0=CPUs disponíveis) */
+  int no_pin;                    /**< Não fixa os workers em CPUs */
   int k;                         /**< Número de documentos top-k a retornar */
   int test;                      /**< Modo de teste (0=desabilitado) */
   int verbose;                   /**< Verbosidade (0=desabilitado, 1=habilitado) */
+  long int batch_size;           /**< Documentos por lote na FASE 1 */
+  size_t memory_budget;          /**< Orçamento de memória em bytes (0=sem limite) */
+  int mem_stats;                 /**< Exibe contabilidade de memória ao final */
+  int checkpoint;                /**< Checkpoints por lote durante a construção */
+  int token_cache;               /**< Grava o cache de tokens na construção */
+  int spimi;                     /**< Constrói índice invertido via SPIMI */
+  size_t spimi_block;            /**< Limite de memória do bloco SPIMI por thread */
+  const char *spimi_dir;         /**< Diretório temporário dos runs SPIMI */
+  int shards;                    /**< Número de shards (0=sem shards) */
+  const char *shard_dir;         /**< Diretório dos sockets dos shards */
+  int shard_serve;               /**< Índice do shard a servir (-1=coordenador) */
+  const char *shard_socket;      /**< Socket do servidor avulso (--shard_serve) */
+  int mapreduce;                 /**< Constrói o índice com processos map/reduce */
+  int mappers;                   /**< Processos map (0=nthreads) */
+  int reducers;                  /**< Processos reduce (0=nthreads) */
+  const char *mr_role;           /**< Executa só uma etapa: map, reduce ou finalize */
+  int mr_id;                     /**< Índice do mapper/reducer em --mr_role */
+  int segments;                  /**< Índice incremental em segmentos imutáveis */
+  int merge_factor;              /**< Segmentos por camada antes do merge (0=nunca) */
+  const char *delete_ids;        /**< article_ids a remover (lista com vírgulas) */
+  const char *update_ids;        /**< article_ids a reindexar (lista com vírgulas) */
+  double compact_ratio;          /**< Fração de removidos que dispara compactação */
+  const char *queries_file;      /**< Arquivo com uma consulta por linha */
+  long int cache_entries;        /**< Resultados guardados no cache de consultas */
+  size_t cache_bytes;            /**< Limite do cache de termos em bytes */
+  int snippets;                  /**< Exibe trecho em torno dos termos da consulta */
+  int exhaustive;                /**< Pontua todos os documentos (sem WAND) */
+  long int champions;            /**< Documentos por termo na camada de campeões */
+  double champion_min;           /**< Score mínimo dos candidatos da camada */
+  int champion_exact;            /**< Fallback sempre que o top-k puder mudar */
+  int impact;                    /**< Consulta score-at-a-time por impacto */
+  long int budget_us;            /**< Prazo por consulta em µs (0 = sem prazo) */
+  long int batch_queries;        /**< Consultas de --queries pontuadas juntas */
+  int lsh_bands;                 /**< Faixas do LSH (0 = desligado) */
+  int lsh_rows;                  /**< Bits da assinatura por faixa */
+  long int lsh_rerank;           /**< Candidatos com cosseno recalculado (0=todos) */
+  int kmeans;                    /**< Clusters do k-means esférico (0 = desligado) */
+  int nprobe;                    /**< Clusters sondados por consulta */
+  double allpairs;               /**< Cosseno mínimo da junção (<0 = desligada) */
+  int allpairs_top;              /**< Vizinhos por documento (0 = todos os pares) */
+  const char *allpairs_out;      /**< Arquivo de saída da junção */
+  const char *filter_ids;        /**< Intervalos de article_id permitidos */
+  const char *filter_sql;        /**< Predicado SQL dos documentos permitidos */
+  const char *complete;          /**< Prefixo a completar (--complete) */
 } Config;
 
-typedef struct {
-  long int doc_id;
-  double similarity;
-} DocSim;
-
 int parse_cli(int argc, char **argv, Config *cfg);
-int compare_sim(const void *a, const void *b);
 void *preprocess_1(void *args);
 void *preprocess_2(void *args);
+void *segment_merge_thread(void *arg);
+void print_top_k(const Config *cfg, const DocSim *scores, long int top_k,
+                 const hash_t *query_tf);
+long int *parse_id_list(const char *list, long int *n_out);
+long int model_version(const char **files, int nfiles);
+roaring_t *build_filter(const Config *cfg);
+const lexicon_t *get_lexicon(const Config *cfg);
+int print_completions(const Config *cfg);
+int answer_query(const Config *cfg, const char *query, shard_cluster *cluster,
+                 qcache_t *cache);
+int answer_batch(const Config *cfg, char **queries, int n);
 void format_filenames(char *filename_tf, char *filename_idf,
-                      char *filename_doc_norms, const char *table,
-                      long int entries);
+                      char *filename_doc_norms, char *filename_postings,
+                      const char *table, long int entries);
 
 /* --------------- Fluxo Principal --------------- */
 
@@ -122,7 +206,8 @@ int main(int argc, char *argv[]) {
 
   // Inicializar configuração com valores padrão
   Config cfg = {
-    .nthreads = 4,
+    .nthreads = 0,
+    .no_pin = 0,
     .entries = 0,
     .db = "./data/wiki-small.db",
     .query_user = "shakespeare english literature",
@@ -130,7 +215,51 @@ int main(int argc, char *argv[]) {
     .table= "sample_articles",
     .k = 10,
     .test = 0,
-    .verbose = 0
+    .verbose = 0,
+    .batch_size = 4096,
+    .memory_budget = 0,
+    .mem_stats = 0,
+    .checkpoint = 0,
+    .token_cache = 0,
+    .spimi = 0,
+    .spimi_block = 0,
+    .spimi_dir = "models/spimi_tmp",
+    .shards = 0,
+    .shard_dir = "/tmp",
+    .shard_serve = -1,
+    .shard_socket = NULL,
+    .mapreduce = 0,
+    .mappers = 0,
+    .reducers = 0,
+    .mr_role = NULL,
+    .mr_id = 0,
+    .segments = 0,
+    .merge_factor = 10,
+    .delete_ids = NULL,
+    .update_ids = NULL,
+    .compact_ratio = 0.2,
+    .queries_file = NULL,
+    .cache_entries = 1024,
+    .cache_bytes = 64 * 1024 * 1024,
+    .snippets = 0,
+    .exhaustive = 0,
+    .champions = 0,
+    .champion_min = 0.0,
+    .champion_exact = 0,
+    .impact = 0,
+    .budget_us = 0,
+    .batch_queries = 0,
+    .lsh_bands = 0,
+    .lsh_rows = 0,
+    .lsh_rerank = 1000,
+    .kmeans = 0,
+    .nprobe = 4,
+    .allpairs = -1.0,
+    .allpairs_top = 0,
+    .allpairs_out = NULL,
+    .filter_ids = NULL,
+    .filter_sql = NULL,
+    .complete = NULL
   };
 
   // [1]
@@ -157,32 +286,330 @@ int main(int argc, char *argv[]) {
       "\tk: %d",
       argc, cfg.nthreads, cfg.entries, cfg.db, cfg.query_user, cfg.table, cfg.test, cfg.k);
 
-  if (cfg.nthreads <= 0 || cfg.nthreads > MAX_THREADS) {
-    fprintf(stderr,
-            "Número de threads inválido (%d). Deve estar entre 1 e %d\n",
-            cfg.nthreads, MAX_THREADS);
+  // Sem --nthreads, uma thread por CPU da máscara de afinidade
+  int ncpus = cpu_init(!cfg.no_pin);
+  if (!cfg.nthreads)
+    cfg.nthreads = ncpus;
+  if (cfg.nthreads < 0) {
+    fprintf(stderr, "Número de threads inválido (%d)\n", cfg.nthreads);
+    return 1;
+  }
+  LOG(stdout, "Threads: %d (%d CPUs, %d nós NUMA)", cfg.nthreads, ncpus,
+      cpu_nodes());
+
+  if (cfg.batch_size <= 0) {
+    fprintf(stderr, "Tamanho de lote inválido (%ld)\n", cfg.batch_size);
     return 1;
   }
 
-  // Determinar número de entradas primeiro (para criar nomes de arquivo)
-  const char *query_count = "select count(*) from \"%w\";";
+  // Determinar número de entradas primeiro (para criar nomes de arquivo).
+  // Os documentos são indexados por article_id: o modelo cobre
+  // [0, max(article_id)] mesmo com lacunas nos ids
+  const char *query_count =
+      "select coalesce(max(article_id) + 1, 0) from \"%w\";";
   long int total = get_single_int(cfg.db, query_count, cfg.table);
+  if (total < 0) {
+    fprintf(stderr, "Erro: banco %s ou tabela %s não encontrado\n", cfg.db,
+            cfg.table);
+    return 1;
+  }
   if (!cfg.entries || cfg.entries > total) {
     LOG(stdout, "Número de entradas %ld excedeu a quantidade total de documentos: %ld", cfg.entries, total);
     cfg.entries = total;
   }
 
+  // Com lacunas nos ids, o N do IDF é o número de linhas, não o tamanho
+  // dos vetores (max(article_id) + 1)
+  char query_live[128];
+  snprintf(query_live, sizeof(query_live),
+           "select count(*) from \"%%w\" where article_id < %ld;", cfg.entries);
+  global_num_live = get_single_int(cfg.db, query_live, cfg.table);
+  if (global_num_live < 0) {
+    fprintf(stderr, "Erro ao contar documentos de %s\n", cfg.table);
+    return 1;
+  }
+
+  // O map/reduce gera o mesmo índice invertido do modo SPIMI
+  if (cfg.mapreduce || cfg.mr_role)
+    cfg.spimi = 1;
+  if (!cfg.mappers)
+    cfg.mappers = cfg.nthreads;
+  if (!cfg.reducers)
+    cfg.reducers = cfg.nthreads;
+  if (cfg.delete_ids || cfg.update_ids)
+    cfg.segments = 1;
+
+  if (cfg.shards < 0 || cfg.shards > cfg.entries) {
+    fprintf(stderr, "Número de shards inválido (%d). Deve estar entre 1 e %ld\n",
+            cfg.shards, cfg.entries);
+    return 1;
+  }
+  if (cfg.shards && (cfg.spimi || cfg.segments)) {
+    fprintf(stderr, "--shards não pode ser combinado com --spimi/--segments\n");
+    return 1;
+  }
+
+  // Servidor avulso de um shard (mesmo protocolo usado pelo coordenador)
+  if (cfg.shard_serve >= 0) {
+    if (!cfg.shards || !cfg.shard_socket) {
+      fprintf(stderr, "--shard_serve requer --shards e --shard_socket\n");
+      return 1;
+    }
+    return shard_serve(cfg.table, cfg.entries, cfg.shard_serve, cfg.shards,
+                       cfg.shard_socket) == 0 ? 0 : 1;
+  }
+
   // Criar nomes de arquivo com table e número de entradas
   char filename_tf[256];
   char filename_idf[256];
   char filename_doc_norms[256];
+  char filename_postings[256];
   format_filenames(filename_tf, filename_idf, filename_doc_norms,
-                   cfg.table, cfg.entries);
+                   filename_postings, cfg.table, cfg.entries);
+  char filename_manifest[256];
+  snprintf(filename_manifest, sizeof(filename_manifest),
+           "models/segments_%s.txt", cfg.table);
+  char filename_vocab[256];
+  snprintf(filename_vocab, sizeof(filename_vocab), "models/vocab_%s_%ld.bin",
+           cfg.table, cfg.entries);
+
+  // Sem limite explícito, cada thread usa uma fração do orçamento (ou 64 MB)
+  spimi_config scfg = {
+    .db = cfg.db,
+    .table = cfg.table,
+    .entries = cfg.entries,
+    .num_live = global_num_live,
+    .nthreads = cfg.nthreads,
+    .batch = cfg.batch_size,
+    .block_bytes = cfg.spimi_block ? cfg.spimi_block
+                   : cfg.memory_budget ? cfg.memory_budget / (2 * cfg.nthreads)
+                                       : ((size_t)64 << 20),
+    .tmp_dir = cfg.spimi_dir
+  };
+
+  // Uma única etapa do map/reduce (processos em outros contêineres/máquinas)
+  if (cfg.mr_role) {
+    int rc = -1;
+    if (strcmp(cfg.mr_role, "map") == 0) {
+      load_stopwords("assets/stopwords.txt");
+      if (global_stopwords)
+        rc = spimi_map(&scfg, cfg.mr_id, cfg.mappers, cfg.reducers);
+      free_stopwords();
+    } else if (strcmp(cfg.mr_role, "reduce") == 0) {
+      rc = spimi_reduce(&scfg, cfg.mr_id, cfg.mappers, cfg.reducers);
+    } else if (strcmp(cfg.mr_role, "finalize") == 0) {
+      rc = spimi_finalize(&scfg, cfg.reducers, filename_postings, filename_idf,
+                          filename_doc_norms);
+      rmdir(cfg.spimi_dir);
+    } else {
+      fprintf(stderr, "Etapa inválida: %s (use map, reduce ou finalize)\n",
+              cfg.mr_role);
+    }
+    return rc == 0 ? 0 : 1;
+  }
+
+  // Construção interrompida com --checkpoint: refeita a partir dos lotes
+  long int ckpt_batch = 0;
+  int ckpt_resume = cfg.spimi || cfg.segments
+                        ? -1
+                        : ckpt_phase(cfg.table, cfg.entries, cfg.db, &ckpt_batch);
+
+  // Modo SPIMI: índice invertido construído fora da memória
+  if (cfg.spimi && (access(filename_postings, F_OK) == -1 ||
+                    access(filename_idf, F_OK) == -1 ||
+                    access(filename_doc_norms, F_OK) == -1)) {
+    load_stopwords("assets/stopwords.txt");
+    if (!global_stopwords) {
+      fprintf(stderr, "Falha ao carregar stopwords\n");
+      return 1;
+    }
 
-  // Caso o arquivo não exista: Pré-processamento
-  if (access(filename_tf, F_OK) == -1 ||
+    printf("Qtd. artigos: %ld\n", cfg.entries);
+    struct timespec t_start_spimi, t_end_spimi;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_spimi);
+
+    int rc = cfg.mapreduce
+                 ? spimi_mapreduce(&scfg, cfg.mappers, cfg.reducers, filename_postings,
+                                   filename_idf, filename_doc_norms)
+                 : spimi_build(&scfg, filename_postings, filename_idf,
+                               filename_doc_norms);
+    if (rc != 0) {
+      fprintf(stderr, "Erro na indexação %s\n", cfg.mapreduce ? "map/reduce" : "SPIMI");
+      return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end_spimi);
+    printf("[SPIMI] Tempo: %.3f segundos\n",
+           get_elapsed_time(&t_start_spimi, &t_end_spimi));
+  }
+
+  int shards_ready = cfg.shards && shard_files_exist(cfg.table, cfg.entries, cfg.shards);
+  pthread_t merge_tid;
+  int merge_started = 0;
+
+  if (shards_ready) {
+
+    /* --------------- Estatísticas Globais dos Shards --------------- */
+
+    // O coordenador só precisa de N e do df global; os vetores ficam nos shards
+    shard_stats *stats = shard_stats_load(cfg.table, cfg.entries, cfg.shards);
+    if (!stats) {
+      fprintf(stderr, "Erro ao carregar estatísticas globais dos shards\n");
+      return 1;
+    }
+    global_idf = shard_stats_idf(stats);
+    global_entries = stats->bounds[stats->nshards];
+    global_vocab_size = hash_size(global_idf);
+    shard_stats_free(stats);
+    printf("Shards encontrados: %d (%ld documentos, %zu termos)\n",
+           cfg.shards, global_entries, global_vocab_size);
+
+  } else if (cfg.segments) {
+
+    /* --------------- Índice Incremental em Segmentos --------------- */
+
+    // Apenas linhas com article_id além do último segmento são indexadas
+    load_stopwords("assets/stopwords.txt");
+    if (!global_stopwords) {
+      fprintf(stderr, "Falha ao carregar stopwords\n");
+      return 1;
+    }
+
+    // Remoções e atualizações antes das linhas novas
+    if (cfg.delete_ids) {
+      long int n;
+      long int *ids = parse_id_list(cfg.delete_ids, &n);
+      long int removed = ids ? segment_delete(cfg.table, ids, n) : -1;
+      free(ids);
+      if (removed < 0) {
+        fprintf(stderr, "Erro ao remover documentos: %s\n", cfg.delete_ids);
+        return 1;
+      }
+      printf("[SEGMENTOS] %ld documentos removidos\n", removed);
+    }
+    if (cfg.update_ids) {
+      long int n;
+      long int *ids = parse_id_list(cfg.update_ids, &n);
+      long int updated = ids ? segment_reindex(&scfg, ids, n) : -1;
+      free(ids);
+      if (updated < 0) {
+        fprintf(stderr, "Erro ao reindexar documentos: %s\n", cfg.update_ids);
+        return 1;
+      }
+    }
+
+    struct timespec t_start_seg, t_end_seg;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_seg);
+    long int added = segment_update(&scfg);
+    if (added < 0) {
+      fprintf(stderr, "Erro ao indexar novo segmento\n");
+      return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_end_seg);
+    if (added > 0)
+      printf("[SEGMENTOS] %ld documentos indexados em %.3f segundos\n", added,
+             get_elapsed_time(&t_start_seg, &t_end_seg));
+
+    if (segment_compact(cfg.table, cfg.compact_ratio) < 0) {
+      fprintf(stderr, "Erro ao compactar segmentos de %s\n", cfg.table);
+      return 1;
+    }
+
+    global_index = segment_open(cfg.table, &global_doc_norms);
+    if (!global_index) {
+      fprintf(stderr, "Erro ao abrir segmentos de %s\n", cfg.table);
+      return 1;
+    }
+    global_entries = global_index->num_docs;
+    global_vocab = index_freeze_vocab(global_index);
+    if (!global_vocab) {
+      fprintf(stderr, "Erro ao congelar vocabulário dos segmentos\n");
+      return 1;
+    }
+
+    // Segmentos já estão em memória: o merge roda junto com a consulta
+    if (cfg.merge_factor > 1) {
+      if (pthread_create(&merge_tid, NULL, segment_merge_thread, &cfg) == 0)
+        merge_started = 1;
+      else
+        fprintf(stderr, "Erro ao criar thread de merge de segmentos\n");
+    }
+
+  } else if (cfg.spimi) {
+
+    /* --------------- Carregamento do Índice Invertido --------------- */
+
+    global_index = index_load(filename_postings);
+    if (!global_index) {
+      fprintf(stderr, "Erro ao carregar índice invertido de %s\n", filename_postings);
+      return 1;
+    }
+    global_entries = global_index->num_docs;
+
+    // Vocabulário salvo junto do índice; refeito se o índice for mais novo
+    if (!file_is_stale(filename_vocab, filename_postings))
+      global_vocab = vocab_open(filename_vocab);
+    if (global_vocab && index_use_vocab(global_index, global_vocab) != 0) {
+      vocab_free(global_vocab);
+      global_vocab = NULL;
+    }
+    if (!global_vocab) {
+      global_vocab = index_freeze_vocab(global_index);
+      if (global_vocab)
+        vocab_save(global_vocab, filename_vocab);
+    }
+
+    global_doc_norms = load_doc_norms(filename_doc_norms, &global_entries,
+                                      cfg.nthreads);
+    if (!global_vocab || !global_doc_norms) {
+      fprintf(stderr, "Erro ao carregar vocabulário/normas do modelo SPIMI\n");
+      return 1;
+    }
+    printf("Índice invertido carregado: %ld termos, %ld documentos\n",
+           global_index->num_terms, global_entries);
+
+  } else if (access(filename_tf, F_OK) == -1 ||
       access(filename_idf, F_OK) == -1 ||
-      access(filename_doc_norms, F_OK) == -1) {
+      access(filename_doc_norms, F_OK) == -1 ||
+      ckpt_resume >= 0) {
+
+    // Verificar orçamento de memória antes de alocar qualquer estrutura
+    long int avg_len = get_single_int(
+        cfg.db, "select cast(avg(length(article_text)) as integer) from \"%w\";",
+        cfg.table);
+    mem_estimate est = mem_estimate_build(cfg.entries, avg_len, cfg.nthreads);
+    long int batch = mem_plan_batch(&est, cfg.memory_budget, cfg.nthreads,
+                                    cfg.batch_size);
+    if (cfg.memory_budget || cfg.mem_stats) {
+      char b_pers[32], b_vocab[32], b_batch[32], b_budget[32];
+      mem_format_size(est.persistent, b_pers, sizeof(b_pers));
+      mem_format_size(est.vocab, b_vocab, sizeof(b_vocab));
+      mem_format_size(est.per_doc_batch * cfg.nthreads *
+                          (size_t)(batch > 0 ? batch : cfg.batch_size),
+                      b_batch, sizeof(b_batch));
+      mem_format_size(cfg.memory_budget, b_budget, sizeof(b_budget));
+      printf("[MEMÓRIA] Estimativa: TF+normas %s, vocabulário %s, lotes %s "
+             "(orçamento: %s)\n",
+             b_pers, b_vocab, b_batch, cfg.memory_budget ? b_budget : "-");
+    }
+    if (batch < 0) {
+      fflush(stdout);
+      fprintf(stderr,
+              "Orçamento de memória insuficiente para %ld documentos "
+              "(texto médio de %ld bytes). Reduza --entries, aumente "
+              "--memory_budget ou use --spimi.\n",
+              cfg.entries, avg_len);
+      return 1;
+    }
+    if (ckpt_resume >= 0 && ckpt_batch != batch) {
+      // Os checkpoints só são encontrados com os limites de lote originais
+      printf("[CHECKPOINT] Lotes de %ld documentos da construção interrompida "
+             "(em vez de %ld)\n", ckpt_batch, batch);
+      batch = ckpt_batch;
+    } else if (batch < cfg.batch_size) {
+      printf("[MEMÓRIA] Lote da FASE 1 reduzido de %ld para %ld documentos\n",
+             cfg.batch_size, batch);
+    }
 
     pthread_t *tids = (pthread_t*) malloc(sizeof(pthread_t) * cfg.nthreads);
     if (!tids) {
@@ -190,25 +617,18 @@ int main(int argc, char *argv[]) {
       return 1;
     }
 
-    thread_args args[MAX_THREADS];
+    thread_args *args = malloc(cfg.nthreads * sizeof(thread_args));
+    hash_t **local_idfs = calloc(cfg.nthreads, sizeof(hash_t *));
 
-    // Inicializar estruturas globais
+    // Inicializar estruturas globais. As hashes TF de cada documento são
+    // criadas pelo worker dono do intervalo (first-touch no seu nó NUMA)
     global_idf = hash_new();
     global_tf = (hash_t **)calloc(cfg.entries, sizeof(hash_t *));
-    if (!global_tf) {
+    if (!global_tf || !args || !local_idfs) {
       fprintf(stderr, "Falha ao alocar memória para global_tf\n");
       return 1;
     }
 
-    // Inicializar cada hash TF individual
-    for (long int i = 0; i < cfg.entries; i++) {
-      global_tf[i] = hash_new();
-      if (!global_tf[i]) {
-        fprintf(stderr, "Falha ao alocar hash TF para documento %ld\n", i);
-        return 1;
-      }
-    }
-
     global_entries = cfg.entries;
 
     // Carregar stopwords (compartilhado por todas threads)
@@ -220,7 +640,36 @@ int main(int argc, char *argv[]) {
 
     printf("Qtd. artigos: %ld\n", cfg.entries);
 
-    // Calcular divisão de trabalho
+    // Checkpoints: continua uma construção pendente ou inicia uma nova
+    int checkpoint = cfg.checkpoint || ckpt_resume >= 0;
+    int fase1_done = ckpt_resume >= CKPT_FASE1;
+    if (ckpt_resume >= 0) {
+      printf("[CHECKPOINT] Retomando construção interrompida (%s)\n",
+             fase1_done ? "FASE 1 concluída: lotes lidos só dos checkpoints"
+                        : "FASE 1 incompleta");
+    } else if (checkpoint) {
+      // Lotes de uma construção anterior podem ter outros limites
+      ckpt_clear(cfg.table, cfg.entries);
+      ckpt_mark(cfg.table, cfg.entries, CKPT_BUILD, batch);
+    }
+
+    // Cache de tokens: lido se cobre os documentos, senão gravado (opcional).
+    // Com a FASE 1 concluída os lotes vêm todos dos checkpoints
+    char filename_tokens[256];
+    snprintf(filename_tokens, sizeof(filename_tokens), "models/tokens_%s.bin",
+             cfg.table);
+    tokcache_t *tokens =
+        fase1_done ? NULL : tokcache_open(filename_tokens, cfg.db, cfg.entries);
+    tokcache_writer **token_writers = NULL;
+    if (tokens)
+      printf("[TOKENS] Lendo tokens de %s (%ld documentos)\n", filename_tokens,
+             tokens->num_docs);
+    else if (cfg.token_cache && !fase1_done)
+      token_writers = calloc(cfg.nthreads, sizeof(tokcache_writer *));
+
+    // Calcular divisão de trabalho. Com checkpoints, cada thread recebe
+    // lotes inteiros: os limites dos lotes não dependem de --nthreads
+    long int nbatches = (cfg.entries + batch - 1) / batch;
     long int base = cfg.entries / cfg.nthreads;
     long int rem = cfg.entries % cfg.nthreads;
 
@@ -236,17 +685,35 @@ int main(int argc, char *argv[]) {
       args[i].nthreads = cfg.nthreads;
       args[i].db = cfg.db;
       args[i].table= cfg.table;
-      args[i].start = i * base + (i < rem ? i : rem);
-      args[i].end = args[i].start + base + (i < rem);
-
-      if (pthread_create(&tids[i], NULL, preprocess_1, (void *)&args[i])) {
+      if (checkpoint) {
+        args[i].start = nbatches * i / cfg.nthreads * batch;
+        args[i].end = nbatches * (i + 1) / cfg.nthreads * batch;
+        if (args[i].start > cfg.entries)
+          args[i].start = cfg.entries;
+        if (args[i].end > cfg.entries)
+          args[i].end = cfg.entries;
+      } else {
+        args[i].start = i * base + (i < rem ? i : rem);
+        args[i].end = args[i].start + base + (i < rem);
+      }
+      args[i].batch = batch;
+      args[i].checkpoint = checkpoint;
+      args[i].resumed = 0;
+      args[i].failed = 0;
+      args[i].tokens = tokens;
+      args[i].token_writer =
+          token_writers ? (token_writers[i] = tokcache_writer_new(
+                               filename_tokens, i, args[i].start,
+                               args[i].end - args[i].start))
+                        : NULL;
+
+      if (cpu_thread_create(&tids[i], i, preprocess_1, (void *)&args[i])) {
         fprintf(stderr, "Erro ao criar thread %ld\n", i);
         return 1;
       }
     }
 
     // Aguardar conclusão da Fase 1 e coletar IDFs locais
-    hash_t *local_idfs[MAX_THREADS];
     for (long int i = 0; i < cfg.nthreads; ++i) {
       void *ret_val;
       if (pthread_join(tids[i], &ret_val)) {
@@ -256,6 +723,18 @@ int main(int argc, char *argv[]) {
       local_idfs[i] = (hash_t *)ret_val;
     }
 
+    // Um intervalo incompleto daria IDF e TF errados: o modelo não é salvo
+    for (long int i = 0; i < cfg.nthreads; ++i) {
+      if (args[i].failed) {
+        fprintf(stderr, "Erro: FASE 1 da thread %ld não terminou; modelo não "
+                        "foi salvo\n", i);
+        for (long int j = 0; token_writers && j < cfg.nthreads; ++j)
+          tokcache_writer_free(token_writers[j]);
+        tokcache_close(tokens);
+        return 1;
+      }
+    }
+
     // Merge dos IDFs locais no global (fora da seção crítica)
     printf("[FASE 1] Fazendo merge dos vocabulários locais...\n");
     for (long int i = 0; i < cfg.nthreads; ++i) {
@@ -266,18 +745,50 @@ int main(int argc, char *argv[]) {
     }
 
     printf("[FASE 1] Vocabulário construído: %zu palavras\n", hash_size(global_idf));
+    if (checkpoint) {
+      long int resumed = 0;
+      for (long int i = 0; i < cfg.nthreads; ++i)
+        resumed += args[i].resumed;
+      printf("[CHECKPOINT] %ld de %ld lotes restaurados\n", resumed, nbatches);
+      if (ckpt_resume >= 0 && resumed < nbatches)
+        printf("[CHECKPOINT] %ld lotes sem checkpoint válido foram lidos do "
+               "banco\n", nbatches - resumed);
+      ckpt_mark(cfg.table, cfg.entries, CKPT_FASE1, batch);
+    }
 
     // Calcular IDF global (single-threaded, entre as fases)
     printf("[FASE 1] Calculando IDF global...\n");
-    set_idf_value(global_idf, global_tf, (double)global_entries, global_entries);
+    set_idf_value(global_idf, global_tf, (double)global_num_live, global_entries);
     global_vocab_size = hash_size(global_idf);
 
+    // O IDF não muda mais: a FASE 2 e as consultas usam o vocabulário congelado
+    global_vocab = vocab_from_hash(global_idf);
+    if (!global_vocab) {
+      fprintf(stderr, "Erro ao congelar vocabulário\n");
+      return 1;
+    }
+
+    // Ids locais das threads → ids do vocabulário congelado
+    tokcache_close(tokens);
+    if (token_writers) {
+      long int cached = tokcache_finish(token_writers, cfg.nthreads,
+                                        global_vocab, filename_tokens);
+      if (cached >= 0)
+        printf("[TOKENS] %ld documentos gravados em %s\n", cached,
+               filename_tokens);
+      else
+        printf("[TOKENS] Cache de tokens não gravado (lotes restaurados de "
+               "checkpoints ou erro de escrita)\n");
+      free(token_writers);
+    }
+
     // Alocar normas
     global_doc_norms = (double *)calloc(global_entries, sizeof(double));
     if (!global_doc_norms) {
       fprintf(stderr, "Erro ao alocar memória para global_doc_norms\n");
       return 1;
     }
+    mem_track_alloc(MEM_NORMS, global_entries * sizeof(double));
 
     clock_gettime(CLOCK_MONOTONIC, &t_end_fase1);
     double elapsed_fase1 = get_elapsed_time(&t_start_fase1, &t_end_fase1);
@@ -291,7 +802,7 @@ int main(int argc, char *argv[]) {
     printf("\n[FASE 2] Calculando TF-IDF e normas...\n");
 
     for (long int i = 0; i < cfg.nthreads; ++i) {
-      if (pthread_create(&tids[i], NULL, preprocess_2, (void *)&args[i])) {
+      if (cpu_thread_create(&tids[i], i, preprocess_2, (void *)&args[i])) {
         fprintf(stderr, "Erro ao criar thread %ld\n", i);
         return 1;
       }
@@ -318,16 +829,29 @@ int main(int argc, char *argv[]) {
     // [15]
     // Salvar estruturas globais em arquivos binários
     printf("\nSalvando estruturas em disco\n");
+    struct timespec t_start_save, t_end_save;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_save);
+
+    int saved = save_hash_array(global_tf, global_entries, filename_tf, cfg.nthreads) == 0;
+    saved &= save_hash(global_idf, filename_idf) == 0;
+    saved &= save_doc_norms(global_doc_norms, global_entries, filename_doc_norms) == 0;
+    saved &= vocab_save(global_vocab, filename_vocab) == 0;
+
+    // Modelo completo em disco: os checkpoints não são mais necessários
+    if (checkpoint && saved)
+      ckpt_clear(cfg.table, cfg.entries);
 
-    save_hash_array(global_tf, global_entries, filename_tf);
-    save_hash(global_idf, filename_idf);
-    save_doc_norms(global_doc_norms, global_entries, filename_doc_norms);
+    clock_gettime(CLOCK_MONOTONIC, &t_end_save);
+    printf("[SALVAR] Tempo: %.3f segundos\n",
+           get_elapsed_time(&t_start_save, &t_end_save));
 
     // Liberar stopwords (usado apenas no pré-processamento)
     free_stopwords();
 
     // Liberar array de thread IDs
     free(tids);
+    free(args);
+    free(local_idfs);
 
   } else {
 
@@ -335,14 +859,18 @@ int main(int argc, char *argv[]) {
 
     printf("Arquivos binários encontrados, carregando estruturas...\n");
 
-    global_tf = load_hash_array(filename_tf, &global_entries);
+    global_tf = load_hash_array(filename_tf, &global_entries, cfg.nthreads);
     if (!global_tf) {
       fprintf(stderr, "Erro ao carregar global_tf de %s\n", filename_tf);
       return 1;
     }
 
-    global_idf = load_hash(filename_idf);
-    if (!global_idf) {
+    // Vocabulário mapeado direto do disco; sem ele, a hash IDF é reconstruída
+    if (!file_is_stale(filename_vocab, filename_idf))
+      global_vocab = vocab_open(filename_vocab);
+    if (!global_vocab)
+      global_idf = load_hash(filename_idf);
+    if (!global_vocab && !global_idf) {
       fprintf(stderr, "Erro ao carregar global_idf de %s\n", filename_idf);
       // Liberar global_tf
       for (long int i = 0; i < global_entries; i++) {
@@ -353,10 +881,12 @@ int main(int argc, char *argv[]) {
       return 1;
     }
 
-    global_doc_norms = load_doc_norms(filename_doc_norms, &global_entries);
+    global_doc_norms = load_doc_norms(filename_doc_norms, &global_entries,
+                                      cfg.nthreads);
     if (!global_doc_norms) {
       fprintf(stderr, "Erro ao carregar global_doc_norms\n");
       hash_free(global_idf);
+      vocab_free(global_vocab);
       for (long int i = 0; i < global_entries; i++) {
         if (global_tf[i])
           hash_free(global_tf[i]);
@@ -365,132 +895,347 @@ int main(int argc, char *argv[]) {
       return 1;
     }
 
-    global_vocab_size = hash_size(global_idf);
-
     printf("Estruturas carregadas com sucesso.\n");
 
     // Carregar stopwords para processar queries
     load_stopwords("assets/stopwords.txt");
   }
 
-  /* --------------- Consulta do Usuário --------------- */
+  /* --------------- Vocabulário Congelado --------------- */
 
-  if (cfg.query_user) {
-    // printf("Consulta do usuário: %s\n", cfg.query_user);
+  // Daqui em diante o IDF só é consultado pela hash perfeita
+  if (!global_vocab) {
+    global_vocab = vocab_from_hash(global_idf);
+    if (!global_vocab) {
+      fprintf(stderr, "Erro ao congelar vocabulário\n");
+      return 1;
+    }
+    if (!shards_ready)
+      vocab_save(global_vocab, filename_vocab);
+  }
+  hash_free(global_idf);
+  global_idf = NULL;
+  global_vocab_size = global_vocab->num_terms;
+
+  // Limites por termo e por bloco para a poda WAND/Block-Max WAND
+  if (global_index && !cfg.exhaustive &&
+      wand_build_bounds(global_index, global_doc_norms) != 0) {
+    fprintf(stderr, "Erro ao calcular limites do WAND\n");
+    return 1;
+  }
 
-    // Carregar stopwords se não estiverem carregadas
-    if (!global_stopwords) {
-      load_stopwords("assets/stopwords.txt");
-      if (!global_stopwords) {
-        fprintf(stderr, "Falha ao carregar stopwords para processar query\n");
-        return 1;
-      }
+  // Listas de campeões: gravadas junto do índice SPIMI, refeitas se ele mudar
+  if (cfg.champions) {
+    if (!global_index) {
+      fprintf(stderr, "--champions requer índice invertido (--spimi, "
+                      "--mapreduce ou --segments)\n");
+      return 1;
     }
+    char filename_champions[256];
+    snprintf(filename_champions, sizeof(filename_champions),
+             "models/champions_%s_%ld_%ld.bin", cfg.table, cfg.entries,
+             cfg.champions);
+    if (!cfg.segments && !file_is_stale(filename_champions, filename_postings))
+      global_champions = champion_load(filename_champions, global_index,
+                                       cfg.champions);
+    if (!global_champions) {
+      global_champions = champion_build(global_index, global_doc_norms,
+                                        cfg.champions);
+      if (global_champions && !cfg.segments)
+        champion_save(global_champions, filename_champions);
+    }
+    if (!global_champions) {
+      fprintf(stderr, "Erro ao construir listas de campeões\n");
+      return 1;
+    }
+  }
 
-    // Processar query (sem threads - é um vetor pequeno)
-    hash_t *query_tf;
-    double query_norm;
+  // Postings reagrupados por impacto quantizado para a consulta com prazo
+  if (cfg.impact) {
+    if (!global_index) {
+      fprintf(stderr, "--impact requer índice invertido (--spimi, "
+                      "--mapreduce ou --segments)\n");
+      return 1;
+    }
+    global_impact = impact_build(global_index, global_doc_norms);
+    if (!global_impact) {
+      fprintf(stderr, "Erro ao construir índice por impacto\n");
+      return 1;
+    }
+  }
 
-    int result = preprocess_query(cfg.query_user, global_idf, &query_tf, &query_norm);
-    if (result != 0) {
-      fprintf(stderr, "Erro ao processar consulta do usuário\n");
-    } else {
-      LOG(stdout, "Consulta processada com sucesso!\n");
-      LOG(stdout, "Norma da query: %.6f\n", query_norm);
-      LOG(stdout, "Tamanho do vetor TF-IDF da query: %zu palavras\n", hash_size(query_tf));
-
-      // DEBUG: Exibir palavras da query
-      if (VERBOSE) {
-          printf("Palavras na query (após processamento):\n");
-          for (size_t i = 0; i < query_tf->cap; i++) {
-            for (HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
-              printf("  '%s': TF-IDF=%.6f\n", e->word, e->value);
-            }
-          }
+  // Assinaturas SimHash gravadas ao lado das normas; faixas montadas na carga
+  if (cfg.lsh_bands) {
+    if (!global_tf || global_index) {
+      fprintf(stderr, "--lsh requer o modelo por documento (sem --spimi, "
+                      "--mapreduce, --segments ou shards já gravados)\n");
+      return 1;
+    }
+    int bits = cfg.lsh_bands * cfg.lsh_rows;
+    char filename_simhash[256];
+    snprintf(filename_simhash, sizeof(filename_simhash),
+             "models/simhash_%s_%ld_%d.bin", cfg.table, cfg.entries, bits);
+    if (!file_is_stale(filename_simhash, filename_tf))
+      global_simhash = simhash_load(filename_simhash, global_entries, bits);
+    if (!global_simhash) {
+      global_simhash = simhash_build(global_tf, global_entries, bits);
+      if (global_simhash)
+        simhash_save(global_simhash, filename_simhash);
+    }
+    if (!global_simhash ||
+        simhash_bands(global_simhash, cfg.lsh_bands, cfg.lsh_rows,
+                      global_doc_norms) != 0) {
+      fprintf(stderr, "Erro ao construir assinaturas SimHash\n");
+      return 1;
+    }
+  }
+
+  // Clusters gravados ao lado do modelo; refeitos se o TF/vocabulário mudar
+  if (cfg.kmeans) {
+    if (!global_tf || global_index) {
+      fprintf(stderr, "--kmeans requer o modelo por documento (sem --spimi, "
+                      "--mapreduce, --segments ou shards já gravados)\n");
+      return 1;
+    }
+    char filename_kmeans[256];
+    snprintf(filename_kmeans, sizeof(filename_kmeans),
+             "models/kmeans_%s_%ld_%d.bin", cfg.table, cfg.entries, cfg.kmeans);
+    if (!file_is_stale(filename_kmeans, filename_tf) &&
+        !file_is_stale(filename_kmeans, filename_vocab))
+      global_kmeans = kmeans_load(filename_kmeans, global_entries,
+                                  global_vocab, cfg.kmeans);
+    if (!global_kmeans) {
+      struct timespec t_start_km, t_end_km;
+      clock_gettime(CLOCK_MONOTONIC, &t_start_km);
+      global_kmeans = kmeans_build(global_tf, global_doc_norms, global_entries,
+                                   global_vocab, cfg.kmeans, cfg.nthreads);
+      clock_gettime(CLOCK_MONOTONIC, &t_end_km);
+      if (global_kmeans) {
+        printf("[K-MEANS] %d clusters em %.3f segundos\n",
+               global_kmeans->nclusters,
+               get_elapsed_time(&t_start_km, &t_end_km));
+        kmeans_save(global_kmeans, filename_kmeans);
       }
+    }
+    if (!global_kmeans) {
+      fprintf(stderr, "Erro ao agrupar documentos com k-means\n");
+      return 1;
+    }
+  }
 
-      // Calcular similaridade com todos os documentos
-      struct timespec t_start_sim, t_end_sim;
-      clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+  if (cfg.shards && !shards_ready) {
+    printf("\n[SHARD] Dividindo %ld documentos em %d shards...\n",
+           global_entries, cfg.shards);
+    if (shard_build(global_tf, global_doc_norms, global_entries,
+                    global_num_live, cfg.shards, cfg.table, cfg.entries) != 0) {
+      fprintf(stderr, "Erro ao salvar shards\n");
+      return 1;
+    }
+  }
 
-      double *similarities = compute_similarities(query_tf, query_norm, global_tf,
-                                                   global_doc_norms, global_entries, cfg.nthreads);
+  /* --------------- Junção por Similaridade --------------- */
 
-      clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
-      double elapsed_sim = get_elapsed_time(&t_start_sim, &t_end_sim);
+  if (cfg.allpairs >= 0.0) {
+    if (!global_index && !global_tf) {
+      fprintf(stderr, "--allpairs requer o modelo por documento ou índice "
+                      "invertido carregado\n");
+      return 1;
+    }
+    char filename_pairs[256];
+    if (cfg.allpairs_out)
+      snprintf(filename_pairs, sizeof(filename_pairs), "%s", cfg.allpairs_out);
+    else
+      snprintf(filename_pairs, sizeof(filename_pairs),
+               "models/allpairs_%s.tsv", cfg.table);
+
+    struct timespec t_start_ap, t_end_ap;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_ap);
+    allpairs_stats ap_stats;
+    if (allpairs_join(global_index, global_tf, global_vocab, global_doc_norms,
+                      global_entries, cfg.allpairs, cfg.allpairs_top,
+                      cfg.nthreads, filename_pairs, &ap_stats) != 0) {
+      fprintf(stderr, "Erro na junção por similaridade\n");
+      return 1;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t_end_ap);
+    printf("\n[ALLPAIRS] %ld %s (cosseno >= %.3f) em %.3f segundos -> %s\n",
+           ap_stats.pairs, cfg.allpairs_top ? "vizinhos" : "pares",
+           cfg.allpairs, get_elapsed_time(&t_start_ap, &t_end_ap),
+           filename_pairs);
+    printf("[ALLPAIRS] %ld de %ld postings indexados, %ld candidatos, "
+           "%ld verificados\n",
+           ap_stats.indexed, ap_stats.nnz, ap_stats.candidates,
+           ap_stats.verified);
+  }
 
-      if (!similarities) {
-        fprintf(stderr, "Erro ao calcular similaridades\n");
-        return 1;
-      }
-      printf("\n[SIMILARIDADE] Tempo: %.3f segundos\n", elapsed_sim);
-
-      // Encontrar os top-k documentos mais similares
-      // Criar array de índices
-      DocSim *scores = (DocSim *)malloc(global_entries * sizeof(DocSim));
-      if (scores) {
-        for (long int i = 0; i < global_entries; i++) {
-          scores[i].doc_id = i;
-          scores[i].similarity = similarities[i];
-        }
+  /* --------------- Consulta do Usuário --------------- */
 
-        qsort(scores, global_entries, sizeof(DocSim), compare_sim);
-
-        // Exibir top-k
-        long int top_k = global_entries < cfg.k ? global_entries : cfg.k;
-        // Buscar o corpus dos top-k documentos
-        printf("\nTop %ld documentos mais similares:\n", top_k);
-        printf("---------------------------------\n");
-        long int *top_ids = (long int *)malloc(top_k * sizeof(long int));
-        if (top_ids) {
-          for (long int i = 0; i < top_k; i++) {
-            top_ids[i] = scores[i].doc_id;
-          }
-
-          char **documents = get_documents_by_ids(cfg.db, cfg.table, top_ids, top_k);
-          if (documents) {
-            for (long int i = 0; i < top_k; i++) {
-              if (documents[i]) {
-                printf("[%ld] %.6f  ",
-                       top_ids[i], scores[i].similarity);
-                // Limitar a exibição a 200 caracteres
-                if (strlen(documents[i]) > 100) {
-		  const char *p = documents[i];
-		  int j = 0;
-		  for (; *p && j < 100; ++j, p++)
-		    putchar(*p);
-		  if (*p) printf("...");
-		  printf("\n");
-                } else {
-                  printf("%s\n", documents[i]);
-                }
-                free(documents[i]);
-              }
-            }
-            free(documents);
-          }
-          free(top_ids);
-        }
+  // Carregar stopwords se não estiverem carregadas
+  if ((cfg.query_user || cfg.queries_file) && !global_stopwords) {
+    load_stopwords("assets/stopwords.txt");
+    if (!global_stopwords) {
+      fprintf(stderr, "Falha ao carregar stopwords para processar query\n");
+      return 1;
+    }
+  }
 
-        free(scores);
-      }
+  // Textos do top-k vêm do armazém mapeado, reconstruído se o banco mudou
+  if (cfg.query_user || cfg.queries_file) {
+    char filename_docs[256];
+    snprintf(filename_docs, sizeof(filename_docs), "models/docstore_%s.bin",
+             cfg.table);
+    if (docstore_is_stale(filename_docs, cfg.db)) {
+      printf("Construindo armazém de documentos %s...\n", filename_docs);
+      if (docstore_build(cfg.db, cfg.table, filename_docs) != 0)
+        fprintf(stderr, "Aviso: textos do top-k serão lidos do SQLite\n");
+    }
+    global_docs = docstore_open(filename_docs);
+  }
+
+  // Filtro de documentos: bitmap comprimido pronto antes da primeira consulta
+  if ((cfg.filter_ids || cfg.filter_sql) && (cfg.query_user || cfg.queries_file)) {
+    if (global_champions || global_impact || global_simhash || global_kmeans ||
+        cfg.shards) {
+      fprintf(stderr, "--filter_ids/--filter_sql não se aplicam a --champions, "
+                      "--impact, --lsh, --kmeans ou --shards\n");
+      return 1;
+    }
+    global_filter = build_filter(&cfg);
+    if (!global_filter)
+      return 1;
+  }
 
-      free(similarities);
+  // Completações do prefixo pedido, antes das consultas
+  if (cfg.complete && print_completions(&cfg) != 0)
+    return 1;
 
-      // Liberar hash da query
-      hash_free(query_tf);
+  // Scatter-gather: os processos de shard atendem todas as consultas
+  shard_cluster *cluster = NULL;
+  if (cfg.shards && (cfg.query_user || cfg.queries_file)) {
+    cluster = shard_cluster_start(cfg.table, cfg.entries, cfg.shards,
+                                  cfg.shard_dir);
+    if (!cluster) {
+      fprintf(stderr, "Erro ao iniciar os processos de shard\n");
+      return 1;
+    }
+  }
+
+  if (cfg.queries_file) {
+    // Várias consultas no mesmo processo, com cache de resultados e termos
+    const char *model_files[] = {filename_tf, filename_idf, filename_doc_norms,
+                                 filename_postings, filename_manifest};
+    qcache_t *cache = qcache_new(cfg.cache_entries, cfg.cache_bytes,
+                                 model_version(model_files, 5));
+    FILE *fp = fopen(cfg.queries_file, "r");
+    if (!cache || !fp) {
+      fprintf(stderr, "Erro ao abrir arquivo de consultas %s\n", cfg.queries_file);
+      qcache_free(cache);
+      if (fp)
+        fclose(fp);
+      shard_cluster_stop(cluster);
+      return 1;
     }
+
+    // Modelo por documento: consultas agrupadas em lotes de uma passada
+    int batch = (cfg.batch_queries > 1 && !global_index && !cluster &&
+                 !global_simhash && !global_kmeans && !global_filter)
+                    ? (int)cfg.batch_queries
+                    : 0;
+    if (cfg.batch_queries > 1 && !batch)
+      printf("Aviso: --batch_queries só se aplica ao modelo por documento "
+             "sem filtro\n");
+    char **pending = batch ? malloc(batch * sizeof(char *)) : NULL;
+    int npending = 0;
+
+    char *line = NULL;
+    size_t line_cap = 0;
+    ssize_t len;
+    int rc = (batch && !pending) ? -1 : 0;
+    while (rc == 0 && (len = getline(&line, &line_cap, fp)) != -1) {
+      while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
+        line[--len] = '\0';
+      if (len == 0)
+        continue;
+      if (pending && query_has_operators(line)) {
+        // Consultas com +termo/-termo não entram no lote
+        if (npending > 0)
+          rc = answer_batch(&cfg, pending, npending);
+        while (npending > 0)
+          free(pending[--npending]);
+        if (rc != 0)
+          break;
+      } else if (pending) {
+        pending[npending++] = strdup(line);
+        if (npending == batch) {
+          rc = answer_batch(&cfg, pending, npending);
+          while (npending > 0)
+            free(pending[--npending]);
+        }
+        continue;
+      }
+      printf("\n[CONSULTA] %s\n", line);
+      rc = answer_query(&cfg, line, cluster, cache);
+    }
+    if (pending) {
+      if (rc == 0 && npending > 0)
+        rc = answer_batch(&cfg, pending, npending);
+      while (npending > 0)
+        free(pending[--npending]);
+      free(pending);
+    }
+    free(line);
+    fclose(fp);
+
+    printf("\n");
+    qcache_report(cache, stdout);
+    if (global_champions)
+      champion_report(global_champions, stdout);
+    if (global_impact)
+      impact_report(global_impact, stdout);
+    if (global_simhash)
+      simhash_report(global_simhash, stdout);
+    if (global_kmeans)
+      kmeans_report(global_kmeans, stdout);
+    qcache_free(cache);
+    if (rc != 0) {
+      shard_cluster_stop(cluster);
+      return 1;
+    }
+  } else if (cfg.query_user) {
+    if (answer_query(&cfg, cfg.query_user, cluster, NULL) != 0) {
+      shard_cluster_stop(cluster);
+      return 1;
+    }
+    if (global_champions)
+      champion_report(global_champions, stdout);
+    if (global_impact)
+      impact_report(global_impact, stdout);
+    if (global_simhash)
+      simhash_report(global_simhash, stdout);
+    if (global_kmeans)
+      kmeans_report(global_kmeans, stdout);
   } else {
     printf("Nenhuma consulta fornecida\n");
   }
+  shard_cluster_stop(cluster);
 
   // Impressão das palavras com IDF (primeiras 5 entradas)
   if (VERBOSE) {
     printf("\nTop 5 palavras (IDF):\n");
     printf("---------------------\n");
-    for (size_t i = 0, c = 0; i < global_idf->cap && c < 5; i++)
-      for (HashEntry *e = global_idf->buckets[i]; e && c < 5; e = e->next, c++)
-        printf("%-15s %.2f\n", e->word, e->value);
+    for (long int id = 0; id < global_vocab->num_terms && id < 5; id++)
+      printf("%-15s %.2f\n", vocab_word(global_vocab, id),
+             vocab_idf(global_vocab, id));
+  }
+
+  if (merge_started) {
+    void *ret_val;
+    pthread_join(merge_tid, &ret_val);
+    long int merges = (long int)ret_val;
+    if (merges < 0)
+      fprintf(stderr, "Erro no merge de segmentos\n");
+    else if (merges > 0)
+      printf("\n[SEGMENTOS] %ld merges em segundo plano concluídos\n", merges);
   }
 
   // Liberar todas as estruturas globais
@@ -504,12 +1249,24 @@ int main(int argc, char *argv[]) {
     free(global_tf);
   }
   LOG(stderr, "DEBUG: global_tf liberado");
-  if (global_idf)
-    hash_free(global_idf);
+  champion_free(global_champions);
+  impact_free(global_impact);
+  simhash_free(global_simhash);
+  kmeans_free(global_kmeans);
+  index_free(global_index);
+  vocab_free(global_vocab);
+  docstore_close(global_docs);
+  roaring_free(global_filter);
+  lexicon_free(global_lexicon);
 
   // Liberar normas
-  if (global_doc_norms)
+  if (global_doc_norms) {
+    mem_track_free(MEM_NORMS, global_entries * sizeof(double));
     free(global_doc_norms);
+  }
+
+  if (cfg.mem_stats || VERBOSE)
+    mem_report(stdout);
 
   clock_gettime(CLOCK_MONOTONIC, &t_end_total);
   double elapsed_total = get_elapsed_time(&t_start_total, &t_end_total);
@@ -525,15 +1282,55 @@ int main(int argc, char *argv[]) {
  * a estrutura Config fornecida.
  *
  * Parâmetros suportados:
- * - --nthreads: Número de threads
- * - --entries: Quantidade de documentos a processar
+ * - --nthreads: Número de threads (default: CPUs da máscara de afinidade)
+ * - --no_pin: Não fixa os workers em CPUs
+ * - --entries: Quantidade de documentos a processar (article_id < entries)
  * - --db: Arquivo SQLite
- * - --query_user: Query direta do usuário
+ * - --query_user: Query direta do usuário (+termo obrigatório, -termo
+ *   proibido, termo* curinga)
  * - --query_filename: Arquivo contendo query
  * - --table: Nome da tabela no banco
  * - --k: Top-k documentos a retornar
  * - --test: Modo de teste
  * - --verbose: Ativa modo verboso
+ * - --batch_size: Documentos por lote na FASE 1
+ * - --memory_budget: Orçamento de memória (reduz lotes ou aborta)
+ * - --mem_stats: Relatório de memória por categoria
+ * - --checkpoint: Checkpoints da FASE 1 para retomar construções interrompidas
+ * - --token_cache: Grava os tokens processados para as próximas construções
+ * - --spimi: Indexação SPIMI (índice invertido em disco)
+ * - --spimi_block: Limite do bloco SPIMI por thread
+ * - --spimi_dir: Diretório temporário do SPIMI
+ * - --shards: Número de shards por intervalo de documentos
+ * - --shard_dir: Diretório dos sockets dos shards
+ * - --shard_serve: Servidor avulso de um shard
+ * - --shard_socket: Socket do servidor avulso
+ * - --mapreduce: Indexação com processos map/reduce
+ * - --mappers / --reducers: Número de processos de cada etapa
+ * - --mr_role / --mr_id: Executa uma única etapa do map/reduce
+ * - --segments: Índice incremental em segmentos imutáveis
+ * - --merge_factor: Política de merge em camadas dos segmentos
+ * - --delete_ids / --update_ids: Remoções e atualizações nos segmentos
+ * - --compact_ratio: Fração de removidos que dispara a compactação
+ * - --queries: Arquivo com várias consultas (uma por linha), com cache
+ * - --cache_entries / --cache_bytes: Limites do cache de consultas
+ * - --snippets: Exibe trechos em torno dos termos da consulta
+ * - --exhaustive: Desliga a poda WAND/Block-Max WAND do índice invertido
+ * - --champions: Consulta primeiro as listas de campeões (r documentos/termo)
+ * - --champion_fallback: Limiar de score dos candidatos ou "exact"
+ * - --impact: Consulta score-at-a-time no índice ordenado por impacto
+ * - --budget_us: Prazo por consulta em µs (implica --impact)
+ * - --batch_queries: Consultas de --queries pontuadas juntas por passada
+ * - --lsh: Candidatos por LSH sobre assinaturas SimHash (faixas x linhas)
+ * - --lsh_rerank: Candidatos mais próximos em Hamming com cosseno exato
+ * - --kmeans: Agrupa os documentos em C clusters (k-means esférico)
+ * - --nprobe: Clusters sondados por consulta com --kmeans
+ * - --allpairs: Grava todos os pares de documentos com cosseno >= τ
+ * - --allpairs_top: Grava os m vizinhos de cada documento (cosseno >= τ)
+ * - --allpairs_out: Arquivo de saída da junção
+ * - --filter_ids: Restringe as consultas a intervalos de article_id
+ * - --filter_sql: Restringe as consultas a um predicado SQL da tabela
+ * - --complete: Lista os termos mais frequentes com o prefixo
  *
  * @param argc Número de argumentos
  * @param argv Array de argumentos
@@ -550,6 +1347,8 @@ int parse_cli(int argc, char **argv, Config *cfg) {
 
     if (strcmp(argv[i], "--nthreads") == 0 && i + 1 < argc) 
       cfg->nthreads = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--no_pin") == 0)
+      cfg->no_pin = 1;
     else if (strcmp(argv[i], "--entries") == 0 && i + 1 < argc) 
       cfg->entries = atol(argv[++i]);
     else if (strcmp(argv[i], "--db") == 0 && i + 1 < argc) 
@@ -566,20 +1365,223 @@ int parse_cli(int argc, char **argv, Config *cfg) {
       cfg->test = atoi(argv[++i]);
     else if (strcmp(argv[i], "--verbose") == 0)
       cfg->verbose = 1;
+    else if (strcmp(argv[i], "--batch_size") == 0 && i + 1 < argc)
+      cfg->batch_size = atol(argv[++i]);
+    else if (strcmp(argv[i], "--memory_budget") == 0 && i + 1 < argc) {
+      cfg->memory_budget = mem_parse_size(argv[++i]);
+      if (!cfg->memory_budget) {
+        fprintf(stderr, "Orçamento de memória inválido: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--mem_stats") == 0)
+      cfg->mem_stats = 1;
+    else if (strcmp(argv[i], "--checkpoint") == 0)
+      cfg->checkpoint = 1;
+    else if (strcmp(argv[i], "--token_cache") == 0)
+      cfg->token_cache = 1;
+    else if (strcmp(argv[i], "--spimi") == 0)
+      cfg->spimi = 1;
+    else if (strcmp(argv[i], "--spimi_block") == 0 && i + 1 < argc) {
+      cfg->spimi_block = mem_parse_size(argv[++i]);
+      if (!cfg->spimi_block) {
+        fprintf(stderr, "Tamanho de bloco SPIMI inválido: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--spimi_dir") == 0 && i + 1 < argc)
+      cfg->spimi_dir = argv[++i];
+    else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc)
+      cfg->shards = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--shard_dir") == 0 && i + 1 < argc)
+      cfg->shard_dir = argv[++i];
+    else if (strcmp(argv[i], "--shard_serve") == 0 && i + 1 < argc)
+      cfg->shard_serve = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--shard_socket") == 0 && i + 1 < argc)
+      cfg->shard_socket = argv[++i];
+    else if (strcmp(argv[i], "--mapreduce") == 0)
+      cfg->mapreduce = 1;
+    else if (strcmp(argv[i], "--mappers") == 0 && i + 1 < argc)
+      cfg->mappers = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--reducers") == 0 && i + 1 < argc)
+      cfg->reducers = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--mr_role") == 0 && i + 1 < argc)
+      cfg->mr_role = argv[++i];
+    else if (strcmp(argv[i], "--mr_id") == 0 && i + 1 < argc)
+      cfg->mr_id = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--segments") == 0)
+      cfg->segments = 1;
+    else if (strcmp(argv[i], "--merge_factor") == 0 && i + 1 < argc)
+      cfg->merge_factor = atoi(argv[++i]);
+    else if (strcmp(argv[i], "--delete_ids") == 0 && i + 1 < argc)
+      cfg->delete_ids = argv[++i];
+    else if (strcmp(argv[i], "--update_ids") == 0 && i + 1 < argc)
+      cfg->update_ids = argv[++i];
+    else if (strcmp(argv[i], "--compact_ratio") == 0 && i + 1 < argc)
+      cfg->compact_ratio = atof(argv[++i]);
+    else if (strcmp(argv[i], "--queries") == 0 && i + 1 < argc)
+      cfg->queries_file = argv[++i];
+    else if (strcmp(argv[i], "--snippets") == 0)
+      cfg->snippets = 1;
+    else if (strcmp(argv[i], "--exhaustive") == 0)
+      cfg->exhaustive = 1;
+    else if (strcmp(argv[i], "--champions") == 0 && i + 1 < argc) {
+      cfg->champions = atol(argv[++i]);
+      if (cfg->champions <= 0) {
+        fprintf(stderr, "Tamanho inválido das listas de campeões: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--champion_fallback") == 0 && i + 1 < argc) {
+      if (strcmp(argv[++i], "exact") == 0)
+        cfg->champion_exact = 1;
+      else
+        cfg->champion_min = atof(argv[i]);
+    }
+    else if (strcmp(argv[i], "--impact") == 0)
+      cfg->impact = 1;
+    else if (strcmp(argv[i], "--budget_us") == 0 && i + 1 < argc) {
+      cfg->budget_us = atol(argv[++i]);
+      if (cfg->budget_us <= 0) {
+        fprintf(stderr, "Prazo inválido: %s\n", argv[i]);
+        return 1;
+      }
+      cfg->impact = 1;
+    }
+    else if (strcmp(argv[i], "--batch_queries") == 0 && i + 1 < argc)
+      cfg->batch_queries = atol(argv[++i]);
+    else if (strcmp(argv[i], "--lsh") == 0 && i + 1 < argc) {
+      if (sscanf(argv[++i], "%dx%d", &cfg->lsh_bands, &cfg->lsh_rows) != 2 ||
+          cfg->lsh_bands <= 0 || cfg->lsh_rows <= 0 || cfg->lsh_rows > 64 ||
+          cfg->lsh_bands * cfg->lsh_rows > SIMHASH_MAX_BITS) {
+        fprintf(stderr, "Faixas LSH inválidas: %s (use BxR, B*R <= %d)\n",
+                argv[i], SIMHASH_MAX_BITS);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--lsh_rerank") == 0 && i + 1 < argc)
+      cfg->lsh_rerank = atol(argv[++i]);
+    else if (strcmp(argv[i], "--kmeans") == 0 && i + 1 < argc) {
+      cfg->kmeans = atoi(argv[++i]);
+      if (cfg->kmeans <= 0) {
+        fprintf(stderr, "Número inválido de clusters: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--allpairs") == 0 && i + 1 < argc) {
+      cfg->allpairs = atof(argv[++i]);
+      if (cfg->allpairs <= 0.0 || cfg->allpairs > 1.0) {
+        fprintf(stderr, "Limiar inválido da junção (0 < τ <= 1): %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--allpairs_top") == 0 && i + 1 < argc) {
+      cfg->allpairs_top = atoi(argv[++i]);
+      if (cfg->allpairs_top <= 0) {
+        fprintf(stderr, "Número inválido de vizinhos: %s\n", argv[i]);
+        return 1;
+      }
+      if (cfg->allpairs < 0.0)
+        cfg->allpairs = 0.0;
+    }
+    else if (strcmp(argv[i], "--allpairs_out") == 0 && i + 1 < argc)
+      cfg->allpairs_out = argv[++i];
+    else if (strcmp(argv[i], "--filter_ids") == 0 && i + 1 < argc)
+      cfg->filter_ids = argv[++i];
+    else if (strcmp(argv[i], "--filter_sql") == 0 && i + 1 < argc)
+      cfg->filter_sql = argv[++i];
+    else if (strcmp(argv[i], "--complete") == 0 && i + 1 < argc)
+      cfg->complete = argv[++i];
+    else if (strcmp(argv[i], "--nprobe") == 0 && i + 1 < argc) {
+      cfg->nprobe = atoi(argv[++i]);
+      if (cfg->nprobe <= 0) {
+        fprintf(stderr, "Número inválido de clusters sondados: %s\n", argv[i]);
+        return 1;
+      }
+    }
+    else if (strcmp(argv[i], "--cache_entries") == 0 && i + 1 < argc)
+      cfg->cache_entries = atol(argv[++i]);
+    else if (strcmp(argv[i], "--cache_bytes") == 0 && i + 1 < argc) {
+      cfg->cache_bytes = mem_parse_size(argv[++i]);
+      if (!cfg->cache_bytes) {
+        fprintf(stderr, "Tamanho de cache inválido: %s\n", argv[i]);
+        return 1;
+      }
+    }
     else {
       fprintf(stderr,
         "Uso: %s <parametros nomeados>\n"
         "--verbose: Verbosidade (default: 0)\n"
-        "--nthreads: Número de threads (default: 4)\n"
-        "--entries: Quantidade de entradas para pré-processamento (default: "
-        "Toda tabela 'sample_articles')\n"
+        "--nthreads: Número de threads (default: CPUs disponíveis)\n"
+        "--no_pin: Não fixa as threads de trabalho em CPUs\n"
+        "--entries: Quantidade de entradas para pré-processamento, isto é, "
+        "article_ids em [0, entries) (default: toda a tabela)\n"
         "--db: Nome do arquivo Sqlite (default: './data/wiki-small.db')\n"
-        "--query_user: Consulta do usuário (default: 'shakespeare english literature')\n"
+        "--query_user: Consulta do usuário (default: 'shakespeare english literature'); "
+        "+termo é obrigatório, -termo proibido e termo* vira os termos de "
+        "maior df com o prefixo, ex.: '+whale migra* -shark'\n"
         "--query_filename: Arquivo com a consulta do usuário\n"
         "--table: Nome da tabela consultada (default: "
         "'sample_articles')\n"
         "--k: Top-k documentos mais similares (default: 10)\n"
-        "--test: Modo de teste (default: 0)\n",
+        "--test: Modo de teste (default: 0)\n"
+        "--batch_size: Documentos por lote na FASE 1 (default: 4096)\n"
+        "--memory_budget: Orçamento de memória, ex.: 512M, 4G (default: sem limite)\n"
+        "--mem_stats: Exibe consumo de memória por categoria e pico de RSS\n"
+        "--checkpoint: Grava checkpoints por lote da FASE 1; uma construção "
+        "interrompida é retomada a partir deles\n"
+        "--token_cache: Grava os tokens de cada documento (ids em varint) em "
+        "models/tokens_<tabela>.bin; construções seguintes leem dali\n"
+        "--spimi: Constrói índice invertido fora da memória (SPIMI)\n"
+        "--spimi_block: Limite de memória do bloco SPIMI por thread, ex.: 256M\n"
+        "--spimi_dir: Diretório temporário dos runs (default: models/spimi_tmp)\n"
+        "--shards: Divide o modelo em N shards e consulta via processos (default: 0)\n"
+        "--shard_dir: Diretório dos sockets Unix dos shards (default: /tmp)\n"
+        "--shard_serve: Apenas serve o shard indicado (requer --shard_socket)\n"
+        "--shard_socket: Caminho do socket Unix do servidor de shard\n"
+        "--mapreduce: Constrói o índice invertido com processos map/reduce\n"
+        "--mappers: Processos map (default: nthreads)\n"
+        "--reducers: Processos reduce / partições de termos (default: nthreads)\n"
+        "--mr_role: Executa só uma etapa: map, reduce ou finalize (com --mr_id)\n"
+        "--mr_id: Índice do mapper/reducer da etapa\n"
+        "--segments: Índice incremental (indexa só linhas novas em segmentos)\n"
+        "--merge_factor: Segmentos por camada antes do merge (default: 10, 0=nunca)\n"
+        "--delete_ids: Remove documentos do índice em segmentos, ex.: 3,17,42\n"
+        "--update_ids: Reindexa documentos alterados no índice em segmentos\n"
+        "--compact_ratio: Fração de removidos que dispara compactação (default: 0.2)\n"
+        "--queries: Arquivo com uma consulta por linha (usa cache de consultas)\n"
+        "--cache_entries: Resultados guardados no cache (default: 1024)\n"
+        "--cache_bytes: Limite do cache de termos, ex.: 64M (default: 64M)\n"
+        "--snippets: Exibe o trecho com os termos da consulta em vez do início\n"
+        "--exhaustive: Pontua todos os documentos do índice (desliga WAND)\n"
+        "--champions: Responde pelas listas de campeões com r documentos por "
+        "termo (requer índice invertido)\n"
+        "--champion_fallback: Limiar de score para evitar o fallback, ou "
+        "'exact' para top-k sempre exato (default: 0)\n"
+        "--impact: Consulta score-at-a-time no índice ordenado por impacto "
+        "(requer índice invertido)\n"
+        "--budget_us: Prazo por consulta em µs; ao estourar devolve o top-k "
+        "parcial (implica --impact)\n"
+        "--batch_queries: Pontua N consultas de --queries por passada nos "
+        "documentos (modelo por documento)\n"
+        "--lsh: Top-k aproximado por LSH em assinaturas SimHash, ex.: 16x8 "
+        "(faixas x linhas; modelo por documento)\n"
+        "--lsh_rerank: Candidatos mais próximos em Hamming com cosseno exato "
+        "(default: 1000, 0=todos)\n"
+        "--kmeans: Agrupa os documentos em C clusters (k-means esférico) e "
+        "consulta só os mais próximos (modelo por documento)\n"
+        "--nprobe: Clusters sondados por consulta com --kmeans (default: 4)\n"
+        "--allpairs: Grava todos os pares de documentos com cosseno >= τ\n"
+        "--allpairs_top: Grava os m vizinhos de cada documento (com "
+        "--allpairs, só os de cosseno >= τ)\n"
+        "--allpairs_out: Arquivo da junção (default: "
+        "models/allpairs_<tabela>.tsv)\n"
+        "--filter_ids: Consulta só os article_ids dos intervalos, ex.: "
+        "0-999,5000,7000-7999\n"
+        "--filter_sql: Consulta só os documentos que satisfazem o predicado "
+        "SQL (avaliado uma vez e guardado em models/)\n"
+        "--complete: Lista os k termos de maior df que começam com o prefixo "
+        "(dicionário ordenado em models/)\n",
         argv[0]);
       return 1;
     }
@@ -590,75 +1592,139 @@ int parse_cli(int argc, char **argv, Config *cfg) {
 /**
  * @brief FASE 1: Construir vocabulário e TF local
  *
- * Pipeline:
- * 1. Extrair textos do SQLite
- * 2. Tokenizar
+ * O intervalo da thread é processado em lotes de t->batch documentos, de
+ * modo que apenas os textos e tokens de um lote fiquem vivos por vez.
+ *
+ * As hashes TF do intervalo são criadas pela própria thread, para que a
+ * memória de cada documento fique no nó NUMA do worker que o processa.
+ *
+ * Pipeline (por lote):
+ * 1-2. Extrair textos do SQLite (conexão própria da thread) e tokenizar
  * 3. Remover stopwords
  * 4. Stemming
  * 5. Popular TF local (global_tf)
  * 6. Popular vocabulário local (IDF)
+ * 7. Gravar checkpoint do lote (com --checkpoint)
+ *
+ * Com checkpoints, um lote já gravado por uma execução interrompida é
+ * restaurado do disco em vez de passar pelos passos 1-6. Com um cache de
+ * tokens válido, os passos 1-4 são substituídos pela leitura dos ids.
  *
  * @param arg Ponteiro para thread_args
- * @return IDF local (hash_t*) para merge posterior no thread principal
+ * @return IDF local (hash_t*) para merge posterior no thread principal, ou
+ *         NULL (intervalo vazio ou erro, com t->failed marcado)
  */
 void *preprocess_1(void *arg) {
   thread_args *t = (thread_args *)arg;
   long int count = t->end - t->start;
 
-  LOG(stdout, "[FASE 1] T%02ld: Processando %ld documentos [%ld, %ld]",
-      t->id, count, t->start, t->end - 1);
+  LOG(stdout, "[FASE 1] T%02ld: Processando %ld documentos [%ld, %ld] (lotes de %ld)",
+      t->id, count, t->start, t->end - 1, t->batch);
 
   if (count <= 0) {
     pthread_exit(NULL);
   }
 
+  // Hashes TF do intervalo criadas aqui: a memória fica no nó desta thread
+  for (long int i = t->start; i < t->end; i++) {
+    global_tf[i] = hash_new();
+    if (!global_tf[i]) {
+      fprintf(stderr, "Falha ao alocar hash TF para documento %ld\n", i);
+      t->failed = 1;
+      pthread_exit(NULL);
+    }
+  }
+
+  db_reader *reader = NULL;
   hash_t *idf = hash_new();
 
-  // [1] Recuperar textos
-  char **article_texts = get_str_arr(t->db,
-                                      "select article_text from \"%w\" "
-                                      "where article_id between ? and ? "
-                                      "order by article_id asc",
-                                      t->start, t->end - 1, t->table);
-  if (!article_texts) {
-    fprintf(stderr, "Thread %02ld: Erro ao obter dados do banco\n", t->id);
-    pthread_exit(NULL);
-  }
+  // Lotes alinhados a múltiplos de t->batch: os mesmos intervalos (e
+  // checkpoints) para qualquer número de threads
+  for (long int lo = t->start, hi; lo < t->end; lo = hi) {
+    hi = (lo / t->batch + 1) * t->batch;
+    if (hi > t->end)
+      hi = t->end;
+    long int n = hi - lo;
+
+    if (t->checkpoint &&
+        ckpt_load_chunk(t->table, global_entries, global_tf, lo, hi, idf) == 0) {
+      t->resumed++;
+      // Sem os tokens do lote, o cache de tokens fica incompleto
+      if (t->token_writer)
+        t->token_writer->failed = 1;
+      continue;
+    }
 
-  // [2] Tokenizar
-  LOG(stdout, "[FASE 1] T%02ld: Tokenizando textos..", t->id);
-  char ***article_vecs = tokenize(article_texts, count);
-  if (!article_vecs) {
-    fprintf(stderr, "Thread %02ld: Erro ao tokenizar\n", t->id);
-    pthread_exit(NULL);
-  }
+    // Tokens já processados por uma construção anterior
+    if (t->tokens) {
+      for (long int d = lo; d < hi; d++)
+        if (tokcache_doc(t->tokens, d, global_tf[d], idf) < 0) {
+          fprintf(stderr, "Thread %02ld: Cache de tokens corrompido (doc %ld)\n",
+                  t->id, d);
+          hash_free(idf);
+          t->failed = 1;
+          pthread_exit(NULL);
+        }
+      if (t->checkpoint &&
+          ckpt_save_chunk(t->table, global_entries, global_tf, lo, hi) != 0)
+        fprintf(stderr, "Thread %02ld: Erro ao gravar checkpoint [%ld, %ld)\n",
+                t->id, lo, hi);
+      continue;
+    }
 
-  // [3] Remover stopwords
-  LOG(stdout, "[FASE 1] T%02ld: Removendo stopwords..", t->id);
-  remove_stopwords(article_vecs, count);
+    // Conexão aberta só quando algum lote precisa dos textos
+    if (!reader && !(reader = db_reader_open(t->db, t->table))) {
+      fprintf(stderr, "Thread %02ld: Erro ao abrir o banco\n", t->id);
+      hash_free(idf);
+      t->failed = 1;
+      pthread_exit(NULL);
+    }
 
-  // [4] Stemming
-  LOG(stdout, "[FASE 1] T%02ld: Stemming..", t->id);
-  stem(article_vecs, count);
+    // [1-2] Recuperar e tokenizar os textos do lote
+    LOG(stdout, "[FASE 1] T%02ld: Tokenizando textos [%ld, %ld]..", t->id, lo, hi - 1);
+    char ***article_vecs = db_reader_tokenize_range(reader, lo, hi - 1);
+    if (!article_vecs) {
+      fprintf(stderr, "Thread %02ld: Erro ao obter dados do banco\n", t->id);
+      db_reader_close(reader);
+      hash_free(idf);
+      t->failed = 1;
+      pthread_exit(NULL);
+    }
 
-  // [5] Popular TF local
-  LOG(stdout, "[FASE 1] T%02ld: Populando hash TF..", t->id);
-  populate_tf_hash(global_tf, article_vecs, count, t->start);
+    // [3] Remover stopwords
+    LOG(stdout, "[FASE 1] T%02ld: Removendo stopwords..", t->id);
+    remove_stopwords(article_vecs, n);
 
-  // [6] Popular vocabulário local
-  LOG(stdout, "[FASE 1] T%02ld: Populando vocabulário..", t->id);
-  set_idf_words(idf, article_vecs, count);
+    // [4] Stemming
+    LOG(stdout, "[FASE 1] T%02ld: Stemming..", t->id);
+    stem(article_vecs, n);
 
-  LOG(stdout, "[FASE 1] T%02ld: Concluída", t->id);
+    // Tokens finais para o cache de tokens (--token_cache)
+    if (t->token_writer)
+      for (long int i = 0; i < n; i++)
+        tokcache_writer_add(t->token_writer, article_vecs[i]);
+
+    // [5] Popular TF local
+    LOG(stdout, "[FASE 1] T%02ld: Populando hash TF..", t->id);
+    populate_tf_hash(global_tf, article_vecs, n, lo);
+
+    // [6] Popular vocabulário local
+    LOG(stdout, "[FASE 1] T%02ld: Populando vocabulário..", t->id);
+    set_idf_words(idf, article_vecs, n);
+
+    free_article_vecs(article_vecs, n);
 
-  // Limpar memória local
-  for (long int i = 0; i < count; i++) {
-    if (article_texts[i]) free(article_texts[i]);
+    // [7] Checkpoint do lote (contagens; o vocabulário sai delas)
+    if (t->checkpoint &&
+        ckpt_save_chunk(t->table, global_entries, global_tf, lo, hi) != 0)
+      fprintf(stderr, "Thread %02ld: Erro ao gravar checkpoint [%ld, %ld)\n",
+              t->id, lo, hi);
   }
+  if (reader)
+    db_reader_close(reader);
 
-  free(article_texts);
-  free_article_vecs(article_vecs, count);
-  // free(tf);  // Ponteiros movidos para global_tf
+  LOG(stdout, "[FASE 1] T%02ld: Concluída", t->id);
+  mem_flush();
 
   // Retornar IDF local para merge no thread principal
   pthread_exit((void *)idf);
@@ -685,15 +1751,464 @@ void *preprocess_2(void *arg) {
   }
 
   // [1] Converter TF para TF-IDF usando IDF global
-  compute_tf_idf(global_tf, global_idf, count, t->start);
+  compute_tf_idf(global_tf, global_vocab, count, t->start);
 
   // [2] Calcular normas dos documentos
   compute_doc_norms(global_doc_norms, global_tf, count, global_vocab_size, t->start);
 
   LOG(stdout, "[FASE 2] T%02ld: Concluída", t->id);
+  mem_flush();
   pthread_exit(NULL);
 }
 
+/**
+ * @brief Merge em camadas dos segmentos em segundo plano
+ *
+ * @param arg Ponteiro para Config
+ * @return Número de merges realizados (-1 em erro)
+ */
+void *segment_merge_thread(void *arg) {
+  const Config *cfg = (const Config *)arg;
+  long int merges = segment_merge(cfg->table, cfg->merge_factor);
+  mem_flush();
+  return (void *)merges;
+}
+
+/**
+ * @brief Responde um lote de consultas com uma passada pelos documentos
+ *
+ * Usado com --queries e --batch_queries no modelo por documento; o cache
+ * de consultas não participa (o lote inteiro é pontuado de uma vez).
+ *
+ * @param cfg Configuração (k, threads)
+ * @param queries Textos das consultas
+ * @param n Número de consultas
+ * @return 0 em sucesso, -1 em erro
+ */
+int answer_batch(const Config *cfg, char **queries, int n) {
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+
+  long int top_k = global_entries < cfg->k ? global_entries : cfg->k;
+  size_t slots = (size_t)n * (top_k > 0 ? top_k : 1);
+  hash_t **query_tfs = calloc(n, sizeof(hash_t *));
+  double *query_norms = calloc(n, sizeof(double));
+  DocSim *top = malloc(slots * sizeof(DocSim));
+  long int *found = malloc(n * sizeof(long int));
+  int rc = (query_tfs && query_norms && top && found) ? 0 : -1;
+
+  for (int i = 0; i < n && rc == 0; i++)
+    if (preprocess_query(queries[i], global_vocab, NULL, &query_tfs[i],
+                         &query_norms[i], NULL) != 0)
+      query_tfs[i] = NULL;
+
+  if (rc == 0)
+    rc = batch_top_k(query_tfs, query_norms, n, global_tf, global_doc_norms,
+                     global_entries, (int)top_k, cfg->nthreads, top, found);
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+
+  if (rc != 0) {
+    fprintf(stderr, "Erro ao pontuar o lote de consultas\n");
+  } else {
+    double elapsed = get_elapsed_time(&t_start, &t_end);
+    printf("\n[LOTE] %d consultas em %.3f segundos (%.1f consultas/s)\n", n,
+           elapsed, elapsed > 0.0 ? n / elapsed : 0.0);
+    for (int i = 0; i < n; i++) {
+      printf("\n[CONSULTA] %s\n", queries[i]);
+      if (!query_tfs[i]) {
+        fprintf(stderr, "Erro ao processar consulta do usuário\n");
+        continue;
+      }
+      print_top_k(cfg, top + (size_t)i * top_k, found[i], query_tfs[i]);
+    }
+  }
+
+  for (int i = 0; query_tfs && i < n; i++)
+    hash_free(query_tfs[i]);
+  free(query_tfs);
+  free(query_norms);
+  free(top);
+  free(found);
+  return rc;
+}
+
+/**
+ * @brief Responde uma consulta e exibe os top-k documentos
+ *
+ * Com cache, o vetor canônico da consulta é procurado antes de qualquer
+ * pontuação; no modelo por documento, as listas dos termos consultados
+ * também vêm do cache (qcache_similarities).
+ *
+ * @param cfg Configuração (k, threads, banco e tabela)
+ * @param query Texto da consulta
+ * @param cluster Processos de shard (NULL sem --shards)
+ * @param cache Cache de consultas (NULL para desabilitar)
+ * @return 0 em sucesso, -1 em erro
+ */
+int answer_query(const Config *cfg, const char *query, shard_cluster *cluster,
+                 qcache_t *cache) {
+  struct timespec t_start_query, t_end_query;
+  clock_gettime(CLOCK_MONOTONIC, &t_start_query);
+
+  // Processar query (sem threads - é um vetor pequeno)
+  hash_t *query_tf;
+  double query_norm;
+  bool_query ops;
+
+  // Curingas (marin*) são expandidos pelo léxico, carregado na primeira vez
+  const lexicon_t *lexicon = query_has_wildcard(query) ? get_lexicon(cfg) : NULL;
+  if (preprocess_query(query, global_vocab, lexicon, &query_tf, &query_norm,
+                       &ops) != 0) {
+    fprintf(stderr, "Erro ao processar consulta do usuário\n");
+    return 0;
+  }
+  LOG(stdout, "Consulta processada com sucesso!\n");
+  LOG(stdout, "Norma da query: %.6f\n", query_norm);
+  LOG(stdout, "Tamanho do vetor TF-IDF da query: %zu palavras\n", hash_size(query_tf));
+
+  // DEBUG: Exibir palavras da query
+  if (VERBOSE) {
+      printf("Palavras na query (após processamento):\n");
+      for (size_t i = 0; i < query_tf->cap; i++) {
+        for (HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
+          printf("  '%s': TF-IDF=%.6f\n", e->word, e->value);
+        }
+      }
+  }
+
+  long int top_k = global_entries < cfg->k ? global_entries : cfg->k;
+  struct timespec t_start_sim, t_end_sim;
+
+  int boolean = ops.nrequired > 0 || ops.nexcluded > 0;
+  char *key = cache ? qcache_key(query_tf, top_k) : NULL;
+  if (key && boolean) {
+    // Os operadores mudam o resultado: entram na chave do cache
+    size_t len = strlen(key) + 1;
+    for (long int i = 0; i < ops.nrequired; i++)
+      len += strlen(ops.required[i]) + 2;
+    for (long int i = 0; i < ops.nexcluded; i++)
+      len += strlen(ops.excluded[i]) + 2;
+    char *grown = realloc(key, len);
+    if (grown) {
+      key = grown;
+      for (long int i = 0; i < ops.nrequired; i++)
+        strcat(strcat(key, ";+"), ops.required[i]);
+      for (long int i = 0; i < ops.nexcluded; i++)
+        strcat(strcat(key, ";-"), ops.excluded[i]);
+    } else {
+      free(key);
+      key = NULL;
+    }
+  }
+  long int cached_n;
+  const DocSim *cached = key ? qcache_get(cache, key, &cached_n) : NULL;
+  if (cached) {
+    clock_gettime(CLOCK_MONOTONIC, &t_end_query);
+    printf("\n[CACHE] Resultado em cache: %.1f µs\n",
+           get_elapsed_time(&t_start_query, &t_end_query) * 1e6);
+    print_top_k(cfg, cached, cached_n, query_tf);
+    free(key);
+    hash_free(query_tf);
+    bool_query_free(&ops);
+    return 0;
+  }
+
+  int rc = 0, answered = 0;
+  if (boolean) {
+    // +termo/-termo: só os documentos que satisfazem os operadores (com
+    // shards, cada shard testa os seus e o coordenador junta)
+    DocSim *top = malloc((top_k > 0 ? top_k : 1) * sizeof(DocSim));
+    long int ncand = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+    long int found =
+        !top      ? -1
+        : cluster ? shard_search(cluster, query_tf, query_norm, &ops,
+                                 (int)top_k, top, &ncand)
+                  : boolean_top_k(global_index, global_tf, query_tf,
+                                  query_norm, global_doc_norms, global_entries,
+                                  &ops, global_filter, (int)top_k, top, &ncand);
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+
+    if (found < 0) {
+      fprintf(stderr, "Erro ao avaliar a consulta booleana\n");
+      rc = -1;
+    } else {
+      printf("\n[BOOLEANA] %ld documentos satisfazem a consulta: %.1f µs\n",
+             ncand, get_elapsed_time(&t_start_sim, &t_end_sim) * 1e6);
+      print_top_k(cfg, top, found, query_tf);
+      if (key)
+        qcache_put(cache, key, top, found);
+    }
+    free(top);
+    answered = 1;
+  }
+
+  if (answered) {
+    // Respondida (ou falhou) pelos operadores booleanos
+  } else if (global_champions) {
+    // Camada 1: só os candidatos das listas de campeões dos termos
+    DocSim *top = malloc((top_k > 0 ? top_k : 1) * sizeof(DocSim));
+    int fallback = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+    long int found =
+        top ? champion_top_k(global_champions, global_index, query_tf, query_norm,
+                             global_doc_norms, (int)top_k, cfg->champion_min,
+                             cfg->champion_exact, top, &fallback)
+            : -1;
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+
+    if (found < 0) {
+      fprintf(stderr, "Erro ao consultar as listas de campeões\n");
+      rc = -1;
+      answered = 1;
+    } else if (fallback) {
+      printf("\n[CAMPEÕES] Candidatos insuficientes em %.1f µs: consultando "
+             "o índice completo\n",
+             get_elapsed_time(&t_start_sim, &t_end_sim) * 1e6);
+    } else {
+      printf("\n[CAMPEÕES] Resposta pelas listas de campeões: %.1f µs\n",
+             get_elapsed_time(&t_start_sim, &t_end_sim) * 1e6);
+      print_top_k(cfg, top, found, query_tf);
+      if (key)
+        qcache_put(cache, key, top, found);
+      answered = 1;
+    }
+    free(top);
+  }
+
+  if (answered) {
+    // Respondida (ou falhou) pelos operadores ou na camada de campeões
+  } else if (global_impact) {
+    // Score-at-a-time: para no prazo com o melhor top-k encontrado
+    struct timespec deadline = t_start_query;
+    deadline.tv_sec += cfg->budget_us / 1000000;
+    deadline.tv_nsec += (cfg->budget_us % 1000000) * 1000;
+    if (deadline.tv_nsec >= 1000000000) {
+      deadline.tv_sec++;
+      deadline.tv_nsec -= 1000000000;
+    }
+
+    DocSim *top = malloc((top_k > 0 ? top_k : 1) * sizeof(DocSim));
+    int exact = 1;
+    long int processed = 0, total = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+    long int found =
+        top ? impact_top_k(global_impact, global_index, query_tf, query_norm,
+                           global_doc_norms, (int)top_k,
+                           cfg->budget_us ? &deadline : NULL, top, &exact,
+                           &processed, &total)
+            : -1;
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+
+    if (found < 0) {
+      fprintf(stderr, "Erro ao consultar o índice por impacto\n");
+      rc = -1;
+    } else {
+      printf("\n[IMPACTO] %ld de %ld postings em %.1f µs, resultado %s\n",
+             processed, total, get_elapsed_time(&t_start_sim, &t_end_sim) * 1e6,
+             exact ? "exato" : "parcial (prazo esgotado)");
+      print_top_k(cfg, top, found, query_tf);
+      // Parciais não vão para o cache: outra execução pode terminar a tempo
+      if (key && exact)
+        qcache_put(cache, key, top, found);
+    }
+    free(top);
+  } else if (global_simhash && !cluster) {
+    // LSH: cosseno exato só dos candidatos mais próximos em Hamming
+    DocSim *top = malloc((top_k > 0 ? top_k : 1) * sizeof(DocSim));
+    long int ncand = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+    long int found =
+        top ? simhash_top_k(global_simhash, global_tf, query_tf, query_norm,
+                            global_doc_norms, (int)top_k, cfg->lsh_rerank, top,
+                            &ncand)
+            : -1;
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+
+    if (found < 0) {
+      fprintf(stderr, "Erro ao consultar as faixas do LSH\n");
+      rc = -1;
+    } else {
+      printf("\n[LSH] %ld candidatos em %.1f µs\n", ncand,
+             get_elapsed_time(&t_start_sim, &t_end_sim) * 1e6);
+      print_top_k(cfg, top, found, query_tf);
+      if (key)
+        qcache_put(cache, key, top, found);
+    }
+    free(top);
+  } else if (global_kmeans && !cluster) {
+    // Centroides primeiro; cosseno exato só nos nprobe clusters mais próximos
+    DocSim *top = malloc((top_k > 0 ? top_k : 1) * sizeof(DocSim));
+    long int scanned = 0;
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+    long int found =
+        top ? kmeans_top_k(global_kmeans, global_vocab, global_tf, query_tf,
+                           query_norm, global_doc_norms, (int)top_k,
+                           cfg->nprobe, top, &scanned)
+            : -1;
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+
+    if (found < 0) {
+      fprintf(stderr, "Erro ao consultar os clusters\n");
+      rc = -1;
+    } else {
+      printf("\n[K-MEANS] %ld documentos em %.1f µs\n", scanned,
+             get_elapsed_time(&t_start_sim, &t_end_sim) * 1e6);
+      print_top_k(cfg, top, found, query_tf);
+      if (key)
+        qcache_put(cache, key, top, found);
+    }
+    free(top);
+  } else if (cluster || (global_index && !cfg->exhaustive)) {
+    // Top-k direto: scatter-gather nos shards (cada um devolve seu top-k e o
+    // coordenador junta) ou travessia com poda WAND no índice invertido
+    DocSim *top = malloc((top_k > 0 ? top_k : 1) * sizeof(DocSim));
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+    long int found =
+        !top      ? -1
+        : cluster ? shard_search(cluster, query_tf, query_norm, NULL,
+                                 (int)top_k, top, NULL)
+                  : wand_top_k(global_index, query_tf, query_norm,
+                               global_doc_norms, (int)top_k, cfg->nthreads,
+                               global_filter, top);
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+
+    if (found < 0) {
+      fprintf(stderr, cluster ? "Erro ao consultar os shards\n"
+                              : "Erro ao calcular o top-k com WAND\n");
+      rc = -1;
+    } else {
+      printf("\n[SIMILARIDADE] Tempo: %.3f segundos\n",
+             get_elapsed_time(&t_start_sim, &t_end_sim));
+      print_top_k(cfg, top, found, query_tf);
+      if (key)
+        qcache_put(cache, key, top, found);
+    }
+    free(top);
+  } else {
+    // Calcular similaridade com todos os documentos
+    clock_gettime(CLOCK_MONOTONIC, &t_start_sim);
+
+    double *similarities =
+        global_index
+            ? index_similarities(global_index, query_tf, query_norm,
+                                 global_doc_norms, cfg->nthreads, global_filter)
+        : cache && !global_filter
+            ? qcache_similarities(cache, query_tf, query_norm, global_tf,
+                                  global_doc_norms, global_entries)
+            : compute_similarities(query_tf, query_norm, global_tf,
+                                   global_doc_norms, global_entries, cfg->nthreads,
+                                   global_filter);
+
+    clock_gettime(CLOCK_MONOTONIC, &t_end_sim);
+    double elapsed_sim = get_elapsed_time(&t_start_sim, &t_end_sim);
+
+    if (!similarities) {
+      fprintf(stderr, "Erro ao calcular similaridades\n");
+      free(key);
+      hash_free(query_tf);
+      bool_query_free(&ops);
+      return -1;
+    }
+    printf("\n[SIMILARIDADE] Tempo: %.3f segundos\n", elapsed_sim);
+
+    // Encontrar os top-k documentos mais similares
+    DocSim *scores = (DocSim *)malloc(global_entries * sizeof(DocSim));
+    if (scores) {
+      mem_track_alloc(MEM_QUERY, global_entries * sizeof(DocSim));
+      long int nscores = 0;
+      // Com filtro, só os documentos permitidos entram no ranking
+      for (long int i = global_filter ? roaring_next(global_filter, 0) : 0;
+           i >= 0 && i < global_entries;
+           i = global_filter ? roaring_next(global_filter, i + 1) : i + 1) {
+        // Documentos removidos (tombstones) não entram no ranking
+        if (global_index && index_is_deleted(global_index, i))
+          continue;
+        scores[nscores].doc_id = i;
+        scores[nscores++].similarity = similarities[i];
+      }
+
+      qsort(scores, nscores, sizeof(DocSim), compare_sim);
+      if (nscores < top_k)
+        top_k = nscores;
+      print_top_k(cfg, scores, top_k, query_tf);
+      if (key)
+        qcache_put(cache, key, scores, top_k);
+
+      mem_track_free(MEM_QUERY, global_entries * sizeof(DocSim));
+      free(scores);
+    }
+
+    mem_track_free(MEM_QUERY, global_entries * sizeof(double));
+    free(similarities);
+  }
+
+  free(key);
+  // Liberar hash da query
+  hash_free(query_tf);
+  bool_query_free(&ops);
+  return rc;
+}
+
+/**
+ * @brief Exibe os top-k documentos com um trecho do texto de cada um
+ *
+ * Os textos vêm do armazém mapeado (global_docs), sem cópia; sem ele,
+ * são buscados no SQLite.
+ *
+ * @param cfg Configuração (banco e tabela dos documentos)
+ * @param scores Documentos já ordenados por similaridade
+ * @param top_k Quantidade de documentos a exibir
+ * @param query_tf Termos da consulta (para --snippets)
+ */
+void print_top_k(const Config *cfg, const DocSim *scores, long int top_k,
+                 const hash_t *query_tf) {
+  printf("\nTop %ld documentos mais similares:\n", top_k);
+  printf("---------------------------------\n");
+  if (top_k <= 0)
+    return;
+
+  long int *top_ids = (long int *)malloc(top_k * sizeof(long int));
+  if (!top_ids)
+    return;
+  for (long int i = 0; i < top_k; i++)
+    top_ids[i] = scores[i].doc_id;
+
+  // Buscar o corpus dos top-k documentos
+  char **documents = NULL;
+  if (global_docs)
+    docstore_prefetch(global_docs, top_ids, top_k);
+  else
+    documents = get_documents_by_ids(cfg->db, cfg->table, top_ids, top_k);
+
+  if (global_docs || documents) {
+    for (long int i = 0; i < top_k; i++) {
+      size_t len;
+      const char *text = global_docs ? docstore_get(global_docs, top_ids[i], &len)
+                                     : documents[i];
+      if (!text)
+        continue;
+      if (!global_docs)
+        len = strlen(text);
+      printf("[%ld] %.6f  ", top_ids[i], scores[i].similarity);
+
+      // Limitar a exibição a 100 caracteres
+      const char *start = text;
+      size_t n = len > 100 ? 100 : len;
+      if (cfg->snippets)
+        n = docstore_snippet(text, len, query_tf, 100, &start);
+      if (start > text)
+        printf("...");
+      fwrite(start, 1, n, stdout);
+      if (start + n < text + len)
+        printf("...");
+      printf("\n");
+    }
+    free_str_arr(documents, top_k);
+  }
+  free(top_ids);
+}
+
 /**
  * @brief Formata nomes de arquivos de modelo com table e entries
  *
@@ -703,19 +2218,222 @@ void *preprocess_2(void *arg) {
  * @param filename_tf Buffer para nome do arquivo TF (mín. 256 bytes)
  * @param filename_idf Buffer para nome do arquivo IDF (mín. 256 bytes)
  * @param filename_doc_norms Buffer para nome do arquivo de normas (mín. 256 bytes)
+ * @param filename_postings Buffer para nome do índice invertido (mín. 256 bytes)
  * @param table Nome da tabela
  * @param entries Número de entradas
  */
 void format_filenames(char *filename_tf, char *filename_idf,
-                      char *filename_doc_norms, const char *table,
-                      long int entries) {
+                      char *filename_doc_norms, char *filename_postings,
+                      const char *table, long int entries) {
   snprintf(filename_tf, 256, "models/tf_%s_%ld.bin", table, entries);
   snprintf(filename_idf, 256, "models/idf_%s_%ld.bin", table, entries);
   snprintf(filename_doc_norms, 256, "models/doc_norms_%s_%ld.bin", table, entries);
+  snprintf(filename_postings, 256, "models/postings_%s_%ld.bin", table, entries);
+}
+
+/**
+ * @brief Converte uma lista de ids separados por vírgula
+ *
+ * @param list Lista, ex.: "3,17,42"
+ * @param n_out Saída: quantidade de ids
+ * @return Vetor de ids (caller deve liberar), ou NULL se a lista for inválida
+ */
+long int *parse_id_list(const char *list, long int *n_out) {
+  long int n = 1;
+  for (const char *p = list; *p; p++)
+    if (*p == ',')
+      n++;
+
+  long int *ids = malloc(n * sizeof(long int));
+  if (!ids)
+    return NULL;
+
+  const char *p = list;
+  for (long int i = 0; i < n; i++) {
+    char *end;
+    ids[i] = strtol(p, &end, 10);
+    if (end == p || ids[i] < 0 || (*end != ',' && *end != '\0')) {
+      fprintf(stderr, "Lista de ids inválida: %s\n", list);
+      free(ids);
+      return NULL;
+    }
+    p = end + 1;
+  }
+  *n_out = n;
+  return ids;
 }
 
-int compare_sim(const void *a, const void *b) {
-    const DocSim *doc1 = (const DocSim *)a;
-    const DocSim *doc2 = (const DocSim *)b;
-    return doc1->similarity > doc2->similarity ? -1 : doc1->similarity < doc2->similarity;
+/**
+ * @brief Versão do modelo em disco (tamanho e data de modificação dos arquivos)
+ *
+ * Qualquer reconstrução, novo segmento ou remoção altera algum desses
+ * arquivos e, portanto, a versão usada para invalidar o cache de consultas.
+ *
+ * @param files Arquivos do modelo (os inexistentes são ignorados)
+ * @param nfiles Número de arquivos
+ * @return Versão (hash dos metadados)
+ */
+long int model_version(const char **files, int nfiles) {
+  uint64_t version = 5381;
+  for (int i = 0; i < nfiles; i++) {
+    struct stat st;
+    if (stat(files[i], &st) != 0)
+      continue;
+    uint64_t meta[3] = {(uint64_t)st.st_size, (uint64_t)st.st_mtim.tv_sec,
+                        (uint64_t)st.st_mtim.tv_nsec};
+    version = version * 33 ^ hash_str((const char *)meta, sizeof(meta));
+  }
+  return (long int)version;
+}
+
+static int filter_add_id(long int id, void *ctx) {
+  return id > (long int)UINT32_MAX || roaring_add(ctx, (uint32_t)id) != 0;
+}
+
+/**
+ * @brief Monta o filtro de documentos das consultas
+ *
+ * --filter_ids vira o bitmap direto; o resultado de --filter_sql fica em
+ * models/filter_<tabela>_<hash do predicado>.bin e só é avaliado de novo
+ * se o banco mudar. Com as duas opções, vale a interseção.
+ *
+ * @param cfg Configuração (banco, tabela, filter_ids e filter_sql)
+ * @return Filtro, ou NULL em erro
+ */
+roaring_t *build_filter(const Config *cfg) {
+  roaring_t *ids = NULL, *sql = NULL;
+  if (cfg->filter_ids && !(ids = roaring_from_ranges(cfg->filter_ids)))
+    return NULL;
+
+  if (cfg->filter_sql) {
+    char filename[300];
+    snprintf(filename, sizeof(filename), "models/filter_%s_%016llx.bin",
+             cfg->table,
+             (unsigned long long)hash_str(cfg->filter_sql,
+                                          strlen(cfg->filter_sql)));
+    if (!file_is_stale(filename, cfg->db))
+      sql = roaring_load(filename);
+    if (!sql) {
+      sql = roaring_new();
+      if (!sql || for_each_id(cfg->db, cfg->table, cfg->filter_sql,
+                              filter_add_id, sql) != 0) {
+        fprintf(stderr, "Erro ao avaliar --filter_sql: %s\n", cfg->filter_sql);
+        roaring_free(sql);
+        roaring_free(ids);
+        return NULL;
+      }
+      roaring_save(sql, filename);
+    }
+  }
+
+  roaring_t *filter = ids && sql ? roaring_and(ids, sql) : ids ? ids : sql;
+  if (ids && sql) {
+    roaring_free(ids);
+    roaring_free(sql);
+  }
+  if (filter)
+    printf("[FILTRO] %ld documentos permitidos (%ld contêineres, %zu bytes)\n",
+           filter->card, filter->n, roaring_bytes(filter));
+  return filter;
+}
+
+/**
+ * @brief Léxico ordenado do modelo, aberto ou construído na primeira chamada
+ *
+ * Gravado em models/lexicon_<table>_<entries>.bin e refeito quando o
+ * vocabulário gravado é mais novo. Com --segments e --shards o
+ * vocabulário não é gravado, então o léxico só vive na memória.
+ *
+ * @param cfg Configuração (tabela, entradas e modo do índice)
+ * @return Léxico, ou NULL em erro
+ */
+const lexicon_t *get_lexicon(const Config *cfg) {
+  if (global_lexicon)
+    return global_lexicon;
+
+  char filename_lexicon[256], filename_vocab[256];
+  snprintf(filename_lexicon, sizeof(filename_lexicon),
+           "models/lexicon_%s_%ld.bin", cfg->table, cfg->entries);
+  snprintf(filename_vocab, sizeof(filename_vocab), "models/vocab_%s_%ld.bin",
+           cfg->table, cfg->entries);
+  int saved = !cfg->segments && !cfg->shards;
+
+  if (saved && !file_is_stale(filename_lexicon, filename_vocab)) {
+    global_lexicon = lexicon_open(filename_lexicon);
+    if (global_lexicon && global_lexicon->num_terms != global_vocab->num_terms) {
+      lexicon_free(global_lexicon);
+      global_lexicon = NULL;
+    }
+    if (global_lexicon)
+      return global_lexicon;
+  }
+
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  global_lexicon = lexicon_build(global_vocab, global_index, global_num_live);
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  if (!global_lexicon) {
+    fprintf(stderr, "Erro ao construir o léxico\n");
+    return NULL;
+  }
+  // Texto dos termos: blocos com front coding x pool do vocabulário
+  const char *lx_base = global_lexicon->base, *vocab_base = global_vocab->base;
+  size_t text_bytes =
+      global_lexicon->size - (size_t)((const char *)global_lexicon->data - lx_base);
+  size_t pool_bytes =
+      global_vocab->size - (size_t)(global_vocab->pool - vocab_base);
+  printf("[LÉXICO] %ld termos em %.1f KB (texto com front coding: %.1f KB; "
+         "no vocabulário: %.1f KB): %.3f s\n",
+         global_lexicon->num_terms, global_lexicon->size / 1024.0,
+         text_bytes / 1024.0, pool_bytes / 1024.0,
+         get_elapsed_time(&t_start, &t_end));
+  if (saved)
+    lexicon_save(global_lexicon, filename_lexicon);
+  return global_lexicon;
+}
+
+/**
+ * @brief Exibe os k termos de maior df que começam com --complete
+ *
+ * @param cfg Configuração (prefixo e k)
+ * @return 0 em sucesso, -1 em erro
+ */
+int print_completions(const Config *cfg) {
+  const lexicon_t *lx = get_lexicon(cfg);
+  if (!lx)
+    return -1;
+  char *prefix = query_prefix(cfg->complete);
+  if (!prefix) {
+    fprintf(stderr, "Prefixo inválido: %s\n", cfg->complete);
+    return -1;
+  }
+
+  struct timespec t_start, t_end;
+  clock_gettime(CLOCK_MONOTONIC, &t_start);
+  long int first;
+  long int total = lexicon_prefix(lx, prefix, strlen(prefix), &first);
+  long int *ids = malloc((cfg->k > 0 ? cfg->k : 1) * sizeof(long int));
+  long int m = (total < 0 || !ids)
+                   ? -1
+                   : lexicon_complete(lx, prefix, strlen(prefix), cfg->k, ids);
+  clock_gettime(CLOCK_MONOTONIC, &t_end);
+  char *buf = malloc(lx->max_len + 1);
+  if (m < 0 || !buf) {
+    fprintf(stderr, "Erro ao completar o prefixo %s\n", prefix);
+    free(ids);
+    free(buf);
+    free(prefix);
+    return -1;
+  }
+
+  printf("\n[COMPLETAR] '%s': %ld termos com o prefixo: %.1f µs\n", prefix,
+         total, get_elapsed_time(&t_start, &t_end) * 1e6);
+  for (long int i = 0; i < m; i++) {
+    lexicon_term(lx, ids[i], buf);
+    printf("  %-20s df=%u\n", buf, lx->df[ids[i]]);
+  }
+  free(ids);
+  free(buf);
+  free(prefix);
+  return 0;
 }
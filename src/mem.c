@@ -0,0 +1,283 @@
+/**
+ * @file mem.c
+ * @brief Contabilidade de memória por categoria e orçamento do pipeline
+ *
+ * Cada alocação relevante do pipeline (hashes, tokens, textos, normas,
+ * buffers de consulta e de I/O) é registrada com uma etiqueta (mem_tag).
+ * Para não transformar os contadores globais em ponto de contenção entre
+ * threads, cada thread acumula um delta local e só o publica nos contadores
+ * atômicos globais quando ele ultrapassa MEM_FLUSH_BYTES (ou em mem_flush()).
+ * Alocações grandes (>= MEM_DIRECT_BYTES, ex.: vetores de normas) são
+ * publicadas imediatamente. O pico por categoria tem, portanto, precisão de
+ * MEM_FLUSH_BYTES por thread.
+ *
+ * Também fornece uma estimativa grosseira do consumo do pré-processamento,
+ * usada por --memory_budget para reduzir o tamanho dos lotes da FASE 1 ou
+ * recusar a execução antes de o processo ser morto por falta de memória.
+ */
+
+#include "../include/mem.h"
+#include "../include/hash_t.h"
+
+#include <ctype.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <sys/resource.h>
+
+#define MEM_FLUSH_BYTES (64 * 1024) /**< Delta local máximo antes de publicar */
+#define MEM_DIRECT_BYTES (4 * 1024) /**< Alocações grandes são publicadas já */
+#define MALLOC_OVERHEAD 16          /**< Cabeçalho aproximado do malloc */
+
+static const char *tag_names[MEM_NUM_TAGS] = {
+    "hash_buckets", "hash_entries", "hash_keys", "tokens",
+    "article_texts", "doc_norms", "query", "io_buffers", "postings",
+    "query_cache", "vocab"};
+
+static _Atomic long long mem_cur[MEM_NUM_TAGS];
+static _Atomic long long mem_max[MEM_NUM_TAGS];
+static _Atomic long long mem_cur_total;
+static _Atomic long long mem_max_total;
+
+static _Thread_local long long local_delta[MEM_NUM_TAGS];
+
+/* ------------- Funções Auxiliares ------------- */
+
+/**
+ * @brief Atualiza um pico atômico se o valor atual o superar
+ */
+static void update_peak(_Atomic long long *peak, long long value) {
+  long long old = atomic_load_explicit(peak, memory_order_relaxed);
+  while (value > old &&
+         !atomic_compare_exchange_weak_explicit(peak, &old, value,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed))
+    ;
+}
+
+/**
+ * @brief Publica o delta local de uma categoria nos contadores globais
+ */
+static void publish(mem_tag tag) {
+  long long d = local_delta[tag];
+  if (!d)
+    return;
+  local_delta[tag] = 0;
+
+  long long cur =
+      atomic_fetch_add_explicit(&mem_cur[tag], d, memory_order_relaxed) + d;
+  long long tot =
+      atomic_fetch_add_explicit(&mem_cur_total, d, memory_order_relaxed) + d;
+  if (d > 0) {
+    update_peak(&mem_max[tag], cur);
+    update_peak(&mem_max_total, tot);
+  }
+}
+
+/* ------------- Registro de Alocações ------------- */
+
+/**
+ * @brief Registra alocação de @p bytes na categoria @p tag
+ */
+void mem_track_alloc(mem_tag tag, size_t bytes) {
+  local_delta[tag] += (long long)bytes;
+  if (bytes >= MEM_DIRECT_BYTES || local_delta[tag] >= MEM_FLUSH_BYTES)
+    publish(tag);
+}
+
+/**
+ * @brief Registra liberação de @p bytes na categoria @p tag
+ */
+void mem_track_free(mem_tag tag, size_t bytes) {
+  local_delta[tag] -= (long long)bytes;
+  if (bytes >= MEM_DIRECT_BYTES || local_delta[tag] <= -MEM_FLUSH_BYTES)
+    publish(tag);
+}
+
+/**
+ * @brief Publica todos os deltas pendentes da thread chamadora
+ *
+ * Deve ser chamada pelas threads de trabalho antes de terminarem.
+ */
+void mem_flush(void) {
+  for (int t = 0; t < MEM_NUM_TAGS; t++)
+    publish((mem_tag)t);
+}
+
+size_t mem_current(mem_tag tag) {
+  long long v = atomic_load(&mem_cur[tag]);
+  return v > 0 ? (size_t)v : 0;
+}
+
+size_t mem_peak(mem_tag tag) { return (size_t)atomic_load(&mem_max[tag]); }
+
+size_t mem_total_peak(void) { return (size_t)atomic_load(&mem_max_total); }
+
+/**
+ * @brief Pico de memória residente (RSS) do processo em KB
+ *
+ * @return Pico de RSS em KB, ou -1 se indisponível
+ */
+long int mem_peak_rss_kb(void) {
+  struct rusage ru;
+  if (getrusage(RUSAGE_SELF, &ru) != 0)
+    return -1;
+  return ru.ru_maxrss; // Linux: KB
+}
+
+/**
+ * @brief Imprime tabela de consumo atual/pico por categoria e o pico de RSS
+ *
+ * @param out Stream de saída
+ */
+void mem_report(FILE *out) {
+  mem_flush();
+
+  char cur[32], peak[32];
+  fprintf(out, "\n[MEMÓRIA] %-14s %12s %12s\n", "Categoria", "Atual", "Pico");
+  for (int t = 0; t < MEM_NUM_TAGS; t++) {
+    mem_format_size(mem_current((mem_tag)t), cur, sizeof(cur));
+    mem_format_size(mem_peak((mem_tag)t), peak, sizeof(peak));
+    fprintf(out, "[MEMÓRIA] %-14s %12s %12s\n", tag_names[t], cur, peak);
+  }
+
+  long long total = atomic_load(&mem_cur_total);
+  mem_format_size(total > 0 ? (size_t)total : 0, cur, sizeof(cur));
+  mem_format_size(mem_total_peak(), peak, sizeof(peak));
+  fprintf(out, "[MEMÓRIA] %-14s %12s %12s\n", "total", cur, peak);
+
+  long int rss = mem_peak_rss_kb();
+  if (rss >= 0) {
+    mem_format_size((size_t)rss * 1024, peak, sizeof(peak));
+    fprintf(out, "[MEMÓRIA] Pico de RSS do processo: %s\n", peak);
+  }
+}
+
+/* ------------- Orçamento de Memória ------------- */
+
+/**
+ * @brief Converte tamanho textual ("512M", "2G", "1048576") em bytes
+ *
+ * Aceita sufixos K, M, G e T (base 1024, maiúsculos ou minúsculos).
+ *
+ * @param str String com o tamanho
+ * @return Tamanho em bytes, ou 0 se inválido
+ */
+size_t mem_parse_size(const char *str) {
+  if (!str)
+    return 0;
+
+  char *end;
+  double value = strtod(str, &end);
+  if (end == str || value <= 0)
+    return 0;
+
+  switch (toupper((unsigned char)*end)) {
+  case 'T':
+    value *= 1024.0;
+    /* fall through */
+  case 'G':
+    value *= 1024.0;
+    /* fall through */
+  case 'M':
+    value *= 1024.0;
+    /* fall through */
+  case 'K':
+    value *= 1024.0;
+    break;
+  case '\0':
+    break;
+  default:
+    return 0;
+  }
+
+  return (size_t)value;
+}
+
+/**
+ * @brief Formata quantidade de bytes em unidade legível (KB, MB, GB)
+ */
+void mem_format_size(size_t bytes, char *buf, size_t buflen) {
+  const char *units[] = {"B", "KB", "MB", "GB", "TB"};
+  double v = (double)bytes;
+  int u = 0;
+  while (v >= 1024.0 && u < 4) {
+    v /= 1024.0;
+    u++;
+  }
+  snprintf(buf, buflen, u ? "%.1f %s" : "%.0f %s", v, units[u]);
+}
+
+/**
+ * @brief Estima memória do pré-processamento a partir do tamanho médio dos textos
+ *
+ * Modelo grosseiro, calibrado para textos em inglês já pré-processados:
+ * ~6 caracteres por token, ~metade dos tokens sobrevive à remoção de
+ * stopwords e ~60% destes são distintos dentro do documento. O vocabulário
+ * segue a lei de Heaps (V = 40 * T^0.5) e é contado uma vez por thread
+ * (vocabulários locais) e uma vez no global.
+ *
+ * @param entries Número de documentos a processar
+ * @param avg_len Tamanho médio do texto (bytes)
+ * @param nthreads Número de threads
+ * @return Estimativa separada em parcelas persistentes e transitórias
+ */
+mem_estimate mem_estimate_build(long int entries, long int avg_len,
+                                int nthreads) {
+  mem_estimate est = {0, 0, 0};
+  if (entries <= 0)
+    return est;
+  if (avg_len < 1)
+    avg_len = 1;
+
+  double tokens = avg_len / 6.0;
+  double uniq = tokens * 0.5 * 0.6;
+
+  size_t cap = HASH_INIT_CAP;
+  while (uniq + 1 > cap * MAX_LOAD)
+    cap <<= 1;
+
+  size_t entry_bytes = sizeof(HashEntry) + MALLOC_OVERHEAD;
+  size_t key_bytes = 8 + MALLOC_OVERHEAD;
+
+  double per_doc = sizeof(hash_t) + MALLOC_OVERHEAD + cap * sizeof(HashEntry *) +
+                   uniq * (entry_bytes + key_bytes) + sizeof(double);
+  est.persistent = (size_t)(per_doc * entries);
+
+  double vocab = 40.0 * sqrt(tokens * 0.5 * entries);
+  est.vocab = (size_t)(vocab * (entry_bytes + key_bytes + 2 * sizeof(void *) / MAX_LOAD) *
+                       (nthreads + 1));
+
+  double batch = 2.0 * (avg_len + 1 + MALLOC_OVERHEAD) +
+                 (avg_len / 3.0 + 100) * sizeof(char *) +
+                 tokens * (8 + MALLOC_OVERHEAD);
+  est.per_doc_batch = (size_t)batch;
+
+  return est;
+}
+
+/**
+ * @brief Calcula o tamanho de lote da FASE 1 que cabe no orçamento
+ *
+ * @param est Estimativa de mem_estimate_build()
+ * @param budget Orçamento em bytes (0 = sem limite)
+ * @param nthreads Número de threads (cada uma mantém um lote vivo)
+ * @param batch_size Tamanho de lote configurado (limite superior)
+ * @return Tamanho de lote, ou -1 se nem a parcela persistente cabe
+ */
+long int mem_plan_batch(const mem_estimate *est, size_t budget, int nthreads,
+                        long int batch_size) {
+  if (!budget)
+    return batch_size;
+
+  size_t fixed = est->persistent + est->vocab;
+  if (fixed >= budget || nthreads <= 0 || !est->per_doc_batch)
+    return -1;
+
+  long int batch =
+      (long int)((budget - fixed) / ((size_t)nthreads * est->per_doc_batch));
+  if (batch < 1)
+    return -1;
+
+  return batch < batch_size ? batch : batch_size;
+}
@@ -0,0 +1,256 @@
+/**
+ * @file normalize.c
+ * @brief Normalização de texto equivalente a preprocess/pipeline-sqlite.py
+ *
+ * Reproduz, na mesma ordem, as etapas que o script Python aplicava à tabela
+ * antes da indexação, de modo que documentos e consultas passem pela mesma
+ * normalização:
+ *
+ *  1. lower + remoção de acentos + restrição a ASCII (uma passada UTF-8)
+ *  2. \' → '
+ *  3. apóstrofo só entre letras; demais sequências de ' viram espaço
+ *  4. vírgula só entre dígitos
+ *  5. hífen só entre caracteres de palavra ([a-z0-9_])
+ *  6. ponto só entre caracteres de palavra
+ *  7. símbolos # : " ( ) [ ] { } ~ = _ | ; < > * $ ` \ viram espaço
+ *  8. ? ! / viram espaço
+ *  9. "'s " vira " "
+ *
+ * Como no script, cada etapa de 3 a 9 termina colapsando espaços em branco
+ * e removendo-os das pontas, e os vizinhos testados (lookbehind/lookahead)
+ * são os do texto da própria etapa. As etapas usam tabelas de classe de
+ * caractere e são feitas in-place sobre o buffer de saída.
+ *
+ * Na remoção de acentos, letras com decomposição canônica viram a letra
+ * base; as sem decomposição (æ, ø, ß, đ, ł, ...) e os demais caracteres não
+ * ASCII são descartados, como em NFD + encode('ascii', 'ignore'). As tabelas
+ * cobrem Latin-1, Latin Extended-A/B e Latin Extended Additional (ắ, ạ,
+ * ẞ...), que são os blocos em que o NFD resulta em letras ASCII; fora deles
+ * só alguns caracteres isolados (K de kelvin, Å de angstrom, ≠, ≮, ≯, ;
+ * grego e ` grego) se decompõem em ASCII. Foram geradas com unicodedata
+ * (Unicode 14).
+ */
+
+#include "../include/normalize.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+enum {
+  C_SPACE = 1,   /**< \s do Python (ASCII) */
+  C_LETTER = 2,  /**< [a-zA-Z] */
+  C_DIGIT = 4,   /**< [0-9] */
+  C_WORD = 8,    /**< \w: letra, dígito ou _ */
+  C_SYMBOL = 16, /**< Símbolos removidos na etapa 7 */
+  C_PUNCT = 32,  /**< ? ! / (etapa 8) */
+};
+
+static uint8_t char_class[256];
+static pthread_once_t classes_once = PTHREAD_ONCE_INIT;
+
+/** Letra base (minúscula) de U+00C0..U+024F; '0' = descartar */
+static const char latin_fold[] =
+    "aaaaaa0ceeeeiiii0nooooo00uuuuy00"
+    "aaaaaa0ceeeeiiii0nooooo00uuuuy0y"
+    "aaaaaaccccccccdd00eeeeeeeeeegggg"
+    "gggghh00iiiiiiiii000jjkk0llllll0"
+    "000nnnnnn000oooooo00rrrrrrssssss"
+    "sstttt00uuuuuuuuuuuuwwyyyzzzzzz0"
+    "00000000000000000000000000000000"
+    "oo0000000000000uu000000000000000"
+    "0000000000000aaiioouuuuuuuuuu0aa"
+    "aa0000ggkkoooo00j000gg00nnaa0000"
+    "aaaaeeeeiiiioooorrrruuuusstt00hh"
+    "000000aaeeooooooooyy000000000000"
+    "0000000000000000";
+/** Letra base (minúscula) de U+1E00..U+1EFF (Latin Extended Additional) */
+static const char latin_ext_fold[] =
+    "aabbbbbbccddddddddddeeeeeeeeeeff"
+    "gghhhhhhhhhhiiiikkkkkkllllllllmm"
+    "mmmmnnnnnnnnoooooooopppprrrrrrrr"
+    "ssssssssssttttttttuuuuuuuuuuvvvv"
+    "wwwwwwwwwwxxxxyyzzzzzzhtwy000000"
+    "aaaaaaaaaaaaaaaaaaaaaaaaeeeeeeee"
+    "eeeeeeeeiiiioooooooooooooooooooo"
+    "oooouuuuuuuuuuuuuuyyyyyyyy000000";
+
+static void init_classes(void) {
+  const char *spaces = " \t\n\r\f\v\x1c\x1d\x1e\x1f";
+  for (const char *p = spaces; *p; p++)
+    char_class[(unsigned char)*p] |= C_SPACE;
+  for (int c = 'a'; c <= 'z'; c++) {
+    char_class[c] |= C_LETTER | C_WORD;
+    char_class[c - 'a' + 'A'] |= C_LETTER | C_WORD;
+  }
+  for (int c = '0'; c <= '9'; c++)
+    char_class[c] |= C_DIGIT | C_WORD;
+  char_class['_'] |= C_WORD;
+  const char *symbols = "#:\"()[]{}~=_|;<>*$`\\";
+  for (const char *p = symbols; *p; p++)
+    char_class[(unsigned char)*p] |= C_SYMBOL;
+  char_class['?'] |= C_PUNCT;
+  char_class['!'] |= C_PUNCT;
+  char_class['/'] |= C_PUNCT;
+}
+
+#define IS(c, cls) (char_class[(unsigned char)(c)] & (cls))
+
+/**
+ * @brief Caractere ASCII (minúsculo) do NFD de cp sem marcas; 0 = descartar
+ */
+static char fold_codepoint(uint32_t cp) {
+  char c = 0;
+  if (cp >= 0xC0 && cp < 0x250)
+    c = latin_fold[cp - 0xC0];
+  else if (cp >= 0x1E00 && cp < 0x1F00)
+    c = latin_ext_fold[cp - 0x1E00];
+  else
+    switch (cp) {
+    case 0x037E: return ';';  // ponto de interrogação grego
+    case 0x1FEF: return '`';  // varia grego
+    case 0x212A: return 'k';  // kelvin
+    case 0x212B: return 'a';  // angstrom
+    case 0x2260: return '=';  // ≠
+    case 0x226E: return '<';  // ≮
+    case 0x226F: return '>';  // ≯
+    }
+  return c == '0' ? 0 : c;
+}
+
+/**
+ * @brief Etapa 1: lower + remoção de acentos + restrição a ASCII
+ */
+static size_t fold_ascii(const char *in, size_t len, char *out) {
+  size_t w = 0;
+  for (size_t i = 0; i < len;) {
+    unsigned char c = (unsigned char)in[i];
+    if (c < 0x80) {
+      out[w++] = (c >= 'A' && c <= 'Z') ? (char)(c + 32) : (char)c;
+      i++;
+      continue;
+    }
+
+    // Decodificar a sequência UTF-8 (bytes inválidos são descartados)
+    size_t n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    uint32_t cp = n == 2 ? c & 0x1F : n == 3 ? c & 0x0F : c & 0x07;
+    size_t k = 1;
+    for (; k < n && i + k < len && ((unsigned char)in[i + k] & 0xC0) == 0x80; k++)
+      cp = (cp << 6) | ((unsigned char)in[i + k] & 0x3F);
+    char folded = k == n ? fold_codepoint(cp) : 0;
+    if (folded)
+      out[w++] = folded;
+    i += k;
+  }
+  return w;
+}
+
+/**
+ * @brief Colapsa espaços em branco em um espaço e remove-os das pontas
+ */
+static size_t collapse_ws(char *s, size_t len) {
+  size_t w = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (IS(s[i], C_SPACE)) {
+      if (w > 0 && s[w - 1] != ' ')
+        s[w++] = ' ';
+    } else {
+      s[w++] = s[i];
+    }
+  }
+  if (w > 0 && s[w - 1] == ' ')
+    w--;
+  return w;
+}
+
+/**
+ * @brief Etapa 2: \' → '
+ */
+static size_t unescape_quotes(char *s, size_t len) {
+  size_t w = 0;
+  for (size_t i = 0; i < len; i++) {
+    if (s[i] == '\\' && i + 1 < len && s[i + 1] == '\'')
+      continue;
+    s[w++] = s[i];
+  }
+  return w;
+}
+
+/**
+ * @brief Etapas 3-6: mantém `ch` apenas entre vizinhos da classe `around`
+ *
+ * Sequências de `ch` que não estão nessa situação viram um único espaço.
+ * A verificação dos vizinhos usa o texto original da etapa.
+ */
+static size_t keep_between(char *s, size_t len, char ch, int around) {
+  size_t w = 0;
+  char prev = '\0'; // Caractere anterior no texto original da etapa
+  for (size_t i = 0; i < len;) {
+    if (s[i] != ch) {
+      prev = s[i];
+      s[w++] = s[i++];
+      continue;
+    }
+    size_t j = i;
+    while (j < len && s[j] == ch)
+      j++;
+    int keep = j == i + 1 && i > 0 && IS(prev, around) && j < len &&
+               IS(s[j], around);
+    s[w++] = keep ? ch : ' ';
+    prev = ch;
+    i = j;
+  }
+  return collapse_ws(s, w);
+}
+
+/**
+ * @brief Etapas 7-8: caracteres da classe viram espaço
+ */
+static size_t replace_class(char *s, size_t len, int cls) {
+  for (size_t i = 0; i < len; i++)
+    if (IS(s[i], cls))
+      s[i] = ' ';
+  return collapse_ws(s, len);
+}
+
+/**
+ * @brief Etapa 9: "'s " → " "
+ */
+static size_t remove_apostrophe_s(char *s, size_t len) {
+  size_t w = 0;
+  for (size_t i = 0; i < len;) {
+    if (s[i] == '\'' && i + 2 < len && s[i + 1] == 's' && s[i + 2] == ' ') {
+      i += 2;
+      continue;
+    }
+    s[w++] = s[i++];
+  }
+  return collapse_ws(s, w);
+}
+
+/**
+ * @brief Normaliza um texto como o pipeline de pré-processamento Python
+ *
+ * @param in Texto de entrada (UTF-8; um '\0' antes de len encerra o texto)
+ * @param len Tamanho da entrada em bytes
+ * @param out Buffer de saída com pelo menos len + 1 bytes
+ * @return Tamanho do texto normalizado (out termina em '\0')
+ */
+size_t normalize_text(const char *in, size_t len, char *out) {
+  pthread_once(&classes_once, init_classes);
+
+  size_t n = 0;
+  while (n < len && in[n])
+    n++;
+
+  n = fold_ascii(in, n, out);
+  n = unescape_quotes(out, n);
+  n = keep_between(out, n, '\'', C_LETTER);
+  n = keep_between(out, n, ',', C_DIGIT);
+  n = keep_between(out, n, '-', C_WORD);
+  n = keep_between(out, n, '.', C_WORD);
+  n = replace_class(out, n, C_SYMBOL);
+  n = replace_class(out, n, C_PUNCT);
+  n = remove_apostrophe_s(out, n);
+  out[n] = '\0';
+  return n;
+}
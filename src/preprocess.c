@@ -17,6 +17,9 @@
 
 #include "../include/file_io.h"
 #include "../include/hash_t.h"
+#include "../include/mem.h"
+#include "../include/normalize.h"
+#include "../include/preprocess.h"
 #include <libstemmer.h>
 #include <math.h>
 #include <pthread.h>
@@ -123,14 +126,14 @@ void set_idf_value(hash_t *set, hash_t **tf, double doc_count,
  * TF-IDF = (1 + log2(TF)) * IDF
  *
  * @param global_tf Array global de hashes TF
- * @param global_idf Hash global de IDF
+ * @param global_vocab Vocabulário congelado (IDF global)
  * @param count Número de documentos a processar
  * @param offset Índice inicial no array global_tf
  */
-void compute_tf_idf(hash_t **global_tf, hash_t *global_idf, long int count,
-                    long int offset) {
-  if (!global_tf || !global_idf || count <= 0) {
-    fprintf(stderr, "Erro: global_tf, global_idf, ou count inválido.\n");
+void compute_tf_idf(hash_t **global_tf, const vocab_t *global_vocab,
+                    long int count, long int offset) {
+  if (!global_tf || !global_vocab || count <= 0) {
+    fprintf(stderr, "Erro: global_tf, global_vocab, ou count inválido.\n");
     pthread_exit(NULL);
   }
 
@@ -147,7 +150,8 @@ void compute_tf_idf(hash_t **global_tf, hash_t *global_idf, long int count,
         // e->value contém a frequência (TF) da palavra no documento
         if (e->value > 0) {
           // Buscar o IDF da palavra
-          double idf = hash_find(global_idf, e->word);
+          double idf = vocab_idf(global_vocab,
+                                 vocab_find(global_vocab, e->word, e->wlen));
 
           // Calcular TF-IDF: (1 + log2(freq)) * IDF
           double tfidf_value = (1.0 + log2(e->value)) * idf;
@@ -229,8 +233,10 @@ void stem(char ***article_vecs, long int count) {
       const char *stemmed = (const char *)sb_stemmer_stem(
           stemmer, (const sb_symbol *)article_vecs[i][j],
           strlen(article_vecs[i][j]));
+      mem_track_free(MEM_TOKENS, strlen(article_vecs[i][j]) + 1);
       free(article_vecs[i][j]);
       article_vecs[i][j] = strdup(stemmed); // Não é seguro
+      mem_track_alloc(MEM_TOKENS, strlen(stemmed) + 1);
     }
   }
   sb_stemmer_delete(stemmer);
@@ -262,11 +268,93 @@ void populate_tf_hash(hash_t **tf, char ***article_vecs, long int count, long in
   }
 }
 
+/**
+ * @brief Reduz a capacidade de um vetor de tokens para n tokens + NULL
+ *
+ * Em caso de falha do realloc o vetor original (maior) é mantido.
+ *
+ * @param vec Ponteiro para o vetor de tokens
+ * @param n Número de tokens válidos no vetor
+ */
+static void shrink_vec(char ***vec, long int n) {
+  char **shrunk = realloc(*vec, (n + 1) * sizeof(char *));
+  if (shrunk)
+    *vec = shrunk;
+}
+
+/**
+ * @brief Tokeniza o texto de um documento em um array de palavras
+ *
+ * Normaliza o texto (normalize_text: lower, acentos, apóstrofos, vírgulas,
+ * hífens, pontos e símbolos) e o divide usando whitespace como delimitador.
+ * O texto recebido não é modificado, o que permite passar a coluna do
+ * SQLite enquanto o statement está na linha.
+ *
+ * @param raw Texto do documento (não modificado)
+ * @param raw_len Tamanho do texto em bytes (um '\0' antes do fim encerra o texto)
+ * @return Vetor de tokens terminado em NULL, ou NULL em erro
+ */
+char **tokenize_doc(const char *raw, size_t raw_len) {
+  // Mesma normalização do antigo pré-processamento Python (normalize.c)
+  char *text = malloc(raw_len + 1);
+  if (!text)
+    return NULL;
+  mem_track_alloc(MEM_ARTICLE_TEXT, raw_len + 1);
+  size_t len = normalize_text(raw, raw_len, text);
+
+  // Estimativa mais conservadora: assume palavras curtas (média 3 chars +
+  // espaço) Adiciona margem de segurança de 100 tokens
+  long int estimated_tokens = len / 3 + 100;
+  char **vec = malloc(estimated_tokens * sizeof(char *));
+  if (!vec) {
+    mem_track_free(MEM_ARTICLE_TEXT, raw_len + 1);
+    free(text);
+    return NULL;
+  }
+
+  long int j = 0;
+  size_t i = 0;
+  while (i < len && text[i]) {
+    while (i < len && (text[i] == ' ' || text[i] == '\t' || text[i] == '\n' ||
+                       text[i] == '\r'))
+      i++;
+    size_t start = i;
+    while (i < len && text[i] && text[i] != ' ' && text[i] != '\t' &&
+           text[i] != '\n' && text[i] != '\r')
+      i++;
+    if (i == start)
+      break;
+
+    if (j >= estimated_tokens - 1) {
+      // Buffer cheio, aumentar tamanho
+      long int new_size = estimated_tokens * 2;
+      char **new_vec = realloc(vec, new_size * sizeof(char *));
+      if (!new_vec) {
+        // Falha no realloc, truncar tokens restantes
+        break;
+      }
+      vec = new_vec;
+      estimated_tokens = new_size;
+    }
+    vec[j] = strndup(text + start, i - start);
+    mem_track_alloc(MEM_TOKENS, i - start + 1);
+    j++;
+  }
+  vec[j] = NULL;
+  mem_track_free(MEM_ARTICLE_TEXT, raw_len + 1);
+  free(text);
+
+  // Devolver a folga da estimativa (o vetor só encolhe daqui em diante)
+  shrink_vec(&vec, j);
+  mem_track_alloc(MEM_TOKENS, (j + 1) * sizeof(char *));
+  return vec;
+}
+
 /**
  * @brief Tokeniza textos de documentos em arrays de palavras
  *
  * Divide textos em tokens usando whitespace como delimitador.
- * Thread-safe (usa strtok_r).
+ * Thread-safe (ver tokenize_doc).
  *
  * @param article_texts Array de strings com textos dos documentos
  * @param count Número de documentos
@@ -274,60 +362,31 @@ void populate_tf_hash(hash_t **tf, char ***article_vecs, long int count, long in
  * @note Caller deve liberar usando free_article_vecs()
  */
 char ***tokenize(char **article_texts, long int count) {
-  char ***article_vecs;
-
-  article_vecs = malloc(count * sizeof(char **));
-  if (!article_vecs) {
-    fprintf(stderr, "Erro ao alocar article_vecs\n");
+  char ***article_vecs = alloc_article_vecs(count);
+  if (!article_vecs)
     return NULL;
-  }
 
   for (long int i = 0; i < count; ++i) {
-    if (!article_texts[i]) {
-      article_vecs[i] = NULL;
-      continue;
-    }
-
-    // Estimativa mais conservadora: assume palavras curtas (média 3 chars +
-    // espaço) Adiciona margem de segurança de 100 tokens
-    long int estimated_tokens = strlen(article_texts[i]) / 3 + 100;
-    article_vecs[i] = malloc(estimated_tokens * sizeof(char *));
-    if (!article_vecs[i]) {
-      article_vecs[i] = NULL;
-      continue;
-    }
-
-    char *text_copy = strdup(article_texts[i]);
-    if (!text_copy) {
-      free(article_vecs[i]);
-      article_vecs[i] = NULL;
-      continue;
-    }
+    if (article_texts[i])
+      article_vecs[i] = tokenize_doc(article_texts[i], strlen(article_texts[i]));
+  }
 
-    long int j = 0;
-    char *saveptr; // (thread-safe)
-    char *token = strtok_r(text_copy, " \t\n\r", &saveptr);
-    while (token != NULL) {
-      if (j >= estimated_tokens - 1) {
-        // Buffer cheio, aumentar tamanho
-        long int new_size = estimated_tokens * 2;
-        char **new_vec = realloc(article_vecs[i], new_size * sizeof(char *));
-        if (!new_vec) {
-          // Falha no realloc, truncar tokens restantes
-          break;
-        }
-        article_vecs[i] = new_vec;
-        estimated_tokens = new_size;
-      }
-      article_vecs[i][j] = strdup(token);
-      j++;
-      token = strtok_r(NULL, " \t\n\r", &saveptr);
-    }
-    article_vecs[i][j] = NULL;
+  return article_vecs;
+}
 
-    free(text_copy);
+/**
+ * @brief Aloca o array de vetores de tokens (todas as posições NULL)
+ *
+ * @param count Número de documentos
+ * @return Array para free_article_vecs(), ou NULL em erro
+ */
+char ***alloc_article_vecs(long int count) {
+  char ***article_vecs = calloc(count ? count : 1, sizeof(char **));
+  if (!article_vecs) {
+    fprintf(stderr, "Erro ao alocar article_vecs\n");
+    return NULL;
   }
-
+  mem_track_alloc(MEM_TOKENS, count * sizeof(char **));
   return article_vecs;
 }
 
@@ -353,16 +412,21 @@ void remove_stopwords(char ***article_vecs, long int count) {
 
     // Filtra stopwords e palavras com apenas uma letra
     long int write_idx = 0;
-    for (long int read_idx = 0; article_vecs[i][read_idx] != NULL; ++read_idx) {
+    long int read_idx = 0;
+    for (; article_vecs[i][read_idx] != NULL; ++read_idx) {
       const char *word = article_vecs[i][read_idx];
       // Mantém a palavra se NÃO for stopword E tiver mais de 1 letra
       if (!hash_contains(global_stopwords, word) && strlen(word) > 1) {
         article_vecs[i][write_idx++] = article_vecs[i][read_idx];
       } else {
+        mem_track_free(MEM_TOKENS, strlen(word) + 1);
         free(article_vecs[i][read_idx]);
       }
     }
     article_vecs[i][write_idx] = NULL;
+
+    shrink_vec(&article_vecs[i], write_idx);
+    mem_track_free(MEM_TOKENS, (read_idx - write_idx) * sizeof(char *));
   }
 }
 
@@ -378,11 +442,15 @@ void free_article_vecs(char ***article_vecs, long int count) {
 
   for (long int i = 0; i < count; ++i) {
     if (article_vecs[i]) {
-      for (long int j = 0; article_vecs[i][j] != NULL; ++j) {
+      long int j = 0;
+      for (; article_vecs[i][j] != NULL; ++j) {
+        mem_track_free(MEM_TOKENS, strlen(article_vecs[i][j]) + 1);
         free(article_vecs[i][j]);
       }
+      mem_track_free(MEM_TOKENS, (j + 1) * sizeof(char *));
       free(article_vecs[i]);
     }
   }
+  mem_track_free(MEM_TOKENS, count * sizeof(char **));
   free(article_vecs);
 }
@@ -9,8 +9,11 @@
 #include <math.h>
 #include <ctype.h>
 #include <pthread.h>
+#include "../include/cpu.h"
 #include "../include/hash_t.h"
+#include "../include/mem.h"
 #include "../include/preprocess.h"
+#include "../include/preprocess_query.h"
 
 /**
  * @brief Argumentos para threads de cálculo de similaridade
@@ -23,6 +26,7 @@ typedef struct {
   hash_t **global_tf;              // Array de hashes TF-IDF dos documentos
   const double *global_doc_norms;  // Array de normas dos documentos
   double *similarities;            // Array de similaridades (compartilhado)
+  const roaring_t *filter;         // Documentos permitidos (NULL = todos)
 } similarity_args;
 
 /**
@@ -30,8 +34,13 @@ typedef struct {
  */
 void *compute_similarities_thread(void *arg) {
   similarity_args *args = (similarity_args *)arg;
+  const roaring_t *filter = args->filter;
 
-  for (long int doc_id = args->start; doc_id < args->end; doc_id++) {
+  // Com filtro, só os documentos permitidos são visitados (os demais
+  // ficam com 0.0 do calloc)
+  for (long int doc_id = filter ? roaring_next(filter, args->start) : args->start;
+       doc_id >= 0 && doc_id < args->end;
+       doc_id = filter ? roaring_next(filter, doc_id + 1) : doc_id + 1) {
     hash_t *doc_tf = args->global_tf[doc_id];
     if (!doc_tf) {
       args->similarities[doc_id] = 0.0;
@@ -61,18 +70,15 @@ void *compute_similarities_thread(void *arg) {
 }
 
 /**
- * @brief Processa query reutilizando pipeline de documentos
+ * @brief Palavras normalizadas de um texto de consulta (sem stopwords e stem)
+ *
+ * @return Vetor de 1 documento (liberar com free_article_vecs), ou NULL
  */
-int preprocess_query(const char *query_user, const hash_t *global_idf,
-                     hash_t **query_tf_out, double *query_norm_out) {
-  if (!query_user || !global_idf) {
-    return -1;
-  }
-
+static char ***query_words(const char *text) {
   // Converter query para formato char** (array de 1 string)
   char **query_array = malloc(2 * sizeof(char *));
-  if (!query_array) return -1;
-  query_array[0] = strdup(query_user);
+  if (!query_array) return NULL;
+  query_array[0] = strdup(text);
   query_array[1] = NULL;
 
   // Pipeline usando funções de documentos
@@ -82,28 +88,265 @@ int preprocess_query(const char *query_user, const hash_t *global_idf,
 
   if (!tokens || !tokens[0]) {
     if (tokens) free(tokens);
-    return -1;
+    return NULL;
   }
 
   // Lowercase manual
   for (long int i = 0; tokens[0][i] != NULL; i++) {
     for (char *p = tokens[0][i]; *p; p++) *p = tolower(*p);
   }
+  return tokens;
+}
 
+/**
+ * @brief Tokens de um texto de consulta (mesmo pipeline dos documentos)
+ *
+ * @return Vetor de 1 documento (liberar com free_article_vecs), ou NULL
+ */
+static char ***query_tokens(const char *text) {
+  char ***tokens = query_words(text);
+  if (!tokens)
+    return NULL;
   remove_stopwords(tokens, 1);
   stem(tokens, 1);
+  return tokens;
+}
+
+/**
+ * @brief Normaliza o prefixo de um curinga ("Marin" → "marin")
+ *
+ * O prefixo passa pela mesma normalização dos documentos, mas sem stem:
+ * "marin*" deve alcançar "marinh" e "marinheir", não só o stem de "marin".
+ *
+ * @return Prefixo (caller deve liberar), ou NULL se não é uma única palavra
+ */
+char *query_prefix(const char *word) {
+  char ***tokens = query_words(word);
+  if (!tokens)
+    return NULL;
+  char *prefix = NULL;
+  if (tokens[0][0] && !tokens[0][1])
+    prefix = strdup(tokens[0][0]);
+  free_article_vecs(tokens, 1);
+  return prefix;
+}
+
+/**
+ * @brief Acrescenta um termo a uma lista (sem repetição)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int add_term(const char *term, char ***list, long int *n) {
+  for (long int j = 0; j < *n; j++)
+    if (strcmp((*list)[j], term) == 0)
+      return 0;
+  char **grown = realloc(*list, (*n + 1) * sizeof(char *));
+  if (!grown)
+    return -1;
+  *list = grown;
+  if (!(grown[*n] = strdup(term)))
+    return -1;
+  (*n)++;
+  return 0;
+}
+
+/**
+ * @brief Acrescenta os stems de text a uma lista (sem repetição)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int add_stems(const char *text, char ***list, long int *n) {
+  char ***tokens = query_tokens(text);
+  if (!tokens)
+    return -1;
+  int rc = 0;
+  for (long int i = 0; rc == 0 && tokens[0][i] != NULL; i++)
+    rc = add_term(tokens[0][i], list, n);
+  free_article_vecs(tokens, 1);
+  return rc;
+}
+
+/**
+ * @brief Acrescenta a uma lista os termos de maior df com o prefixo de word
+ *
+ * @param word Palavra sem o '*' final
+ * @return 0 em sucesso (mesmo sem termos), -1 em erro
+ */
+static int add_completions(const lexicon_t *lexicon, const char *word,
+                           char ***list, long int *n) {
+  char *prefix = query_prefix(word);
+  if (!prefix)
+    return 0;
+  long int ids[LEXICON_EXPAND];
+  long int m = lexicon_complete(lexicon, prefix, strlen(prefix), LEXICON_EXPAND,
+                                ids);
+  char *buf = malloc(lexicon->max_len + 1);
+  int rc = (m < 0 || !buf) ? -1 : 0;
+  for (long int i = 0; rc == 0 && i < m; i++)
+    rc = lexicon_term(lexicon, ids[i], buf) < 0 ? -1 : add_term(buf, list, n);
+  free(buf);
+  free(prefix);
+  return rc;
+}
+
+/**
+ * @brief Verifica se a consulta tem palavras terminadas em '*' (curingas)
+ */
+int query_has_wildcard(const char *query_user) {
+  for (const char *p = query_user; *p; p++)
+    if (*p == '*' && p > query_user && !isspace((unsigned char)p[-1]) &&
+        (!p[1] || isspace((unsigned char)p[1])))
+      return 1;
+  return 0;
+}
+
+/**
+ * @brief Verifica se a consulta tem palavras com '+' ou '-' na frente, ou
+ *        curingas
+ */
+int query_has_operators(const char *query_user) {
+  for (const char *p = query_user; *p; p++)
+    if ((*p == '+' || *p == '-') &&
+        (p == query_user || isspace((unsigned char)p[-1])) && p[1] &&
+        !isspace((unsigned char)p[1]))
+      return 1;
+  return query_has_wildcard(query_user);
+}
+
+/**
+ * @brief Separa os operadores booleanos e os curingas da consulta
+ *
+ * Palavras iniciadas por '+' são obrigatórias e continuam no vetor da
+ * consulta; palavras iniciadas por '-' são proibidas e saem dele. Com
+ * léxico, palavras terminadas em '*' saem do texto e viram os termos de
+ * maior df com o prefixo: em wild, ou em ops->excluded se começam com
+ * '-' ('+marin*' conta como curinga comum, sem obrigar nenhum termo). O
+ * texto devolvido é a consulta sem os operadores (igual à original se
+ * não há nenhum).
+ *
+ * @return Texto para o vetor TF-IDF (caller deve liberar), ou NULL em erro
+ */
+static char *parse_operators(const char *query_user, bool_query *ops,
+                             const lexicon_t *lexicon, char ***wild,
+                             long int *nwild) {
+  size_t len = strlen(query_user);
+  char *text = strdup(query_user);
+  char *word = malloc(len + 1);
+  if (!text || !word) {
+    free(text);
+    free(word);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < len;) {
+    if (isspace((unsigned char)text[i])) {
+      i++;
+      continue;
+    }
+    size_t start = i;
+    while (i < len && !isspace((unsigned char)text[i]))
+      i++;
+    char op = text[start];
+    int has_op = (op == '+' || op == '-') && i - start >= 2;
+    size_t wstart = start + (has_op ? 1 : 0);
+    int wildcard = lexicon && text[i - 1] == '*' && i - wstart >= 2;
+    if (!has_op && !wildcard)
+      continue;
+
+    size_t wlen = i - wstart - (wildcard ? 1 : 0);
+    memcpy(word, text + wstart, wlen);
+    word[wlen] = '\0';
+    int rc;
+    if (wildcard)
+      rc = op == '-' ? add_completions(lexicon, word, &ops->excluded,
+                                       &ops->nexcluded)
+                     : add_completions(lexicon, word, wild, nwild);
+    else
+      rc = op == '+' ? add_stems(word, &ops->required, &ops->nrequired)
+                     : add_stems(word, &ops->excluded, &ops->nexcluded);
+    if (rc != 0) {
+      free(text);
+      free(word);
+      return NULL;
+    }
+    // '+termo' continua na consulta sem o operador; '-termo' e curingas saem
+    memset(text + start, ' ', op == '+' && !wildcard ? 1 : i - start);
+  }
+  free(word);
+  return text;
+}
 
-  // Calcular TF
+/**
+ * @brief Libera as listas de termos de uma consulta booleana
+ */
+void bool_query_free(bool_query *ops) {
+  if (!ops)
+    return;
+  for (long int i = 0; i < ops->nrequired; i++)
+    free(ops->required[i]);
+  for (long int i = 0; i < ops->nexcluded; i++)
+    free(ops->excluded[i]);
+  free(ops->required);
+  free(ops->excluded);
+  memset(ops, 0, sizeof(bool_query));
+}
+
+/**
+ * @brief Processa query reutilizando pipeline de documentos
+ *
+ * @param lexicon Léxico para expandir curingas (marin*); NULL os ignora
+ * @param ops Saída: termos obrigatórios (+termo) e proibidos (-termo); com
+ *            NULL, '+', '-' e '*' são ignorados como qualquer pontuação
+ */
+int preprocess_query(const char *query_user, const vocab_t *global_vocab,
+                     const lexicon_t *lexicon, hash_t **query_tf_out,
+                     double *query_norm_out, bool_query *ops) {
+  if (!query_user || !global_vocab) {
+    return -1;
+  }
+
+  char *text = NULL;
+  char **wild = NULL;
+  long int nwild = 0;
+  if (ops) {
+    memset(ops, 0, sizeof(bool_query));
+    text = parse_operators(query_user, ops, lexicon, &wild, &nwild);
+    if (!text) {
+      for (long int i = 0; i < nwild; i++)
+        free(wild[i]);
+      free(wild);
+      bool_query_free(ops);
+      return -1;
+    }
+  }
+
+  char ***tokens = query_tokens(text ? text : query_user);
+  free(text);
+  if (!tokens) {
+    for (long int i = 0; i < nwild; i++)
+      free(wild[i]);
+    free(wild);
+    bool_query_free(ops);
+    return -1;
+  }
+
+  // Calcular TF (cada expansão de curinga conta como uma ocorrência)
   hash_t *query_tf = hash_new();
   for (long int i = 0; tokens[0][i] != NULL; i++) {
     hash_add(query_tf, tokens[0][i], 1.0);
   }
+  for (long int i = 0; i < nwild; i++) {
+    hash_add(query_tf, wild[i], 1.0);
+    free(wild[i]);
+  }
+  free(wild);
 
   // Calcular TF-IDF
   for (size_t i = 0; i < query_tf->cap; i++) {
     for (HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
       if (e->value > 0) {
-        double idf = hash_find(global_idf, e->word);
+        double idf = vocab_idf(global_vocab,
+                               vocab_find(global_vocab, e->word, e->wlen));
         e->value = (idf == 0.0) ? 0.0 : (1.0 + log2(e->value)) * idf;
       }
     }
@@ -130,21 +373,23 @@ int preprocess_query(const char *query_user, const hash_t *global_idf,
  */
 double *compute_similarities(const hash_t *query_tf, double query_norm,
                              hash_t **global_tf, const double *global_doc_norms,
-                             long int num_docs, int nthreads) {
+                             long int num_docs, int nthreads,
+                             const roaring_t *filter) {
   if (!query_tf || !global_tf || !global_doc_norms || num_docs <= 0) {
     return NULL;
   }
 
   if (nthreads <= 0) nthreads = 1;
-  if (nthreads > 16) nthreads = 16;
 
   double *similarities = (double *)calloc(num_docs, sizeof(double));
   if (!similarities) return NULL;
+  mem_track_alloc(MEM_QUERY, num_docs * sizeof(double));
 
   pthread_t *threads = malloc(nthreads * sizeof(pthread_t));
   similarity_args *args = malloc(nthreads * sizeof(similarity_args));
 
   if (!threads || !args) {
+    mem_track_free(MEM_QUERY, num_docs * sizeof(double));
     free(similarities);
     if (threads) free(threads);
     if (args) free(args);
@@ -163,8 +408,9 @@ double *compute_similarities(const hash_t *query_tf, double query_norm,
     args[i].global_tf = global_tf;
     args[i].global_doc_norms = global_doc_norms;
     args[i].similarities = similarities;
+    args[i].filter = filter;
 
-    if (pthread_create(&threads[i], NULL, compute_similarities_thread, &args[i])) {
+    if (cpu_thread_create(&threads[i], i, compute_similarities_thread, &args[i])) {
       fprintf(stderr, "Erro ao criar thread %d para similaridade\n", i);
       // Cleanup
       for (int j = 0; j < i; j++) {
@@ -172,6 +418,7 @@ double *compute_similarities(const hash_t *query_tf, double query_norm,
       }
       free(threads);
       free(args);
+      mem_track_free(MEM_QUERY, num_docs * sizeof(double));
       free(similarities);
       return NULL;
     }
@@ -187,3 +434,175 @@ double *compute_similarities(const hash_t *query_tf, double query_norm,
 
   return similarities;
 }
+
+/**
+ * @brief Ordena por similaridade decrescente (empate: menor doc_id primeiro)
+ *
+ * O desempate por doc_id deixa o ranking determinístico, seja ele montado
+ * a partir do vetor completo de similaridades ou do merge de top-k parciais.
+ */
+int compare_sim(const void *a, const void *b) {
+  const DocSim *doc1 = (const DocSim *)a;
+  const DocSim *doc2 = (const DocSim *)b;
+  if (doc1->similarity != doc2->similarity)
+    return doc1->similarity > doc2->similarity ? -1 : 1;
+  return (doc1->doc_id > doc2->doc_id) - (doc1->doc_id < doc2->doc_id);
+}
+
+/** a fica depois de b no ranking (compare_sim) */
+static inline int ranks_after(const DocSim *a, const DocSim *b) {
+  return compare_sim(a, b) > 0;
+}
+
+/**
+ * @brief Insere no heap de top-k (raiz = pior documento) mantendo no máximo k
+ *
+ * @param heap Heap com k posições
+ * @param n Documentos no heap (atualizado)
+ * @param k Tamanho máximo
+ * @param item Documento candidato
+ */
+void topk_offer(DocSim *heap, long int *n, int k, DocSim item) {
+  long int i;
+  if (*n < k) {
+    i = (*n)++;
+    while (i > 0 && ranks_after(&item, &heap[(i - 1) / 2])) {
+      heap[i] = heap[(i - 1) / 2];
+      i = (i - 1) / 2;
+    }
+    heap[i] = item;
+    return;
+  }
+  if (!ranks_after(&heap[0], &item))
+    return;
+
+  // Substitui a raiz e desce
+  i = 0;
+  for (;;) {
+    long int l = 2 * i + 1, r = l + 1, worst = i;
+    const DocSim *w = &item;
+    if (l < *n && ranks_after(&heap[l], w)) {
+      worst = l;
+      w = &heap[l];
+    }
+    if (r < *n && ranks_after(&heap[r], w))
+      worst = r;
+    if (worst == i)
+      break;
+    heap[i] = heap[worst];
+    i = worst;
+  }
+  heap[i] = item;
+}
+
+static int compare_long(const void *a, const void *b) {
+  long int x = *(const long int *)a, y = *(const long int *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Completa um top-k de scores positivos com documentos de score zero
+ *
+ * Reproduz a cauda da ordenação do vetor completo de similaridades: os
+ * documentos que não estão em out, em ordem crescente de doc_id.
+ *
+ * @param out Top-k (scores positivos nas n primeiras posições)
+ * @param n Documentos já em out
+ * @param k Tamanho do top-k
+ * @param num_docs Número de documentos
+ * @param deleted Bitmap de documentos removidos (NULL se nenhum)
+ * @param filter Documentos permitidos (NULL = todos)
+ * @return Documentos em out, ou -1 em falha de alocação
+ */
+long int topk_fill_zeros(DocSim *out, long int n, long int k, long int num_docs,
+                         const uint64_t *deleted, const roaring_t *filter) {
+  if (n >= k)
+    return n;
+
+  long int npos = n;
+  long int *pos_ids = malloc((npos ? npos : 1) * sizeof(long int));
+  if (!pos_ids)
+    return -1;
+  for (long int i = 0; i < npos; i++)
+    pos_ids[i] = out[i].doc_id;
+  qsort(pos_ids, npos, sizeof(long int), compare_long);
+
+  long int j = 0;
+  for (long int d = filter ? roaring_next(filter, 0) : 0;
+       d >= 0 && d < num_docs && n < k;
+       d = filter ? roaring_next(filter, d + 1) : d + 1) {
+    while (j < npos && pos_ids[j] < d)
+      j++;
+    if ((j < npos && pos_ids[j] == d) ||
+        (deleted && ((deleted[d >> 6] >> (d & 63)) & 1)))
+      continue;
+    out[n++] = (DocSim){d, 0.0};
+  }
+  free(pos_ids);
+  return n;
+}
+
+/**
+ * @brief Top-k exato de uma lista de candidatos (modelo por documento)
+ *
+ * Cada candidato recebe o mesmo cosseno de compute_similarities (soma na
+ * ordem dos buckets da query); o hash de cada termo da query é calculado
+ * uma vez para todos os candidatos.
+ *
+ * @param query_tf Vetor TF-IDF da consulta
+ * @param query_norm Norma da consulta
+ * @param global_tf Vetores TF-IDF dos documentos
+ * @param global_doc_norms Normas dos documentos
+ * @param num_docs Número de documentos (para completar com score zero)
+ * @param cands Documentos candidatos (sem repetição)
+ * @param ncands Número de candidatos
+ * @param k Tamanho do top-k
+ * @param out Saída: top-k ordenado (k posições)
+ * @return Documentos em out, ou -1 em falha de alocação
+ */
+long int rerank_top_k(const hash_t *query_tf, double query_norm,
+                      hash_t **global_tf, const double *global_doc_norms,
+                      long int num_docs, const long int *cands,
+                      long int ncands, int k, DocSim *out) {
+  if (k <= 0)
+    return 0;
+
+  size_t nterms = query_tf->size;
+  const HashEntry **terms = malloc((nterms ? nterms : 1) * sizeof(HashEntry *));
+  uint64_t *hashes = malloc((nterms ? nterms : 1) * sizeof(uint64_t));
+  if (!terms || !hashes) {
+    free(terms);
+    free(hashes);
+    return -1;
+  }
+  size_t nt = 0;
+  for (size_t i = 0; i < query_tf->cap; i++)
+    for (HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
+      hashes[nt] = hash_str(e->word, e->wlen);
+      terms[nt++] = e;
+    }
+
+  long int n = 0;
+  for (long int i = 0; i < ncands; i++) {
+    long int d = cands[i];
+    const hash_t *doc = global_tf[d];
+    double norm = global_doc_norms[d];
+    if (!doc || norm <= 0.0)
+      continue;
+    double dot = 0.0;
+    for (size_t t = 0; t < nt; t++) {
+      double v = hash_find_prehashed(doc, terms[t]->word, terms[t]->wlen,
+                                     hashes[t]);
+      if (v > 0.0)
+        dot += terms[t]->value * v;
+    }
+    double sim = query_norm > 0.0 ? dot / (query_norm * norm) : 0.0;
+    if (sim > 0.0)
+      topk_offer(out, &n, k, (DocSim){d, sim});
+  }
+  free(terms);
+  free(hashes);
+
+  qsort(out, n, sizeof(DocSim), compare_sim);
+  return topk_fill_zeros(out, n, k, num_docs, NULL, NULL);
+}
@@ -0,0 +1,433 @@
+/**
+ * @file qcache.c
+ * @brief Cache de consultas em dois níveis com despejo LRU
+ *
+ * - Nível 1 (resultados): a chave é o vetor canônico da consulta (termos já
+ *   normalizados e com stem, em ordem lexicográfica, com seus pesos TF-IDF)
+ *   mais o k pedido; o valor é o top-k já ordenado. Uma consulta repetida,
+ *   mesmo com palavras em outra ordem ou flexões diferentes do mesmo stem,
+ *   é respondida sem pontuação nem ordenação.
+ * - Nível 2 (termos): para o modelo por documento (global_tf), extrair a
+ *   lista de documentos de um termo exige um hash_find em cada documento.
+ *   Os termos consultados ficam guardados como listas (doc_ids, TF-IDF), e
+ *   consultas que repetem termos populares pontuam apenas essas listas.
+ *
+ * Os dois níveis são limitados (número de resultados e bytes de postings) e
+ * despejam o item usado há mais tempo. Todo conteúdo pertence a uma versão
+ * do modelo: qcache_set_version com outra versão esvazia o cache.
+ */
+
+#include "../include/qcache.h"
+#include "../include/mem.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* ------------- LRU Genérico (chave string → bloco alocado) ------------- */
+
+typedef struct lru_node {
+  char *key;
+  uint64_t hash;
+  void *data;             // Bloco único, liberado com free()
+  size_t bytes;           // Bytes contabilizados (chave + dados)
+  struct lru_node *prev;  // Mais recente
+  struct lru_node *next;  // Menos recente
+  struct lru_node *hnext; // Próximo no bucket
+} lru_node;
+
+struct lru_cache {
+  lru_node **buckets;
+  size_t nbuckets;        // Potência de 2
+  lru_node *head;         // Usado mais recentemente
+  lru_node *tail;         // Próximo a ser despejado
+  size_t count;
+  size_t max_count;       // 0 = sem limite de itens
+  size_t bytes;
+  size_t max_bytes;       // 0 = sem limite de bytes
+};
+
+static lru_cache *lru_new(size_t max_count, size_t max_bytes) {
+  lru_cache *c = calloc(1, sizeof(lru_cache));
+  if (!c)
+    return NULL;
+  c->max_count = max_count;
+  c->max_bytes = max_bytes;
+  c->nbuckets = 64;
+  while (c->nbuckets < max_count && c->nbuckets < ((size_t)1 << 20))
+    c->nbuckets <<= 1;
+  if (!max_count)
+    c->nbuckets = 4096;
+  c->buckets = calloc(c->nbuckets, sizeof(lru_node *));
+  if (!c->buckets) {
+    free(c);
+    return NULL;
+  }
+  return c;
+}
+
+static void lru_unlink(lru_cache *c, lru_node *n) {
+  if (n->prev)
+    n->prev->next = n->next;
+  else
+    c->head = n->next;
+  if (n->next)
+    n->next->prev = n->prev;
+  else
+    c->tail = n->prev;
+  n->prev = n->next = NULL;
+}
+
+static void lru_push_front(lru_cache *c, lru_node *n) {
+  n->prev = NULL;
+  n->next = c->head;
+  if (c->head)
+    c->head->prev = n;
+  c->head = n;
+  if (!c->tail)
+    c->tail = n;
+}
+
+static void lru_remove(lru_cache *c, lru_node *n) {
+  lru_node **pp = &c->buckets[n->hash & (c->nbuckets - 1)];
+  while (*pp != n)
+    pp = &(*pp)->hnext;
+  *pp = n->hnext;
+
+  lru_unlink(c, n);
+  c->count--;
+  c->bytes -= n->bytes;
+  mem_track_free(MEM_CACHE, n->bytes);
+  free(n->key);
+  free(n->data);
+  free(n);
+}
+
+static void lru_clear(lru_cache *c) {
+  while (c->tail)
+    lru_remove(c, c->tail);
+}
+
+static void lru_free(lru_cache *c) {
+  if (!c)
+    return;
+  lru_clear(c);
+  free(c->buckets);
+  free(c);
+}
+
+/**
+ * @brief Busca a chave e a marca como usada mais recentemente
+ *
+ * @return Dados do item, ou NULL se ausente
+ */
+static void *lru_get(lru_cache *c, const char *key) {
+  size_t len = strlen(key);
+  uint64_t h = hash_str(key, len);
+  for (lru_node *n = c->buckets[h & (c->nbuckets - 1)]; n; n = n->hnext) {
+    if (n->hash == h && !strcmp(n->key, key)) {
+      if (n != c->head) {
+        lru_unlink(c, n);
+        lru_push_front(c, n);
+      }
+      return n->data;
+    }
+  }
+  return NULL;
+}
+
+static size_t lru_item_bytes(const char *key, size_t bytes) {
+  return bytes + strlen(key) + 1 + sizeof(lru_node);
+}
+
+/**
+ * @brief Verifica se o item cabe no limite de bytes do cache
+ */
+static int lru_fits(const lru_cache *c, const char *key, size_t bytes) {
+  return !c->max_bytes || lru_item_bytes(key, bytes) <= c->max_bytes;
+}
+
+/**
+ * @brief Insere (ou substitui) um item, despejando os menos recentes
+ *
+ * O cache assume a posse de data, inclusive quando o item não cabe.
+ *
+ * @return 0 se inserido, -1 se descartado
+ */
+static int lru_put(lru_cache *c, const char *key, void *data, size_t bytes) {
+  if (!lru_fits(c, key, bytes)) {
+    free(data);
+    return -1;
+  }
+  size_t len = strlen(key);
+  bytes = lru_item_bytes(key, bytes);
+
+  uint64_t h = hash_str(key, len);
+  for (lru_node *n = c->buckets[h & (c->nbuckets - 1)]; n; n = n->hnext) {
+    if (n->hash == h && !strcmp(n->key, key)) {
+      lru_remove(c, n);
+      break;
+    }
+  }
+
+  while (c->tail && ((c->max_count && c->count >= c->max_count) ||
+                     (c->max_bytes && c->bytes + bytes > c->max_bytes)))
+    lru_remove(c, c->tail);
+
+  lru_node *n = malloc(sizeof(lru_node));
+  char *k = strdup(key);
+  if (!n || !k) {
+    free(n);
+    free(k);
+    free(data);
+    return -1;
+  }
+  n->key = k;
+  n->hash = h;
+  n->data = data;
+  n->bytes = bytes;
+  n->hnext = c->buckets[h & (c->nbuckets - 1)];
+  c->buckets[h & (c->nbuckets - 1)] = n;
+  lru_push_front(c, n);
+  c->count++;
+  c->bytes += bytes;
+  mem_track_alloc(MEM_CACHE, bytes);
+  return 0;
+}
+
+/* ------------- Cache de Consultas ------------- */
+
+typedef struct {
+  long int n;
+  DocSim top[];
+} result_entry;
+
+typedef struct {
+  long int n;
+  long int *doc_ids;
+  double *values;
+} term_postings;
+
+/**
+ * @brief Cria o cache de consultas
+ *
+ * @param max_results Máximo de resultados guardados (nível 1)
+ * @param max_term_bytes Máximo de bytes de postings guardados (nível 2)
+ * @param version Versão do modelo carregado
+ * @return Cache, ou NULL em erro
+ */
+qcache_t *qcache_new(size_t max_results, size_t max_term_bytes,
+                     long int version) {
+  qcache_t *cache = calloc(1, sizeof(qcache_t));
+  if (!cache)
+    return NULL;
+  cache->version = version;
+  cache->results = lru_new(max_results ? max_results : 1, 0);
+  cache->terms = lru_new(0, max_term_bytes);
+  if (!cache->results || !cache->terms) {
+    qcache_free(cache);
+    return NULL;
+  }
+  return cache;
+}
+
+void qcache_free(qcache_t *cache) {
+  if (!cache)
+    return;
+  lru_free(cache->results);
+  lru_free(cache->terms);
+  free(cache);
+}
+
+/**
+ * @brief Invalida o cache se o modelo mudou de versão
+ */
+void qcache_set_version(qcache_t *cache, long int version) {
+  if (cache->version == version)
+    return;
+  lru_clear(cache->results);
+  lru_clear(cache->terms);
+  cache->version = version;
+}
+
+static int cmp_entry_word(const void *a, const void *b) {
+  return strcmp((*(const HashEntry *const *)a)->word,
+                (*(const HashEntry *const *)b)->word);
+}
+
+/**
+ * @brief Chave canônica da consulta: "termo=peso;..." em ordem + "k=<k>"
+ *
+ * @param query_tf Vetor TF-IDF da consulta (termos já com stem)
+ * @param k Quantidade de documentos pedida
+ * @return Chave (caller deve liberar), ou NULL em erro
+ */
+char *qcache_key(const hash_t *query_tf, long int k) {
+  size_t n = hash_size(query_tf);
+  const HashEntry **entries = malloc((n ? n : 1) * sizeof(HashEntry *));
+  if (!entries)
+    return NULL;
+
+  size_t m = 0, len = 32;
+  for (size_t i = 0; i < query_tf->cap; i++) {
+    for (const HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
+      entries[m++] = e;
+      len += e->wlen + 32;
+    }
+  }
+  qsort(entries, m, sizeof(HashEntry *), cmp_entry_word);
+
+  char *key = malloc(len);
+  if (key) {
+    size_t off = 0;
+    for (size_t i = 0; i < m; i++)
+      off += snprintf(key + off, len - off, "%s=%.17g;", entries[i]->word,
+                      entries[i]->value);
+    snprintf(key + off, len - off, "k=%ld", k);
+  }
+  free(entries);
+  return key;
+}
+
+/**
+ * @brief Busca o top-k de uma consulta já respondida
+ *
+ * @param n_out Saída: quantidade de documentos do resultado
+ * @return Top-k ordenado (pertence ao cache), ou NULL se ausente
+ */
+const DocSim *qcache_get(qcache_t *cache, const char *key, long int *n_out) {
+  result_entry *r = lru_get(cache->results, key);
+  if (!r) {
+    cache->result_misses++;
+    return NULL;
+  }
+  cache->result_hits++;
+  *n_out = r->n;
+  return r->top;
+}
+
+/**
+ * @brief Guarda o top-k de uma consulta
+ */
+void qcache_put(qcache_t *cache, const char *key, const DocSim *top, long int n) {
+  size_t bytes = sizeof(result_entry) + n * sizeof(DocSim);
+  result_entry *r = malloc(bytes);
+  if (!r)
+    return;
+  r->n = n;
+  memcpy(r->top, top, n * sizeof(DocSim));
+  lru_put(cache->results, key, r, bytes);
+}
+
+/**
+ * @brief Lista de documentos do termo (do cache ou extraída de global_tf)
+ *
+ * @return Postings do termo, ou NULL em falha de alocação. Se a lista não
+ *         couber no cache, *owned recebe 1 e o caller deve liberá-la.
+ */
+static term_postings *term_lookup(qcache_t *cache, const char *word,
+                                  hash_t **global_tf, long int num_docs,
+                                  int *owned) {
+  *owned = 0;
+  term_postings *tp = lru_get(cache->terms, word);
+  if (tp) {
+    cache->term_hits++;
+    return tp;
+  }
+  cache->term_misses++;
+
+  long int n = 0;
+  for (long int d = 0; d < num_docs; d++)
+    if (global_tf[d] && hash_find(global_tf[d], word) > 0.0)
+      n++;
+
+  size_t bytes = sizeof(term_postings) + n * (sizeof(long int) + sizeof(double));
+  tp = malloc(bytes);
+  if (!tp)
+    return NULL;
+  tp->n = n;
+  tp->values = (double *)(tp + 1);
+  tp->doc_ids = (long int *)(tp->values + n);
+
+  long int i = 0;
+  for (long int d = 0; d < num_docs && i < n; d++) {
+    double v = global_tf[d] ? hash_find(global_tf[d], word) : 0.0;
+    if (v > 0.0) {
+      tp->doc_ids[i] = d;
+      tp->values[i++] = v;
+    }
+  }
+
+  // Listas maiores que o cache inteiro são usadas uma vez e descartadas
+  if (!lru_fits(cache->terms, word, bytes)) {
+    *owned = 1;
+    return tp;
+  }
+  return lru_put(cache->terms, word, tp, bytes) == 0 ? tp : NULL;
+}
+
+/**
+ * @brief Similaridade de cosseno termo a termo usando o cache de termos
+ *
+ * Para cada documento, os produtos são somados na mesma ordem de
+ * compute_similarities_thread (ordem dos buckets da query), então os
+ * scores são idênticos aos da varredura por documento.
+ *
+ * @return Vetor de similaridades (num_docs posições), ou NULL em erro
+ */
+double *qcache_similarities(qcache_t *cache, const hash_t *query_tf,
+                            double query_norm, hash_t **global_tf,
+                            const double *global_doc_norms, long int num_docs) {
+  if (!query_tf || !global_tf || !global_doc_norms || num_docs <= 0)
+    return NULL;
+
+  double *similarities = calloc(num_docs, sizeof(double));
+  if (!similarities)
+    return NULL;
+  mem_track_alloc(MEM_QUERY, num_docs * sizeof(double));
+
+  for (size_t b = 0; b < query_tf->cap; b++) {
+    for (const HashEntry *q = query_tf->buckets[b]; q; q = q->next) {
+      int owned;
+      term_postings *tp = term_lookup(cache, q->word, global_tf, num_docs, &owned);
+      if (!tp) {
+        mem_track_free(MEM_QUERY, num_docs * sizeof(double));
+        free(similarities);
+        return NULL;
+      }
+      for (long int i = 0; i < tp->n; i++)
+        similarities[tp->doc_ids[i]] += q->value * tp->values[i];
+      if (owned)
+        free(tp);
+    }
+  }
+
+  for (long int d = 0; d < num_docs; d++) {
+    double doc_norm = global_doc_norms[d];
+    if (query_norm > 0.0 && doc_norm > 0.0)
+      similarities[d] /= query_norm * doc_norm;
+    else
+      similarities[d] = 0.0;
+  }
+  return similarities;
+}
+
+static void report_level(FILE *out, const char *name, long int hits,
+                         long int misses, const lru_cache *c) {
+  long int total = hits + misses;
+  char size[32];
+  mem_format_size(c->bytes, size, sizeof(size));
+  fprintf(out, "[CACHE] %-10s acertos=%ld faltas=%ld taxa=%.1f%% itens=%zu (%s)\n",
+          name, hits, misses, total ? 100.0 * hits / total : 0.0, c->count,
+          size);
+}
+
+/**
+ * @brief Exibe contadores de acerto de cada nível
+ */
+void qcache_report(const qcache_t *cache, FILE *out) {
+  report_level(out, "resultados", cache->result_hits, cache->result_misses,
+               cache->results);
+  report_level(out, "termos", cache->term_hits, cache->term_misses,
+               cache->terms);
+}
@@ -0,0 +1,432 @@
+/**
+ * @file roaring.c
+ * @brief Conjunto de documentos em bitmap comprimido (estilo Roaring)
+ *
+ * Os doc_ids (32 bits) são agrupados pelos 16 bits altos. Cada grupo é um
+ * contêiner: até ROARING_ARRAY_MAX documentos, um array ordenado dos 16 bits
+ * baixos; acima disso, um bitmap de 65536 bits (8 KB). Os contêineres ficam
+ * em ordem de key, então um intervalo de 65536 documentos sem nenhum
+ * documento do filtro não ocupa espaço e é saltado inteiro por
+ * roaring_next.
+ *
+ * Formato em disco (roaring_save):
+ *   magic[8], long int n, long int card,
+ *   n × {uint16_t key, uint16_t is_bitmap, uint32_t card,
+ *        card × uint16_t (array) ou 1024 × uint64_t (bitmap)}
+ */
+
+#include "../include/roaring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ROARING_MAGIC "ROARING1"
+#define ROARING_WORDS 1024  /**< Palavras de 64 bits de um contêiner bitmap */
+
+roaring_t *roaring_new(void) { return calloc(1, sizeof(roaring_t)); }
+
+void roaring_free(roaring_t *r) {
+  if (!r)
+    return;
+  for (long int i = 0; i < r->n; i++) {
+    free(r->c[i].array);
+    free(r->c[i].bits);
+  }
+  free(r->c);
+  free(r);
+}
+
+/**
+ * @brief Primeiro contêiner com key >= key (r->n se nenhum)
+ */
+static long int find_key(const roaring_t *r, uint32_t key) {
+  // Inserções em ordem crescente caem quase sempre no último contêiner
+  if (r->n > 0 && r->c[r->n - 1].key < key)
+    return r->n;
+  long int lo = 0, hi = r->n;
+  while (lo < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (r->c[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static long int lower_bound16(const uint16_t *a, long int n, uint32_t x) {
+  long int lo = 0, hi = n;
+  while (lo < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (a[mid] < x)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+/**
+ * @brief Contêiner de key (criado vazio, como array, se não existe)
+ */
+static roaring_container *get_container(roaring_t *r, uint32_t key) {
+  long int i = find_key(r, key);
+  if (i < r->n && r->c[i].key == key)
+    return &r->c[i];
+  if (r->n == r->cap) {
+    long int cap = r->cap ? 2 * r->cap : 16;
+    roaring_container *c = realloc(r->c, cap * sizeof(roaring_container));
+    if (!c)
+      return NULL;
+    r->c = c;
+    r->cap = cap;
+  }
+  memmove(&r->c[i + 1], &r->c[i], (r->n - i) * sizeof(roaring_container));
+  r->c[i] = (roaring_container){(uint16_t)key, 0, 0, NULL, NULL};
+  r->n++;
+  return &r->c[i];
+}
+
+static int to_bitmap(roaring_container *c) {
+  if (c->bits)
+    return 0;
+  uint64_t *bits = calloc(ROARING_WORDS, sizeof(uint64_t));
+  if (!bits)
+    return -1;
+  for (uint32_t i = 0; i < c->card; i++)
+    bits[c->array[i] >> 6] |= 1ULL << (c->array[i] & 63);
+  free(c->array);
+  c->array = NULL;
+  c->cap = 0;
+  c->bits = bits;
+  return 0;
+}
+
+/**
+ * @brief Insere x no conjunto
+ *
+ * @return 0 em sucesso, -1 em falha de alocação
+ */
+int roaring_add(roaring_t *r, uint32_t x) {
+  roaring_container *c = get_container(r, x >> 16);
+  if (!c)
+    return -1;
+  uint32_t low = x & 0xFFFF;
+
+  if (c->bits) {
+    uint64_t bit = 1ULL << (low & 63);
+    if (!(c->bits[low >> 6] & bit)) {
+      c->bits[low >> 6] |= bit;
+      c->card++;
+      r->card++;
+    }
+    return 0;
+  }
+
+  long int pos = lower_bound16(c->array, c->card, low);
+  if (pos < c->card && c->array[pos] == low)
+    return 0;
+  if (c->card == ROARING_ARRAY_MAX) {
+    if (to_bitmap(c) != 0)
+      return -1;
+    return roaring_add(r, x);
+  }
+  if (c->card == c->cap) {
+    uint32_t cap = c->cap ? 2 * c->cap : 16;
+    if (cap > ROARING_ARRAY_MAX)
+      cap = ROARING_ARRAY_MAX;
+    uint16_t *array = realloc(c->array, cap * sizeof(uint16_t));
+    if (!array)
+      return -1;
+    c->array = array;
+    c->cap = cap;
+  }
+  memmove(&c->array[pos + 1], &c->array[pos], (c->card - pos) * sizeof(uint16_t));
+  c->array[pos] = (uint16_t)low;
+  c->card++;
+  r->card++;
+  return 0;
+}
+
+/**
+ * @brief Insere o intervalo [lo, hi]
+ *
+ * Trechos de mais de ROARING_ARRAY_MAX documentos em um mesmo contêiner
+ * são marcados direto no bitmap.
+ *
+ * @return 0 em sucesso, -1 em falha de alocação
+ */
+int roaring_add_range(roaring_t *r, uint32_t lo, uint32_t hi) {
+  if (lo > hi)
+    return 0;
+  for (uint32_t key = lo >> 16; key <= (hi >> 16); key++) {
+    uint32_t clo = key == (lo >> 16) ? (lo & 0xFFFF) : 0;
+    uint32_t chi = key == (hi >> 16) ? (hi & 0xFFFF) : 0xFFFF;
+    roaring_container *c = get_container(r, key);
+    if (!c)
+      return -1;
+
+    if (!c->bits && chi - clo + 1 <= ROARING_ARRAY_MAX) {
+      for (uint32_t v = clo; v <= chi; v++)
+        if (roaring_add(r, (key << 16) | v) != 0)
+          return -1;
+      continue;
+    }
+    if (to_bitmap(c) != 0)
+      return -1;
+    for (uint32_t v = clo; v <= chi;) {
+      if ((v & 63) == 0 && v + 63 <= chi) {
+        c->bits[v >> 6] = ~0ULL;
+        v += 64;
+      } else {
+        c->bits[v >> 6] |= 1ULL << (v & 63);
+        v++;
+      }
+    }
+    r->card -= c->card;
+    c->card = 0;
+    for (int w = 0; w < ROARING_WORDS; w++)
+      c->card += __builtin_popcountll(c->bits[w]);
+    r->card += c->card;
+  }
+  return 0;
+}
+
+/**
+ * @brief Interseção de dois conjuntos
+ *
+ * @return Novo conjunto, ou NULL em falha de alocação
+ */
+roaring_t *roaring_and(const roaring_t *a, const roaring_t *b) {
+  roaring_t *r = roaring_new();
+  if (!r)
+    return NULL;
+  long int i = 0, j = 0;
+  while (i < a->n && j < b->n) {
+    const roaring_container *x = &a->c[i], *y = &b->c[j];
+    if (x->key < y->key) {
+      i++;
+      continue;
+    }
+    if (y->key < x->key) {
+      j++;
+      continue;
+    }
+    uint32_t base = (uint32_t)x->key << 16;
+    if (x->bits && y->bits) {
+      for (int w = 0; w < ROARING_WORDS; w++)
+        for (uint64_t m = x->bits[w] & y->bits[w]; m; m &= m - 1)
+          if (roaring_add(r, base | (uint32_t)(w * 64 + __builtin_ctzll(m))) != 0)
+            goto fail;
+    } else {
+      // Array contra array ou bitmap: percorre o array
+      const roaring_container *s = x->bits ? y : x, *o = x->bits ? x : y;
+      for (uint32_t k = 0; k < s->card; k++) {
+        uint32_t v = s->array[k];
+        int in = o->bits ? (int)((o->bits[v >> 6] >> (v & 63)) & 1)
+                         : (lower_bound16(o->array, o->card, v) < o->card &&
+                            o->array[lower_bound16(o->array, o->card, v)] == v);
+        if (in && roaring_add(r, base | v) != 0)
+          goto fail;
+      }
+    }
+    i++;
+    j++;
+  }
+  return r;
+
+fail:
+  roaring_free(r);
+  return NULL;
+}
+
+/**
+ * @brief Conjunto a partir de intervalos, ex.: "0-999,5000,7000-7999"
+ *
+ * @return Conjunto, ou NULL se a lista é inválida
+ */
+roaring_t *roaring_from_ranges(const char *spec) {
+  roaring_t *r = roaring_new();
+  const char *p = spec;
+  while (r && p && *p) {
+    char *end;
+    long int lo = strtol(p, &end, 10), hi = lo;
+    if (end == p || lo < 0)
+      goto fail;
+    p = end;
+    if (*p == '-') {
+      hi = strtol(p + 1, &end, 10);
+      if (end == p + 1 || hi < lo)
+        goto fail;
+      p = end;
+    }
+    if (hi > UINT32_MAX || roaring_add_range(r, (uint32_t)lo, (uint32_t)hi) != 0)
+      goto fail;
+    if (*p == ',')
+      p++;
+    else if (*p)
+      goto fail;
+  }
+  return r;
+
+fail:
+  fprintf(stderr, "Lista de intervalos inválida: %s\n", spec);
+  roaring_free(r);
+  return NULL;
+}
+
+/* ------------- Consulta ------------- */
+
+int roaring_contains(const roaring_t *r, uint32_t x) {
+  long int i = find_key(r, x >> 16);
+  if (i >= r->n || r->c[i].key != (x >> 16))
+    return 0;
+  const roaring_container *c = &r->c[i];
+  uint32_t low = x & 0xFFFF;
+  if (c->bits)
+    return (c->bits[low >> 6] >> (low & 63)) & 1;
+  long int pos = lower_bound16(c->array, c->card, low);
+  return pos < c->card && c->array[pos] == low;
+}
+
+/**
+ * @brief Menor documento do conjunto >= x
+ *
+ * Contêineres ausentes (65536 documentos sem nenhum do conjunto) são
+ * saltados de uma vez; no bitmap, 64 documentos por palavra.
+ *
+ * @return Documento, ou -1 se não há nenhum >= x
+ */
+long int roaring_next(const roaring_t *r, long int x) {
+  if (x < 0)
+    x = 0;
+  if (x > (long int)UINT32_MAX)
+    return -1;
+  uint32_t key = (uint32_t)x >> 16, low = (uint32_t)x & 0xFFFF;
+  for (long int i = find_key(r, key); i < r->n; i++, low = 0) {
+    const roaring_container *c = &r->c[i];
+    if (c->key > key)
+      low = 0;
+    long int base = (long int)c->key << 16;
+    if (c->bits) {
+      long int w = low >> 6;
+      uint64_t m = c->bits[w] & (~0ULL << (low & 63));
+      while (!m && ++w < ROARING_WORDS)
+        m = c->bits[w];
+      if (m)
+        return base + w * 64 + __builtin_ctzll(m);
+    } else {
+      long int pos = lower_bound16(c->array, c->card, low);
+      if (pos < c->card)
+        return base + c->array[pos];
+    }
+  }
+  return -1;
+}
+
+size_t roaring_bytes(const roaring_t *r) {
+  size_t bytes = sizeof(roaring_t) + r->cap * sizeof(roaring_container);
+  for (long int i = 0; i < r->n; i++)
+    bytes += r->c[i].bits ? ROARING_WORDS * sizeof(uint64_t)
+                          : r->c[i].cap * sizeof(uint16_t);
+  return bytes;
+}
+
+/* ------------- Persistência ------------- */
+
+/**
+ * @brief Grava o conjunto (gravado em .tmp e trocado com rename)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+int roaring_save(const roaring_t *r, const char *filename) {
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+  int ok = fwrite(ROARING_MAGIC, 1, 8, fp) == 8 &&
+           fwrite(&r->n, sizeof(long int), 1, fp) == 1 &&
+           fwrite(&r->card, sizeof(long int), 1, fp) == 1;
+  for (long int i = 0; ok && i < r->n; i++) {
+    const roaring_container *c = &r->c[i];
+    uint16_t is_bitmap = c->bits != NULL;
+    ok = fwrite(&c->key, sizeof(uint16_t), 1, fp) == 1 &&
+         fwrite(&is_bitmap, sizeof(uint16_t), 1, fp) == 1 &&
+         fwrite(&c->card, sizeof(uint32_t), 1, fp) == 1 &&
+         (is_bitmap
+              ? fwrite(c->bits, sizeof(uint64_t), ROARING_WORDS, fp) == ROARING_WORDS
+              : fwrite(c->array, sizeof(uint16_t), c->card, fp) == c->card);
+  }
+  if (fclose(fp) != 0)
+    ok = 0;
+  if (!ok || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar filtro %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Carrega um conjunto gravado por roaring_save
+ *
+ * @return Conjunto, ou NULL (arquivo ausente ou inválido)
+ */
+roaring_t *roaring_load(const char *filename) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+    return NULL;
+
+  char magic[8];
+  long int n = 0, card = 0;
+  roaring_t *r = NULL;
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, ROARING_MAGIC, 8) != 0 ||
+      fread(&n, sizeof(long int), 1, fp) != 1 ||
+      fread(&card, sizeof(long int), 1, fp) != 1 || n < 0 || n > 65536 ||
+      !(r = roaring_new()) ||
+      !(r->c = calloc(n ? n : 1, sizeof(roaring_container))))
+    goto fail;
+  r->cap = n;
+
+  for (long int i = 0; i < n; i++) {
+    roaring_container *c = &r->c[r->n++];
+    uint16_t is_bitmap;
+    if (fread(&c->key, sizeof(uint16_t), 1, fp) != 1 ||
+        fread(&is_bitmap, sizeof(uint16_t), 1, fp) != 1 ||
+        fread(&c->card, sizeof(uint32_t), 1, fp) != 1 ||
+        (i > 0 && c->key <= r->c[i - 1].key))
+      goto fail;
+    if (is_bitmap) {
+      c->bits = malloc(ROARING_WORDS * sizeof(uint64_t));
+      if (!c->bits ||
+          fread(c->bits, sizeof(uint64_t), ROARING_WORDS, fp) != ROARING_WORDS)
+        goto fail;
+    } else {
+      if (c->card > ROARING_ARRAY_MAX)
+        goto fail;
+      c->cap = c->card;
+      c->array = malloc((c->card ? c->card : 1) * sizeof(uint16_t));
+      if (!c->array || fread(c->array, sizeof(uint16_t), c->card, fp) != c->card)
+        goto fail;
+    }
+    r->card += c->card;
+  }
+  fclose(fp);
+  if (r->card != card) {
+    fprintf(stderr, "Erro: filtro inválido: %s\n", filename);
+    roaring_free(r);
+    return NULL;
+  }
+  return r;
+
+fail:
+  fprintf(stderr, "Erro: filtro inválido: %s\n", filename);
+  fclose(fp);
+  roaring_free(r);
+  return NULL;
+}
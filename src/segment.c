@@ -0,0 +1,1078 @@
+/**
+ * @file segment.c
+ * @brief Índice incremental formado por segmentos imutáveis
+ *
+ * Cada segmento é um run do SPIMI com TF bruto (ver spimi_build_run) seguido
+ * da lista de documentos que ele cobre:
+ *
+ *     <run>  long int doc_ids[ndocs] (crescentes), long int ndocs
+ *
+ * Nenhum peso depende do IDF, de modo que um segmento nunca precisa ser
+ * reescrito quando o corpus cresce. A lista de segmentos fica no manifesto
+ * models/segments_<table>.txt:
+ *
+ *     next_seq <n>
+ *     <arquivo> <first_id> <last_id> <ndocs> <ndeleted>
+ *
+ * O manifesto é sempre reescrito em um arquivo temporário e trocado com
+ * rename(), então um leitor vê a versão antiga ou a nova, nunca uma parcial.
+ *
+ * Remoções não alteram o segmento: o documento é marcado no bitmap de
+ * tombstones do segmento (<arquivo>.del, um bit por posição da lista de
+ * documentos). Uma atualização marca a versão antiga e indexa o texto atual
+ * em um segmento novo, de modo que cada article_id está vivo em no máximo
+ * um segmento.
+ *
+ * - segment_update indexa apenas as linhas com article_id maior que o último
+ *   indexado, em um novo segmento;
+ * - segment_delete / segment_reindex aplicam remoções e atualizações;
+ * - segment_open junta os segmentos em um inv_index_t ignorando postings
+ *   removidos e recalcula df, N (documentos vivos), IDF, TF-IDF e normas a
+ *   partir do TF bruto, o que mantém os scores corretos após cada mudança;
+ * - segment_merge aplica a política em camadas (tiered): sempre que houver
+ *   `factor` segmentos consecutivos na mesma camada (floor(log_factor(docs))),
+ *   eles são unidos em um só. O número de segmentos fica em
+ *   O(factor * log_factor(N));
+ * - segment_compact reescreve o índice sem os documentos removidos quando a
+ *   fração de tombstones passa do limite.
+ */
+
+#include "../include/segment.h"
+#include "../include/log.h"
+#include "../include/mem.h"
+#include "../include/sqlite_helper.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BIT_WORDS(n) (((n) + 63) / 64)
+#define BIT_TEST(bits, i) (((bits)[(i) >> 6] >> ((i) & 63)) & 1)
+#define BIT_SET(bits, i) ((bits)[(i) >> 6] |= (uint64_t)1 << ((i) & 63))
+
+/* ------------- Manifesto ------------- */
+
+static void manifest_filename(char *filename, const char *table) {
+  snprintf(filename, 256, "models/segments_%s.txt", table);
+}
+
+static void tombstone_filename(char *filename, const segment_info *seg) {
+  snprintf(filename, 300, "%s.del", seg->file);
+}
+
+/**
+ * @brief Libera a lista de segmentos do manifesto
+ */
+void segment_manifest_free(segment_manifest *manifest) {
+  free(manifest->segs);
+  manifest->segs = NULL;
+  manifest->count = 0;
+}
+
+/**
+ * @brief Lê o manifesto de segmentos da tabela
+ *
+ * Um manifesto inexistente equivale a um índice vazio.
+ *
+ * @param table Nome da tabela
+ * @param manifest Manifesto a preencher
+ * @return 0 em sucesso, -1 se o manifesto estiver corrompido
+ */
+int segment_manifest_load(const char *table, segment_manifest *manifest) {
+  char filename[256];
+  manifest_filename(filename, table);
+  memset(manifest, 0, sizeof(*manifest));
+
+  FILE *fp = fopen(filename, "r");
+  if (!fp)
+    return 0;
+
+  int cap = 0;
+  if (fscanf(fp, "next_seq %ld\n", &manifest->next_seq) != 1) {
+    fprintf(stderr, "Erro: manifesto inválido: %s\n", filename);
+    fclose(fp);
+    return -1;
+  }
+
+  segment_info seg;
+  while (fscanf(fp, "%255s %ld %ld %ld %ld\n", seg.file, &seg.first_id,
+                &seg.last_id, &seg.ndocs, &seg.ndeleted) == 5) {
+    if (manifest->count == cap) {
+      cap = cap ? cap * 2 : 8;
+      segment_info *ns = realloc(manifest->segs, cap * sizeof(segment_info));
+      if (!ns) {
+        segment_manifest_free(manifest);
+        fclose(fp);
+        return -1;
+      }
+      manifest->segs = ns;
+    }
+    manifest->segs[manifest->count++] = seg;
+  }
+
+  fclose(fp);
+  return 0;
+}
+
+/**
+ * @brief Grava o manifesto de forma atômica (arquivo temporário + rename)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int manifest_save(const char *table, const segment_manifest *manifest) {
+  char filename[256], tmp[300];
+  manifest_filename(filename, table);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "w");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+
+  fprintf(fp, "next_seq %ld\n", manifest->next_seq);
+  for (int i = 0; i < manifest->count; i++) {
+    const segment_info *s = &manifest->segs[i];
+    fprintf(fp, "%s %ld %ld %ld %ld\n", s->file, s->first_id, s->last_id,
+            s->ndocs, s->ndeleted);
+  }
+
+  if (fclose(fp) != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar manifesto %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+static int manifest_append(segment_manifest *manifest, const segment_info *seg) {
+  segment_info *ns =
+      realloc(manifest->segs, (manifest->count + 1) * sizeof(segment_info));
+  if (!ns)
+    return -1;
+  manifest->segs = ns;
+  manifest->segs[manifest->count++] = *seg;
+  return 0;
+}
+
+/**
+ * @brief Próximo article_id ainda não coberto por nenhum segmento
+ */
+static long int manifest_next_id(const segment_manifest *manifest) {
+  long int next_id = 0;
+  for (int i = 0; i < manifest->count; i++)
+    if (manifest->segs[i].last_id + 1 > next_id)
+      next_id = manifest->segs[i].last_id + 1;
+  return next_id;
+}
+
+/* ------------- Lista de Documentos e Tombstones ------------- */
+
+/**
+ * @brief Acrescenta a lista de documentos ao final do run do segmento
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int append_doc_list(const char *filename, const long int *ids,
+                           long int n) {
+  FILE *fp = fopen(filename, "ab");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir segmento %s\n", filename);
+    return -1;
+  }
+  fwrite(ids, sizeof(long int), n, fp);
+  fwrite(&n, sizeof(long int), 1, fp);
+  return fclose(fp) == 0 ? 0 : -1;
+}
+
+/**
+ * @brief Lê a lista de documentos cobertos por um segmento
+ *
+ * @param filename Arquivo do segmento
+ * @param n_out Saída: número de documentos
+ * @return Vetor de article_ids crescentes (caller deve liberar), ou NULL em erro
+ */
+static long int *read_doc_list(const char *filename, long int *n_out) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir segmento %s\n", filename);
+    return NULL;
+  }
+
+  long int n = 0;
+  long int *ids = NULL;
+  if (fseek(fp, -(long int)sizeof(long int), SEEK_END) == 0 &&
+      fread(&n, sizeof(long int), 1, fp) == 1 && n >= 0 &&
+      fseek(fp, -(long int)((n + 1) * sizeof(long int)), SEEK_END) == 0) {
+    ids = malloc((n ? n : 1) * sizeof(long int));
+    if (ids && fread(ids, sizeof(long int), n, fp) != (size_t)n) {
+      free(ids);
+      ids = NULL;
+    }
+  }
+  fclose(fp);
+
+  if (!ids)
+    fprintf(stderr, "Erro: lista de documentos inválida em %s\n", filename);
+  *n_out = n;
+  return ids;
+}
+
+/**
+ * @brief Carrega o bitmap de tombstones do segmento (zerado se não existir)
+ *
+ * @param seg Segmento
+ * @param ndocs Tamanho da lista de documentos do segmento
+ * @return Bitmap com BIT_WORDS(ndocs) palavras (caller deve liberar)
+ */
+static uint64_t *load_tombstones(const segment_info *seg, long int ndocs) {
+  uint64_t *bits = calloc(BIT_WORDS(ndocs) ? BIT_WORDS(ndocs) : 1,
+                          sizeof(uint64_t));
+  if (!bits || seg->ndeleted == 0)
+    return bits;
+
+  char filename[300];
+  tombstone_filename(filename, seg);
+  FILE *fp = fopen(filename, "rb");
+  long int nbits = 0;
+  if (!fp || fread(&nbits, sizeof(long int), 1, fp) != 1 || nbits != ndocs ||
+      fread(bits, sizeof(uint64_t), BIT_WORDS(ndocs), fp) !=
+          (size_t)BIT_WORDS(ndocs)) {
+    fprintf(stderr, "Erro: tombstones inválidos em %s\n", filename);
+    free(bits);
+    bits = NULL;
+  }
+  if (fp)
+    fclose(fp);
+  return bits;
+}
+
+static int save_tombstones(const segment_info *seg, const uint64_t *bits,
+                           long int ndocs) {
+  char filename[300], tmp[310];
+  tombstone_filename(filename, seg);
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+  fwrite(&ndocs, sizeof(long int), 1, fp);
+  fwrite(bits, sizeof(uint64_t), BIT_WORDS(ndocs), fp);
+  if (fclose(fp) != 0 || rename(tmp, filename) != 0) {
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+static void remove_segment_files(const segment_info *seg) {
+  char filename[300];
+  tombstone_filename(filename, seg);
+  remove(seg->file);
+  remove(filename);
+}
+
+/* ------------- Atualização ------------- */
+
+static int cmp_long(const void *a, const void *b) {
+  long int x = *(const long int *)a, y = *(const long int *)b;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Indexa ids (crescentes) ou o intervalo [first, first + n) em um
+ *        novo segmento e o acrescenta ao manifesto (sem gravá-lo)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int add_segment(const spimi_config *cfg, segment_manifest *manifest,
+                       const long int *ids, long int first, long int n) {
+  segment_info seg = {0};
+  snprintf(seg.file, sizeof(seg.file), "models/seg_%s_%ld.bin", cfg->table,
+           manifest->next_seq);
+  seg.first_id = ids ? ids[0] : first;
+  seg.last_id = ids ? ids[n - 1] : first + n - 1;
+  seg.ndocs = n;
+
+  spimi_config scfg = *cfg;
+  scfg.entries = n;
+  if (scfg.nthreads > n)
+    scfg.nthreads = (int)n;
+
+  long int *range = NULL;
+  if (!ids) {
+    range = malloc(n * sizeof(long int));
+    if (!range)
+      return -1;
+    for (long int i = 0; i < n; i++)
+      range[i] = first + i;
+  }
+
+  int rc = ids ? spimi_build_run_ids(&scfg, ids, seg.file)
+               : spimi_build_run(&scfg, first, seg.file);
+  if (rc == 0)
+    rc = append_doc_list(seg.file, ids ? ids : range, n);
+  if (rc == 0)
+    rc = manifest_append(manifest, &seg);
+  free(range);
+
+  if (rc != 0) {
+    remove(seg.file);
+    return -1;
+  }
+  manifest->next_seq++;
+  return 0;
+}
+
+/**
+ * @brief Indexa em um novo segmento as linhas ainda não indexadas
+ *
+ * @param cfg Configuração do SPIMI (db, table, nthreads, batch, block_bytes,
+ *            tmp_dir); entries é ignorado
+ * @return Número de documentos novos (0 se o índice já está atualizado),
+ *         ou -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+long int segment_update(const spimi_config *cfg) {
+  segment_manifest manifest;
+  if (segment_manifest_load(cfg->table, &manifest) != 0)
+    return -1;
+
+  long int next_id = manifest_next_id(&manifest);
+  long int max_id = get_single_int(
+      cfg->db, "select coalesce(max(article_id), -1) from \"%w\";", cfg->table);
+  long int count = max_id + 1 - next_id;
+  if (count <= 0) {
+    segment_manifest_free(&manifest);
+    return 0;
+  }
+
+  printf("[SEGMENTOS] Indexando %ld documentos novos [%ld, %ld]\n", count,
+         next_id, max_id);
+  int rc = add_segment(cfg, &manifest, NULL, next_id, count);
+  if (rc == 0)
+    rc = manifest_save(cfg->table, &manifest);
+
+  segment_manifest_free(&manifest);
+  return rc == 0 ? count : -1;
+}
+
+/**
+ * @brief Marca documentos como removidos nos segmentos em que estão vivos
+ *
+ * @param manifest Manifesto (ndeleted é atualizado; não é gravado aqui)
+ * @param ids article_ids em ordem crescente
+ * @param n Número de ids
+ * @return Número de documentos marcados, ou -1 em erro
+ */
+static long int mark_deleted(segment_manifest *manifest, const long int *ids,
+                             long int n) {
+  long int marked = 0;
+
+  for (int s = 0; s < manifest->count; s++) {
+    segment_info *seg = &manifest->segs[s];
+    if (n == 0 || ids[n - 1] < seg->first_id || ids[0] > seg->last_id)
+      continue;
+
+    long int ndocs;
+    long int *docs = read_doc_list(seg->file, &ndocs);
+    uint64_t *dead = docs ? load_tombstones(seg, ndocs) : NULL;
+    if (!docs || !dead) {
+      free(docs);
+      return -1;
+    }
+
+    long int changed = 0;
+    for (long int i = 0; i < n; i++) {
+      const long int *hit = bsearch(&ids[i], docs, ndocs, sizeof(long int),
+                                    cmp_long);
+      if (!hit)
+        continue;
+      long int pos = hit - docs;
+      if (!BIT_TEST(dead, pos)) {
+        BIT_SET(dead, pos);
+        changed++;
+      }
+    }
+
+    int rc = 0;
+    if (changed) {
+      rc = save_tombstones(seg, dead, ndocs);
+      seg->ndeleted += changed;
+      marked += changed;
+    }
+    free(docs);
+    free(dead);
+    if (rc != 0)
+      return -1;
+  }
+  return marked;
+}
+
+/**
+ * @brief Ordena e remove duplicatas de uma lista de ids
+ *
+ * @return Nova quantidade de ids
+ */
+static long int sort_unique(long int *ids, long int n) {
+  qsort(ids, n, sizeof(long int), cmp_long);
+  long int m = 0;
+  for (long int i = 0; i < n; i++)
+    if (m == 0 || ids[i] != ids[m - 1])
+      ids[m++] = ids[i];
+  return m;
+}
+
+/**
+ * @brief Remove documentos do índice (tombstones)
+ *
+ * @param table Nome da tabela
+ * @param ids article_ids a remover (reordenados aqui)
+ * @param n Número de ids
+ * @return Número de documentos removidos, ou -1 em erro
+ */
+long int segment_delete(const char *table, long int *ids, long int n) {
+  segment_manifest manifest;
+  if (segment_manifest_load(table, &manifest) != 0)
+    return -1;
+
+  n = sort_unique(ids, n);
+  long int marked = mark_deleted(&manifest, ids, n);
+  if (marked > 0 && manifest_save(table, &manifest) != 0)
+    marked = -1;
+
+  segment_manifest_free(&manifest);
+  return marked;
+}
+
+/**
+ * @brief Reindexa documentos alterados na tabela
+ *
+ * A versão antiga de cada id recebe tombstone e o texto atual é indexado em
+ * um segmento novo. Ids que não existem mais na tabela ficam apenas
+ * removidos.
+ *
+ * @param cfg Configuração do SPIMI (db, table, nthreads, batch, tmp_dir)
+ * @param ids article_ids alterados (reordenados aqui)
+ * @param n Número de ids
+ * @return Número de documentos reindexados, ou -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+long int segment_reindex(const spimi_config *cfg, long int *ids, long int n) {
+  segment_manifest manifest;
+  if (segment_manifest_load(cfg->table, &manifest) != 0)
+    return -1;
+
+  n = sort_unique(ids, n);
+  long int rc = mark_deleted(&manifest, ids, n);
+
+  // Apenas ids que ainda existem (e já foram alcançados pela indexação)
+  long int next_id = manifest_next_id(&manifest);
+  long int live = 0;
+  char **texts = rc >= 0 && n > 0 ? get_documents_by_ids(cfg->db, cfg->table, ids, n)
+                                  : NULL;
+  for (long int i = 0; texts && i < n; i++)
+    if (texts[i] && ids[i] < next_id)
+      ids[live++] = ids[i];
+  free_str_arr(texts, n);
+
+  if (rc >= 0 && live > 0) {
+    printf("[SEGMENTOS] Reindexando %ld documentos alterados\n", live);
+    if (add_segment(cfg, &manifest, ids, 0, live) != 0)
+      rc = -1;
+  }
+  if (rc >= 0 && manifest_save(cfg->table, &manifest) != 0)
+    rc = -1;
+
+  segment_manifest_free(&manifest);
+  return rc < 0 ? -1 : live;
+}
+
+/* ------------- Carregamento (segmentos → listas com TF bruto) ------------- */
+
+typedef struct {
+  inv_index_t *index;
+  long int *caps;     // Capacidade de cada lista em construção
+  char *unsorted;     // Lista recebeu doc_id menor que o último (atualizações)
+  long int cap;       // Capacidade de index->lists
+  uint64_t *live;     // Documentos vivos por article_id
+  long int num_live;  // Quantidade de documentos vivos
+} index_builder;
+
+static int builder_init(index_builder *b, long int num_docs) {
+  memset(b, 0, sizeof(*b));
+  b->index = calloc(1, sizeof(inv_index_t));
+  b->live = calloc(BIT_WORDS(num_docs) ? BIT_WORDS(num_docs) : 1,
+                   sizeof(uint64_t));
+  if (!b->index || !b->live) {
+    free(b->index);
+    free(b->live);
+    memset(b, 0, sizeof(*b));
+    return -1;
+  }
+  b->index->lookup = hash_new();
+  b->index->num_docs = num_docs;
+  return 0;
+}
+
+/**
+ * @brief Libera estruturas auxiliares; devolve o índice (ou o libera em erro)
+ */
+static void builder_finish(index_builder *b, int failed) {
+  if (!failed) {
+    mem_track_free(MEM_POSTINGS,
+                   (b->cap - b->index->num_terms) * sizeof(PostingList));
+    for (long int t = 0; t < b->index->num_terms; t++)
+      mem_track_free(MEM_POSTINGS, (b->caps[t] - b->index->lists[t].df) *
+                                       (sizeof(long int) + sizeof(double)));
+  } else {
+    index_free(b->index);
+    b->index = NULL;
+  }
+  free(b->caps);
+  free(b->unsorted);
+  b->caps = NULL;
+  b->unsorted = NULL;
+}
+
+/**
+ * @brief Acrescenta postings (TF bruto em values) à lista do termo
+ *
+ * @return 0 em sucesso, -1 em falha de alocação
+ */
+static int builder_append(index_builder *b, const char *word, size_t wlen,
+                          const long int *ids, const int *tfs, long int n) {
+  inv_index_t *index = b->index;
+  long int pos;
+
+  if (hash_contains(index->lookup, word)) {
+    pos = (long int)hash_find(index->lookup, word);
+  } else {
+    if (index->num_terms == b->cap) {
+      long int ncap = b->cap ? b->cap * 2 : 1024;
+      PostingList *nl = realloc(index->lists, ncap * sizeof(PostingList));
+      if (!nl)
+        return -1;
+      index->lists = nl;
+      long int *nc = realloc(b->caps, ncap * sizeof(long int));
+      if (!nc)
+        return -1;
+      b->caps = nc;
+      char *nu = realloc(b->unsorted, ncap);
+      if (!nu)
+        return -1;
+      b->unsorted = nu;
+      mem_track_alloc(MEM_POSTINGS, (ncap - b->cap) * sizeof(PostingList));
+      b->cap = ncap;
+    }
+    pos = index->num_terms++;
+    PostingList *pl = &index->lists[pos];
+    memset(pl, 0, sizeof(*pl));
+    b->caps[pos] = 0;
+    b->unsorted[pos] = 0;
+    pl->word = strdup(word);
+    if (!pl->word)
+      return -1;
+    pl->wlen = wlen;
+    hash_add(index->lookup, word, (double)pos);
+  }
+
+  PostingList *pl = &index->lists[pos];
+  if (pl->df + n > b->caps[pos]) {
+    long int ncap = b->caps[pos] ? b->caps[pos] : 4;
+    while (ncap < pl->df + n)
+      ncap *= 2;
+    long int *ni = realloc(pl->doc_ids, ncap * sizeof(long int));
+    if (!ni)
+      return -1;
+    pl->doc_ids = ni;
+    double *nv = realloc(pl->values, ncap * sizeof(double));
+    if (!nv)
+      return -1;
+    pl->values = nv;
+    mem_track_alloc(MEM_POSTINGS,
+                    (ncap - b->caps[pos]) * (sizeof(long int) + sizeof(double)));
+    b->caps[pos] = ncap;
+  }
+
+  if (pl->df > 0 && ids[0] < pl->doc_ids[pl->df - 1])
+    b->unsorted[pos] = 1;
+  for (long int i = 0; i < n; i++) {
+    pl->doc_ids[pl->df + i] = ids[i];
+    pl->values[pl->df + i] = (double)tfs[i];
+  }
+  pl->df += n;
+  return 0;
+}
+
+/**
+ * @brief Lê um segmento e acrescenta ao índice os postings de documentos vivos
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int load_segment(const segment_info *seg, index_builder *b) {
+  long int ndocs;
+  long int *docs = read_doc_list(seg->file, &ndocs);
+  uint64_t *dead = docs ? load_tombstones(seg, ndocs) : NULL;
+  if (!docs || !dead) {
+    free(docs);
+    return -1;
+  }
+
+  // Tombstones indexados por article_id dentro de [first_id, last_id]
+  long int span = seg->last_id - seg->first_id + 1;
+  uint64_t *dead_by_id = calloc(BIT_WORDS(span) ? BIT_WORDS(span) : 1,
+                                sizeof(uint64_t));
+  FILE *fp = fopen(seg->file, "rb");
+  long int *ids = NULL;
+  int *tfs = NULL;
+  long int buf_cap = 0;
+  char word[256];
+  int rc = -1;
+
+  if (!dead_by_id || !fp)
+    goto out;
+
+  for (long int i = 0; i < ndocs; i++) {
+    if (BIT_TEST(dead, i)) {
+      BIT_SET(dead_by_id, docs[i] - seg->first_id);
+    } else {
+      BIT_SET(b->live, docs[i]);
+      b->num_live++;
+    }
+  }
+
+  long int num_terms;
+  if (fread(&num_terms, sizeof(long int), 1, fp) != 1)
+    goto out;
+
+  for (long int t = 0; t < num_terms; t++) {
+    size_t wlen;
+    long int n;
+    if (fread(&wlen, sizeof(size_t), 1, fp) != 1 || wlen >= sizeof(word) ||
+        fread(word, 1, wlen, fp) != wlen ||
+        fread(&n, sizeof(long int), 1, fp) != 1 || n < 0)
+      goto out;
+    word[wlen] = '\0';
+
+    if (n > buf_cap) {
+      long int *ni = realloc(ids, n * sizeof(long int));
+      if (ni)
+        ids = ni;
+      int *nt = realloc(tfs, n * sizeof(int));
+      if (nt)
+        tfs = nt;
+      if (!ni || !nt)
+        goto out;
+      buf_cap = n;
+    }
+    if (fread(ids, sizeof(long int), n, fp) != (size_t)n ||
+        fread(tfs, sizeof(int), n, fp) != (size_t)n)
+      goto out;
+
+    // Descartar postings de documentos removidos
+    long int live = n;
+    if (seg->ndeleted > 0) {
+      live = 0;
+      for (long int i = 0; i < n; i++) {
+        if (BIT_TEST(dead_by_id, ids[i] - seg->first_id))
+          continue;
+        ids[live] = ids[i];
+        tfs[live++] = tfs[i];
+      }
+    }
+
+    if (live > 0 && builder_append(b, word, wlen, ids, tfs, live) != 0)
+      goto out;
+  }
+  rc = 0;
+
+out:
+  if (rc != 0)
+    fprintf(stderr, "Erro: segmento truncado ou corrompido: %s\n", seg->file);
+  if (fp)
+    fclose(fp);
+  free(ids);
+  free(tfs);
+  free(dead_by_id);
+  free(dead);
+  free(docs);
+  return rc;
+}
+
+typedef struct {
+  long int id;
+  double value;
+} posting_pair;
+
+static int cmp_pair(const void *a, const void *b) {
+  long int x = ((const posting_pair *)a)->id, y = ((const posting_pair *)b)->id;
+  return (x > y) - (x < y);
+}
+
+/**
+ * @brief Carrega segmentos em um índice com TF bruto e doc_ids ordenados
+ *
+ * @return 0 em sucesso, -1 em erro (b->index liberado)
+ */
+static int load_segments(const segment_info *segs, int count, index_builder *b) {
+  for (int i = 0; i < count; i++) {
+    if (load_segment(&segs[i], b) != 0) {
+      builder_finish(b, 1);
+      return -1;
+    }
+  }
+
+  // Listas que receberam documentos reindexados fora de ordem
+  for (long int t = 0; t < b->index->num_terms; t++) {
+    if (!b->unsorted[t])
+      continue;
+    PostingList *pl = &b->index->lists[t];
+    posting_pair *pairs = malloc(pl->df * sizeof(posting_pair));
+    if (!pairs) {
+      builder_finish(b, 1);
+      return -1;
+    }
+    for (long int i = 0; i < pl->df; i++)
+      pairs[i] = (posting_pair){pl->doc_ids[i], pl->values[i]};
+    qsort(pairs, pl->df, sizeof(posting_pair), cmp_pair);
+    for (long int i = 0; i < pl->df; i++) {
+      pl->doc_ids[i] = pairs[i].id;
+      pl->values[i] = pairs[i].value;
+    }
+    free(pairs);
+  }
+
+  builder_finish(b, 0);
+  return 0;
+}
+
+static long int segments_span(const segment_info *segs, int count) {
+  long int num_docs = 0;
+  for (int i = 0; i < count; i++)
+    if (segs[i].last_id + 1 > num_docs)
+      num_docs = segs[i].last_id + 1;
+  return num_docs;
+}
+
+/**
+ * @brief Abre todos os segmentos da tabela como um único índice invertido
+ *
+ * df e N (documentos vivos) são globais; IDF, TF-IDF e normas são
+ * recalculados aqui com as mesmas fórmulas da construção completa.
+ * Documentos removidos ficam marcados em index->deleted.
+ *
+ * @param table Nome da tabela
+ * @param doc_norms_out Saída: normas dos documentos (caller deve liberar)
+ * @return Índice invertido, ou NULL em erro (ou sem segmentos)
+ */
+inv_index_t *segment_open(const char *table, double **doc_norms_out) {
+  segment_manifest manifest;
+  if (segment_manifest_load(table, &manifest) != 0)
+    return NULL;
+  if (manifest.count == 0) {
+    fprintf(stderr, "Nenhum segmento indexado para %s\n", table);
+    return NULL;
+  }
+
+  long int num_docs = segments_span(manifest.segs, manifest.count);
+  index_builder b;
+  if (builder_init(&b, num_docs) != 0 ||
+      load_segments(manifest.segs, manifest.count, &b) != 0) {
+    free(b.live);
+    segment_manifest_free(&manifest);
+    return NULL;
+  }
+  inv_index_t *index = b.index;
+
+  double *norms = calloc(num_docs, sizeof(double));
+  if (!norms) {
+    free(b.live);
+    index_free(index);
+    segment_manifest_free(&manifest);
+    return NULL;
+  }
+  mem_track_alloc(MEM_NORMS, num_docs * sizeof(double));
+
+  // TF bruto → TF-IDF com df e N globais (apenas documentos vivos)
+  for (long int t = 0; t < index->num_terms; t++) {
+    PostingList *pl = &index->lists[t];
+    pl->idf = log2((double)b.num_live / (double)pl->df);
+    for (long int i = 0; i < pl->df; i++) {
+      pl->values[i] = (1.0 + log2(pl->values[i])) * pl->idf;
+      norms[pl->doc_ids[i]] += pl->values[i] * pl->values[i];
+    }
+  }
+  for (long int d = 0; d < num_docs; d++)
+    norms[d] = sqrt(norms[d]);
+
+  // Bitmap de removidos: complemento dos vivos (NULL se todos vivos)
+  if (b.num_live < num_docs) {
+    for (long int w = 0; w < BIT_WORDS(num_docs); w++)
+      b.live[w] = ~b.live[w];
+    index->deleted = b.live;
+  } else {
+    free(b.live);
+  }
+
+  printf("[SEGMENTOS] %d segmentos abertos: %ld documentos vivos de %ld, "
+         "%ld termos\n",
+         manifest.count, b.num_live, num_docs, index->num_terms);
+
+  segment_manifest_free(&manifest);
+  *doc_norms_out = norms;
+  return index;
+}
+
+/* ------------- Merge e Compactação ------------- */
+
+static int cmp_posting_word(const void *a, const void *b) {
+  return strcmp((*(const PostingList *const *)a)->word,
+                (*(const PostingList *const *)b)->word);
+}
+
+/**
+ * @brief Grava um índice com TF bruto como segmento (run + lista de docs)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int write_segment(const char *filename, const inv_index_t *index,
+                         const uint64_t *live, long int first, long int last) {
+  const PostingList **order =
+      malloc((index->num_terms ? index->num_terms : 1) * sizeof(PostingList *));
+  FILE *fp = fopen(filename, "wb");
+  int rc = -1;
+  if (!order || !fp)
+    goto out;
+
+  for (long int t = 0; t < index->num_terms; t++)
+    order[t] = &index->lists[t];
+  qsort(order, index->num_terms, sizeof(PostingList *), cmp_posting_word);
+
+  fwrite(&index->num_terms, sizeof(long int), 1, fp);
+  for (long int t = 0; t < index->num_terms; t++) {
+    const PostingList *pl = order[t];
+    fwrite(&pl->wlen, sizeof(size_t), 1, fp);
+    fwrite(pl->word, 1, pl->wlen, fp);
+    fwrite(&pl->df, sizeof(long int), 1, fp);
+    fwrite(pl->doc_ids, sizeof(long int), pl->df, fp);
+    for (long int i = 0; i < pl->df; i++) {
+      int tf = (int)pl->values[i];
+      fwrite(&tf, sizeof(int), 1, fp);
+    }
+  }
+
+  long int ndocs = 0;
+  for (long int d = first; d <= last; d++) {
+    if (BIT_TEST(live, d)) {
+      fwrite(&d, sizeof(long int), 1, fp);
+      ndocs++;
+    }
+  }
+  fwrite(&ndocs, sizeof(long int), 1, fp);
+  rc = ferror(fp) ? -1 : 0;
+
+out:
+  if (fp && fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0)
+    fprintf(stderr, "Erro ao gravar segmento %s\n", filename);
+  free(order);
+  return rc;
+}
+
+/**
+ * @brief Une manifest->segs[lo .. lo + n) em um segmento sem tombstones
+ *
+ * Sem remoções e com intervalos crescentes e disjuntos, os runs são unidos
+ * em streaming (spimi_merge_runs). Caso contrário, os documentos vivos são
+ * carregados em memória e regravados.
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int merge_group(const char *table, segment_manifest *manifest, int lo,
+                       int n) {
+  segment_info *group = manifest->segs + lo;
+  segment_info merged = {0};
+  snprintf(merged.file, sizeof(merged.file), "models/seg_%s_%ld.bin", table,
+           manifest->next_seq);
+
+  int streaming = 1;
+  for (int i = 0; i < n; i++)
+    if (group[i].ndeleted > 0 ||
+        (i > 0 && group[i].first_id <= group[i - 1].last_id))
+      streaming = 0;
+
+  int rc = -1;
+  if (streaming) {
+    char **inputs = malloc(n * sizeof(char *));
+    long int total = 0;
+    for (int i = 0; i < n; i++)
+      total += group[i].ndocs;
+    long int *docs = malloc((total ? total : 1) * sizeof(long int));
+    if (inputs && docs) {
+      long int k = 0;
+      rc = 0;
+      for (int i = 0; i < n && rc == 0; i++) {
+        inputs[i] = group[i].file;
+        long int m;
+        long int *part = read_doc_list(group[i].file, &m);
+        if (!part || m != group[i].ndocs) {
+          rc = -1;
+        } else {
+          memcpy(docs + k, part, m * sizeof(long int));
+          k += m;
+        }
+        free(part);
+      }
+      if (rc == 0)
+        rc = spimi_merge_runs(inputs, n, merged.file);
+      if (rc == 0)
+        rc = append_doc_list(merged.file, docs, total);
+    }
+    merged.first_id = group[0].first_id;
+    merged.last_id = group[n - 1].last_id;
+    merged.ndocs = total;
+    free(inputs);
+    free(docs);
+  } else {
+    long int span = segments_span(group, n);
+    index_builder b;
+    if (builder_init(&b, span) == 0 && load_segments(group, n, &b) == 0) {
+      merged.ndocs = b.num_live;
+      merged.first_id = span;
+      merged.last_id = -1;
+      for (long int d = 0; d < span; d++) {
+        if (BIT_TEST(b.live, d)) {
+          if (merged.first_id > d)
+            merged.first_id = d;
+          merged.last_id = d;
+        }
+      }
+      rc = merged.ndocs > 0 ? write_segment(merged.file, b.index, b.live,
+                                             merged.first_id, merged.last_id)
+                            : 0;
+      index_free(b.index);
+    }
+    free(b.live);
+  }
+
+  if (rc != 0) {
+    remove(merged.file);
+    return -1;
+  }
+
+  // Substituir o grupo pelo segmento unido (ou nada, se não sobrou documento)
+  segment_info *old = malloc(n * sizeof(segment_info));
+  if (!old) {
+    remove(merged.file);
+    return -1;
+  }
+  memcpy(old, group, n * sizeof(segment_info));
+  int keep = merged.ndocs > 0;
+  if (keep)
+    group[0] = merged;
+  memmove(group + keep, group + n,
+          (manifest->count - lo - n) * sizeof(segment_info));
+  manifest->count -= n - keep;
+  manifest->next_seq++;
+
+  rc = manifest_save(table, manifest);
+  if (rc == 0) {
+    for (int i = 0; i < n; i++)
+      remove_segment_files(&old[i]);
+    LOG(stdout, "[SEGMENTOS] %d segmentos unidos em %s (%ld documentos)", n,
+        merged.file, merged.ndocs);
+  } else {
+    remove(merged.file);
+  }
+  free(old);
+  return rc;
+}
+
+static int tier_of(long int num_docs, int factor) {
+  int tier = 0;
+  for (long int n = num_docs; n >= factor; n /= factor)
+    tier++;
+  return tier;
+}
+
+/**
+ * @brief Une segmentos consecutivos da mesma camada até não restar grupo
+ *
+ * Os segmentos novos são gravados antes de o manifesto ser trocado; os
+ * antigos só são removidos depois, então leitores que abriram o manifesto
+ * anterior já leram seus arquivos (segment_open carrega tudo em memória).
+ *
+ * @param table Nome da tabela
+ * @param factor Quantos segmentos da mesma camada disparam um merge (>= 2)
+ * @return Número de merges realizados, ou -1 em erro
+ */
+int segment_merge(const char *table, int factor) {
+  if (factor < 2)
+    return 0;
+
+  segment_manifest manifest;
+  if (segment_manifest_load(table, &manifest) != 0)
+    return -1;
+
+  int merges = 0;
+  for (;;) {
+    // Primeiro grupo de `factor` segmentos consecutivos na mesma camada
+    int lo = -1;
+    for (int i = 0; i + factor <= manifest.count && lo < 0; i++) {
+      const segment_info *s = manifest.segs;
+      int tier = tier_of(s[i].ndocs - s[i].ndeleted, factor);
+      int j = i + 1;
+      while (j < i + factor && tier_of(s[j].ndocs - s[j].ndeleted, factor) == tier)
+        j++;
+      if (j == i + factor)
+        lo = i;
+    }
+    if (lo < 0)
+      break;
+
+    if (merge_group(table, &manifest, lo, factor) != 0) {
+      segment_manifest_free(&manifest);
+      return -1;
+    }
+    merges++;
+  }
+
+  segment_manifest_free(&manifest);
+  return merges;
+}
+
+/**
+ * @brief Reescreve o índice sem documentos removidos se houver tombstones demais
+ *
+ * @param table Nome da tabela
+ * @param threshold Fração de documentos removidos que dispara a compactação
+ * @return 1 se compactou, 0 se não foi necessário, -1 em erro
+ */
+int segment_compact(const char *table, double threshold) {
+  segment_manifest manifest;
+  if (segment_manifest_load(table, &manifest) != 0)
+    return -1;
+
+  long int total = 0, deleted = 0;
+  for (int i = 0; i < manifest.count; i++) {
+    total += manifest.segs[i].ndocs;
+    deleted += manifest.segs[i].ndeleted;
+  }
+
+  int rc = 0;
+  double ratio = total ? (double)deleted / (double)total : 0.0;
+  if (deleted > 0 && ratio > threshold) {
+    printf("[SEGMENTOS] Compactando: %ld de %ld documentos removidos (%.1f%%)\n",
+           deleted, total, 100.0 * ratio);
+    rc = merge_group(table, &manifest, 0, manifest.count) == 0 ? 1 : -1;
+  }
+
+  segment_manifest_free(&manifest);
+  return rc;
+}
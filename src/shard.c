@@ -0,0 +1,910 @@
+/**
+ * @file shard.c
+ * @brief Shards por intervalo de documentos e consulta scatter-gather
+ *
+ * O construtor divide os documentos em N intervalos contíguos. Cada shard i
+ * é salvo com as funções de serialização já existentes:
+ *
+ *     models/shard_<table>_<entries>_<i>of<N>_tf.bin     (save_hash_array)
+ *     models/shard_<table>_<entries>_<i>of<N>_df.bin     (save_hash, df local)
+ *     models/shard_<table>_<entries>_<i>of<N>_norms.bin  (save_doc_norms)
+ *
+ * e um arquivo pequeno de estatísticas globais:
+ *
+ *     models/shards_<table>_<entries>_<N>.bin
+ *       long int num_live, int nshards, long int bounds[nshards + 1],
+ *       size_t num_terms, para cada termo: size_t wlen, char word[wlen], long int df
+ *
+ * O df global é a soma dos df locais. O coordenador deriva dele o IDF da
+ * query (log2(N/df), como set_idf_value) e os shards guardam os pesos e
+ * normas calculados com esse mesmo IDF global, então os scores coincidem
+ * exatamente com a execução sem shards.
+ *
+ * Protocolo (socket Unix SOCK_STREAM, inteiros de tamanho fixo na ordem de
+ * bytes do host):
+ *
+ *     requisição: int32 op (1 = consulta, 2 = encerrar, 3 = booleana)
+ *       consulta: int32 k, double query_norm, int32 nterms,
+ *                 nterms × (int32 wlen, char word[wlen], double peso)
+ *       booleana: consulta, seguida de int32 nrequired,
+ *                 nrequired × (int32 wlen, char word[wlen]), int32 nexcluded,
+ *                 nexcluded × (int32 wlen, char word[wlen])
+ *     resposta:   [int64 satisfeitos (só booleana)],
+ *                 int32 n, n × (int64 doc_id, double similaridade)
+ *
+ * Na consulta booleana (+termo/-termo) cada shard testa os operadores nos
+ * seus documentos, como o caminho por documento de boolean_top_k: só
+ * entram no top-k os que satisfazem a consulta, e o coordenador soma os
+ * satisfeitos de cada shard.
+ *
+ * Os termos seguem a ordem dos buckets da query no coordenador e o shard
+ * acumula o produto escalar nessa ordem, como compute_similarities_thread.
+ * Para atravessar máquinas basta trocar AF_UNIX por TCP e fixar a ordem de
+ * bytes dos campos.
+ */
+
+#include "../include/shard.h"
+#include "../include/cpu.h"
+#include "../include/file_io.h"
+#include "../include/log.h"
+#include "../include/mem.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define SHARD_OP_QUERY 1
+#define SHARD_OP_SHUTDOWN 2
+#define SHARD_OP_BOOLEAN 3
+#define SHARD_CONNECT_TRIES 1200  /**< Tentativas de conexão (50 ms cada) */
+
+/* ------------- Nomes de Arquivos ------------- */
+
+static void shard_filenames(char *filename_tf, char *filename_df,
+                            char *filename_norms, const char *table,
+                            long int entries, int shard, int nshards) {
+  snprintf(filename_tf, 256, "models/shard_%s_%ld_%dof%d_tf.bin", table,
+           entries, shard, nshards);
+  snprintf(filename_df, 256, "models/shard_%s_%ld_%dof%d_df.bin", table,
+           entries, shard, nshards);
+  snprintf(filename_norms, 256, "models/shard_%s_%ld_%dof%d_norms.bin", table,
+           entries, shard, nshards);
+}
+
+static void stats_filename(char *filename, const char *table, long int entries,
+                           int nshards) {
+  snprintf(filename, 256, "models/shards_%s_%ld_%d.bin", table, entries,
+           nshards);
+}
+
+/**
+ * @brief Verifica se todos os arquivos dos shards já existem
+ *
+ * @return 1 se existirem, 0 caso contrário
+ */
+int shard_files_exist(const char *table, long int entries, int nshards) {
+  char f_tf[256], f_df[256], f_norms[256], f_stats[256];
+
+  stats_filename(f_stats, table, entries, nshards);
+  if (access(f_stats, F_OK) == -1)
+    return 0;
+
+  for (int i = 0; i < nshards; i++) {
+    shard_filenames(f_tf, f_df, f_norms, table, entries, i, nshards);
+    if (access(f_tf, F_OK) == -1 || access(f_df, F_OK) == -1 ||
+        access(f_norms, F_OK) == -1)
+      return 0;
+  }
+  return 1;
+}
+
+/* ------------- Construção ------------- */
+
+static int save_stats(const char *filename, long int num_docs, int nshards,
+                      const long int *bounds, const hash_t *df) {
+  FILE *fp = fopen(filename, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", filename);
+    return -1;
+  }
+
+  size_t num_terms = hash_size(df);
+  fwrite(&num_docs, sizeof(long int), 1, fp);
+  fwrite(&nshards, sizeof(int), 1, fp);
+  fwrite(bounds, sizeof(long int), nshards + 1, fp);
+  fwrite(&num_terms, sizeof(size_t), 1, fp);
+
+  for (size_t i = 0; i < df->cap; i++) {
+    for (HashEntry *e = df->buckets[i]; e; e = e->next) {
+      long int count = (long int)e->value;
+      fwrite(&e->wlen, sizeof(size_t), 1, fp);
+      fwrite(e->word, sizeof(char), e->wlen, fp);
+      fwrite(&count, sizeof(long int), 1, fp);
+    }
+  }
+
+  if (fclose(fp) != 0) {
+    fprintf(stderr, "Erro ao escrever %s\n", filename);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Divide o modelo em shards por intervalo de documentos
+ *
+ * Cada shard recebe os vetores TF-IDF e as normas do seu intervalo e o df
+ * local dos seus termos; o arquivo de estatísticas guarda N, os intervalos
+ * e o df global (soma dos locais).
+ *
+ * @param global_tf Vetores TF-IDF de todos os documentos
+ * @param global_doc_norms Normas de todos os documentos
+ * @param num_docs Número de documentos (tamanho dos vetores)
+ * @param num_live N do IDF (documentos existentes, sem lacunas de ids)
+ * @param nshards Número de shards (1 a num_docs)
+ * @param table Nome da tabela (para os nomes de arquivo)
+ * @param entries Número de entradas (para os nomes de arquivo)
+ * @return 0 em sucesso, -1 em erro
+ */
+int shard_build(hash_t **global_tf, const double *global_doc_norms,
+                long int num_docs, long int num_live, int nshards,
+                const char *table, long int entries) {
+  if (!global_tf || !global_doc_norms || nshards <= 0 || nshards > num_docs) {
+    fprintf(stderr, "Erro: parâmetros inválidos para divisão em shards\n");
+    return -1;
+  }
+
+  long int *bounds = malloc((nshards + 1) * sizeof(long int));
+  hash_t *global_df = hash_new();
+  if (!bounds || !global_df) {
+    free(bounds);
+    hash_free(global_df);
+    return -1;
+  }
+
+  long int base = num_docs / nshards;
+  long int rem = num_docs % nshards;
+  bounds[0] = 0;
+  for (int i = 0; i < nshards; i++)
+    bounds[i + 1] = bounds[i] + base + (i < rem);
+
+  int ret = 0;
+  for (int i = 0; i < nshards && ret == 0; i++) {
+    char f_tf[256], f_df[256], f_norms[256];
+    shard_filenames(f_tf, f_df, f_norms, table, entries, i, nshards);
+
+    long int start = bounds[i], count = bounds[i + 1] - bounds[i];
+
+    hash_t *local_df = hash_new();
+    for (long int d = start; d < start + count; d++) {
+      if (!global_tf[d])
+        continue;
+      for (size_t b = 0; b < global_tf[d]->cap; b++)
+        for (HashEntry *e = global_tf[d]->buckets[b]; e; e = e->next)
+          hash_add(local_df, e->word, 1.0);
+    }
+
+    if (save_hash_array(global_tf + start, count, f_tf, cpu_available()) != 0 ||
+        save_hash(local_df, f_df) != 0 ||
+        save_doc_norms(global_doc_norms + start, count, f_norms) != 0)
+      ret = -1;
+
+    LOG(stdout, "[SHARD] %d/%d: documentos [%ld, %ld), %zu termos locais", i,
+        nshards, start, start + count, hash_size(local_df));
+
+    hash_merge(global_df, local_df);
+    hash_free(local_df);
+  }
+
+  if (ret == 0) {
+    char f_stats[256];
+    stats_filename(f_stats, table, entries, nshards);
+    ret = save_stats(f_stats, num_live, nshards, bounds, global_df);
+    if (ret == 0)
+      printf("[SHARD] %d shards salvos (%zu termos, estatísticas em %s)\n",
+             nshards, hash_size(global_df), f_stats);
+  }
+
+  free(bounds);
+  hash_free(global_df);
+  return ret;
+}
+
+/* ------------- Estatísticas Globais ------------- */
+
+/**
+ * @brief Libera estatísticas globais dos shards
+ */
+void shard_stats_free(shard_stats *stats) {
+  if (!stats)
+    return;
+  free(stats->bounds);
+  hash_free(stats->df);
+  free(stats);
+}
+
+/**
+ * @brief Carrega N, intervalos e df global do arquivo de estatísticas
+ *
+ * @return Estatísticas carregadas, ou NULL em erro
+ */
+shard_stats *shard_stats_load(const char *table, long int entries,
+                              int nshards) {
+  char filename[256];
+  stats_filename(filename, table, entries, nshards);
+
+  FILE *fp = fopen(filename, "rb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para leitura\n", filename);
+    return NULL;
+  }
+
+  shard_stats *stats = calloc(1, sizeof(*stats));
+  if (!stats) {
+    fclose(fp);
+    return NULL;
+  }
+
+  size_t num_terms = 0;
+  int ok = fread(&stats->num_docs, sizeof(long int), 1, fp) == 1 &&
+           fread(&stats->nshards, sizeof(int), 1, fp) == 1 &&
+           stats->nshards == nshards;
+  if (ok) {
+    stats->bounds = malloc((nshards + 1) * sizeof(long int));
+    ok = stats->bounds &&
+         fread(stats->bounds, sizeof(long int), nshards + 1, fp) ==
+             (size_t)(nshards + 1) &&
+         fread(&num_terms, sizeof(size_t), 1, fp) == 1;
+  }
+
+  stats->df = hash_new();
+  for (size_t i = 0; ok && i < num_terms; i++) {
+    size_t wlen;
+    long int df;
+    char word[256];
+    ok = fread(&wlen, sizeof(size_t), 1, fp) == 1 && wlen < sizeof(word) &&
+         fread(word, 1, wlen, fp) == wlen &&
+         fread(&df, sizeof(long int), 1, fp) == 1;
+    if (ok) {
+      word[wlen] = '\0';
+      hash_add(stats->df, word, (double)df);
+    }
+  }
+  fclose(fp);
+
+  if (!ok) {
+    fprintf(stderr, "Erro: arquivo de estatísticas truncado ou inválido: %s\n",
+            filename);
+    shard_stats_free(stats);
+    return NULL;
+  }
+
+  LOG(stdout, "Estatísticas globais carregadas de %s (N=%ld, %zu termos)",
+      filename, stats->num_docs, num_terms);
+  return stats;
+}
+
+/**
+ * @brief Constrói hash termo → IDF a partir do df global
+ *
+ * Mesma fórmula de set_idf_value: IDF = log2(N / df).
+ *
+ * @return Nova hash com os IDFs (caller deve liberar)
+ */
+hash_t *shard_stats_idf(const shard_stats *stats) {
+  hash_t *idf = hash_new();
+  for (size_t i = 0; i < stats->df->cap; i++)
+    for (HashEntry *e = stats->df->buckets[i]; e; e = e->next)
+      hash_add(idf, e->word,
+               e->value > 0 ? log2((double)stats->num_docs / e->value) : 0.0);
+  return idf;
+}
+
+/* ------------- E/S no Socket ------------- */
+
+static int write_all(int fd, const void *buf, size_t len) {
+  const char *p = buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int read_all(int fd, void *buf, size_t len) {
+  char *p = buf;
+  while (len > 0) {
+    ssize_t n = read(fd, p, len);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    p += n;
+    len -= n;
+  }
+  return 0;
+}
+
+/* ------------- Servidor de Shard ------------- */
+
+typedef struct {
+  int32_t k;
+  double query_norm;
+  int32_t nterms;
+  char **words;
+  double *weights;
+  int boolean;         /**< Consulta com operadores (SHARD_OP_BOOLEAN) */
+  bool_query ops;      /**< Termos obrigatórios e proibidos */
+} shard_request;
+
+static void free_request(shard_request *req) {
+  for (int32_t i = 0; i < req->nterms; i++)
+    free(req->words[i]);
+  free(req->words);
+  free(req->weights);
+  bool_query_free(&req->ops);
+  memset(req, 0, sizeof(*req));
+}
+
+/**
+ * @brief Lê uma lista de termos (int32 n, n × (int32 wlen, word))
+ *
+ * @return 0 em sucesso, -1 em erro (os termos lidos ficam em *list)
+ */
+static int read_words(int fd, char ***list, long int *n) {
+  int32_t count;
+  if (read_all(fd, &count, sizeof(int32_t)) != 0 || count < 0)
+    return -1;
+  *list = calloc(count ? count : 1, sizeof(char *));
+  if (!*list)
+    return -1;
+  for (int32_t i = 0; i < count; i++) {
+    int32_t wlen;
+    if (read_all(fd, &wlen, sizeof(int32_t)) != 0 || wlen < 0)
+      return -1;
+    char *word = malloc(wlen + 1);
+    if (!word)
+      return -1;
+    (*list)[(*n)++] = word;
+    if (read_all(fd, word, wlen) != 0)
+      return -1;
+    word[wlen] = '\0';
+  }
+  return 0;
+}
+
+static int read_request(int fd, shard_request *req, int boolean) {
+  memset(req, 0, sizeof(*req));
+  req->boolean = boolean;
+  if (read_all(fd, &req->k, sizeof(int32_t)) != 0 ||
+      read_all(fd, &req->query_norm, sizeof(double)) != 0 ||
+      read_all(fd, &req->nterms, sizeof(int32_t)) != 0 || req->k < 0 ||
+      req->nterms < 0)
+    return -1;
+
+  int32_t nterms = req->nterms;
+  req->nterms = 0;
+  req->words = calloc(nterms ? nterms : 1, sizeof(char *));
+  req->weights = malloc((nterms ? nterms : 1) * sizeof(double));
+  if (!req->words || !req->weights)
+    return -1;
+
+  for (int32_t i = 0; i < nterms; i++) {
+    int32_t wlen;
+    if (read_all(fd, &wlen, sizeof(int32_t)) != 0 || wlen < 0)
+      return -1;
+    req->words[i] = malloc(wlen + 1);
+    req->nterms++;
+    if (!req->words[i] || read_all(fd, req->words[i], wlen) != 0 ||
+        read_all(fd, &req->weights[i], sizeof(double)) != 0)
+      return -1;
+    req->words[i][wlen] = '\0';
+  }
+  if (boolean &&
+      (read_words(fd, &req->ops.required, &req->ops.nrequired) != 0 ||
+       read_words(fd, &req->ops.excluded, &req->ops.nexcluded) != 0))
+    return -1;
+  return 0;
+}
+
+/**
+ * @brief Verifica se o documento satisfaz os operadores da consulta
+ *
+ * Como no caminho por documento de boolean_top_k: todos os obrigatórios,
+ * nenhum proibido e, sem obrigatórios, ao menos um termo da consulta.
+ */
+static int shard_matches(const hash_t *doc, const shard_request *req) {
+  const bool_query *ops = &req->ops;
+  for (long int i = 0; i < ops->nrequired; i++)
+    if (!hash_contains(doc, ops->required[i]))
+      return 0;
+  for (long int i = 0; i < ops->nexcluded; i++)
+    if (hash_contains(doc, ops->excluded[i]))
+      return 0;
+  if (ops->nrequired > 0)
+    return 1;
+  for (int32_t t = 0; t < req->nterms; t++)
+    if (hash_contains(doc, req->words[t]))
+      return 1;
+  return 0;
+}
+
+/**
+ * @brief Insere (doc, score) no heap mínimo dos k melhores
+ *
+ * A raiz é o pior candidato (menor score; no empate, maior doc_id).
+ */
+static void topk_push(DocSim *heap, long int *size, long int k, DocSim item) {
+  if (*size < k) {
+    long int i = (*size)++;
+    while (i > 0) {
+      long int parent = (i - 1) / 2;
+      if (compare_sim(&heap[parent], &item) >= 0)
+        break;
+      heap[i] = heap[parent];
+      i = parent;
+    }
+    heap[i] = item;
+    return;
+  }
+
+  if (compare_sim(&item, &heap[0]) >= 0)
+    return;
+
+  long int i = 0;
+  for (;;) {
+    long int l = 2 * i + 1, r = l + 1, worst = i;
+    const DocSim *cur = worst == i ? &item : &heap[worst];
+    if (l < k && compare_sim(&heap[l], cur) > 0) {
+      worst = l;
+      cur = &heap[l];
+    }
+    if (r < k && compare_sim(&heap[r], cur) > 0)
+      worst = r;
+    if (worst == i)
+      break;
+    heap[i] = heap[worst];
+    i = worst;
+  }
+  heap[i] = item;
+}
+
+/**
+ * @brief Calcula os k melhores documentos do shard para uma query
+ *
+ * Na consulta booleana só documentos que satisfazem os operadores entram.
+ *
+ * @param matched Saída: documentos que satisfazem a consulta booleana
+ * @return Número de resultados em out (ordenados por compare_sim)
+ */
+static long int shard_topk(hash_t **tf, const double *norms, long int count,
+                           long int offset, const shard_request *req,
+                           DocSim *out, long int *matched) {
+  long int size = 0;
+  *matched = 0;
+  if (req->k <= 0)
+    return 0;
+
+  for (long int d = 0; d < count; d++) {
+    if (!tf[d])
+      continue;
+    if (req->boolean) {
+      if (!shard_matches(tf[d], req))
+        continue;
+      (*matched)++;
+    }
+
+    double dot_product = 0.0;
+    for (int32_t t = 0; t < req->nterms; t++) {
+      double doc_tfidf = hash_find(tf[d], req->words[t]);
+      if (doc_tfidf > 0.0)
+        dot_product += req->weights[t] * doc_tfidf;
+    }
+
+    double similarity = 0.0;
+    if (req->query_norm > 0.0 && norms[d] > 0.0)
+      similarity = dot_product / (req->query_norm * norms[d]);
+
+    DocSim item = {offset + d, similarity};
+    topk_push(out, &size, req->k, item);
+  }
+
+  qsort(out, size, sizeof(DocSim), compare_sim);
+  return size;
+}
+
+static int send_results(int fd, const DocSim *results, long int n) {
+  int32_t count = (int32_t)n;
+  if (write_all(fd, &count, sizeof(int32_t)) != 0)
+    return -1;
+  for (long int i = 0; i < n; i++) {
+    int64_t doc_id = results[i].doc_id;
+    if (write_all(fd, &doc_id, sizeof(int64_t)) != 0 ||
+        write_all(fd, &results[i].similarity, sizeof(double)) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Atende uma conexão até o cliente pedir encerramento ou desconectar
+ *
+ * @return 1 se recebeu pedido de encerramento, 0 caso contrário
+ */
+static int serve_connection(int fd, hash_t **tf, const double *norms,
+                            long int count, long int offset, int shard) {
+  for (;;) {
+    int32_t op;
+    if (read_all(fd, &op, sizeof(int32_t)) != 0)
+      return 0;
+    if (op == SHARD_OP_SHUTDOWN)
+      return 1;
+    if (op != SHARD_OP_QUERY && op != SHARD_OP_BOOLEAN) {
+      fprintf(stderr, "Shard %d: operação desconhecida %d\n", shard, op);
+      return 0;
+    }
+
+    shard_request req;
+    if (read_request(fd, &req, op == SHARD_OP_BOOLEAN) != 0) {
+      fprintf(stderr, "Shard %d: requisição inválida\n", shard);
+      free_request(&req);
+      return 0;
+    }
+
+    long int k = req.k < count ? req.k : count;
+    DocSim *results = malloc((k ? k : 1) * sizeof(DocSim));
+    if (!results) {
+      free_request(&req);
+      return 0;
+    }
+    req.k = (int32_t)k;
+
+    long int matched;
+    long int n = shard_topk(tf, norms, count, offset, &req, results, &matched);
+    int64_t satisfied = matched;
+    int err = (req.boolean &&
+               write_all(fd, &satisfied, sizeof(int64_t)) != 0) ||
+              send_results(fd, results, n);
+    free(results);
+    free_request(&req);
+    if (err)
+      return 0;
+  }
+}
+
+/**
+ * @brief Carrega um shard e atende consultas em um socket Unix
+ *
+ * Roda até receber SHARD_OP_SHUTDOWN. Conexões encerradas sem esse pedido
+ * apenas liberam o servidor para o próximo cliente.
+ *
+ * @param table Nome da tabela
+ * @param entries Número de entradas do modelo
+ * @param shard Índice do shard (0 a nshards-1)
+ * @param nshards Número de shards
+ * @param socket_path Caminho do socket Unix
+ * @return 0 em sucesso, -1 em erro
+ */
+int shard_serve(const char *table, long int entries, int shard, int nshards,
+                const char *socket_path) {
+  if (shard < 0 || shard >= nshards || !socket_path) {
+    fprintf(stderr, "Erro: shard %d inválido (nshards=%d)\n", shard, nshards);
+    return -1;
+  }
+
+  // Shards distribuídos entre os nós NUMA: o shard é carregado (first-touch)
+  // e pontuado no mesmo nó
+  int node = shard % cpu_nodes();
+  if (cpu_nodes() > 1 && cpu_bind_node(shard) == 0)
+    LOG(stdout, "Shard %d: fixado no nó NUMA %d", shard, node);
+
+  shard_stats *stats = shard_stats_load(table, entries, nshards);
+  if (!stats)
+    return -1;
+  long int offset = stats->bounds[shard];
+  long int expected = stats->bounds[shard + 1] - offset;
+  shard_stats_free(stats);
+
+  char f_tf[256], f_df[256], f_norms[256];
+  shard_filenames(f_tf, f_df, f_norms, table, entries, shard, nshards);
+
+  long int count = 0, num_norms = 0;
+  hash_t **tf = load_hash_array(f_tf, &count, 1);
+  double *norms = load_doc_norms(f_norms, &num_norms, 1);
+  if (!tf || !norms || count != expected || num_norms != expected) {
+    fprintf(stderr, "Shard %d: arquivos inválidos (%s, %s)\n", shard, f_tf,
+            f_norms);
+    return -1;
+  }
+
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  if (strlen(socket_path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Shard %d: caminho de socket muito longo: %s\n", shard,
+            socket_path);
+    return -1;
+  }
+  strcpy(addr.sun_path, socket_path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(socket_path);
+  if (listen_fd < 0 ||
+      bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(listen_fd, 4) != 0) {
+    fprintf(stderr, "Shard %d: erro ao escutar em %s: %s\n", shard,
+            socket_path, strerror(errno));
+    if (listen_fd >= 0)
+      close(listen_fd);
+    return -1;
+  }
+
+  LOG(stdout, "[SHARD] %d/%d: %ld documentos [%ld, %ld) em %s", shard, nshards,
+      count, offset, offset + count, socket_path);
+
+  int shutdown_requested = 0;
+  while (!shutdown_requested) {
+    int fd = accept(listen_fd, NULL, NULL);
+    if (fd < 0) {
+      if (errno == EINTR)
+        continue;
+      fprintf(stderr, "Shard %d: erro em accept: %s\n", shard, strerror(errno));
+      break;
+    }
+    shutdown_requested = serve_connection(fd, tf, norms, count, offset, shard);
+    close(fd);
+  }
+
+  close(listen_fd);
+  unlink(socket_path);
+
+  for (long int i = 0; i < count; i++)
+    if (tf[i])
+      hash_free(tf[i]);
+  free(tf);
+  mem_track_free(MEM_NORMS, count * sizeof(double));
+  free(norms);
+  return shutdown_requested ? 0 : -1;
+}
+
+/* ------------- Coordenador ------------- */
+
+static int connect_shard(const char *path) {
+  struct sockaddr_un addr = {0};
+  addr.sun_family = AF_UNIX;
+  strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+
+  for (int attempt = 0; attempt < SHARD_CONNECT_TRIES; attempt++) {
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+      return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0)
+      return fd;
+    close(fd);
+
+    // Servidor ainda carregando o shard
+    struct timespec ts = {0, 50 * 1000 * 1000};
+    nanosleep(&ts, NULL);
+  }
+  return -1;
+}
+
+/**
+ * @brief Encerra servidores, fecha conexões e remove sockets
+ */
+void shard_cluster_stop(shard_cluster *cluster) {
+  if (!cluster)
+    return;
+
+  for (int i = 0; i < cluster->nshards; i++) {
+    if (cluster->fds[i] >= 0) {
+      int32_t op = SHARD_OP_SHUTDOWN;
+      write_all(cluster->fds[i], &op, sizeof(int32_t));
+      close(cluster->fds[i]);
+    }
+  }
+
+  for (int i = 0; i < cluster->nshards; i++) {
+    if (cluster->pids[i] > 0) {
+      int status;
+      waitpid(cluster->pids[i], &status, 0);
+      if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        fprintf(stderr, "Shard %d terminou com erro\n", i);
+    }
+    if (cluster->paths[i]) {
+      unlink(cluster->paths[i]);
+      free(cluster->paths[i]);
+    }
+  }
+
+  free(cluster->pids);
+  free(cluster->fds);
+  free(cluster->paths);
+  free(cluster);
+}
+
+/**
+ * @brief Cria um processo servidor por shard e conecta a cada um
+ *
+ * @param table Nome da tabela
+ * @param entries Número de entradas do modelo
+ * @param nshards Número de shards
+ * @param socket_dir Diretório dos sockets Unix
+ * @return Cluster conectado, ou NULL em erro
+ */
+shard_cluster *shard_cluster_start(const char *table, long int entries,
+                                   int nshards, const char *socket_dir) {
+  shard_cluster *cluster = calloc(1, sizeof(*cluster));
+  if (!cluster)
+    return NULL;
+  cluster->pids = calloc(nshards, sizeof(pid_t));
+  cluster->fds = malloc(nshards * sizeof(int));
+  cluster->paths = calloc(nshards, sizeof(char *));
+  if (!cluster->pids || !cluster->fds || !cluster->paths) {
+    free(cluster->pids);
+    free(cluster->fds);
+    free(cluster->paths);
+    free(cluster);
+    return NULL;
+  }
+  for (int i = 0; i < nshards; i++)
+    cluster->fds[i] = -1;
+  cluster->nshards = nshards;
+
+  // Buffers herdados pelo fork seriam impressos duas vezes
+  fflush(stdout);
+  fflush(stderr);
+
+  for (int i = 0; i < nshards; i++) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/tfidf_%ld_%d.sock", socket_dir,
+             (long int)getpid(), i);
+    cluster->paths[i] = strdup(path);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "Erro ao criar processo do shard %d\n", i);
+      shard_cluster_stop(cluster);
+      return NULL;
+    }
+    if (pid == 0)
+      _exit(shard_serve(table, entries, i, nshards, path) == 0 ? 0 : 1);
+    cluster->pids[i] = pid;
+  }
+
+  for (int i = 0; i < nshards; i++) {
+    cluster->fds[i] = connect_shard(cluster->paths[i]);
+    if (cluster->fds[i] < 0) {
+      fprintf(stderr, "Erro ao conectar ao shard %d (%s)\n", i,
+              cluster->paths[i]);
+      shard_cluster_stop(cluster);
+      return NULL;
+    }
+  }
+
+  printf("[SHARD] %d processos de shard prontos\n", nshards);
+  return cluster;
+}
+
+/**
+ * @brief Envia uma lista de termos (int32 n, n × (int32 wlen, word))
+ */
+static int send_words(int fd, char **words, long int n) {
+  int32_t count = (int32_t)n;
+  if (write_all(fd, &count, sizeof(int32_t)) != 0)
+    return -1;
+  for (long int i = 0; i < n; i++) {
+    int32_t wlen = (int32_t)strlen(words[i]);
+    if (write_all(fd, &wlen, sizeof(int32_t)) != 0 ||
+        write_all(fd, words[i], wlen) != 0)
+      return -1;
+  }
+  return 0;
+}
+
+static int send_query(int fd, const hash_t *query_tf, double query_norm,
+                      const bool_query *ops, int32_t k) {
+  int32_t op = ops ? SHARD_OP_BOOLEAN : SHARD_OP_QUERY;
+  int32_t nterms = (int32_t)hash_size(query_tf);
+  if (write_all(fd, &op, sizeof(int32_t)) != 0 ||
+      write_all(fd, &k, sizeof(int32_t)) != 0 ||
+      write_all(fd, &query_norm, sizeof(double)) != 0 ||
+      write_all(fd, &nterms, sizeof(int32_t)) != 0)
+    return -1;
+
+  for (size_t i = 0; i < query_tf->cap; i++) {
+    for (HashEntry *e = query_tf->buckets[i]; e; e = e->next) {
+      int32_t wlen = (int32_t)e->wlen;
+      if (write_all(fd, &wlen, sizeof(int32_t)) != 0 ||
+          write_all(fd, e->word, e->wlen) != 0 ||
+          write_all(fd, &e->value, sizeof(double)) != 0)
+        return -1;
+    }
+  }
+  if (ops && (send_words(fd, ops->required, ops->nrequired) != 0 ||
+              send_words(fd, ops->excluded, ops->nexcluded) != 0))
+    return -1;
+  return 0;
+}
+
+/**
+ * @brief Envia a query a todos os shards e junta os top-k parciais
+ *
+ * A query é enviada a todos antes de ler qualquer resposta, então os shards
+ * calculam em paralelo.
+ *
+ * @param cluster Cluster conectado
+ * @param query_tf Hash TF-IDF da query (IDF global)
+ * @param query_norm Norma da query
+ * @param ops Termos obrigatórios e proibidos (NULL sem operadores)
+ * @param k Número de resultados
+ * @param out Saída com espaço para k resultados
+ * @param ncand_out Saída: documentos que satisfazem os operadores (com ops)
+ * @return Número de resultados em out, ou -1 em erro
+ */
+long int shard_search(shard_cluster *cluster, const hash_t *query_tf,
+                      double query_norm, const bool_query *ops, int k,
+                      DocSim *out, long int *ncand_out) {
+  if (!cluster || !query_tf || k <= 0 || !out)
+    return -1;
+  if (ncand_out)
+    *ncand_out = 0;
+
+  for (int i = 0; i < cluster->nshards; i++) {
+    if (send_query(cluster->fds[i], query_tf, query_norm, ops, k) != 0) {
+      fprintf(stderr, "Erro ao enviar consulta ao shard %d\n", i);
+      return -1;
+    }
+  }
+
+  long int capacity = (long int)k * cluster->nshards;
+  DocSim *all = malloc(capacity * sizeof(DocSim));
+  if (!all)
+    return -1;
+  mem_track_alloc(MEM_QUERY, capacity * sizeof(DocSim));
+
+  long int total = 0;
+  int err = 0;
+  for (int i = 0; i < cluster->nshards; i++) {
+    int32_t n;
+    int64_t satisfied = 0;
+    if ((ops && read_all(cluster->fds[i], &satisfied, sizeof(int64_t)) != 0) ||
+        read_all(cluster->fds[i], &n, sizeof(int32_t)) != 0 || n < 0 || n > k) {
+      fprintf(stderr, "Erro ao receber resultados do shard %d\n", i);
+      err = 1;
+      continue;
+    }
+    for (int32_t j = 0; j < n && !err; j++) {
+      int64_t doc_id;
+      if (read_all(cluster->fds[i], &doc_id, sizeof(int64_t)) != 0 ||
+          read_all(cluster->fds[i], &all[total].similarity, sizeof(double)) != 0)
+        err = 1;
+      all[total++].doc_id = (long int)doc_id;
+    }
+    if (ncand_out)
+      *ncand_out += (long int)satisfied;
+  }
+
+  long int n = -1;
+  if (!err) {
+    qsort(all, total, sizeof(DocSim), compare_sim);
+    n = total < k ? total : k;
+    memcpy(out, all, n * sizeof(DocSim));
+  }
+
+  mem_track_free(MEM_QUERY, capacity * sizeof(DocSim));
+  free(all);
+  return n;
+}
@@ -0,0 +1,373 @@
+/**
+ * @file simhash.c
+ * @brief Assinaturas SimHash e LSH em faixas para busca aproximada por cosseno
+ *
+ * Cada documento do modelo por documento (global_tf) ganha uma assinatura de
+ * b bits: o bit j é o sinal do produto do vetor TF-IDF com o hiperplano
+ * aleatório j (SimHash). Os hiperplanos não são guardados: a componente de
+ * um termo em 64 hiperplanos é gerada a partir do hash_str do termo, então
+ * documentos e consultas usam os mesmos hiperplanos sem nenhuma tabela.
+ * Dois vetores diferem em cada bit com probabilidade ângulo / π.
+ *
+ * A assinatura é dividida em faixas de r bits. Cada faixa é uma tabela
+ * (chave da faixa → documentos), guardada como um vetor ordenado por chave.
+ * Os candidatos de uma consulta são os documentos que coincidem com ela em
+ * alguma faixa; com mais faixas cresce o recall, com mais linhas por faixa
+ * caem os candidatos. Os candidatos são ordenados pela distância de Hamming
+ * (POPCNT) entre as assinaturas e só os mais próximos têm o cosseno exato
+ * recalculado a partir de global_tf.
+ */
+
+#include "../include/simhash.h"
+#include "../include/mem.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SIMHASH_MAGIC "SIMHASH1"
+#define SIMHASH_WORDS (SIMHASH_MAX_BITS / 64)
+
+/**
+ * @brief Mistura de 64 bits (splitmix64): sinais de 64 hiperplanos
+ */
+static uint64_t simhash_mix(uint64_t x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+/**
+ * @brief Assinatura SimHash de um vetor TF-IDF
+ *
+ * @param vec Vetor (termo → peso)
+ * @param bits Bits da assinatura
+ * @param acc Rascunho com bits posições
+ * @param sig Saída: assinatura com (bits + 63) / 64 palavras
+ */
+static void simhash_sign(const hash_t *vec, int bits, double *acc,
+                         uint64_t *sig) {
+  int words = (bits + 63) / 64;
+  memset(acc, 0, bits * sizeof(double));
+  memset(sig, 0, words * sizeof(uint64_t));
+  if (!vec)
+    return;
+
+  for (size_t i = 0; i < vec->cap; i++)
+    for (HashEntry *e = vec->buckets[i]; e; e = e->next) {
+      double v = e->value;
+      if (v <= 0.0)
+        continue;
+      uint64_t h = hash_str(e->word, e->wlen);
+      for (int w = 0; w < words; w++) {
+        uint64_t r = simhash_mix(h + (uint64_t)w * 0xD6E8FEB86659FD93ULL);
+        int n = bits - w * 64 < 64 ? bits - w * 64 : 64;
+        double *a = acc + w * 64;
+        for (int j = 0; j < n; j++)
+          a[j] += ((r >> j) & 1) ? v : -v;
+      }
+    }
+
+  for (int j = 0; j < bits; j++)
+    if (acc[j] > 0.0)
+      sig[j >> 6] |= 1ULL << (j & 63);
+}
+
+/**
+ * @brief len bits da assinatura a partir do bit start (len <= 64)
+ */
+static uint64_t simhash_band_key(const uint64_t *sig, int start, int len) {
+  int w = start >> 6, off = start & 63;
+  uint64_t v = sig[w] >> off;
+  if (off + len > 64)
+    v |= sig[w + 1] << (64 - off);
+  return len == 64 ? v : v & ((1ULL << len) - 1);
+}
+
+static int hamming_generic(const uint64_t *a, const uint64_t *b, int words) {
+  int d = 0;
+  for (int w = 0; w < words; w++)
+    d += __builtin_popcountll(a[w] ^ b[w]);
+  return d;
+}
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+// Mesma função com a instrução POPCNT; escolhida em tempo de execução
+__attribute__((target("popcnt"))) static int
+hamming_popcnt(const uint64_t *a, const uint64_t *b, int words) {
+  int d = 0;
+  for (int w = 0; w < words; w++)
+    d += __builtin_popcountll(a[w] ^ b[w]);
+  return d;
+}
+#endif
+
+static int compare_entry(const void *a, const void *b) {
+  const simhash_entry *x = a, *y = b;
+  if (x->key != y->key)
+    return x->key < y->key ? -1 : 1;
+  return (x->doc_id > y->doc_id) - (x->doc_id < y->doc_id);
+}
+
+static simhash_t *simhash_alloc(long int num_docs, int bits) {
+  simhash_t *sh = calloc(1, sizeof(simhash_t));
+  if (!sh)
+    return NULL;
+  sh->bits = bits;
+  sh->words = (bits + 63) / 64;
+  sh->num_docs = num_docs;
+  sh->sigs = malloc((num_docs ? num_docs : 1) * sh->words * sizeof(uint64_t));
+  if (!sh->sigs) {
+    free(sh);
+    return NULL;
+  }
+  mem_track_alloc(MEM_NORMS, num_docs * sh->words * sizeof(uint64_t));
+  return sh;
+}
+
+/**
+ * @brief Calcula as assinaturas de todos os documentos
+ *
+ * @param global_tf Vetores TF-IDF dos documentos
+ * @param num_docs Número de documentos
+ * @param bits Bits por assinatura (1 a SIMHASH_MAX_BITS)
+ * @return Assinaturas (sem faixas), ou NULL em erro
+ */
+simhash_t *simhash_build(hash_t **global_tf, long int num_docs, int bits) {
+  if (bits <= 0 || bits > SIMHASH_MAX_BITS)
+    return NULL;
+  simhash_t *sh = simhash_alloc(num_docs, bits);
+  if (!sh)
+    return NULL;
+
+  double acc[SIMHASH_MAX_BITS];
+  for (long int d = 0; d < num_docs; d++)
+    simhash_sign(global_tf[d], bits, acc, sh->sigs + d * sh->words);
+  return sh;
+}
+
+/**
+ * @brief Grava as assinaturas (ao lado das normas do modelo)
+ *
+ * @param sh Assinaturas
+ * @param filename Arquivo de destino (gravado via .tmp + rename)
+ * @return 0 em sucesso, -1 em erro
+ */
+int simhash_save(const simhash_t *sh, const char *filename) {
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+
+  long int bits = sh->bits;
+  size_t n = (size_t)sh->num_docs * sh->words;
+  int rc = fwrite(SIMHASH_MAGIC, 1, 8, fp) == 8 &&
+                   fwrite(&bits, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(&sh->num_docs, sizeof(long int), 1, fp) == 1 &&
+                   fwrite(sh->sigs, sizeof(uint64_t), n, fp) == n
+               ? 0
+               : -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar assinaturas SimHash %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Carrega as assinaturas gravadas para este modelo
+ *
+ * @param filename Arquivo gravado por simhash_save
+ * @param num_docs Documentos esperados
+ * @param bits Bits esperados por assinatura
+ * @return Assinaturas, ou NULL se ausentes, de outro modelo ou inválidas
+ */
+simhash_t *simhash_load(const char *filename, long int num_docs, int bits) {
+  FILE *fp = fopen(filename, "rb");
+  if (!fp)
+    return NULL;
+
+  char magic[8];
+  long int file_bits, n;
+  if (fread(magic, 1, 8, fp) != 8 || memcmp(magic, SIMHASH_MAGIC, 8) != 0 ||
+      fread(&file_bits, sizeof(long int), 1, fp) != 1 ||
+      fread(&n, sizeof(long int), 1, fp) != 1 || file_bits != bits ||
+      n != num_docs) {
+    fclose(fp);
+    return NULL;
+  }
+
+  simhash_t *sh = simhash_alloc(num_docs, bits);
+  size_t total = (size_t)num_docs * (sh ? sh->words : 0);
+  if (!sh || fread(sh->sigs, sizeof(uint64_t), total, fp) != total) {
+    fprintf(stderr, "Aviso: assinaturas SimHash inválidas em %s\n", filename);
+    fclose(fp);
+    simhash_free(sh);
+    return NULL;
+  }
+  fclose(fp);
+  return sh;
+}
+
+/**
+ * @brief Monta as tabelas das faixas do LSH
+ *
+ * @param sh Assinaturas
+ * @param bands Número de faixas
+ * @param rows Bits por faixa (bands * rows <= sh->bits, rows <= 64)
+ * @param global_doc_norms Normas (documentos vazios ficam fora das faixas)
+ * @return 0 em sucesso, -1 em erro
+ */
+int simhash_bands(simhash_t *sh, int bands, int rows,
+                  const double *global_doc_norms) {
+  if (bands <= 0 || rows <= 0 || rows > 64 || bands * rows > sh->bits)
+    return -1;
+
+  long int N = sh->num_docs;
+  sh->buckets = malloc((size_t)bands * (N ? N : 1) * sizeof(simhash_entry));
+  sh->band_len = calloc(bands, sizeof(long int));
+  sh->stamp = malloc((N ? N : 1) * sizeof(long int));
+  sh->cands = malloc((N ? N : 1) * sizeof(long int));
+  if (!sh->buckets || !sh->band_len || !sh->stamp || !sh->cands)
+    return -1;
+  sh->bands = bands;
+  sh->rows = rows;
+  mem_track_alloc(MEM_POSTINGS, (size_t)bands * N * sizeof(simhash_entry) +
+                                    2 * N * sizeof(long int));
+
+  for (int b = 0; b < bands; b++) {
+    simhash_entry *bk = sh->buckets + (size_t)b * N;
+    long int n = 0;
+    for (long int d = 0; d < N; d++) {
+      if (global_doc_norms[d] <= 0.0)
+        continue;
+      bk[n].key = simhash_band_key(sh->sigs + d * sh->words, b * rows, rows);
+      bk[n++].doc_id = d;
+    }
+    qsort(bk, n, sizeof(simhash_entry), compare_entry);
+    sh->band_len[b] = n;
+  }
+  for (long int d = 0; d < N; d++)
+    sh->stamp[d] = -1;
+
+  sh->hamming = hamming_generic;
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+  if (__builtin_cpu_supports("popcnt"))
+    sh->hamming = hamming_popcnt;
+#endif
+  return 0;
+}
+
+void simhash_free(simhash_t *sh) {
+  if (!sh)
+    return;
+  mem_track_free(MEM_NORMS, sh->num_docs * sh->words * sizeof(uint64_t));
+  if (sh->bands)
+    mem_track_free(MEM_POSTINGS,
+                   (size_t)sh->bands * sh->num_docs * sizeof(simhash_entry) +
+                       2 * sh->num_docs * sizeof(long int));
+  free(sh->sigs);
+  free(sh->buckets);
+  free(sh->band_len);
+  free(sh->stamp);
+  free(sh->cands);
+  free(sh);
+}
+
+/**
+ * @brief Top-k aproximado: candidatos das faixas, Hamming e cosseno exato
+ *
+ * O score de cada documento devolvido é exato (mesma soma de
+ * compute_similarities); a aproximação está só em quais documentos são
+ * pontuados.
+ *
+ * @param sh Assinaturas com faixas (simhash_bands)
+ * @param global_tf Vetores TF-IDF dos documentos
+ * @param query_tf Vetor TF-IDF da consulta
+ * @param query_norm Norma da consulta
+ * @param global_doc_norms Normas dos documentos
+ * @param k Tamanho do top-k
+ * @param rerank Candidatos mais próximos em Hamming a pontuar (0 = todos)
+ * @param out Saída: top-k ordenado
+ * @param ncand Saída: candidatos gerados pelas faixas
+ * @return Documentos em out, ou -1 em erro
+ */
+long int simhash_top_k(simhash_t *sh, hash_t **global_tf,
+                       const hash_t *query_tf, double query_norm,
+                       const double *global_doc_norms, int k, long int rerank,
+                       DocSim *out, long int *ncand) {
+  *ncand = 0;
+  if (k <= 0)
+    return 0;
+
+  double acc[SIMHASH_MAX_BITS];
+  uint64_t qsig[SIMHASH_WORDS];
+  simhash_sign(query_tf, sh->bits, acc, qsig);
+  long int query = sh->queries++;
+
+  // [1] Candidatos: documentos que coincidem com a consulta em alguma faixa
+  long int nc = 0;
+  for (int b = 0; b < sh->bands; b++) {
+    const simhash_entry *bk = sh->buckets + (size_t)b * sh->num_docs;
+    uint64_t key = simhash_band_key(qsig, b * sh->rows, sh->rows);
+    long int lo = 0, hi = sh->band_len[b];
+    while (lo < hi) {
+      long int mid = lo + (hi - lo) / 2;
+      if (bk[mid].key < key)
+        lo = mid + 1;
+      else
+        hi = mid;
+    }
+    for (; lo < sh->band_len[b] && bk[lo].key == key; lo++)
+      if (sh->stamp[bk[lo].doc_id] != query) {
+        sh->stamp[bk[lo].doc_id] = query;
+        sh->cands[nc++] = bk[lo].doc_id;
+      }
+  }
+  sh->candidates += nc;
+  *ncand = nc;
+
+  // [2] Só os rerank candidatos mais próximos em Hamming (contagem por
+  // distância; empates pela ordem das faixas)
+  long int limit = rerank > 0 && rerank < nc ? rerank : nc;
+  if (limit < nc) {
+    long int count[SIMHASH_MAX_BITS + 1] = {0};
+    for (long int i = 0; i < nc; i++)
+      count[sh->hamming(qsig, sh->sigs + sh->cands[i] * sh->words, sh->words)]++;
+    int cut = 0;
+    long int below = 0;
+    while (below + count[cut] < limit)
+      below += count[cut++];
+    long int ties = limit - below, w = 0;
+    for (long int i = 0; i < nc && w < limit; i++) {
+      int dist =
+          sh->hamming(qsig, sh->sigs + sh->cands[i] * sh->words, sh->words);
+      if (dist < cut || (dist == cut && ties-- > 0))
+        sh->cands[w++] = sh->cands[i];
+    }
+  }
+  sh->reranked += limit;
+
+  // [3] Cosseno exato dos candidatos
+  return rerank_top_k(query_tf, query_norm, global_tf, global_doc_norms,
+                      sh->num_docs, sh->cands, limit, k, out);
+}
+
+void simhash_report(const simhash_t *sh, FILE *out) {
+  char size[32];
+  mem_format_size(sh->num_docs * sh->words * sizeof(uint64_t), size,
+                  sizeof(size));
+  fprintf(out,
+          "[LSH] %d faixas × %d linhas, consultas=%ld candidatos/consulta=%.1f "
+          "recalculados/consulta=%.1f (assinaturas: %s)\n",
+          sh->bands, sh->rows, sh->queries,
+          sh->queries ? (double)sh->candidates / sh->queries : 0.0,
+          sh->queries ? (double)sh->reranked / sh->queries : 0.0, size);
+}
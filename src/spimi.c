@@ -0,0 +1,1342 @@
+/**
+ * @file spimi.c
+ * @brief Indexação SPIMI (Single-Pass In-Memory Indexing) para corpora maiores que a RAM
+ *
+ * Em vez de manter a tabela TF de todos os documentos em global_tf até o
+ * fim, cada thread indexa seu intervalo de documentos em um bloco em memória
+ * (dicionário termo → lista de (doc_id, tf)). Quando o bloco atinge o limite
+ * de memória configurado, os termos são ordenados e gravados como um "run"
+ * parcial no diretório temporário, já particionados por hash do termo.
+ *
+ * Em seguida, uma thread de merge por partição faz o merge multivias de
+ * todos os runs da partição. Como cada thread indexa um intervalo contíguo
+ * e crescente de documentos, concatenar as listas de um termo na ordem
+ * (thread, run) já produz doc_ids ordenados. Durante o merge são calculados
+ * df, IDF, TF-IDF de cada posting e a soma de quadrados das normas.
+ *
+ * Saída: o índice invertido (ver index.c), o IDF (formato de save_hash) e as
+ * normas (formato de save_doc_norms). O modelo por documento (tf_*.bin) não
+ * é gerado neste modo.
+ *
+ * Formato de um run (run_p<partição>_t<thread>_<seq>.bin):
+ *
+ *     long int num_terms
+ *     para cada termo (ordem lexicográfica):
+ *       size_t wlen, char word[wlen], long int n,
+ *       long int doc_ids[n], int tfs[n]
+ *
+ * As mesmas etapas também podem rodar como processos map/reduce separados
+ * (spimi_map, spimi_reduce, spimi_finalize), ver o fim deste arquivo.
+ * spimi_build_run e spimi_merge_runs produzem um único run com TF bruto
+ * (sem IDF), usado como segmento imutável pelo índice incremental.
+ */
+
+#include "../include/spimi.h"
+#include "../include/cpu.h"
+#include "../include/file_io.h"
+#include "../include/hash_t.h"
+#include "../include/log.h"
+#include "../include/mem.h"
+#include "../include/preprocess.h"
+#include "../include/sqlite_helper.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#define SPIMI_IO_BUF (1 << 20) /**< Buffer de stdio para runs e partições */
+
+/* ------------- Bloco em Memória ------------- */
+
+typedef struct {
+  long int *doc_ids;
+  int *tfs;
+  long int len;
+  long int cap;
+} spimi_list;
+
+typedef struct {
+  hash_t *dict;      // termo → posição em lists
+  spimi_list *lists; // listas do bloco
+  long int nlists;
+  long int cap;
+  size_t bytes;      // Estimativa do tamanho do bloco
+} spimi_block;
+
+typedef struct {
+  const spimi_config *cfg;
+  long int id;
+  long int start;
+  long int end;
+  const long int *ids; // Se não nulo: [start, end) são posições neste vetor
+  int nparts;
+  long int nruns; // Saída: número de runs gravados
+  int failed;
+} spimi_worker_args;
+
+typedef struct {
+  const spimi_config *cfg;
+  int part;
+  int nparts;
+  int nworkers;          // Threads (ou mappers) que gravaram runs
+  const long int *nruns; // Runs por thread de indexação
+  long int fanin;        // Máximo de runs abertos por merge
+  long int num_live;     // N do IDF (linhas existentes)
+  double *norm_sq;       // Saída: soma dos quadrados por documento
+  hash_t *idf;           // Saída: IDF dos termos da partição
+  const char *output;    // Se não nulo: grava um único run (TF bruto) aqui
+  long int num_terms;    // Saída
+  int failed;
+} spimi_merge_args;
+
+static void run_filename(char *buf, size_t len, const char *dir, int part,
+                         long int tid, long int seq) {
+  snprintf(buf, len, "%s/run_p%d_t%ld_%ld.bin", dir, part, tid, seq);
+}
+
+static void part_filename(char *buf, size_t len, const char *dir, int part) {
+  snprintf(buf, len, "%s/part_%d.bin", dir, part);
+}
+
+static FILE *open_buffered(const char *filename, const char *mode,
+                           char **buf_out) {
+  FILE *fp = fopen(filename, mode);
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s\n", filename);
+    return NULL;
+  }
+  *buf_out = malloc(SPIMI_IO_BUF);
+  if (*buf_out) {
+    setvbuf(fp, *buf_out, _IOFBF, SPIMI_IO_BUF);
+    mem_track_alloc(MEM_IO, SPIMI_IO_BUF);
+  }
+  return fp;
+}
+
+static void close_buffered(FILE *fp, char *buf) {
+  fclose(fp);
+  if (buf) {
+    mem_track_free(MEM_IO, SPIMI_IO_BUF);
+    free(buf);
+  }
+}
+
+static void block_init(spimi_block *b) {
+  b->dict = hash_new();
+  b->lists = NULL;
+  b->nlists = 0;
+  b->cap = 0;
+  b->bytes = 0;
+}
+
+static void block_clear(spimi_block *b) {
+  for (long int i = 0; i < b->nlists; i++) {
+    mem_track_free(MEM_POSTINGS,
+                   b->lists[i].cap * (sizeof(long int) + sizeof(int)));
+    free(b->lists[i].doc_ids);
+    free(b->lists[i].tfs);
+  }
+  mem_track_free(MEM_POSTINGS, b->cap * sizeof(spimi_list));
+  free(b->lists);
+  hash_free(b->dict);
+}
+
+/**
+ * @brief Adiciona posting (doc_id, tf) à lista do termo no bloco
+ *
+ * @return 0 em sucesso, -1 em falha de alocação
+ */
+static int block_add(spimi_block *b, const char *word, long int doc_id, int tf) {
+  long int idx;
+  if (hash_contains(b->dict, word)) {
+    idx = (long int)hash_find(b->dict, word);
+  } else {
+    if (b->nlists == b->cap) {
+      long int ncap = b->cap ? b->cap * 2 : 1024;
+      spimi_list *nl = realloc(b->lists, ncap * sizeof(spimi_list));
+      if (!nl)
+        return -1;
+      mem_track_alloc(MEM_POSTINGS, (ncap - b->cap) * sizeof(spimi_list));
+      b->bytes += (ncap - b->cap) * sizeof(spimi_list);
+      b->lists = nl;
+      b->cap = ncap;
+    }
+    idx = b->nlists++;
+    memset(&b->lists[idx], 0, sizeof(spimi_list));
+    hash_add(b->dict, word, (double)idx);
+    b->bytes += sizeof(HashEntry) + strlen(word) + 1 + 2 * sizeof(void *);
+  }
+
+  spimi_list *l = &b->lists[idx];
+  if (l->len == l->cap) {
+    long int ncap = l->cap ? l->cap * 2 : 4;
+    long int *nd = realloc(l->doc_ids, ncap * sizeof(long int));
+    if (!nd)
+      return -1;
+    l->doc_ids = nd;
+    int *nt = realloc(l->tfs, ncap * sizeof(int));
+    if (!nt)
+      return -1;
+    l->tfs = nt;
+    size_t grow = (ncap - l->cap) * (sizeof(long int) + sizeof(int));
+    mem_track_alloc(MEM_POSTINGS, grow);
+    b->bytes += grow;
+    l->cap = ncap;
+  }
+  l->doc_ids[l->len] = doc_id;
+  l->tfs[l->len] = tf;
+  l->len++;
+  return 0;
+}
+
+static int cmp_entry_word(const void *a, const void *b) {
+  const HashEntry *ea = *(const HashEntry *const *)a;
+  const HashEntry *eb = *(const HashEntry *const *)b;
+  return strcmp(ea->word, eb->word);
+}
+
+/**
+ * @brief Grava o bloco como um run ordenado por partição e o esvazia
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int block_flush(spimi_block *b, const spimi_config *cfg, long int tid,
+                       long int seq, int nparts) {
+  HashEntry **entries = malloc((b->nlists ? b->nlists : 1) * sizeof(HashEntry *));
+  long int *part_count = calloc(nparts, sizeof(long int));
+  long int *part_off = calloc(nparts + 1, sizeof(long int));
+  HashEntry **sorted = malloc((b->nlists ? b->nlists : 1) * sizeof(HashEntry *));
+  int rc = -1;
+
+  if (!entries || !part_count || !part_off || !sorted)
+    goto out;
+
+  // Agrupar entradas do dicionário por partição (counting sort)
+  long int n = 0;
+  for (size_t i = 0; i < b->dict->cap; i++)
+    for (HashEntry *e = b->dict->buckets[i]; e; e = e->next) {
+      entries[n++] = e;
+      part_count[hash_str(e->word, e->wlen) % nparts]++;
+    }
+  for (int p = 0; p < nparts; p++)
+    part_off[p + 1] = part_off[p] + part_count[p];
+  memset(part_count, 0, nparts * sizeof(long int));
+  for (long int i = 0; i < n; i++) {
+    int p = hash_str(entries[i]->word, entries[i]->wlen) % nparts;
+    sorted[part_off[p] + part_count[p]++] = entries[i];
+  }
+
+  for (int p = 0; p < nparts; p++) {
+    long int cnt = part_off[p + 1] - part_off[p];
+    HashEntry **slice = sorted + part_off[p];
+    qsort(slice, cnt, sizeof(HashEntry *), cmp_entry_word);
+
+    char filename[512];
+    char *iobuf;
+    run_filename(filename, sizeof(filename), cfg->tmp_dir, p, tid, seq);
+    FILE *fp = open_buffered(filename, "wb", &iobuf);
+    if (!fp)
+      goto out;
+
+    fwrite(&cnt, sizeof(long int), 1, fp);
+    for (long int i = 0; i < cnt; i++) {
+      const spimi_list *l = &b->lists[(long int)slice[i]->value];
+      fwrite(&slice[i]->wlen, sizeof(size_t), 1, fp);
+      fwrite(slice[i]->word, 1, slice[i]->wlen, fp);
+      fwrite(&l->len, sizeof(long int), 1, fp);
+      fwrite(l->doc_ids, sizeof(long int), l->len, fp);
+      fwrite(l->tfs, sizeof(int), l->len, fp);
+    }
+
+    int write_err = ferror(fp);
+    close_buffered(fp, iobuf);
+    if (write_err) {
+      fprintf(stderr, "Erro ao gravar run %s\n", filename);
+      goto out;
+    }
+  }
+
+  LOG(stdout, "[SPIMI] T%02ld: run %ld gravado (%ld termos, ~%zu bytes)", tid,
+      seq, n, b->bytes);
+  rc = 0;
+
+out:
+  free(entries);
+  free(part_count);
+  free(part_off);
+  free(sorted);
+  block_clear(b);
+  block_init(b);
+  return rc;
+}
+
+static int cmp_str(const void *a, const void *b) {
+  return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* ------------- Indexação (workers) ------------- */
+
+/**
+ * @brief Thread de indexação: tokeniza seu intervalo e grava runs parciais
+ */
+static void *spimi_worker(void *arg) {
+  spimi_worker_args *t = (spimi_worker_args *)arg;
+  const spimi_config *cfg = t->cfg;
+  spimi_block block;
+  block_init(&block);
+
+  db_reader *reader = db_reader_open(cfg->db, cfg->table);
+  if (!reader)
+    t->failed = 1;
+
+  for (long int lo = t->start; lo < t->end && !t->failed; lo += cfg->batch) {
+    long int hi = lo + cfg->batch < t->end ? lo + cfg->batch : t->end;
+    long int n = hi - lo;
+
+    char ***article_vecs =
+        t->ids ? db_reader_tokenize_ids(reader, t->ids + lo, n)
+               : db_reader_tokenize_range(reader, lo, hi - 1);
+    if (!article_vecs) {
+      fprintf(stderr, "Thread %02ld: Erro ao obter dados do banco\n", t->id);
+      t->failed = 1;
+      break;
+    }
+    remove_stopwords(article_vecs, n);
+    stem(article_vecs, n);
+
+    for (long int i = 0; i < n && !t->failed; i++) {
+      char **tokens = article_vecs[i];
+      if (!tokens)
+        continue;
+
+      // Ordenar os tokens do documento: termos iguais ficam contíguos (TF)
+      long int ntok = 0;
+      while (tokens[ntok])
+        ntok++;
+      qsort(tokens, ntok, sizeof(char *), cmp_str);
+
+      for (long int j = 0; j < ntok;) {
+        long int k = j + 1;
+        while (k < ntok && strcmp(tokens[k], tokens[j]) == 0)
+          k++;
+        long int doc_id = t->ids ? t->ids[lo + i] : lo + i;
+        if (block_add(&block, tokens[j], doc_id, (int)(k - j)) != 0) {
+          fprintf(stderr, "Thread %02ld: Falha ao alocar bloco SPIMI\n", t->id);
+          t->failed = 1;
+          break;
+        }
+        j = k;
+      }
+
+      if (!t->failed && block.bytes >= cfg->block_bytes &&
+          block_flush(&block, cfg, t->id, t->nruns++, t->nparts) != 0)
+        t->failed = 1;
+    }
+
+    free_article_vecs(article_vecs, n);
+    if (t->failed)
+      break;
+  }
+
+  db_reader_close(reader);
+  if (!t->failed && block.nlists > 0 &&
+      block_flush(&block, cfg, t->id, t->nruns++, t->nparts) != 0)
+    t->failed = 1;
+
+  block_clear(&block);
+  mem_flush();
+  return NULL;
+}
+
+/* ------------- Merge Multivias (por partição) ------------- */
+
+typedef struct {
+  FILE *fp;
+  char *iobuf;
+  long int remaining; // Termos ainda não lidos do run
+  char *word;
+  size_t wlen;
+  size_t wcap;
+  long int n;         // Postings do termo corrente (ainda no arquivo)
+  long int order;     // Posição do run na ordem (thread, seq)
+} run_cursor;
+
+/**
+ * @brief Avança o cursor para o próximo termo do run
+ *
+ * @return 1 se há termo corrente, 0 no fim do run, -1 em erro
+ */
+static int cursor_next(run_cursor *c) {
+  if (c->remaining <= 0)
+    return 0;
+  if (fread(&c->wlen, sizeof(size_t), 1, c->fp) != 1)
+    return -1;
+  if (c->wlen + 1 > c->wcap) {
+    char *nw = realloc(c->word, c->wlen + 1);
+    if (!nw)
+      return -1;
+    c->word = nw;
+    c->wcap = c->wlen + 1;
+  }
+  if (fread(c->word, 1, c->wlen, c->fp) != c->wlen ||
+      fread(&c->n, sizeof(long int), 1, c->fp) != 1)
+    return -1;
+  c->word[c->wlen] = '\0';
+  c->remaining--;
+  return 1;
+}
+
+static int cursor_less(const run_cursor *a, const run_cursor *b) {
+  int c = strcmp(a->word, b->word);
+  return c < 0 || (c == 0 && a->order < b->order);
+}
+
+static void heap_push(run_cursor **heap, long int *size, run_cursor *c) {
+  long int i = (*size)++;
+  heap[i] = c;
+  while (i > 0) {
+    long int parent = (i - 1) / 2;
+    if (!cursor_less(heap[i], heap[parent]))
+      break;
+    run_cursor *tmp = heap[i];
+    heap[i] = heap[parent];
+    heap[parent] = tmp;
+    i = parent;
+  }
+}
+
+static run_cursor *heap_pop(run_cursor **heap, long int *size) {
+  run_cursor *top = heap[0];
+  heap[0] = heap[--(*size)];
+  long int i = 0;
+  for (;;) {
+    long int l = 2 * i + 1, r = l + 1, m = i;
+    if (l < *size && cursor_less(heap[l], heap[m]))
+      m = l;
+    if (r < *size && cursor_less(heap[r], heap[m]))
+      m = r;
+    if (m == i)
+      break;
+    run_cursor *tmp = heap[i];
+    heap[i] = heap[m];
+    heap[m] = tmp;
+    i = m;
+  }
+  return top;
+}
+
+typedef struct {
+  long int *ids;
+  double *values;
+  int *tfs;
+  long int cap;
+} merge_buf;
+
+static int merge_buf_reserve(merge_buf *buf, long int need) {
+  if (need <= buf->cap)
+    return 0;
+  long int ncap = buf->cap ? buf->cap : 1024;
+  while (ncap < need)
+    ncap *= 2;
+  long int *ni = realloc(buf->ids, ncap * sizeof(long int));
+  if (ni)
+    buf->ids = ni;
+  double *nv = realloc(buf->values, ncap * sizeof(double));
+  if (nv)
+    buf->values = nv;
+  int *nt = realloc(buf->tfs, ncap * sizeof(int));
+  if (nt)
+    buf->tfs = nt;
+  if (!ni || !nv || !nt)
+    return -1;
+  mem_track_alloc(MEM_POSTINGS, (ncap - buf->cap) * (sizeof(long int) +
+                                                     sizeof(double) +
+                                                     sizeof(int)));
+  buf->cap = ncap;
+  return 0;
+}
+
+/**
+ * @brief Merge multivias de runs (na ordem dada) em um único arquivo
+ *
+ * Com final=0 a saída é um novo run (mesmo formato da entrada), usado nos
+ * níveis intermediários quando há mais runs do que descritores disponíveis.
+ * Com final=1 a saída é a partição do índice: df, IDF e TF-IDF de cada
+ * posting são calculados e a soma de quadrados é acumulada em m->norm_sq.
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+static int merge_files(char **inputs, long int n, const char *output, int final,
+                       spimi_merge_args *m, merge_buf *buf) {
+  run_cursor *cursors = calloc(n ? n : 1, sizeof(run_cursor));
+  run_cursor **heap = malloc((n ? n : 1) * sizeof(run_cursor *));
+  long int heap_size = 0;
+  long int num_terms = 0;
+  char *out_buf = NULL;
+  FILE *out = NULL;
+  char *word = NULL;
+  int rc = -1;
+
+  if (!cursors || !heap)
+    goto out;
+
+  for (long int i = 0; i < n; i++) {
+    run_cursor *c = &cursors[i];
+    c->order = i;
+    c->fp = open_buffered(inputs[i], "rb", &c->iobuf);
+    if (!c->fp || fread(&c->remaining, sizeof(long int), 1, c->fp) != 1)
+      goto out;
+    int r = cursor_next(c);
+    if (r < 0)
+      goto out;
+    if (r > 0)
+      heap_push(heap, &heap_size, c);
+  }
+
+  out = open_buffered(output, "wb", &out_buf);
+  if (!out)
+    goto out;
+  if (!final)
+    fwrite(&num_terms, sizeof(long int), 1, out); // Reescrito ao final
+
+  while (heap_size > 0) {
+    long int df = 0;
+    run_cursor *c = heap_pop(heap, &heap_size);
+    size_t wlen = c->wlen;
+    word = strdup(c->word);
+    if (!word)
+      goto out;
+
+    // Concatenar as listas de todos os runs que contêm o termo
+    for (;;) {
+      if (merge_buf_reserve(buf, df + c->n) != 0)
+        goto out;
+      if (fread(buf->ids + df, sizeof(long int), c->n, c->fp) != (size_t)c->n ||
+          fread(buf->tfs + df, sizeof(int), c->n, c->fp) != (size_t)c->n)
+        goto out;
+      df += c->n;
+
+      int r = cursor_next(c);
+      if (r < 0)
+        goto out;
+      if (r > 0)
+        heap_push(heap, &heap_size, c);
+
+      if (heap_size == 0 || strcmp(heap[0]->word, word) != 0)
+        break;
+      c = heap_pop(heap, &heap_size);
+    }
+
+    fwrite(&wlen, sizeof(size_t), 1, out);
+    fwrite(word, 1, wlen, out);
+    fwrite(&df, sizeof(long int), 1, out);
+
+    if (final) {
+      // df conhecido: IDF, TF-IDF e contribuição para as normas
+      double idf = log2((double)m->num_live / (double)df);
+      for (long int i = 0; i < df; i++) {
+        buf->values[i] = (1.0 + log2((double)buf->tfs[i])) * idf;
+        m->norm_sq[buf->ids[i]] += buf->values[i] * buf->values[i];
+      }
+      fwrite(&idf, sizeof(double), 1, out);
+      fwrite(buf->ids, sizeof(long int), df, out);
+      fwrite(buf->values, sizeof(double), df, out);
+      hash_add(m->idf, word, idf);
+    } else {
+      fwrite(buf->ids, sizeof(long int), df, out);
+      fwrite(buf->tfs, sizeof(int), df, out);
+    }
+
+    num_terms++;
+    free(word);
+    word = NULL;
+  }
+
+  if (!final) {
+    fseek(out, 0, SEEK_SET);
+    fwrite(&num_terms, sizeof(long int), 1, out);
+  } else {
+    m->num_terms = num_terms;
+  }
+
+  if (ferror(out)) {
+    fprintf(stderr, "Erro ao gravar %s\n", output);
+    goto out;
+  }
+  rc = 0;
+
+out:
+  free(word);
+  if (out)
+    close_buffered(out, out_buf);
+  for (long int i = 0; i < n && cursors; i++) {
+    if (cursors[i].fp)
+      close_buffered(cursors[i].fp, cursors[i].iobuf);
+    free(cursors[i].word);
+  }
+  free(cursors);
+  free(heap);
+  return rc;
+}
+
+/**
+ * @brief Thread de merge: une os runs de uma partição em uma lista por termo
+ *
+ * Se a partição tiver mais runs do que m->fanin (limite de arquivos abertos
+ * por thread), grupos consecutivos de runs são primeiro unidos em runs
+ * intermediários; a ordem (thread, seq) é preservada, logo os doc_ids
+ * continuam crescentes. O último nível gera a partição final do índice.
+ */
+static void *spimi_merge(void *arg) {
+  spimi_merge_args *m = (spimi_merge_args *)arg;
+  const spimi_config *cfg = m->cfg;
+  merge_buf buf = {NULL, NULL, NULL, 0};
+
+  m->idf = hash_new();
+
+  long int n = 0;
+  for (int t = 0; t < m->nworkers; t++)
+    n += m->nruns[t];
+
+  char **inputs = calloc(n ? n : 1, sizeof(char *));
+  if (!inputs) {
+    m->failed = 1;
+    goto out;
+  }
+
+  // Ordem (thread, seq): garante doc_ids crescentes no merge
+  long int k = 0;
+  for (int t = 0; t < m->nworkers; t++)
+    for (long int s = 0; s < m->nruns[t]; s++) {
+      inputs[k] = malloc(512);
+      if (!inputs[k]) {
+        m->failed = 1;
+        goto out;
+      }
+      run_filename(inputs[k++], 512, cfg->tmp_dir, m->part, t, s);
+    }
+
+  for (int level = 0; n > m->fanin; level++) {
+    long int groups = (n + m->fanin - 1) / m->fanin;
+    LOG(stdout, "[SPIMI] P%02d: nível %d, %ld runs → %ld", m->part, level, n,
+        groups);
+
+    for (long int g = 0; g < groups; g++) {
+      long int lo = g * m->fanin;
+      long int cnt = lo + m->fanin < n ? m->fanin : n - lo;
+      char *merged = malloc(512);
+      if (!merged) {
+        m->failed = 1;
+        goto out;
+      }
+      snprintf(merged, 512, "%s/mrg_p%d_l%d_%ld.bin", cfg->tmp_dir, m->part,
+               level, g);
+      if (merge_files(inputs + lo, cnt, merged, 0, m, &buf) != 0) {
+        free(merged);
+        m->failed = 1;
+        goto out;
+      }
+      for (long int i = lo; i < lo + cnt; i++) {
+        remove(inputs[i]);
+        free(inputs[i]);
+        inputs[i] = NULL;
+      }
+      inputs[g] = merged;
+    }
+    n = groups;
+  }
+
+  char filename[512];
+  part_filename(filename, sizeof(filename), cfg->tmp_dir, m->part);
+  if (merge_files(inputs, n, m->output ? m->output : filename, !m->output, m,
+                  &buf) != 0)
+    m->failed = 1;
+
+out:
+  for (long int i = 0; inputs && i < n; i++) {
+    if (inputs[i]) {
+      remove(inputs[i]);
+      free(inputs[i]);
+    }
+  }
+  free(inputs);
+  mem_track_free(MEM_POSTINGS,
+                 buf.cap * (sizeof(long int) + sizeof(double) + sizeof(int)));
+  free(buf.ids);
+  free(buf.values);
+  free(buf.tfs);
+  mem_flush();
+  return NULL;
+}
+
+/* ------------- Orquestração ------------- */
+
+/**
+ * @brief Máximo de runs abertos por merge, respeitando o limite de descritores
+ *
+ * @param concurrent Merges executando ao mesmo tempo no processo
+ */
+static long int merge_fanin(int concurrent) {
+  long int fanin = 512;
+  struct rlimit rl;
+  if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur != RLIM_INFINITY) {
+    long int avail = ((long int)rl.rlim_cur - 32) / concurrent - 1;
+    if (avail < fanin)
+      fanin = avail;
+  }
+  return fanin < 2 ? 2 : fanin;
+}
+
+/**
+ * @brief Concatena as partições no arquivo final de postings
+ */
+static int write_postings(const spimi_config *cfg, int nparts, long int num_docs,
+                          long int num_terms, const char *filename) {
+  char *out_buf;
+  FILE *out = open_buffered(filename, "wb", &out_buf);
+  if (!out)
+    return -1;
+
+  fwrite(&num_docs, sizeof(long int), 1, out);
+  fwrite(&num_terms, sizeof(long int), 1, out);
+
+  char *chunk = malloc(SPIMI_IO_BUF);
+  int rc = chunk ? 0 : -1;
+  for (int p = 0; p < nparts && rc == 0; p++) {
+    char part[512];
+    part_filename(part, sizeof(part), cfg->tmp_dir, p);
+    FILE *in = fopen(part, "rb");
+    if (!in) {
+      fprintf(stderr, "Erro ao abrir partição %s\n", part);
+      rc = -1;
+      break;
+    }
+    size_t n;
+    while ((n = fread(chunk, 1, SPIMI_IO_BUF, in)) > 0)
+      fwrite(chunk, 1, n, out);
+    fclose(in);
+    remove(part);
+  }
+  free(chunk);
+
+  if (ferror(out))
+    rc = -1;
+  close_buffered(out, out_buf);
+  return rc;
+}
+
+/**
+ * @brief Constrói índice invertido, IDF e normas no modo SPIMI
+ *
+ * @param cfg Configuração da indexação
+ * @param filename_postings Arquivo de saída do índice invertido
+ * @param filename_idf Arquivo de saída do IDF
+ * @param filename_doc_norms Arquivo de saída das normas
+ * @return 0 em sucesso, -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+int spimi_build(const spimi_config *cfg, const char *filename_postings,
+                const char *filename_idf, const char *filename_doc_norms) {
+  int nthreads = cfg->nthreads;
+  int nparts = nthreads;
+  long int num_docs = cfg->entries;
+  int rc = -1;
+
+  if (mkdir(cfg->tmp_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Erro ao criar diretório temporário %s\n", cfg->tmp_dir);
+    return -1;
+  }
+
+  pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+  spimi_worker_args *wargs = calloc(nthreads, sizeof(spimi_worker_args));
+  spimi_merge_args *margs = calloc(nparts, sizeof(spimi_merge_args));
+  long int *nruns = calloc(nthreads, sizeof(long int));
+  double *norms = calloc(num_docs, sizeof(double));
+  hash_t *idf = NULL;
+  if (!tids || !wargs || !margs || !nruns || !norms) {
+    fprintf(stderr, "Falha ao alocar estruturas do SPIMI\n");
+    goto out;
+  }
+  mem_track_alloc(MEM_NORMS, num_docs * sizeof(double));
+
+  /* ---------- Indexação em blocos ---------- */
+  printf("\n[SPIMI] Indexando blocos (limite de %zu bytes por thread)...\n",
+         cfg->block_bytes);
+
+  long int base = num_docs / nthreads;
+  long int rem = num_docs % nthreads;
+  for (int i = 0; i < nthreads; i++) {
+    wargs[i].cfg = cfg;
+    wargs[i].id = i;
+    wargs[i].nparts = nparts;
+    wargs[i].start = i * base + (i < rem ? i : rem);
+    wargs[i].end = wargs[i].start + base + (i < rem);
+    if (cpu_thread_create(&tids[i], i, spimi_worker, &wargs[i])) {
+      fprintf(stderr, "Erro ao criar thread %d\n", i);
+      for (int j = 0; j < i; j++)
+        pthread_join(tids[j], NULL);
+      goto out;
+    }
+  }
+
+  int failed = 0;
+  long int total_runs = 0;
+  for (int i = 0; i < nthreads; i++) {
+    pthread_join(tids[i], NULL);
+    failed |= wargs[i].failed;
+    nruns[i] = wargs[i].nruns;
+    total_runs += nruns[i];
+  }
+  if (failed)
+    goto out;
+  printf("[SPIMI] %ld runs gravados em %s\n", total_runs, cfg->tmp_dir);
+
+  /* ---------- Merge paralelo ---------- */
+  printf("[SPIMI] Merge multivias de %d partições...\n", nparts);
+
+  long int fanin = merge_fanin(nparts);
+
+  int started = 0;
+  for (int p = 0; p < nparts; p++) {
+    margs[p].cfg = cfg;
+    margs[p].part = p;
+    margs[p].nparts = nparts;
+    margs[p].nworkers = nthreads;
+    margs[p].nruns = nruns;
+    margs[p].fanin = fanin;
+    margs[p].num_live = cfg->num_live;
+    margs[p].norm_sq = calloc(num_docs, sizeof(double));
+    if (!margs[p].norm_sq) {
+      fprintf(stderr, "Falha ao alocar normas parciais\n");
+      failed = 1;
+      break;
+    }
+    mem_track_alloc(MEM_NORMS, num_docs * sizeof(double));
+    if (cpu_thread_create(&tids[p], p, spimi_merge, &margs[p])) {
+      fprintf(stderr, "Erro ao criar thread de merge %d\n", p);
+      failed = 1;
+      break;
+    }
+    started++;
+  }
+
+  long int num_terms = 0;
+  idf = hash_new();
+  for (int p = 0; p < started; p++) {
+    pthread_join(tids[p], NULL);
+    failed |= margs[p].failed;
+    num_terms += margs[p].num_terms;
+    hash_merge(idf, margs[p].idf);
+    for (long int d = 0; d < num_docs; d++)
+      norms[d] += margs[p].norm_sq[d];
+  }
+  if (failed)
+    goto out;
+
+  for (long int d = 0; d < num_docs; d++)
+    norms[d] = sqrt(norms[d]);
+
+  printf("[SPIMI] Vocabulário: %ld termos\n", num_terms);
+
+  /* ---------- Saída ---------- */
+  if (write_postings(cfg, nparts, num_docs, num_terms, filename_postings) != 0 ||
+      save_hash(idf, filename_idf) != 0 ||
+      save_doc_norms(norms, num_docs, filename_doc_norms) != 0)
+    goto out;
+
+  LOG(stdout, "Índice invertido salvo em %s", filename_postings);
+  rc = 0;
+
+out:
+  // Remover runs e partições temporárias
+  for (int p = 0; nruns && p < nparts; p++) {
+    char filename[512];
+    for (int t = 0; t < nthreads; t++)
+      for (long int s = 0; s < nruns[t]; s++) {
+        run_filename(filename, sizeof(filename), cfg->tmp_dir, p, t, s);
+        remove(filename);
+      }
+    part_filename(filename, sizeof(filename), cfg->tmp_dir, p);
+    remove(filename);
+  }
+  rmdir(cfg->tmp_dir);
+
+  for (int p = 0; margs && p < nparts; p++) {
+    if (margs[p].norm_sq) {
+      mem_track_free(MEM_NORMS, num_docs * sizeof(double));
+      free(margs[p].norm_sq);
+    }
+    hash_free(margs[p].idf);
+  }
+  if (norms)
+    mem_track_free(MEM_NORMS, num_docs * sizeof(double));
+  free(norms);
+  hash_free(idf);
+  free(nruns);
+  free(margs);
+  free(wargs);
+  free(tids);
+  return rc;
+}
+
+/* ------------- Runs com TF Bruto (segmentos) ------------- */
+
+/**
+ * @brief Indexa um intervalo de documentos ou uma lista de ids em um único run
+ *
+ * Mesmo pipeline do spimi_build com uma só partição; o merge final grava o
+ * run (termos ordenados, doc_ids crescentes, TF bruto) em output, sem IDF.
+ * Com ids nulo, indexa [first_doc, first_doc + entries); caso contrário,
+ * ids[0..entries), que devem estar em ordem crescente.
+ */
+static int build_run(const spimi_config *cfg, long int first_doc,
+                     const long int *ids, const char *output) {
+  int nthreads = cfg->nthreads;
+  int rc = -1;
+
+  if (mkdir(cfg->tmp_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Erro ao criar diretório temporário %s\n", cfg->tmp_dir);
+    return -1;
+  }
+
+  pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+  spimi_worker_args *wargs = calloc(nthreads, sizeof(spimi_worker_args));
+  long int *nruns = calloc(nthreads, sizeof(long int));
+  if (!tids || !wargs || !nruns)
+    goto out;
+
+  long int base = cfg->entries / nthreads;
+  long int rem = cfg->entries % nthreads;
+  int started = 0, failed = 0;
+  for (int i = 0; i < nthreads; i++) {
+    wargs[i].cfg = cfg;
+    wargs[i].id = i;
+    wargs[i].nparts = 1;
+    wargs[i].ids = ids;
+    wargs[i].start = first_doc + i * base + (i < rem ? i : rem);
+    wargs[i].end = wargs[i].start + base + (i < rem);
+    if (cpu_thread_create(&tids[i], i, spimi_worker, &wargs[i])) {
+      fprintf(stderr, "Erro ao criar thread %d\n", i);
+      failed = 1;
+      break;
+    }
+    started++;
+  }
+  for (int i = 0; i < started; i++) {
+    pthread_join(tids[i], NULL);
+    failed |= wargs[i].failed;
+    nruns[i] = wargs[i].nruns;
+  }
+
+  if (!failed) {
+    spimi_merge_args m = {0};
+    m.cfg = cfg;
+    m.nparts = 1;
+    m.nworkers = started;
+    m.nruns = nruns;
+    m.fanin = merge_fanin(1);
+    m.output = output;
+    spimi_merge(&m);
+    hash_free(m.idf);
+    rc = m.failed ? -1 : 0;
+  }
+
+out:
+  for (int t = 0; nruns && t < nthreads; t++) {
+    char filename[512];
+    for (long int s = 0; s < nruns[t]; s++) {
+      run_filename(filename, sizeof(filename), cfg->tmp_dir, 0, t, s);
+      remove(filename);
+    }
+  }
+  rmdir(cfg->tmp_dir);
+  free(nruns);
+  free(wargs);
+  free(tids);
+  return rc;
+}
+
+/**
+ * @brief Indexa os documentos [first_doc, first_doc + entries) em um único run
+ *
+ * @param cfg Configuração (entries = quantidade de documentos a indexar)
+ * @param first_doc Primeiro article_id do intervalo
+ * @param output Arquivo do run de saída
+ * @return 0 em sucesso, -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+int spimi_build_run(const spimi_config *cfg, long int first_doc,
+                    const char *output) {
+  return build_run(cfg, first_doc, NULL, output);
+}
+
+/**
+ * @brief Indexa os documentos ids[0..cfg->entries) em um único run
+ *
+ * @param cfg Configuração (entries = quantidade de ids)
+ * @param ids article_ids em ordem crescente
+ * @param output Arquivo do run de saída
+ * @return 0 em sucesso, -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+int spimi_build_run_ids(const spimi_config *cfg, const long int *ids,
+                        const char *output) {
+  return build_run(cfg, 0, ids, output);
+}
+
+/**
+ * @brief Merge de runs com intervalos de documentos crescentes em um único run
+ *
+ * @param inputs Runs na ordem dos seus doc_ids
+ * @param n Número de runs
+ * @param output Run de saída
+ * @return 0 em sucesso, -1 em erro
+ */
+int spimi_merge_runs(char **inputs, long int n, const char *output) {
+  spimi_merge_args m = {0};
+  merge_buf buf = {NULL, NULL, NULL, 0};
+
+  int rc = merge_files(inputs, n, output, 0, &m, &buf);
+
+  mem_track_free(MEM_POSTINGS,
+                 buf.cap * (sizeof(long int) + sizeof(double) + sizeof(int)));
+  free(buf.ids);
+  free(buf.values);
+  free(buf.tfs);
+  return rc;
+}
+
+/* ------------- Map/Shuffle/Reduce em Processos ------------- */
+
+/*
+ * As mesmas etapas do spimi_build, em processos independentes que só se
+ * comunicam por arquivos no diretório temporário (que pode ser um volume
+ * compartilhado entre contêineres ou máquinas):
+ *
+ *   map i      tokeniza o i-ésimo intervalo de article_id e grava os runs
+ *              run_p<r>_t<i>_<seq>.bin, particionados por hash do termo;
+ *   reduce r   descobre os runs da partição r, faz o merge (df, IDF, TF-IDF)
+ *              e grava part_<r>.bin, idf_<r>.bin (save_hash) e
+ *              normsq_<r>.bin (somas parciais de quadrados, save_doc_norms);
+ *   finalize   soma as normas parciais e junta partições e IDFs nos
+ *              arquivos finais do índice.
+ *
+ * Todos os mappers devem terminar antes do primeiro reducer começar.
+ */
+
+static void reduce_filenames(char *idf, char *normsq, size_t len,
+                             const char *dir, int part) {
+  snprintf(idf, len, "%s/idf_%d.bin", dir, part);
+  snprintf(normsq, len, "%s/normsq_%d.bin", dir, part);
+}
+
+/**
+ * @brief Conta os runs gravados por um mapper para uma partição
+ */
+static long int count_runs(const char *dir, int part, long int mapper) {
+  char filename[512];
+  long int seq = 0;
+  for (;; seq++) {
+    run_filename(filename, sizeof(filename), dir, part, mapper, seq);
+    if (access(filename, F_OK) == -1)
+      return seq;
+  }
+}
+
+/**
+ * @brief Etapa map: indexa o intervalo do mapper e grava runs por partição
+ *
+ * @param cfg Configuração (entries, batch, block_bytes, tmp_dir)
+ * @param mapper Índice do mapper (0 a nmappers-1)
+ * @param nmappers Número de mappers
+ * @param nreducers Número de partições de termos
+ * @return 0 em sucesso, -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+int spimi_map(const spimi_config *cfg, int mapper, int nmappers,
+              int nreducers) {
+  if (mapper < 0 || mapper >= nmappers || nreducers <= 0) {
+    fprintf(stderr, "Erro: mapper %d inválido (mappers=%d, reducers=%d)\n",
+            mapper, nmappers, nreducers);
+    return -1;
+  }
+  if (mkdir(cfg->tmp_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Erro ao criar diretório temporário %s\n", cfg->tmp_dir);
+    return -1;
+  }
+
+  long int base = cfg->entries / nmappers;
+  long int rem = cfg->entries % nmappers;
+  spimi_worker_args w = {0};
+  w.cfg = cfg;
+  w.id = mapper;
+  w.nparts = nreducers;
+  w.start = mapper * base + (mapper < rem ? mapper : rem);
+  w.end = w.start + base + (mapper < rem);
+
+  spimi_worker(&w);
+
+  LOG(stdout, "[MAP] M%02d: documentos [%ld, %ld), %ld runs", mapper, w.start,
+      w.end, w.nruns);
+  return w.failed ? -1 : 0;
+}
+
+/**
+ * @brief Etapa reduce: merge dos runs de uma partição de termos
+ *
+ * @param cfg Configuração (entries, tmp_dir)
+ * @param reducer Índice da partição (0 a nreducers-1)
+ * @param nmappers Número de mappers que gravaram runs
+ * @param nreducers Número de partições
+ * @return 0 em sucesso, -1 em erro
+ */
+int spimi_reduce(const spimi_config *cfg, int reducer, int nmappers,
+                 int nreducers) {
+  if (reducer < 0 || reducer >= nreducers || nmappers <= 0) {
+    fprintf(stderr, "Erro: reducer %d inválido (mappers=%d, reducers=%d)\n",
+            reducer, nmappers, nreducers);
+    return -1;
+  }
+
+  long int *nruns = calloc(nmappers, sizeof(long int));
+  spimi_merge_args m = {0};
+  m.cfg = cfg;
+  m.part = reducer;
+  m.nparts = nreducers;
+  m.nworkers = nmappers;
+  m.nruns = nruns;
+  m.fanin = merge_fanin(1);
+  m.num_live = cfg->num_live;
+  m.norm_sq = calloc(cfg->entries, sizeof(double));
+  if (!nruns || !m.norm_sq) {
+    fprintf(stderr, "Falha ao alocar estruturas do reducer %d\n", reducer);
+    free(nruns);
+    free(m.norm_sq);
+    return -1;
+  }
+  mem_track_alloc(MEM_NORMS, cfg->entries * sizeof(double));
+
+  long int total_runs = 0;
+  for (int t = 0; t < nmappers; t++) {
+    nruns[t] = count_runs(cfg->tmp_dir, reducer, t);
+    total_runs += nruns[t];
+  }
+
+  spimi_merge(&m);
+
+  int rc = -1;
+  if (!m.failed) {
+    char f_idf[512], f_normsq[512];
+    reduce_filenames(f_idf, f_normsq, sizeof(f_idf), cfg->tmp_dir, reducer);
+    if (save_hash(m.idf, f_idf) == 0 &&
+        save_doc_norms(m.norm_sq, cfg->entries, f_normsq) == 0)
+      rc = 0;
+  }
+
+  LOG(stdout, "[REDUCE] R%02d: %ld runs, %ld termos", reducer, total_runs,
+      m.num_terms);
+
+  mem_track_free(MEM_NORMS, cfg->entries * sizeof(double));
+  free(m.norm_sq);
+  hash_free(m.idf);
+  free(nruns);
+  return rc;
+}
+
+/**
+ * @brief Etapa final: normas, IDF e índice a partir das saídas dos reducers
+ *
+ * @param cfg Configuração (entries, tmp_dir)
+ * @param nreducers Número de partições
+ * @param filename_postings Arquivo de saída do índice invertido
+ * @param filename_idf Arquivo de saída do IDF
+ * @param filename_doc_norms Arquivo de saída das normas
+ * @return 0 em sucesso, -1 em erro
+ */
+int spimi_finalize(const spimi_config *cfg, int nreducers,
+                   const char *filename_postings, const char *filename_idf,
+                   const char *filename_doc_norms) {
+  long int num_docs = cfg->entries;
+  long int num_terms = 0;
+  int rc = -1;
+
+  hash_t *idf = hash_new();
+  double *norms = calloc(num_docs, sizeof(double));
+  if (!norms) {
+    hash_free(idf);
+    return -1;
+  }
+  mem_track_alloc(MEM_NORMS, num_docs * sizeof(double));
+
+  // Somar as partes na ordem das partições (mesma ordem do spimi_build)
+  for (int p = 0; p < nreducers; p++) {
+    char f_idf[512], f_normsq[512];
+    reduce_filenames(f_idf, f_normsq, sizeof(f_idf), cfg->tmp_dir, p);
+
+    hash_t *part_idf = load_hash(f_idf);
+    long int n = 0;
+    double *norm_sq = load_doc_norms(f_normsq, &n, 1);
+    if (!part_idf || !norm_sq || n != num_docs) {
+      fprintf(stderr, "Erro: saída do reducer %d ausente ou inválida\n", p);
+      hash_free(part_idf);
+      if (norm_sq) {
+        mem_track_free(MEM_NORMS, n * sizeof(double));
+        free(norm_sq);
+      }
+      goto out;
+    }
+
+    // Termos são disjuntos entre partições
+    num_terms += hash_size(part_idf);
+    hash_merge(idf, part_idf);
+    hash_free(part_idf);
+    for (long int d = 0; d < num_docs; d++)
+      norms[d] += norm_sq[d];
+    mem_track_free(MEM_NORMS, n * sizeof(double));
+    free(norm_sq);
+  }
+
+  for (long int d = 0; d < num_docs; d++)
+    norms[d] = sqrt(norms[d]);
+
+  printf("[MAPREDUCE] Vocabulário: %ld termos\n", num_terms);
+
+  if (write_postings(cfg, nreducers, num_docs, num_terms, filename_postings) != 0 ||
+      save_hash(idf, filename_idf) != 0 ||
+      save_doc_norms(norms, num_docs, filename_doc_norms) != 0)
+    goto out;
+  rc = 0;
+
+out:
+  for (int p = 0; p < nreducers; p++) {
+    char f_idf[512], f_normsq[512];
+    reduce_filenames(f_idf, f_normsq, sizeof(f_idf), cfg->tmp_dir, p);
+    remove(f_idf);
+    remove(f_normsq);
+  }
+  mem_track_free(MEM_NORMS, num_docs * sizeof(double));
+  free(norms);
+  hash_free(idf);
+  return rc;
+}
+
+/**
+ * @brief Executa n processos da etapa indicada e espera todos terminarem
+ *
+ * @return 0 se todos terminaram com sucesso, -1 caso contrário
+ */
+static int run_stage(const spimi_config *cfg, int reduce, int n, int nmappers,
+                     int nreducers) {
+  pid_t *pids = calloc(n, sizeof(pid_t));
+  if (!pids)
+    return -1;
+
+  // Buffers herdados pelo fork seriam impressos duas vezes
+  fflush(stdout);
+  fflush(stderr);
+
+  int failed = 0, started = 0;
+  for (int i = 0; i < n; i++) {
+    pid_t pid = fork();
+    if (pid < 0) {
+      fprintf(stderr, "Erro ao criar processo %s %d\n",
+              reduce ? "reducer" : "mapper", i);
+      failed = 1;
+      break;
+    }
+    if (pid == 0) {
+      int r = reduce ? spimi_reduce(cfg, i, nmappers, nreducers)
+                     : spimi_map(cfg, i, nmappers, nreducers);
+      fflush(stdout);
+      _exit(r == 0 ? 0 : 1);
+    }
+    pids[started++] = pid;
+  }
+
+  for (int i = 0; i < started; i++) {
+    int status;
+    if (waitpid(pids[i], &status, 0) < 0 || !WIFEXITED(status) ||
+        WEXITSTATUS(status) != 0) {
+      fprintf(stderr, "Processo %s %d falhou\n", reduce ? "reducer" : "mapper", i);
+      failed = 1;
+    }
+  }
+
+  free(pids);
+  return failed ? -1 : 0;
+}
+
+/**
+ * @brief Remove runs e saídas intermediárias deixadas no diretório temporário
+ */
+static void remove_stage_files(const spimi_config *cfg, int nmappers,
+                               int nreducers) {
+  char filename[512], other[512];
+  for (int p = 0; p < nreducers; p++) {
+    for (int t = 0; t < nmappers; t++) {
+      for (long int s = 0;; s++) {
+        run_filename(filename, sizeof(filename), cfg->tmp_dir, p, t, s);
+        if (remove(filename) != 0)
+          break;
+      }
+    }
+    part_filename(filename, sizeof(filename), cfg->tmp_dir, p);
+    remove(filename);
+    reduce_filenames(filename, other, sizeof(filename), cfg->tmp_dir, p);
+    remove(filename);
+    remove(other);
+  }
+  rmdir(cfg->tmp_dir);
+}
+
+/**
+ * @brief Constrói o índice com processos mappers e reducers locais
+ *
+ * Equivalente a spimi_build, mas cada etapa roda em processos separados
+ * (um por mapper/reducer), comunicando-se apenas por arquivos.
+ *
+ * @param cfg Configuração da indexação
+ * @param nmappers Número de processos map
+ * @param nreducers Número de processos reduce (partições de termos)
+ * @param filename_postings Arquivo de saída do índice invertido
+ * @param filename_idf Arquivo de saída do IDF
+ * @param filename_doc_norms Arquivo de saída das normas
+ * @return 0 em sucesso, -1 em erro
+ * @note Requer stopwords carregadas (load_stopwords)
+ */
+int spimi_mapreduce(const spimi_config *cfg, int nmappers, int nreducers,
+                    const char *filename_postings, const char *filename_idf,
+                    const char *filename_doc_norms) {
+  if (nmappers <= 0 || nreducers <= 0 || nmappers > cfg->entries) {
+    fprintf(stderr, "Número de mappers/reducers inválido (%d/%d)\n", nmappers,
+            nreducers);
+    return -1;
+  }
+  if (mkdir(cfg->tmp_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "Erro ao criar diretório temporário %s\n", cfg->tmp_dir);
+    return -1;
+  }
+
+  int rc = -1;
+  printf("\n[MAPREDUCE] Map: %d processos...\n", nmappers);
+  if (run_stage(cfg, 0, nmappers, nmappers, nreducers) != 0)
+    goto out;
+
+  printf("[MAPREDUCE] Reduce: %d processos...\n", nreducers);
+  if (run_stage(cfg, 1, nreducers, nmappers, nreducers) != 0)
+    goto out;
+
+  rc = spimi_finalize(cfg, nreducers, filename_postings, filename_idf,
+                      filename_doc_norms);
+
+out:
+  remove_stage_files(cfg, nmappers, nreducers);
+  return rc;
+}
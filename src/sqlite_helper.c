@@ -7,6 +7,15 @@
  * - Consultas para obter valores inteiros (contagens)
  * - Extração de arrays de strings (textos de documentos)
  * - Busca de documentos específicos por IDs
+ * - Leitores por thread (db_reader) para a indexação
+ *
+ * Todas as conexões são somente leitura (SQLITE_OPEN_READONLY | NOMUTEX)
+ * e usam mmap_size/cache_size maiores que o padrão: o arquivo é lido via
+ * mmap, sem cópia para o page cache do SQLite, e não há mutex por
+ * conexão. Cada thread de indexação abre um db_reader com statements
+ * preparados uma única vez e reaproveitados em todos os lotes; o texto de
+ * cada linha vai direto para o tokenizador enquanto o statement está na
+ * linha, sem strdup intermediário.
  */
 
 #include <sqlite3.h>
@@ -15,6 +24,35 @@
 #include <string.h>
 
 #include "../include/log.h"
+#include "../include/mem.h"
+#include "../include/preprocess.h"
+#include "../include/sqlite_helper.h"
+
+#define READER_MMAP_SIZE "268435456" /**< Bytes do arquivo mapeados por conexão */
+#define READER_CACHE_KB "-16384"     /**< Page cache por conexão (KB) */
+
+/**
+ * @brief Abre conexão somente leitura, sem mutex, com mmap e cache ajustados
+ *
+ * @param filename Caminho para o arquivo SQLite
+ * @param db Saída: conexão aberta
+ * @return 0 em sucesso, -1 em erro (conexão já fechada)
+ */
+static int open_readonly(const char *filename, sqlite3 **db) {
+  int rc = sqlite3_open_v2(filename, db,
+                           SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, NULL);
+  if (rc != SQLITE_OK) {
+    fprintf(stderr, "Erro ao abrir banco: %s\n", sqlite3_errmsg(*db));
+    sqlite3_close(*db);
+    return -1;
+  }
+  sqlite3_exec(*db,
+               "PRAGMA mmap_size=" READER_MMAP_SIZE ";"
+               "PRAGMA cache_size=" READER_CACHE_KB ";"
+               "PRAGMA query_only=1;",
+               NULL, NULL, NULL);
+  return 0;
+}
 
 /**
  * @brief Executa query SQL e retorna um único valor inteiro
@@ -33,15 +71,13 @@ long int get_single_int(const char *filename, const char *query,
   sqlite3 *db;
   sqlite3_stmt *stmt;
 
-  rc = sqlite3_open(filename, &db);
-  if (rc) {
-    fprintf(stderr, "Erro ao abrir banco: %s\n", sqlite3_errmsg(db));
-    return 1;
-  }
+  if (open_readonly(filename, &db) != 0)
+    return -1;
 
   char *sql = sqlite3_mprintf(query, table);
   if (!sql) {
     fprintf(stderr, "Erro ao formatar statement: %s\n", sqlite3_errmsg(db));
+    sqlite3_close(db);
     return -1;
   }
 
@@ -50,6 +86,8 @@ long int get_single_int(const char *filename, const char *query,
   rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
   if (rc != SQLITE_OK) {
     fprintf(stderr, "Erro ao preparar o statement: %s\n", sqlite3_errmsg(db));
+    sqlite3_free(sql);
+    sqlite3_close(db);
     return -1;
   }
 
@@ -85,15 +123,13 @@ char **get_str_arr(const char *filename, const char *query, long int start,
   char **result = NULL;
   long int i = 0;
 
-  rc = sqlite3_open(filename, &db);
-  if (rc) {
-    fprintf(stderr, "Erro ao abrir banco: %s\n", sqlite3_errmsg(db));
+  if (open_readonly(filename, &db) != 0)
     return NULL;
-  }
 
   char *sql = sqlite3_mprintf(query, table);
   if (!sql) {
     fprintf(stderr, "Erro ao formatar statement: %s\n", sqlite3_errmsg(db));
+    sqlite3_close(db);
     return NULL;
   }
 
@@ -118,11 +154,14 @@ char **get_str_arr(const char *filename, const char *query, long int start,
     sqlite3_close(db);
     return NULL;
   }
+  mem_track_alloc(MEM_ARTICLE_TEXT, array_size * sizeof(char *));
 
   while (sqlite3_step(stmt) == SQLITE_ROW && i < array_size) {
     const unsigned char *text = sqlite3_column_text(stmt, 0);
-    if (text)
+    if (text) {
       result[i++] = strdup((const char *)text);
+      mem_track_alloc(MEM_ARTICLE_TEXT, strlen((const char *)text) + 1);
+    }
   }
 
   sqlite3_finalize(stmt);
@@ -131,17 +170,146 @@ char **get_str_arr(const char *filename, const char *query, long int start,
   return result;
 }
 
+/* ------------- Leitores por Thread ------------- */
+
+struct db_reader {
+  sqlite3 *db;
+  sqlite3_stmt *range_stmt; // article_id between ? and ?
+  sqlite3_stmt *id_stmt;    // article_id = ?
+};
+
+/**
+ * @brief Abre um leitor com conexão própria e statements já preparados
+ *
+ * Um leitor não deve ser compartilhado entre threads (conexão NOMUTEX).
+ *
+ * @param filename Caminho para o arquivo SQLite
+ * @param table Nome da tabela dos documentos
+ * @return Leitor, ou NULL em erro
+ */
+db_reader *db_reader_open(const char *filename, const char *table) {
+  db_reader *r = calloc(1, sizeof(db_reader));
+  if (!r)
+    return NULL;
+  if (open_readonly(filename, &r->db) != 0) {
+    free(r);
+    return NULL;
+  }
+
+  char *range_sql = sqlite3_mprintf(
+      "SELECT article_id, article_text FROM \"%w\" "
+      "WHERE article_id BETWEEN ? AND ? ORDER BY article_id",
+      table);
+  char *id_sql = sqlite3_mprintf(
+      "SELECT article_text FROM \"%w\" WHERE article_id = ?", table);
+  if (!range_sql || !id_sql ||
+      sqlite3_prepare_v2(r->db, range_sql, -1, &r->range_stmt, NULL) != SQLITE_OK ||
+      sqlite3_prepare_v2(r->db, id_sql, -1, &r->id_stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "Erro ao preparar statement: %s\n", sqlite3_errmsg(r->db));
+    sqlite3_free(range_sql);
+    sqlite3_free(id_sql);
+    db_reader_close(r);
+    return NULL;
+  }
+  sqlite3_free(range_sql);
+  sqlite3_free(id_sql);
+  return r;
+}
+
+void db_reader_close(db_reader *r) {
+  if (!r)
+    return;
+  sqlite3_finalize(r->range_stmt);
+  sqlite3_finalize(r->id_stmt);
+  sqlite3_close(r->db);
+  free(r);
+}
+
+/**
+ * @brief Texto de um documento; válido até a próxima chamada no leitor
+ *
+ * @return Texto (pertence ao SQLite), ou NULL se o ID não existe
+ */
+static const char *reader_fetch(db_reader *r, long int doc_id, size_t *len_out) {
+  sqlite3_reset(r->id_stmt);
+  sqlite3_bind_int64(r->id_stmt, 1, doc_id);
+  if (sqlite3_step(r->id_stmt) != SQLITE_ROW)
+    return NULL;
+  const char *text = (const char *)sqlite3_column_text(r->id_stmt, 0);
+  *len_out = (size_t)sqlite3_column_bytes(r->id_stmt, 0);
+  return text;
+}
+
+/**
+ * @brief Tokeniza os documentos com article_id em [lo, hi]
+ *
+ * Cada texto é tokenizado direto do buffer do SQLite. A posição i do
+ * resultado corresponde ao article_id lo + i (NULL se a linha não existe),
+ * então lacunas na sequência de IDs não deslocam os documentos seguintes.
+ *
+ * @return Vetores de tokens (hi - lo + 1 posições) para free_article_vecs,
+ *         ou NULL em erro
+ */
+char ***db_reader_tokenize_range(db_reader *r, long int lo, long int hi) {
+  long int n = hi - lo + 1;
+  char ***article_vecs = alloc_article_vecs(n);
+  if (!article_vecs)
+    return NULL;
+
+  sqlite3_reset(r->range_stmt);
+  sqlite3_bind_int64(r->range_stmt, 1, lo);
+  sqlite3_bind_int64(r->range_stmt, 2, hi);
+
+  int rc;
+  while ((rc = sqlite3_step(r->range_stmt)) == SQLITE_ROW) {
+    long int id = sqlite3_column_int64(r->range_stmt, 0);
+    const char *text = (const char *)sqlite3_column_text(r->range_stmt, 1);
+    if (!text || id < lo || id > hi || article_vecs[id - lo])
+      continue;
+    article_vecs[id - lo] =
+        tokenize_doc(text, (size_t)sqlite3_column_bytes(r->range_stmt, 1));
+  }
+
+  if (rc != SQLITE_DONE) {
+    fprintf(stderr, "Erro ao ler documentos: %s\n", sqlite3_errmsg(r->db));
+    free_article_vecs(article_vecs, n);
+    return NULL;
+  }
+  return article_vecs;
+}
+
+/**
+ * @brief Tokeniza os documentos com os IDs dados (posição i = doc_ids[i])
+ *
+ * @return Vetores de tokens (n posições) para free_article_vecs, ou NULL
+ */
+char ***db_reader_tokenize_ids(db_reader *r, const long int *doc_ids,
+                               long int n) {
+  char ***article_vecs = alloc_article_vecs(n);
+  if (!article_vecs)
+    return NULL;
+
+  for (long int i = 0; i < n; i++) {
+    size_t len;
+    const char *text = reader_fetch(r, doc_ids[i], &len);
+    if (text)
+      article_vecs[i] = tokenize_doc(text, len);
+  }
+  return article_vecs;
+}
+
 /**
  * @brief Busca textos de documentos específicos por seus IDs
  *
- * Executa múltiplas queries para obter o texto de k documentos cujos IDs
- * são fornecidos no array doc_ids. Usado para exibir resultados top-k.
+ * Prepara uma única query (article_id = ?) e a reexecuta para cada um dos
+ * k IDs fornecidos no array doc_ids. Usado para exibir resultados top-k.
  *
  * @param filename_db Caminho para o arquivo SQLite
  * @param table Nome da tabela contendo os documentos
  * @param doc_ids Array com IDs dos documentos a buscar
  * @param k Número de documentos a buscar
- * @return Array de k strings com os textos, ou NULL em erro
+ * @return Array de k strings com os textos (NULL nos IDs inexistentes),
+ *         ou NULL em erro
  * @note Caller deve liberar o array e as strings individualmente
  */
 char **get_documents_by_ids(const char *filename, const char *table,
@@ -150,72 +318,144 @@ char **get_documents_by_ids(const char *filename, const char *table,
     return NULL;
   }
 
-  int rc;
-  sqlite3 *db;
-  sqlite3_stmt *stmt;
-  char **result = NULL;
-
-  rc = sqlite3_open(filename, &db);
-  if (rc) {
-    fprintf(stderr, "Erro ao abrir banco: %s\n", sqlite3_errmsg(db));
+  db_reader *reader = db_reader_open(filename, table);
+  if (!reader)
     return NULL;
-  }
 
   // Alocar array de resultados
-  result = (char **)calloc(k, sizeof(char *));
+  char **result = (char **)calloc(k, sizeof(char *));
   if (!result) {
     fprintf(stderr, "Erro ao alocar memória para resultados\n");
-    sqlite3_close(db);
+    db_reader_close(reader);
     return NULL;
   }
+  mem_track_alloc(MEM_ARTICLE_TEXT, k * sizeof(char *));
 
-  // Para cada ID, buscar o documento
   for (long int i = 0; i < k; i++) {
-    // Query: SELECT article_text FROM table WHERE article_id = ?
-    char *sql = sqlite3_mprintf("SELECT article_text FROM \"%w\" WHERE article_id = ?", table);
-    if (!sql) {
-      fprintf(stderr, "Erro ao formatar statement\n");
-      // Liberar resultados já alocados
-      for (long int j = 0; j < i; j++) {
-        free(result[j]);
-      }
-      free(result);
-      sqlite3_close(db);
-      return NULL;
+    size_t len;
+    const char *text = reader_fetch(reader, doc_ids[i], &len);
+    if (text) {
+      result[i] = strdup(text);
+      mem_track_alloc(MEM_ARTICLE_TEXT, len + 1);
     }
+  }
 
-    rc = sqlite3_prepare_v2(db, sql, -1, &stmt, NULL);
-    if (rc != SQLITE_OK) {
-      fprintf(stderr, "Erro ao preparar statement: %s\n", sqlite3_errmsg(db));
-      sqlite3_free(sql);
-      // Liberar resultados já alocados
-      for (long int j = 0; j < i; j++) {
-        free(result[j]);
-      }
-      free(result);
-      sqlite3_close(db);
-      return NULL;
-    }
+  db_reader_close(reader);
+  return result;
+}
 
-    // Bind do article_id (doc_ids[i] + 1 porque IDs começam em 1)
-    sqlite3_bind_int64(stmt, 1, doc_ids[i]);
-
-    rc = sqlite3_step(stmt);
-    if (rc == SQLITE_ROW) {
-      const unsigned char *text = sqlite3_column_text(stmt, 0);
-      if (text) {
-        result[i] = strdup((const char *)text);
-      } else {
-        result[i] = NULL;
-      }
-    } else {
-      result[i] = NULL;
-    }
+/**
+ * @brief Percorre todos os documentos da tabela em ordem de article_id
+ *
+ * Usa um único statement; o texto passado ao callback pertence ao SQLite e
+ * só é válido durante a chamada.
+ *
+ * @param filename Caminho para o arquivo SQLite
+ * @param table Nome da tabela contendo os documentos
+ * @param callback Chamado com (article_id, texto, tamanho, ctx); retorno
+ *                 diferente de 0 interrompe a leitura
+ * @param ctx Contexto repassado ao callback
+ * @return 0 em sucesso, -1 em erro
+ */
+int for_each_document(const char *filename, const char *table,
+                      int (*callback)(long int, const char *, size_t, void *),
+                      void *ctx) {
+  sqlite3 *db;
+  sqlite3_stmt *stmt;
 
-    sqlite3_finalize(stmt);
+  if (open_readonly(filename, &db) != 0)
+    return -1;
+
+  char *sql = sqlite3_mprintf(
+      "SELECT article_id, article_text FROM \"%w\" ORDER BY article_id", table);
+  if (!sql || sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "Erro ao preparar statement: %s\n", sqlite3_errmsg(db));
     sqlite3_free(sql);
+    sqlite3_close(db);
+    return -1;
+  }
+
+  int rc;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW) {
+    const char *text = (const char *)sqlite3_column_text(stmt, 1);
+    size_t len = (size_t)sqlite3_column_bytes(stmt, 1);
+    if (text && callback(sqlite3_column_int64(stmt, 0), text, len, ctx) != 0)
+      break;
   }
 
+  int ok = rc == SQLITE_ROW || rc == SQLITE_DONE;
+  if (!ok)
+    fprintf(stderr, "Erro ao ler documentos: %s\n", sqlite3_errmsg(db));
+  sqlite3_finalize(stmt);
+  sqlite3_free(sql);
   sqlite3_close(db);
-  return result;
+  return ok ? 0 : -1;
+}
+
+/**
+ * @brief Percorre os article_id que satisfazem um predicado SQL
+ *
+ * O predicado é inserido como está em WHERE (a conexão é somente leitura e
+ * query_only, então não pode alterar o banco).
+ *
+ * @param filename Caminho para o arquivo SQLite
+ * @param table Nome da tabela contendo os documentos
+ * @param predicate Expressão SQL sobre as colunas da tabela
+ * @param callback Chamado com (article_id, ctx); retorno diferente de 0
+ *                 interrompe a leitura
+ * @param ctx Contexto repassado ao callback
+ * @return 0 em sucesso, -1 em erro
+ */
+int for_each_id(const char *filename, const char *table, const char *predicate,
+                int (*callback)(long int, void *), void *ctx) {
+  sqlite3 *db;
+  sqlite3_stmt *stmt;
+
+  if (open_readonly(filename, &db) != 0)
+    return -1;
+
+  char *sql = sqlite3_mprintf(
+      "SELECT article_id FROM \"%w\" WHERE (%s) ORDER BY article_id", table,
+      predicate);
+  if (!sql || sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK) {
+    fprintf(stderr, "Erro ao preparar statement: %s\n", sqlite3_errmsg(db));
+    sqlite3_free(sql);
+    sqlite3_close(db);
+    return -1;
+  }
+
+  LOG(stdout, "Executando query: %s\n", sql);
+
+  int rc;
+  while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    if (callback(sqlite3_column_int64(stmt, 0), ctx) != 0)
+      break;
+
+  int ok = rc == SQLITE_ROW || rc == SQLITE_DONE;
+  if (!ok)
+    fprintf(stderr, "Erro ao avaliar filtro: %s\n", sqlite3_errmsg(db));
+  sqlite3_finalize(stmt);
+  sqlite3_free(sql);
+  sqlite3_close(db);
+  return ok ? 0 : -1;
+}
+
+/**
+ * @brief Libera array de strings retornado por get_str_arr/get_documents_by_ids
+ *
+ * @param arr Array de strings (entradas NULL são ignoradas)
+ * @param count Número de posições do array
+ */
+void free_str_arr(char **arr, long int count) {
+  if (!arr)
+    return;
+
+  for (long int i = 0; i < count; i++) {
+    if (arr[i]) {
+      mem_track_free(MEM_ARTICLE_TEXT, strlen(arr[i]) + 1);
+      free(arr[i]);
+    }
+  }
+  mem_track_free(MEM_ARTICLE_TEXT, count * sizeof(char *));
+  free(arr);
 }
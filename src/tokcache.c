@@ -0,0 +1,440 @@
+/**
+ * @file tokcache.c
+ * @brief Cache de tokens: sequências de ids de termos já processados
+ *
+ * A FASE 1 gasta quase todo o tempo lendo o SQLite, tokenizando, removendo
+ * stopwords e aplicando o stemmer. Com --token_cache, os tokens finais de
+ * cada documento são gravados como ids de termos em varint, junto com o
+ * dicionário, em
+ *
+ *     models/tokens_<table>.bin
+ *       magic[8], num_docs, num_terms, pool_bytes, stream_bytes,
+ *       crc[3] (uint32: pool, offsets, stream), pad (uint32),
+ *       pool (termos terminados em '\0', em ordem de id), alinhamento a 8,
+ *       offsets[num_docs + 1] (uint64), stream (ids em LEB128)
+ *
+ * Cada seção tem seu CRC-32C, conferido ao abrir: um cache corrompido é
+ * descartado e a FASE 1 volta a ler o SQLite.
+ *
+ * Os ids são os do vocabulário congelado da construção que gravou o cache.
+ * Durante a FASE 1 cada thread ainda não conhece esses ids: ela numera os
+ * termos com um dicionário local e grava os ids locais em um arquivo
+ * temporário; depois que o vocabulário global existe, tokcache_finish
+ * traduz os ids e concatena as threads na ordem dos documentos.
+ *
+ * Uma construção posterior (qualquer --entries até num_docs) mapeia o
+ * arquivo e reconstrói TF e vocabulário dos ids, na mesma ordem dos
+ * tokens originais, sem passar pelo SQLite nem pelo stemmer.
+ */
+
+#include "../include/tokcache.h"
+#include "../include/file_io.h"
+#include "../include/log.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define TOKCACHE_MAGIC "TOKENS02"
+#define TOKCACHE_CRC (8 + 3 * sizeof(long int) + sizeof(uint64_t))
+#define TOKCACHE_HEADER (TOKCACHE_CRC + 4 * sizeof(uint32_t))
+
+/* ------------- Varint ------------- */
+
+#define TOKCACHE_BUF (1 << 20)  /**< Buffer de saída de tokcache_finish */
+
+/**
+ * @brief Grava v em LEB128 em buf (até 10 bytes); devolve os bytes usados
+ */
+static inline int put_varint(unsigned char *buf, uint64_t v) {
+  int n = 0;
+  while (v >= 0x80) {
+    buf[n++] = (unsigned char)(v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  buf[n++] = (unsigned char)v;
+  return n;
+}
+
+/**
+ * @brief Lê um varint de [*p, end); devolve -1 se o valor está truncado
+ */
+static inline int get_varint(const unsigned char **p, const unsigned char *end,
+                             uint64_t *v) {
+  uint64_t x = 0;
+  for (int shift = 0; *p < end && shift < 64; shift += 7) {
+    unsigned char b = *(*p)++;
+    x |= (uint64_t)(b & 0x7F) << shift;
+    if (!(b & 0x80)) {
+      *v = x;
+      return 0;
+    }
+  }
+  return -1;
+}
+
+/* ------------- Leitura ------------- */
+
+/**
+ * @brief Mapeia o cache, se ele cobre os documentos pedidos
+ *
+ * @param filename Arquivo do cache
+ * @param db Banco de origem (o cache não vale se o banco é mais novo)
+ * @param entries Documentos da construção
+ * @return Cache mapeado, ou NULL (ausente, desatualizado, pequeno, inválido
+ *         ou com CRC divergente)
+ */
+tokcache_t *tokcache_open(const char *filename, const char *db,
+                          long int entries) {
+  if (access(filename, F_OK) == -1 || file_is_stale(filename, db) ||
+      file_is_stale(filename, "assets/stopwords.txt"))
+    return NULL;
+
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)TOKCACHE_HEADER) {
+    close(fd);
+    return NULL;
+  }
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  const char *p = (const char *)base;
+  size_t size = st.st_size;
+  long int num_docs, num_terms, pool_bytes;
+  uint64_t stream_bytes;
+  uint32_t crc[3];
+  memcpy(&num_docs, p + 8, sizeof(long int));
+  memcpy(&num_terms, p + 8 + sizeof(long int), sizeof(long int));
+  memcpy(&pool_bytes, p + 8 + 2 * sizeof(long int), sizeof(long int));
+  memcpy(&stream_bytes, p + 8 + 3 * sizeof(long int), sizeof(uint64_t));
+  memcpy(crc, p + TOKCACHE_CRC, sizeof(crc));
+
+  size_t off_pos = (TOKCACHE_HEADER + pool_bytes + 7) & ~(size_t)7;
+  int ok = memcmp(p, TOKCACHE_MAGIC, 8) == 0 && num_docs >= 0 &&
+           num_terms >= 0 && pool_bytes >= 0 &&
+           off_pos + (num_docs + 1) * sizeof(uint64_t) + stream_bytes == size;
+
+  // Seções conferidas antes de qualquer id ou offset ser usado
+  if (ok) {
+    size_t off_bytes = (num_docs + 1) * sizeof(uint64_t);
+    ok = crc32c(0, p + TOKCACHE_HEADER, pool_bytes) == crc[0] &&
+         crc32c(0, p + off_pos, off_bytes) == crc[1] &&
+         crc32c(0, p + off_pos + off_bytes, stream_bytes) == crc[2];
+  }
+
+  tokcache_t *tc = ok ? calloc(1, sizeof(tokcache_t)) : NULL;
+  if (tc) {
+    tc->num_docs = num_docs;
+    tc->num_terms = num_terms;
+    tc->offsets = (const uint64_t *)(p + off_pos);
+    tc->stream = (const unsigned char *)(p + off_pos +
+                                         (num_docs + 1) * sizeof(uint64_t));
+    tc->base = base;
+    tc->size = size;
+    tc->words = malloc((num_terms ? num_terms : 1) * sizeof(char *));
+    ok = tc->words && tc->offsets[num_docs] == stream_bytes;
+
+    // Termo de cada id: percorre o pool
+    const char *w = p + TOKCACHE_HEADER, *end = w + pool_bytes;
+    for (long int i = 0; ok && i < num_terms; i++) {
+      const char *z = memchr(w, '\0', end - w);
+      if (!z) {
+        ok = 0;
+        break;
+      }
+      tc->words[i] = w;
+      w = z + 1;
+    }
+  }
+  if (!ok) {
+    fprintf(stderr, "Erro: cache de tokens inválido ou corrompido (lendo do "
+                    "banco): %s\n", filename);
+    if (tc)
+      free(tc->words);
+    free(tc);
+    munmap(base, size);
+    return NULL;
+  }
+
+  if (num_docs < entries) {
+    LOG(stdout, "[TOKENS] %s cobre %ld de %ld documentos", filename, num_docs,
+        entries);
+    tokcache_close(tc);
+    return NULL;
+  }
+  madvise(base, size, MADV_SEQUENTIAL);
+  return tc;
+}
+
+void tokcache_close(tokcache_t *tc) {
+  if (!tc)
+    return;
+  munmap(tc->base, tc->size);
+  free(tc->words);
+  free(tc);
+}
+
+/**
+ * @brief Repõe os tokens do documento d nas hashes TF e de vocabulário
+ *
+ * Equivale a populate_tf_hash + set_idf_words sobre os tokens originais.
+ *
+ * @param tc Cache de tokens
+ * @param d Documento (< tc->num_docs)
+ * @param tf Hash TF do documento
+ * @param vocab Vocabulário local (IDF) da thread
+ * @return Tokens do documento, ou -1 se a sequência está corrompida
+ */
+long int tokcache_doc(const tokcache_t *tc, long int d, hash_t *tf,
+                      hash_t *vocab) {
+  const unsigned char *p = tc->stream + tc->offsets[d];
+  const unsigned char *end = tc->stream + tc->offsets[d + 1];
+  long int n = 0;
+  while (p < end) {
+    uint64_t id;
+    if (get_varint(&p, end, &id) != 0 || id >= (uint64_t)tc->num_terms)
+      return -1;
+    hash_add(tf, tc->words[id], 1.0);
+    hash_add(vocab, tc->words[id], 0.0);
+    n++;
+  }
+  return n;
+}
+
+/* ------------- Gravação ------------- */
+
+/**
+ * @brief Escritor da thread id para os documentos [first, first + count)
+ *
+ * @return Escritor, ou NULL em erro
+ */
+tokcache_writer *tokcache_writer_new(const char *filename, int id,
+                                     long int first, long int count) {
+  tokcache_writer *w = calloc(1, sizeof(tokcache_writer));
+  if (!w)
+    return NULL;
+  snprintf(w->path, sizeof(w->path), "%s.%d.tmp", filename, id);
+  w->first = first;
+  w->count = count;
+  w->dict = hash_new();
+  w->lens = malloc((count ? count : 1) * sizeof(uint64_t));
+  w->fp = fopen(w->path, "w+b");
+  if (!w->lens || !w->fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", w->path);
+    tokcache_writer_free(w);
+    return NULL;
+  }
+  return w;
+}
+
+/**
+ * @brief Grava os tokens do próximo documento do intervalo
+ *
+ * @param w Escritor da thread
+ * @param tokens Tokens finais (terminados em NULL), ou NULL (sem texto)
+ */
+void tokcache_writer_add(tokcache_writer *w, char **tokens) {
+  if (w->failed || w->added >= w->count) {
+    w->failed = 1;
+    return;
+  }
+  long int ntokens = 0;
+  while (tokens && tokens[ntokens])
+    ntokens++;
+  if ((size_t)ntokens * 10 > w->buf_cap) {
+    unsigned char *buf = realloc(w->buf, ntokens * 10);
+    if (!buf) {
+      w->failed = 1;
+      return;
+    }
+    w->buf = buf;
+    w->buf_cap = ntokens * 10;
+  }
+
+  uint64_t bytes = 0;
+  for (long int j = 0; j < ntokens; j++) {
+    long int id = (long int)hash_find(w->dict, tokens[j]) - 1;
+    if (id < 0) {
+      if (w->num_words == w->cap_words) {
+        long int cap = w->cap_words ? 2 * w->cap_words : 1024;
+        char **words = realloc(w->words, cap * sizeof(char *));
+        if (!words) {
+          w->failed = 1;
+          return;
+        }
+        w->words = words;
+        w->cap_words = cap;
+      }
+      id = w->num_words;
+      w->words[w->num_words++] = strdup(tokens[j]);
+      hash_add(w->dict, tokens[j], (double)(id + 1));
+    }
+    bytes += put_varint(w->buf + bytes, (uint64_t)id);
+  }
+  if (bytes && fwrite(w->buf, 1, bytes, w->fp) != bytes)
+    w->failed = 1;
+  w->lens[w->added++] = bytes;
+}
+
+void tokcache_writer_free(tokcache_writer *w) {
+  if (!w)
+    return;
+  if (w->fp) {
+    fclose(w->fp);
+    remove(w->path);
+  }
+  for (long int i = 0; i < w->num_words; i++)
+    free(w->words[i]);
+  free(w->words);
+  free(w->lens);
+  free(w->buf);
+  if (w->dict)
+    hash_free(w->dict);
+  free(w);
+}
+
+/**
+ * @brief Traduz os ids locais das threads e grava o cache
+ *
+ * Os escritores precisam cobrir intervalos consecutivos a partir do
+ * documento 0, todos completos. Os escritores são liberados.
+ *
+ * @param writers Escritores das threads, em ordem de documentos
+ * @param n Número de escritores
+ * @param vocab Vocabulário congelado da construção (ids do cache)
+ * @param filename Arquivo do cache (gravado em .tmp e trocado com rename)
+ * @return Documentos gravados, ou -1 em erro
+ */
+long int tokcache_finish(tokcache_writer **writers, int n, const vocab_t *vocab,
+                         const char *filename) {
+  long int num_docs = 0;
+  int ok = 1;
+  for (int i = 0; i < n; i++) {
+    if (!writers[i] || writers[i]->failed || writers[i]->first != num_docs ||
+        writers[i]->added != writers[i]->count)
+      ok = 0;
+    else
+      num_docs += writers[i]->count;
+  }
+
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+  FILE *fp = ok ? fopen(tmp, "wb") : NULL;
+  uint64_t *offsets = ok ? calloc(num_docs + 1, sizeof(uint64_t)) : NULL;
+  if (!fp || !offsets) {
+    if (ok)
+      fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    ok = 0;
+  }
+
+  // [1] Cabeçalho e dicionário (pool); offsets reservados
+  long int num_terms = vocab->num_terms, pool_bytes = 0;
+  for (long int t = 0; t < num_terms; t++)
+    pool_bytes += vocab->entries[t].str_len + 1;
+  size_t off_pos = (TOKCACHE_HEADER + pool_bytes + 7) & ~(size_t)7;
+  uint64_t stream_bytes = 0;
+  uint32_t crc[4] = {0, 0, 0, 0};
+  if (ok) {
+    fwrite(TOKCACHE_MAGIC, 1, 8, fp);
+    fwrite(&num_docs, sizeof(long int), 1, fp);
+    fwrite(&num_terms, sizeof(long int), 1, fp);
+    fwrite(&pool_bytes, sizeof(long int), 1, fp);
+    fwrite(&stream_bytes, sizeof(uint64_t), 1, fp);
+    fwrite(crc, sizeof(uint32_t), 4, fp);
+    for (long int t = 0; t < num_terms; t++) {
+      const char *word = vocab_word(vocab, t);
+      fwrite(word, 1, vocab->entries[t].str_len + 1, fp);
+      crc[0] = crc32c(crc[0], word, vocab->entries[t].str_len + 1);
+    }
+    for (size_t pad = TOKCACHE_HEADER + pool_bytes; pad < off_pos; pad++)
+      putc(0, fp);
+    fwrite(offsets, sizeof(uint64_t), num_docs + 1, fp);
+  }
+  unsigned char *out = ok ? malloc(TOKCACHE_BUF) : NULL;
+  size_t out_len = 0;
+  if (ok && !out)
+    ok = 0;
+
+  // [2] Ids locais → ids do vocabulário, thread a thread (arquivo
+  // temporário mapeado; saída em blocos de TOKCACHE_BUF)
+  long int d = 0;
+  for (int i = 0; ok && i < n; i++) {
+    tokcache_writer *w = writers[i];
+    uint64_t in_bytes = 0;
+    for (long int k = 0; k < w->count; k++)
+      in_bytes += w->lens[k];
+    long int *remap = malloc((w->num_words ? w->num_words : 1) * sizeof(long int));
+    void *in = MAP_FAILED;
+    if (remap && fflush(w->fp) == 0 && in_bytes > 0)
+      in = mmap(NULL, in_bytes, PROT_READ, MAP_PRIVATE, fileno(w->fp), 0);
+    if (!remap || (in_bytes > 0 && in == MAP_FAILED)) {
+      free(remap);
+      ok = 0;
+      break;
+    }
+    for (long int j = 0; j < w->num_words && ok; j++)
+      if ((remap[j] = vocab_find(vocab, w->words[j], strlen(w->words[j]))) < 0)
+        ok = 0;
+
+    const unsigned char *p = in_bytes > 0 ? (const unsigned char *)in : NULL;
+    for (long int k = 0; ok && k < w->count; k++, d++) {
+      const unsigned char *end = p + w->lens[k];
+      while (p < end) {
+        uint64_t id;
+        if (get_varint(&p, end, &id) != 0 || id >= (uint64_t)w->num_words) {
+          ok = 0;
+          break;
+        }
+        if (out_len + 10 > TOKCACHE_BUF) {
+          ok = fwrite(out, 1, out_len, fp) == out_len;
+          crc[2] = crc32c(crc[2], out, out_len);
+          out_len = 0;
+        }
+        int len = put_varint(out + out_len, (uint64_t)remap[id]);
+        out_len += len;
+        stream_bytes += len;
+      }
+      offsets[d + 1] = stream_bytes;
+    }
+    if (in_bytes > 0)
+      munmap(in, in_bytes);
+    free(remap);
+  }
+  if (ok && out_len) {
+    ok = fwrite(out, 1, out_len, fp) == out_len;
+    crc[2] = crc32c(crc[2], out, out_len);
+  }
+  free(out);
+
+  // [3] Offsets, tamanho do stream e CRCs no lugar reservado
+  if (ok) {
+    crc[1] = crc32c(0, offsets, (num_docs + 1) * sizeof(uint64_t));
+    ok = fseek(fp, 8 + 3 * sizeof(long int), SEEK_SET) == 0 &&
+         fwrite(&stream_bytes, sizeof(uint64_t), 1, fp) == 1 &&
+         fwrite(crc, sizeof(uint32_t), 4, fp) == 4 &&
+         fseek(fp, off_pos, SEEK_SET) == 0 &&
+         fwrite(offsets, sizeof(uint64_t), num_docs + 1, fp) ==
+             (size_t)num_docs + 1;
+  }
+  if (fp && fclose(fp) != 0)
+    ok = 0;
+  free(offsets);
+  for (int i = 0; i < n; i++)
+    tokcache_writer_free(writers[i]);
+
+  if (!ok || rename(tmp, filename) != 0) {
+    if (fp)
+      fprintf(stderr, "Erro ao gravar cache de tokens %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return num_docs;
+}
@@ -0,0 +1,432 @@
+/**
+ * @file vocab.c
+ * @brief Vocabulário somente leitura com hash perfeita mínima (CHD)
+ *
+ * Depois da construção o IDF não muda mais, então o vocabulário é
+ * "congelado": cada termo recebe um id denso em [0, num_terms) calculado
+ * por uma hash perfeita mínima no estilo hash-and-displace (CHD). Os termos
+ * são espalhados em num_terms / VOCAB_BUCKET_SIZE buckets; cada bucket
+ * guarda o deslocamento que leva todos os seus termos a posições livres.
+ * Buckets com um único termo, colocados por último, guardam diretamente a
+ * posição livre (bit VOCAB_DIRECT), o que permite usar exatamente
+ * num_terms posições.
+ *
+ * A busca calcula o hash, lê disp[bucket] e compara o termo da entrada
+ * resultante: sem encadeamento e sem laços além do hash e do memcmp.
+ *
+ * O buffer em memória tem o mesmo layout do arquivo
+ * (models/vocab_<table>_<entries>.bin), que é aberto com mmap:
+ *
+ *     char magic[8] ("VOCABMP1")
+ *     long int num_terms
+ *     long int num_buckets
+ *     uint64_t seed
+ *     long int pool_size
+ *     uint32_t disp[num_buckets]      (completado até múltiplo de 8 bytes)
+ *     vocab_entry entries[num_terms]  (str_off, str_len, postings, idf)
+ *     char pool[pool_size]            (termos na ordem dos ids, com '\0')
+ */
+
+#include "../include/vocab.h"
+#include "../include/mem.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define VOCAB_MAGIC "VOCABMP1"
+#define VOCAB_HEADER (8 + 3 * sizeof(long int) + sizeof(uint64_t))
+#define VOCAB_DIRECT 0x80000000u   /**< Bucket unitário: disp é a posição */
+#define VOCAB_BUCKET_SIZE 4        /**< Termos por bucket em média */
+#define VOCAB_MAX_DISP (1u << 20)  /**< Tentativas por bucket antes de trocar a semente */
+#define VOCAB_MAX_SEEDS 16         /**< Sementes tentadas antes de desistir */
+
+/* ------------- Hash ------------- */
+
+static inline uint64_t mix64(uint64_t x) {
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/**
+ * @brief FNV-1a de 64 bits seguido de mistura final (hash_str não mistura
+ *        o suficiente para separar os buckets)
+ */
+static inline uint64_t term_hash(const char *word, size_t len, uint64_t seed) {
+  uint64_t h = 0xcbf29ce484222325ULL ^ seed;
+  for (size_t i = 0; i < len; i++)
+    h = (h ^ (unsigned char)word[i]) * 0x100000001b3ULL;
+  return mix64(h);
+}
+
+static inline uint64_t bucket_of(uint64_t h, uint64_t num_buckets) {
+  return ((h >> 32) * num_buckets) >> 32;
+}
+
+static inline uint64_t slot_of(uint64_t h, uint32_t d, uint64_t num_terms) {
+  return ((mix64(h + d * 0x9e3779b97f4a7c15ULL) & 0xffffffffULL) * num_terms) >> 32;
+}
+
+/* ------------- Construção ------------- */
+
+/**
+ * @brief Escolhe os deslocamentos de todos os buckets
+ *
+ * @param hashes Hash de cada termo
+ * @param n Número de termos
+ * @param nb Número de buckets
+ * @param disp Saída: deslocamento de cada bucket
+ * @param slots Saída: posição (id) de cada termo
+ * @return 0 em sucesso, -1 se algum bucket não couber (trocar a semente)
+ */
+static int place_buckets(const uint64_t *hashes, long int n, long int nb,
+                         uint32_t *disp, long int *slots) {
+  long int *start = calloc(nb + 1, sizeof(long int));
+  long int *members = malloc(n * sizeof(long int));
+  long int *by_size = malloc(nb * sizeof(long int));
+  uint64_t *taken = calloc((n + 63) / 64, sizeof(uint64_t));
+  int rc = -1;
+  if (!start || !members || !by_size || !taken)
+    goto out;
+
+  // Termos agrupados por bucket (counting sort)
+  for (long int i = 0; i < n; i++)
+    start[bucket_of(hashes[i], nb) + 1]++;
+  long int max_size = 0;
+  for (long int b = 0; b < nb; b++) {
+    if (start[b + 1] > max_size)
+      max_size = start[b + 1];
+    start[b + 1] += start[b];
+  }
+  long int *fill = by_size; // Reaproveitado como cursor antes de ordenar
+  memcpy(fill, start, nb * sizeof(long int));
+  for (long int i = 0; i < n; i++)
+    members[fill[bucket_of(hashes[i], nb)]++] = i;
+
+  // Buckets do maior para o menor (counting sort por tamanho)
+  long int *size_start = calloc(max_size + 2, sizeof(long int));
+  uint64_t *try_slots = malloc((max_size + 1) * sizeof(uint64_t));
+  if (!size_start || !try_slots) {
+    free(size_start);
+    free(try_slots);
+    goto out;
+  }
+  for (long int b = 0; b < nb; b++)
+    size_start[max_size - (start[b + 1] - start[b]) + 1]++;
+  for (long int s = 0; s <= max_size; s++)
+    size_start[s + 1] += size_start[s];
+  for (long int b = 0; b < nb; b++)
+    by_size[size_start[max_size - (start[b + 1] - start[b])]++] = b;
+  free(size_start);
+
+  long int next_free = 0;
+  rc = 0;
+  for (long int k = 0; k < nb && rc == 0; k++) {
+    long int b = by_size[k];
+    long int first = start[b], size = start[b + 1] - first;
+
+    if (size == 0) {
+      disp[b] = 0;
+    } else if (size == 1) {
+      // Unitários vão direto para a próxima posição livre
+      while ((taken[next_free >> 6] >> (next_free & 63)) & 1)
+        next_free++;
+      taken[next_free >> 6] |= 1ULL << (next_free & 63);
+      disp[b] = VOCAB_DIRECT | (uint32_t)next_free;
+      slots[members[first]] = next_free;
+    } else {
+      uint32_t d = 0;
+      for (; d < VOCAB_MAX_DISP; d++) {
+        long int j = 0;
+        for (; j < size; j++) {
+          uint64_t s = slot_of(hashes[members[first + j]], d, n);
+          if ((taken[s >> 6] >> (s & 63)) & 1)
+            break;
+          long int m = 0;
+          while (m < j && try_slots[m] != s)
+            m++;
+          if (m < j)
+            break;
+          try_slots[j] = s;
+        }
+        if (j == size)
+          break;
+      }
+      if (d == VOCAB_MAX_DISP) {
+        rc = -1;
+        break;
+      }
+      for (long int j = 0; j < size; j++) {
+        taken[try_slots[j] >> 6] |= 1ULL << (try_slots[j] & 63);
+        slots[members[first + j]] = (long int)try_slots[j];
+      }
+      disp[b] = d;
+    }
+  }
+  free(try_slots);
+
+out:
+  free(start);
+  free(members);
+  free(by_size);
+  free(taken);
+  return rc;
+}
+
+/**
+ * @brief Aponta os campos do vocabulário para dentro do buffer
+ *
+ * @return 0 se o cabeçalho é válido para o tamanho do buffer, -1 caso contrário
+ */
+static int vocab_attach(vocab_t *vocab, void *base, size_t size) {
+  const char *p = (const char *)base;
+  if (size < VOCAB_HEADER || memcmp(p, VOCAB_MAGIC, 8) != 0)
+    return -1;
+
+  long int pool_size;
+  memcpy(&vocab->num_terms, p + 8, sizeof(long int));
+  memcpy(&vocab->num_buckets, p + 8 + sizeof(long int), sizeof(long int));
+  memcpy(&vocab->seed, p + 8 + 2 * sizeof(long int), sizeof(uint64_t));
+  memcpy(&pool_size, p + 8 + 2 * sizeof(long int) + sizeof(uint64_t),
+         sizeof(long int));
+  if (vocab->num_terms < 0 || vocab->num_buckets < 1 || pool_size < 0 ||
+      vocab->num_terms >= (long int)VOCAB_DIRECT ||
+      (size_t)vocab->num_buckets > size)
+    return -1;
+
+  size_t disp_bytes = ((size_t)vocab->num_buckets * sizeof(uint32_t) + 7) & ~(size_t)7;
+  size_t entries_off = VOCAB_HEADER + disp_bytes;
+  size_t pool_off = entries_off + (size_t)vocab->num_terms * sizeof(vocab_entry);
+  if (pool_off + (size_t)pool_size != size)
+    return -1;
+
+  vocab->disp = (const uint32_t *)(p + VOCAB_HEADER);
+  vocab->entries = (const vocab_entry *)(p + entries_off);
+  vocab->pool = p + pool_off;
+  vocab->base = base;
+  vocab->size = size;
+  return 0;
+}
+
+/**
+ * @brief Congela um vocabulário em hash perfeita mínima
+ *
+ * @param terms Termos (distintos) com IDF e posição da lista invertida
+ * @param n Número de termos
+ * @return Vocabulário construído, ou NULL em erro
+ */
+vocab_t *vocab_build(const vocab_term *terms, long int n) {
+  if (n < 0 || n >= (long int)VOCAB_DIRECT)
+    return NULL;
+
+  size_t pool_size = 0;
+  for (long int i = 0; i < n; i++)
+    pool_size += terms[i].wlen + 1;
+  if (pool_size > UINT32_MAX) {
+    fprintf(stderr, "Erro: vocabulário grande demais (%zu bytes)\n", pool_size);
+    return NULL;
+  }
+
+  long int nb = n / VOCAB_BUCKET_SIZE + 1;
+  size_t disp_bytes = ((size_t)nb * sizeof(uint32_t) + 7) & ~(size_t)7;
+  size_t size = VOCAB_HEADER + disp_bytes + (size_t)n * sizeof(vocab_entry) + pool_size;
+
+  vocab_t *vocab = calloc(1, sizeof(vocab_t));
+  char *base = calloc(1, size);
+  uint64_t *hashes = malloc((n ? n : 1) * sizeof(uint64_t));
+  long int *slots = malloc((n ? n : 1) * sizeof(long int));
+  if (!vocab || !base || !hashes || !slots)
+    goto fail;
+
+  uint32_t *disp = (uint32_t *)(base + VOCAB_HEADER);
+  uint64_t seed = 0;
+  int placed = n ? -1 : 0;
+  while (placed != 0 && seed < VOCAB_MAX_SEEDS) {
+    for (long int i = 0; i < n; i++)
+      hashes[i] = term_hash(terms[i].word, terms[i].wlen, seed);
+    placed = place_buckets(hashes, n, nb, disp, slots);
+    if (placed != 0)
+      seed++;
+  }
+  if (placed != 0) {
+    fprintf(stderr, "Erro: não foi possível construir a hash perfeita "
+                    "(termos repetidos?)\n");
+    goto fail;
+  }
+
+  long int pool_len = (long int)pool_size;
+  memcpy(base, VOCAB_MAGIC, 8);
+  memcpy(base + 8, &n, sizeof(long int));
+  memcpy(base + 8 + sizeof(long int), &nb, sizeof(long int));
+  memcpy(base + 8 + 2 * sizeof(long int), &seed, sizeof(uint64_t));
+  memcpy(base + 8 + 2 * sizeof(long int) + sizeof(uint64_t), &pool_len,
+         sizeof(long int));
+  if (vocab_attach(vocab, base, size) != 0)
+    goto fail;
+
+  // Entradas e pool na ordem dos ids: termos vizinhos ficam juntos no pool
+  long int *term_at = malloc((n ? n : 1) * sizeof(long int));
+  if (!term_at)
+    goto fail;
+  for (long int i = 0; i < n; i++)
+    term_at[slots[i]] = i;
+
+  vocab_entry *entries = (vocab_entry *)vocab->entries;
+  char *pool = (char *)vocab->pool;
+  uint32_t off = 0;
+  for (long int id = 0; id < n; id++) {
+    const vocab_term *t = &terms[term_at[id]];
+    entries[id].str_off = off;
+    entries[id].str_len = (uint32_t)t->wlen;
+    entries[id].postings = t->postings;
+    entries[id].idf = t->idf;
+    memcpy(pool + off, t->word, t->wlen);
+    off += (uint32_t)t->wlen + 1;
+  }
+  free(term_at);
+  free(hashes);
+  free(slots);
+
+  vocab->mapped = 0;
+  mem_track_alloc(MEM_VOCAB, size);
+  return vocab;
+
+fail:
+  free(vocab);
+  free(base);
+  free(hashes);
+  free(slots);
+  return NULL;
+}
+
+/**
+ * @brief Congela a hash termo → IDF (sem índice invertido)
+ *
+ * @param idf Hash global de IDF
+ * @return Vocabulário construído, ou NULL em erro
+ */
+vocab_t *vocab_from_hash(const hash_t *idf) {
+  if (!idf)
+    return NULL;
+
+  long int n = (long int)hash_size(idf);
+  vocab_term *terms = malloc((n ? n : 1) * sizeof(vocab_term));
+  if (!terms)
+    return NULL;
+
+  long int i = 0;
+  for (size_t b = 0; b < idf->cap; b++)
+    for (HashEntry *e = idf->buckets[b]; e; e = e->next, i++)
+      terms[i] = (vocab_term){e->word, e->wlen, e->value, -1};
+
+  vocab_t *vocab = vocab_build(terms, n);
+  free(terms);
+  return vocab;
+}
+
+/* ------------- Persistência ------------- */
+
+/**
+ * @brief Grava o vocabulário (gravado em .tmp e trocado com rename)
+ *
+ * @return 0 em sucesso, -1 em erro
+ */
+int vocab_save(const vocab_t *vocab, const char *filename) {
+  char tmp[300];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", filename);
+
+  FILE *fp = fopen(tmp, "wb");
+  if (!fp) {
+    fprintf(stderr, "Erro ao abrir arquivo %s para escrita\n", tmp);
+    return -1;
+  }
+  int rc = fwrite(vocab->base, 1, vocab->size, fp) == vocab->size ? 0 : -1;
+  if (fclose(fp) != 0)
+    rc = -1;
+  if (rc != 0 || rename(tmp, filename) != 0) {
+    fprintf(stderr, "Erro ao gravar vocabulário %s\n", filename);
+    remove(tmp);
+    return -1;
+  }
+  return 0;
+}
+
+/**
+ * @brief Mapeia em memória um vocabulário salvo com vocab_save
+ *
+ * @return Vocabulário, ou NULL se ausente ou inválido
+ */
+vocab_t *vocab_open(const char *filename) {
+  int fd = open(filename, O_RDONLY);
+  if (fd < 0)
+    return NULL;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)VOCAB_HEADER) {
+    close(fd);
+    return NULL;
+  }
+
+  void *base = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED)
+    return NULL;
+
+  vocab_t *vocab = calloc(1, sizeof(vocab_t));
+  if (!vocab || vocab_attach(vocab, base, st.st_size) != 0) {
+    fprintf(stderr, "Erro: vocabulário inválido: %s\n", filename);
+    free(vocab);
+    munmap(base, st.st_size);
+    return NULL;
+  }
+  vocab->mapped = 1;
+  madvise(base, st.st_size, MADV_RANDOM);
+  return vocab;
+}
+
+void vocab_free(vocab_t *vocab) {
+  if (!vocab)
+    return;
+  if (vocab->mapped) {
+    munmap(vocab->base, vocab->size);
+  } else {
+    mem_track_free(MEM_VOCAB, vocab->size);
+    free(vocab->base);
+  }
+  free(vocab);
+}
+
+/* ------------- Busca ------------- */
+
+/**
+ * @brief Id denso do termo
+ *
+ * @param vocab Vocabulário congelado
+ * @param word Termo procurado
+ * @param len Comprimento do termo
+ * @return Id em [0, num_terms), ou -1 se o termo não pertence ao vocabulário
+ */
+long int vocab_find(const vocab_t *vocab, const char *word, size_t len) {
+  if (vocab->num_terms == 0)
+    return -1;
+
+  uint64_t h = term_hash(word, len, vocab->seed);
+  uint32_t d = vocab->disp[bucket_of(h, vocab->num_buckets)];
+  long int id = (d & VOCAB_DIRECT) ? (long int)(d & ~VOCAB_DIRECT)
+                                   : (long int)slot_of(h, d, vocab->num_terms);
+  if (id >= vocab->num_terms)
+    return -1;
+
+  const vocab_entry *e = &vocab->entries[id];
+  if (e->str_len != len || memcmp(vocab->pool + e->str_off, word, len) != 0)
+    return -1;
+  return id;
+}
@@ -0,0 +1,396 @@
+/**
+ * @file wand.c
+ * @brief Top-k exato documento a documento com WAND e Block-Max WAND
+ *
+ * Para cada termo t da consulta, a contribuição ao cosseno de um documento d
+ * é q_t * v_td / (|q| * |d|). wand_build_bounds guarda em cada lista o
+ * máximo de v_td / |d| (max_score) e o mesmo máximo por bloco de WAND_BLOCK
+ * postings (block_max), então q_t * max / |q| limita a contribuição do
+ * termo em toda a lista ou em um bloco.
+ *
+ * Os cursores das listas andam juntos por doc_id crescente. Ordenados pelo
+ * documento atual, o pivô é o primeiro cursor em que a soma dos limites
+ * supera o limiar (pior score do heap de top-k): documentos anteriores não
+ * podem entrar no top-k (WAND). Antes de avaliar o pivô, os limites dos
+ * blocos que o contêm são somados; se não superam o limiar, todos os
+ * cursores saltam para depois do menor desses blocos (Block-Max WAND).
+ *
+ * O score de cada documento avaliado é calculado somando os termos na ordem
+ * dos buckets da query, como compute_similarities_thread e
+ * index_similarities, então o top-k coincide com o da pontuação exaustiva.
+ * Para não podar documentos por arredondamento, os limites são comparados
+ * com folga (WAND_SLACK). Documentos de score zero não passam pelo heap: se
+ * faltarem resultados, o top-k é completado com os menores doc_ids, como
+ * na ordenação do vetor completo de similaridades.
+ *
+ * Com um filtro (roaring_t), um pivô fora do filtro não é avaliado: os
+ * cursores até ele saltam direto para o próximo documento permitido, então
+ * trechos inteiros das listas fora do filtro nunca são lidos.
+ *
+ * Cada thread percorre um intervalo contíguo de documentos com seu próprio
+ * heap; os heaps são unidos no final.
+ */
+
+#include "../include/wand.h"
+#include "../include/cpu.h"
+#include "../include/mem.h"
+
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define WAND_SLACK (1.0 + 1e-9)            /**< Folga dos limites (arredondamento) */
+#define WAND_MIN_DOCS_PER_THREAD 16384     /**< Documentos mínimos por thread */
+
+/* ------------- Limites por termo e por bloco ------------- */
+
+/**
+ * @brief Calcula max_score e block_max de todas as listas do índice
+ *
+ * @param index Índice invertido
+ * @param global_doc_norms Normas dos documentos
+ * @return 0 em sucesso, -1 em falha de alocação
+ */
+int wand_build_bounds(inv_index_t *index, const double *global_doc_norms) {
+  for (long int t = 0; t < index->num_terms; t++) {
+    PostingList *pl = &index->lists[t];
+    if (pl->block_max)
+      continue;
+
+    long int nblocks = (pl->df + WAND_BLOCK - 1) / WAND_BLOCK;
+    pl->block_max = malloc((nblocks ? nblocks : 1) * sizeof(double));
+    pl->block_last = malloc((nblocks ? nblocks : 1) * sizeof(long int));
+    if (!pl->block_max || !pl->block_last)
+      return -1;
+    mem_track_alloc(MEM_POSTINGS, nblocks * (sizeof(double) + sizeof(long int)));
+
+    pl->max_score = 0.0;
+    for (long int b = 0; b < nblocks; b++) {
+      double m = 0.0;
+      long int last = (b + 1) * WAND_BLOCK < pl->df ? (b + 1) * WAND_BLOCK : pl->df;
+      for (long int p = b * WAND_BLOCK; p < last; p++) {
+        double norm = global_doc_norms[pl->doc_ids[p]];
+        if (pl->values[p] > 0.0 && norm > 0.0 && pl->values[p] / norm > m)
+          m = pl->values[p] / norm;
+      }
+      pl->block_max[b] = m;
+      pl->block_last[b] = pl->doc_ids[last - 1];
+      if (m > pl->max_score)
+        pl->max_score = m;
+    }
+  }
+  return 0;
+}
+
+/* ------------- Cursores ------------- */
+
+typedef struct {
+  const PostingList *pl;
+  double weight;     // Peso TF-IDF do termo na query
+  double ub;         // Limite da contribuição na lista inteira
+  double scale;      // weight / |q| (multiplica block_max)
+  long int pos;      // Posting atual
+  long int end;      // Fim do intervalo da thread (exclusivo)
+  long int block;    // Bloco raso: último bloco consultado para o pivô
+} wand_cursor;
+
+static inline long int cursor_doc(const wand_cursor *c) {
+  return c->pos < c->end ? c->pl->doc_ids[c->pos] : LONG_MAX;
+}
+
+/**
+ * @brief Avança o cursor até o primeiro doc_id >= target (busca galopante)
+ */
+static void cursor_seek(wand_cursor *c, long int target) {
+  const long int *ids = c->pl->doc_ids;
+  if (c->pos >= c->end || ids[c->pos] >= target)
+    return;
+
+  long int lo = c->pos, step = 1;
+  while (lo + step < c->end && ids[lo + step] < target) {
+    lo += step;
+    step *= 2;
+  }
+  long int hi = lo + step < c->end ? lo + step : c->end;
+  // ids[lo] < target; resposta em (lo, hi]
+  while (lo + 1 < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (ids[mid] < target)
+      lo = mid;
+    else
+      hi = mid;
+  }
+  c->pos = hi;
+}
+
+/**
+ * @brief Limite do bloco que contém o primeiro doc_id >= pivot
+ *
+ * @param c Cursor (não exaurido, com documento atual <= pivot)
+ * @param pivot Documento pivô
+ * @param last_out Saída: último doc_id coberto pelo bloco (LONG_MAX se a
+ *                 lista não tem documentos >= pivot)
+ * @return Limite da contribuição do termo para documentos até last_out
+ */
+static double cursor_block_bound(wand_cursor *c, long int pivot,
+                                 long int *last_out) {
+  const PostingList *pl = c->pl;
+  long int nblocks = (pl->df + WAND_BLOCK - 1) / WAND_BLOCK;
+  long int b = c->pos / WAND_BLOCK > c->block ? c->pos / WAND_BLOCK : c->block;
+  while (b < nblocks) {
+    if (pl->block_last[b] >= pivot) {
+      c->block = b;
+      *last_out = pl->block_last[b];
+      return c->scale * pl->block_max[b];
+    }
+    b++;
+  }
+  c->block = b;
+  *last_out = LONG_MAX;
+  return 0.0;
+}
+
+/* ------------- Travessia por intervalo ------------- */
+
+typedef struct {
+  const inv_index_t *index;
+  const wand_cursor *terms;  // Cursores modelo, na ordem dos buckets da query
+  int nterms;
+  double query_norm;
+  const double *doc_norms;
+  const roaring_t *filter;   // Documentos permitidos (NULL = todos)
+  long int start;            // Primeiro documento do intervalo
+  long int end;              // Fim do intervalo (exclusivo)
+  int k;
+  DocSim *heap;              // Saída: top-k do intervalo (k posições)
+  long int n;                // Saída: documentos no heap
+  int failed;
+} wand_args;
+
+/**
+ * @brief Primeira posição da lista com doc_id >= target (busca binária)
+ */
+static long int lower_bound(const long int *ids, long int n, long int target) {
+  long int lo = 0, hi = n;
+  while (lo < hi) {
+    long int mid = lo + (hi - lo) / 2;
+    if (ids[mid] < target)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+  return lo;
+}
+
+static void *wand_thread(void *arg) {
+  wand_args *a = (wand_args *)arg;
+  int m = a->nterms;
+
+  wand_cursor *cur = malloc(m * sizeof(wand_cursor));
+  wand_cursor **sorted = malloc(m * sizeof(wand_cursor *));
+  if (!cur || !sorted) {
+    free(cur);
+    free(sorted);
+    a->failed = 1;
+    return NULL;
+  }
+  for (int i = 0; i < m; i++) {
+    cur[i] = a->terms[i];
+    cur[i].pos = lower_bound(cur[i].pl->doc_ids, cur[i].pl->df, a->start);
+    cur[i].end = lower_bound(cur[i].pl->doc_ids, cur[i].pl->df, a->end);
+    cur[i].block = 0;
+    sorted[i] = &cur[i];
+  }
+
+  for (;;) {
+    // Ordenar pelo documento atual (inserção: a ordem muda pouco)
+    for (int i = 1; i < m; i++) {
+      wand_cursor *c = sorted[i];
+      long int d = cursor_doc(c);
+      int j = i;
+      while (j > 0 && cursor_doc(sorted[j - 1]) > d) {
+        sorted[j] = sorted[j - 1];
+        j--;
+      }
+      sorted[j] = c;
+    }
+
+    double theta = a->n == a->k ? a->heap[0].similarity : 0.0;
+
+    // Pivô: primeiro cursor em que a soma dos limites supera o limiar
+    double acc = 0.0;
+    int p = -1;
+    for (int i = 0; i < m && cursor_doc(sorted[i]) != LONG_MAX; i++) {
+      acc += sorted[i]->ub;
+      if (acc * WAND_SLACK > theta) {
+        p = i;
+        break;
+      }
+    }
+    if (p < 0)
+      break;
+
+    long int pivot = cursor_doc(sorted[p]);
+    while (p + 1 < m && cursor_doc(sorted[p + 1]) == pivot)
+      p++;
+
+    if (a->filter && !roaring_contains(a->filter, (uint32_t)pivot)) {
+      long int allowed = roaring_next(a->filter, pivot);
+      if (allowed < 0 || allowed >= a->end)
+        break;
+      for (int i = 0; i <= p; i++)
+        cursor_seek(sorted[i], allowed);
+      continue;
+    }
+
+    // Block-Max: limites dos blocos que contêm o pivô
+    double bm = 0.0;
+    long int next = p + 1 < m ? cursor_doc(sorted[p + 1]) : LONG_MAX;
+    for (int i = 0; i <= p; i++) {
+      long int last;
+      bm += cursor_block_bound(sorted[i], pivot, &last);
+      if (last != LONG_MAX && last + 1 < next)
+        next = last + 1;
+    }
+
+    if (bm * WAND_SLACK <= theta) {
+      // Nenhum documento em [pivot, next) alcança o limiar
+      if (next == LONG_MAX || next >= a->end)
+        break;
+      for (int i = 0; i <= p; i++)
+        cursor_seek(sorted[i], next);
+    } else if (cursor_doc(sorted[0]) == pivot) {
+      // Todos os cursores até o pivô estão nele: score exato
+      if (!index_is_deleted(a->index, pivot)) {
+        double dot = 0.0;
+        for (int t = 0; t < m; t++) {
+          const wand_cursor *c = &cur[t];
+          if (cursor_doc(c) == pivot && c->pl->values[c->pos] > 0.0)
+            dot += c->weight * c->pl->values[c->pos];
+        }
+        double norm = a->doc_norms[pivot];
+        double sim = (a->query_norm > 0.0 && norm > 0.0)
+                         ? dot / (a->query_norm * norm)
+                         : 0.0;
+        if (sim > 0.0)
+          topk_offer(a->heap, &a->n, a->k, (DocSim){pivot, sim});
+      }
+      for (int i = 0; i <= p; i++)
+        sorted[i]->pos++;
+    } else {
+      // Cursores atrás do pivô saltam direto para ele
+      for (int i = 0; i <= p && cursor_doc(sorted[i]) < pivot; i++)
+        cursor_seek(sorted[i], pivot);
+    }
+  }
+
+  free(cur);
+  free(sorted);
+  return NULL;
+}
+
+/* ------------- Consulta ------------- */
+
+/**
+ * @brief Top-k documentos por similaridade cosseno, com poda WAND/BMW
+ *
+ * Requer wand_build_bounds no índice. O resultado é o mesmo (documentos,
+ * scores e ordem) de ordenar o vetor de index_similarities.
+ *
+ * @param index Índice invertido
+ * @param query_tf Hash TF-IDF da query
+ * @param query_norm Norma da query
+ * @param global_doc_norms Normas dos documentos
+ * @param k Número de documentos
+ * @param nthreads Número de threads
+ * @param filter Documentos permitidos (NULL = todos)
+ * @param out Saída: top-k ordenados (k posições)
+ * @return Número de documentos em out, ou -1 em erro
+ */
+long int wand_top_k(const inv_index_t *index, const hash_t *query_tf,
+                    double query_norm, const double *global_doc_norms, int k,
+                    int nthreads, const roaring_t *filter, DocSim *out) {
+  if (!index || !query_tf || !global_doc_norms || k <= 0)
+    return k <= 0 ? 0 : -1;
+
+  // Cursores na ordem dos buckets da query (ordem de soma do score)
+  wand_cursor *terms = malloc((hash_size(query_tf) + 1) * sizeof(wand_cursor));
+  if (!terms)
+    return -1;
+  int m = 0;
+  for (size_t i = 0; i < query_tf->cap; i++)
+    for (HashEntry *q = query_tf->buckets[i]; q; q = q->next) {
+      const PostingList *pl = index_find(index, q->word);
+      // Peso zero não altera nenhum score
+      if (!pl || pl->df == 0 || q->value <= 0.0 || !pl->block_max)
+        continue;
+      double scale = query_norm > 0.0 ? q->value / query_norm : 0.0;
+      terms[m++] = (wand_cursor){pl, q->value, scale * pl->max_score, scale,
+                                 0, 0, 0};
+    }
+
+  long int num_docs = index->num_docs;
+  long int max_threads = num_docs / WAND_MIN_DOCS_PER_THREAD + 1;
+  if (nthreads <= 0) nthreads = 1;
+  if (nthreads > max_threads) nthreads = (int)max_threads;
+
+  wand_args *args = calloc(nthreads, sizeof(wand_args));
+  pthread_t *tids = malloc(nthreads * sizeof(pthread_t));
+  DocSim *heaps = malloc((size_t)nthreads * k * sizeof(DocSim));
+  if (!args || !tids || !heaps) {
+    free(terms);
+    free(args);
+    free(tids);
+    free(heaps);
+    return -1;
+  }
+  mem_track_alloc(MEM_QUERY, (size_t)nthreads * k * sizeof(DocSim));
+
+  long int base = num_docs / nthreads, rem = num_docs % nthreads;
+  int created = 0, failed = 0;
+  for (int i = 0; i < nthreads; i++) {
+    args[i] = (wand_args){index, terms, m, query_norm, global_doc_norms, filter,
+                          i * base + (i < rem ? i : rem), 0, k,
+                          heaps + (size_t)i * k, 0, 0};
+    args[i].end = args[i].start + base + (i < rem);
+    if (m == 0)
+      continue;
+    if (nthreads == 1) {
+      wand_thread(&args[i]);
+    } else if (cpu_thread_create(&tids[i], i, wand_thread, &args[i])) {
+      fprintf(stderr, "Erro ao criar thread %d para WAND\n", i);
+      failed = 1;
+      break;
+    } else {
+      created++;
+    }
+  }
+  for (int i = 0; i < created; i++)
+    pthread_join(tids[i], NULL);
+
+  // Une os heaps das threads (documentos distintos entre intervalos)
+  long int total = 0;
+  for (int i = 0; i < nthreads; i++) {
+    failed |= args[i].failed;
+    memmove(heaps + total, args[i].heap, args[i].n * sizeof(DocSim));
+    total += args[i].n;
+  }
+  qsort(heaps, total, sizeof(DocSim), compare_sim);
+  long int n = total < k ? total : k;
+  memcpy(out, heaps, n * sizeof(DocSim));
+
+  // Completa com documentos de score zero, na ordem de doc_id
+  if (!failed && n < k) {
+    n = topk_fill_zeros(out, n, k, num_docs, index->deleted, filter);
+    failed = n < 0;
+  }
+
+  mem_track_free(MEM_QUERY, (size_t)nthreads * k * sizeof(DocSim));
+  free(terms);
+  free(args);
+  free(tids);
+  free(heaps);
+  return failed ? -1 : n;
+}